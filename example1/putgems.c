@@ -53,6 +53,8 @@ int main(int argc, char *argv[])
     // allocated for level
     level_free(lvl);
     level_deinit(&lvl);
+    // Free data files cached for drawing map bitmaps
+    free_draw_resources_cache();
 
     // This command should be always last function used from library
     free_messages();
@@ -79,6 +81,8 @@ int main(int argc, char *argv[])
     // allocated for level
     level_free(lvl);
     level_deinit(&lvl);
+    // Free data files cached for drawing map bitmaps
+    free_draw_resources_cache();
 
     // This command should be always last function used from library
     free_messages();
@@ -92,6 +96,8 @@ int main(int argc, char *argv[])
   // allocated for level
   level_free(lvl);
   level_deinit(&lvl);
+  // Free data files cached for drawing map bitmaps
+  free_draw_resources_cache();
 
   // This command should be always last function used from library
   free_messages();
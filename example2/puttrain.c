@@ -82,6 +82,8 @@ int main(int argc, char *argv[])
     // allocated for level
     level_free(lvl);
     level_deinit(&lvl);
+    // Free data files cached for drawing map bitmaps
+    free_draw_resources_cache();
 
     // This command should be always last function used from library
     free_messages();
@@ -126,6 +128,8 @@ int main(int argc, char *argv[])
     // allocated for level
     level_free(lvl);
     level_deinit(&lvl);
+    // Free data files cached for drawing map bitmaps
+    free_draw_resources_cache();
 
     // This command should be always last function used from library
     free_messages();
@@ -146,6 +150,8 @@ int main(int argc, char *argv[])
   // allocated for level
   level_free(lvl);
   level_deinit(&lvl);
+  // Free data files cached for drawing map bitmaps
+  free_draw_resources_cache();
 
   // This command should be always last function used from library
   free_messages();
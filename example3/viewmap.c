@@ -369,6 +369,8 @@ int main (int argc, char *argv[])
 
     level_free(lvl);
     level_deinit(&lvl);
+    // Free data files cached for drawing map bitmaps
+    free_draw_resources_cache();
     free_messages();
     return 3;
   }
@@ -409,6 +411,8 @@ int main (int argc, char *argv[])
   // Free memory allocated for level
   level_free(lvl);
   level_deinit(&lvl);
+  // Free data files cached for drawing map bitmaps
+  free_draw_resources_cache();
 
   // This command should be always last function used from library
   free_messages();
@@ -285,8 +285,10 @@ static void process_events()
                       tx=sx/MAP_SUBNUM_X;ty=sy/MAP_SUBNUM_Y;
                       if (get_tile_slab(lvl,tx,ty)!=slab_drawing)
                       {
+                          level_update_begin(lvl);
                           user_set_slab(lvl,tx,ty,slab_drawing);
                           user_set_tile_owner(lvl,tx,ty,PLAYER0);
+                          level_update_commit(lvl);
                       }
                       message_info("New %s put at (%d,%d)",
                           get_slab_fullname(get_tile_slab(lvl,tx,ty)),tx,ty);
@@ -334,6 +336,8 @@ static void process_events()
                       max_dist++;
                       int i;
                       int tx,ty;
+                      /* Update the map graphics once, after all slabs are set */
+                      level_update_begin(lvl);
                       for (i=0;i<max_dist;i++)
                       {
                           tx=tile_cur.x+(dist_x*i/max_dist);
@@ -344,6 +348,7 @@ static void process_events()
                             user_set_tile_owner(lvl,tx,ty,PLAYER0);
                           }
                       }
+                      level_update_commit(lvl);
                       if (max_dist==1)
                           message_info("New %s put at (%d,%d)",
                               get_slab_fullname(get_tile_slab(lvl,tx,ty)),tx,ty);
@@ -536,6 +541,8 @@ int main (int argc, char *argv[])
   // Free memory allocated for level
   level_free(lvl);
   level_deinit(&lvl);
+  // Free data files cached for drawing map bitmaps
+  free_draw_resources_cache();
 
   // This command should be always last function used from library
   free_messages();
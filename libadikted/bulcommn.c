@@ -22,6 +22,7 @@
 #include "lbfileio.h"
 
 #include "bulcommn.h"
+#include "lbcontext.h"
 
 /**
  * RNC compression magic identifier, as string.
@@ -161,18 +162,18 @@ short write_bmp_fn_24b (const char *fname, int width, int height, const char *da
 }
 
 /**
- * Writes indexed colour bitmap into opened file.
+ * Writes header of RGB colour bitmap into opened file.
+ * Rows of the bitmap should be written after it, starting from the bottom one;
+ * write_bmp_fp_24b_rows() can be used for that.
  * @param out Destination file (already opened for writing).
  * @param width Bitmap width.
  * @param height Bitmap height.
- * @param data Bitmap data buffer.
  * @return Returns 0 on success, error code on failure.
  */
-short write_bmp_fp_24b(FILE *out, int width, int height, const char *data)
+short write_bmp_fp_24b_header(FILE *out, int width, int height)
 {
   int pwidth, pheight;
   long data_len;
-  int i;
     
   /* Positive width and height */
   if (width>=0)
@@ -184,12 +185,10 @@ short write_bmp_fp_24b(FILE *out, int width, int height, const char *data)
   else
     pheight=-height;
     
-  int datawidth=width*3;
-  int padding_size=4-(datawidth&3);
-  /* Length of data */
-  data_len = (pwidth+padding_size)*pheight;
+  /* Length of data; every row is padded to 4 bytes */
+  data_len = (long)((pwidth*3+3)&(~3))*pheight;
   fputs("BM",out);
-  write_int32_le_file (out, 3*data_len+0x36);
+  write_int32_le_file (out, data_len+0x36);
   write_int32_le_file (out, 0);
   write_int32_le_file (out, 0x36);
   write_int32_le_file (out, 40);
@@ -198,25 +197,59 @@ short write_bmp_fp_24b(FILE *out, int width, int height, const char *data)
   write_int16_le_file (out, 1);
   write_int16_le_file (out, 24);
   write_int32_le_file (out, 0);
+  write_int32_le_file (out, data_len);
   write_int32_le_file (out, 0);
   write_int32_le_file (out, 0);
   write_int32_le_file (out, 0);
   write_int32_le_file (out, 0);
-  write_int32_le_file (out, 0);
-    
-    for (i=1; i <= pheight; i++)
-    {
-        fwrite (data+(pheight-i)*datawidth, datawidth, 1, out);
-        if ((padding_size&3) > 0)
-        {
-            int cntr;
-            for (cntr=0;cntr<padding_size;cntr++)
-                fputc (0, out);
-        }
-    }
-    
-    fclose (out);
-    return 0;
+  if (ferror(out))
+    return 1;
+  return 0;
+}
+
+/**
+ * Writes rows of RGB colour bitmap into opened file, after the header.
+ * Rows are written from the last one to the first, so a bitmap can be
+ * written in parts, starting from its bottom part.
+ * @param out Destination file (already opened for writing).
+ * @param width Bitmap width.
+ * @param rows Amount of rows to write.
+ * @param data Bitmap data buffer.
+ * @param scanln Length of one row in data buffer.
+ * @return Returns 0 on success, error code on failure.
+ */
+short write_bmp_fp_24b_rows(FILE *out, int width, int rows, const char *data, int scanln)
+{
+  static const char padding[4]={0,0,0,0};
+  int datawidth=width*3;
+  int padding_size=((datawidth+3)&(~3))-datawidth;
+  int i;
+  for (i=rows-1; i>=0; i--)
+  {
+      fwrite (data+i*scanln, datawidth, 1, out);
+      if (padding_size > 0)
+          fwrite (padding, padding_size, 1, out);
+  }
+  if (ferror(out))
+    return 1;
+  return 0;
+}
+
+/**
+ * Writes RGB colour bitmap into opened file.
+ * @param out Destination file (already opened for writing).
+ * @param width Bitmap width.
+ * @param height Bitmap height.
+ * @param data Bitmap data buffer.
+ * @return Returns 0 on success, error code on failure.
+ */
+short write_bmp_fp_24b(FILE *out, int width, int height, const char *data)
+{
+  short result;
+  result=write_bmp_fp_24b_header(out,width,height);
+  if (result==0)
+    result=write_bmp_fp_24b_rows(out,width,(height>=0)?height:-height,data,width*3);
+  return result;
 }
 
 
@@ -237,14 +270,88 @@ int read_palette_rgb(unsigned char *palette, const char *fname, unsigned int nCo
     return 0;
 }
 
+/* Amount of rnd() calls; allows to check if a result depends on randomness */
+THREAD_LOCAL unsigned long rnd_calls_count=0;
+/* In dry run, rnd() only counts calls and doesn't use the random generator */
+THREAD_LOCAL short rnd_dry_run=false;
+
 /**
  * Returns a random number within given range.
+ * Uses random number generator of the context bound to current thread;
+ * the default context uses rand().
  */
 unsigned int rnd(const unsigned int range)
 {
+    rnd_calls_count++;
+    if (rnd_dry_run)
+      return 0;
+    struct ADIKT_CONTEXT *ctx=adikt_context_get();
+    if (ctx->rnd_own)
+    {
+      ctx->rnd_seed=(ctx->rnd_seed*214013+2531011)&0xffffffff;
+      return (((ctx->rnd_seed>>16)&0x7fff)%(range));
+    }
     return (rand()%(range));
 }
 
+/**
+ * Enables or disables dry run mode of rnd() in the current thread.
+ * In dry run, rnd() always returns 0 and the random number generator
+ * state is untouched; used when computing in threads, to find out
+ * which results require random numbers without changing them.
+ * Returns previous mode.
+ */
+short rnd_set_dry_run(const short dry_run)
+{
+    short prev_dry_run=rnd_dry_run;
+    rnd_dry_run=dry_run;
+    return prev_dry_run;
+}
+
+/**
+ * Converts time to local time, storing the result in given structure.
+ * Unlike localtime(), can be safely used in several threads.
+ */
+struct tm *localtime_safe(const time_t *timep, struct tm *result)
+{
+#if defined(_WIN32)
+    /* Windows C library keeps the result in a per-thread buffer */
+    struct tm *tmp=localtime(timep);
+    if (tmp==NULL) return NULL;
+    memcpy(result,tmp,sizeof(struct tm));
+    return result;
+#else
+    return localtime_r(timep,result);
+#endif
+}
+
+/**
+ * Converts time to UTC, storing the result in given structure.
+ * Unlike gmtime(), can be safely used in several threads.
+ */
+struct tm *gmtime_safe(const time_t *timep, struct tm *result)
+{
+#if defined(_WIN32)
+    /* Windows C library keeps the result in a per-thread buffer */
+    struct tm *tmp=gmtime(timep);
+    if (tmp==NULL) return NULL;
+    memcpy(result,tmp,sizeof(struct tm));
+    return result;
+#else
+    return gmtime_r(timep,result);
+#endif
+}
+
+/**
+ * Returns amount of rnd() calls made so far in the current thread.
+ * Comparing the value before and after some operation tells
+ * whether the operation used random numbers.
+ */
+unsigned long get_rnd_calls_count(void)
+{
+    return rnd_calls_count;
+}
+
 /**
  * Gives version of the RNC file.
  * Requies buff to be at least 4 bytes long.
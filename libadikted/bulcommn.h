@@ -23,6 +23,10 @@
 /* Routines */
 
 DLLIMPORT unsigned int rnd(const unsigned int range);
+DLLIMPORT unsigned long get_rnd_calls_count(void);
+DLLIMPORT short rnd_set_dry_run(const short dry_run);
+DLLIMPORT struct tm *localtime_safe(const time_t *timep, struct tm *result);
+DLLIMPORT struct tm *gmtime_safe(const time_t *timep, struct tm *result);
 
 DLLIMPORT short write_bmp_fn_idx (const char *fname, int width, int height, const unsigned char *pal, 
 		const char *data, int red, int green, int blue, int mult);
@@ -31,6 +35,8 @@ DLLIMPORT short write_bmp_fp_idx (FILE *out, int width, int height,
         int red, int green, int blue, int mult);
 DLLIMPORT short write_bmp_fn_24b (const char *fname, int width, int height, const char *data);
 DLLIMPORT short write_bmp_fp_24b (FILE *out, int width, int height, const char *data);
+DLLIMPORT short write_bmp_fp_24b_header (FILE *out, int width, int height);
+DLLIMPORT short write_bmp_fp_24b_rows (FILE *out, int width, int rows, const char *data, int scanln);
 
 DLLIMPORT int read_palette_rgb(unsigned char *palette, const char *fname, unsigned int nColors);
 
@@ -48,11 +48,12 @@ long rnc_crc (const void *data, unsigned long len);
 #define RNC_UNPACKED_CRC_ERROR -5
 #define RNC_HEADER_VAL_ERROR   -6
 #define RNC_HUF_EXCEEDS_RANGE  -7
+#define RNC_MALLOC_ERROR       -8
 
 /**
  * Flags to ignore errors.
  */
-enum EXTRA_OBJ_LOAD {
+enum RNC_IGNORE_FLAGS {
     RNC_IGNORE_NONE               = 0x0000,
     RNC_IGNORE_FILE_IS_NOT_RNC    = 0x0001,
     RNC_IGNORE_HUF_DECODE_ERROR   = 0x0002,
@@ -61,6 +62,11 @@ enum EXTRA_OBJ_LOAD {
     RNC_IGNORE_UNPACKED_CRC_ERROR = 0x0010,
     RNC_IGNORE_HEADER_VAL_ERROR   = 0x0020,
     RNC_IGNORE_HUF_EXCEEDS_RANGE  = 0x0040,
+    /* Both CRCs are ignored - for data which was validated before;
+     * the CRCs aren't even computed then */
+    RNC_IGNORE_CRC_ERRORS         = RNC_IGNORE_PACKED_CRC_ERROR|RNC_IGNORE_UNPACKED_CRC_ERROR,
+    /* Not an error flag - disables the table-driven decoding loop */
+    RNC_SIMPLE_DECODE             = 0x0100,
     };
 
 #ifdef INTERNAL
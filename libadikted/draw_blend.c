@@ -0,0 +1,695 @@
+/******************************************************************************/
+/** @file draw_blend.c
+ * Blending pixels of RGB buffers.
+ * @par Purpose:
+ *     Routines which tint and blend rows of pixels in RGB buffers.
+ *     Every routine has a scalar version; if the processor supports
+ *     SSE2 or AVX2, vectorized versions are selected at runtime.
+ *     Compiled with MAIN_DRAWBLEND defined, it's a standalone program
+ *     which benchmarks the routines.
+ * @par Comment:
+ *     All versions of a routine give identical results.
+ * @date     17 Oct 2026
+ * @par  Copying and copyrights:
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ */
+/******************************************************************************/
+
+#include "draw_blend.h"
+
+#ifdef MAIN_DRAWBLEND
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <time.h>
+#endif
+
+#include "draw_map.h"
+
+/* Vectorized routines need target attributes and runtime CPU detection */
+#if defined(__GNUC__) && ((__GNUC__>4)||((__GNUC__==4)&&(__GNUC_MINOR__>=9))) \
+    && (defined(__i386__)||defined(__x86_64__))
+# define BLEND_X86_SIMD
+# include <immintrin.h>
+# define BLEND_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+/* Level used by the routines; negative if not detected yet */
+short blend_simd_level=-1;
+
+/**
+ * Returns the best instruction set supported by the processor.
+ * @return Returns one of BLEND_SIMD_LEVEL values.
+ */
+short blend_simd_supported(void)
+{
+#if defined(BLEND_X86_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return BLEND_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return BLEND_SIMD_SSE2;
+#endif
+    return BLEND_SIMD_NONE;
+}
+
+/**
+ * Returns the instruction set used by blending routines.
+ * @return Returns one of BLEND_SIMD_LEVEL values.
+ */
+short blend_get_simd_level(void)
+{
+    if (blend_simd_level<0)
+        blend_simd_level=blend_simd_supported();
+    return blend_simd_level;
+}
+
+/**
+ * Sets the instruction set used by blending routines.
+ * If the level isn't supported by the processor, the best supported
+ * level below it is used.
+ * @param level One of BLEND_SIMD_LEVEL values.
+ * @return Returns the level which will be used.
+ */
+short blend_set_simd_level(short level)
+{
+    short supported=blend_simd_supported();
+    if (level<BLEND_SIMD_NONE)
+        level=BLEND_SIMD_NONE;
+    if (level>supported)
+        level=supported;
+    blend_simd_level=level;
+    return blend_simd_level;
+}
+
+/**
+ * Multiplies color of one pixel at given offset of destination buffer.
+ * Multiplies PALETTE_ENTRY color values with previous pixel values.
+ * @param dest The destination buffer.
+ * @param offset Position in destination buffer of the pixel.
+ * @param color Pixel color.
+ */
+void draw_pixel_mul_offs(unsigned char *dest,
+    const unsigned long offset,const struct PALETTE_ENTRY *color)
+{
+  unsigned short nvalr,nvalg,nvalb;
+  nvalb=(dest[offset+0]);
+  nvalg=(dest[offset+1]);
+  nvalr=(dest[offset+2]);
+  unsigned short sum=nvalr+nvalg+nvalb;
+  dest[offset+0]=min(nvalb+((sum*color->b)>>10),255);
+  dest[offset+1]=min(nvalg+((sum*color->g)>>10),255);
+  dest[offset+2]=min(nvalr+((sum*color->r)>>10),255);
+}
+
+/**
+ * Puts color of one pixel at given offset of destination buffer, uses alpha channel.
+ * Adds PALETTE_ENTRY color values with previous pixel values, using alpha as factor.
+ * @param dest The destination buffer.
+ * @param offset Position in destination buffer of the pixel.
+ * @param alpha Pixel alpha.
+ * @param color Pixel color.
+ */
+void draw_pixel_x4walpha_offs(unsigned char *dest,
+    const unsigned long offset,const unsigned short alpha,
+    const struct PALETTE_ENTRY *color)
+{
+  unsigned short nvalr,nvalg,nvalb;
+  nvalb=(dest[offset+0]);
+  nvalg=(dest[offset+1]);
+  nvalr=(dest[offset+2]);
+  dest[offset+0]=(alpha*nvalb+(255-alpha)*(color->b<<2))>>8;
+  dest[offset+1]=(alpha*nvalg+(255-alpha)*(color->g<<2))>>8;
+  dest[offset+2]=(alpha*nvalr+(255-alpha)*(color->r<<2))>>8;
+}
+
+/**
+ * Multiplies values of pixels in a row with given factors.
+ * Scalar version, see draw_pixel_mul_offs().
+ * @param dest The first pixel of the row.
+ * @param count Amount of pixels.
+ * @param color Multiply factors.
+ */
+void blend_row_mul_scalar(unsigned char *dest,int count,const struct PALETTE_ENTRY *color)
+{
+    int i;
+    for (i=0;i<count;i++)
+        draw_pixel_mul_offs(dest,3*i,color);
+}
+
+/**
+ * Adds given values to pixels in a row, with saturation.
+ * Scalar version.
+ * @param dest The first pixel of the row.
+ * @param count Amount of pixels.
+ * @param color Values to sum with.
+ */
+void blend_row_sum_scalar(unsigned char *dest,int count,const struct PALETTE_ENTRY *color)
+{
+    int i;
+    for (i=0;i<count;i++)
+    {
+        dest[3*i+0]=min(dest[3*i+0]+color->b,255);
+        dest[3*i+1]=min(dest[3*i+1]+color->g,255);
+        dest[3*i+2]=min(dest[3*i+2]+color->r,255);
+    }
+}
+
+/**
+ * Puts a row of palette colors on pixels, using alpha channel.
+ * Scalar version, see draw_pixel_x4walpha_offs().
+ * @param dest The first pixel of the row.
+ * @param count Amount of pixels.
+ * @param alpha Alpha values of the placed pixels.
+ * @param data Palette indexes of the placed pixels.
+ * @param pal The palette.
+ */
+void blend_row_x4walpha_scalar(unsigned char *dest,int count,const unsigned char *alpha,
+    const unsigned char *data,const struct PALETTE_ENTRY *pal)
+{
+    int i;
+    for (i=0;i<count;i++)
+        draw_pixel_x4walpha_offs(dest,3*i,alpha[i],&pal[data[i]]);
+}
+
+#if defined(BLEND_X86_SIMD)
+
+/*
+ * Routines below work on pixel components widened to 16 bits. A group of
+ * registers stores components of whole pixels, so sums of pixels can be
+ * computed by shifting the values between neighbouring registers.
+ */
+
+/* Moves 16-bit lanes of a towards lower lanes; upper lanes come from b */
+#define SSE2_NEXT_LANES(a,b,n) _mm_or_si128(_mm_srli_si128(a,2*(n)),_mm_slli_si128(b,16-2*(n)))
+/* Moves 16-bit lanes of a towards upper lanes; lower lanes come from p */
+#define SSE2_PREV_LANES(a,p,n) _mm_or_si128(_mm_slli_si128(a,2*(n)),_mm_srli_si128(p,16-2*(n)))
+#define AVX2_NEXT_LANES(a,b,n) _mm256_alignr_epi8(_mm256_permute2x128_si256(a,b,0x21),a,2*(n))
+#define AVX2_PREV_LANES(a,p,n) _mm256_alignr_epi8(a,_mm256_permute2x128_si256(p,a,0x21),16-2*(n))
+/* Joins two 128-bit registers into one 256-bit register */
+#define AVX2_JOIN(lo,hi) _mm256_inserti128_si256(_mm256_castsi128_si256(lo),hi,1)
+
+/**
+ * Multiplies values of pixels in a row with given factors.
+ * SSE2 version, see draw_pixel_mul_offs().
+ * @param dest The first pixel of the row.
+ * @param count Amount of pixels.
+ * @param color Multiply factors.
+ */
+BLEND_TARGET("sse2")
+void blend_row_mul_sse2(unsigned char *dest,int count,const struct PALETTE_ENTRY *color)
+{
+    const short b=color->b;
+    const short g=color->g;
+    const short r=color->r;
+    const __m128i zero=_mm_setzero_si128();
+    const __m128i col0=_mm_setr_epi16(b,g,r,b,g,r,b,g);
+    const __m128i col1=_mm_setr_epi16(r,b,g,r,b,g,r,b);
+    const __m128i col2=_mm_setr_epi16(g,r,b,g,r,b,g,r);
+    /* Lanes of blue components */
+    const __m128i mask0=_mm_setr_epi16(-1,0,0,-1,0,0,-1,0);
+    const __m128i mask1=_mm_setr_epi16(0,-1,0,0,-1,0,0,-1);
+    const __m128i mask2=_mm_setr_epi16(0,0,-1,0,0,-1,0,0);
+    int i;
+    /* Blocks of 8 pixels, stored in 3 registers */
+    for (i=0;i+8<=count;i+=8)
+    {
+        unsigned char *pos=dest+3*i;
+        __m128i lo=_mm_loadu_si128((const __m128i *)pos);
+        __m128i hi=_mm_loadl_epi64((const __m128i *)(pos+16));
+        __m128i w0=_mm_unpacklo_epi8(lo,zero);
+        __m128i w1=_mm_unpackhi_epi8(lo,zero);
+        __m128i w2=_mm_unpacklo_epi8(hi,zero);
+        /* Sums of pixel components, in the lanes of blue components */
+        __m128i t0=_mm_add_epi16(_mm_add_epi16(w0,SSE2_NEXT_LANES(w0,w1,1)),SSE2_NEXT_LANES(w0,w1,2));
+        __m128i t1=_mm_add_epi16(_mm_add_epi16(w1,SSE2_NEXT_LANES(w1,w2,1)),SSE2_NEXT_LANES(w1,w2,2));
+        __m128i t2=_mm_add_epi16(_mm_add_epi16(w2,SSE2_NEXT_LANES(w2,zero,1)),SSE2_NEXT_LANES(w2,zero,2));
+        t0=_mm_and_si128(t0,mask0);
+        t1=_mm_and_si128(t1,mask1);
+        t2=_mm_and_si128(t2,mask2);
+        /* Copying the sums to lanes of green and red components */
+        __m128i s0=_mm_add_epi16(_mm_add_epi16(t0,SSE2_PREV_LANES(t0,zero,1)),SSE2_PREV_LANES(t0,zero,2));
+        __m128i s1=_mm_add_epi16(_mm_add_epi16(t1,SSE2_PREV_LANES(t1,t0,1)),SSE2_PREV_LANES(t1,t0,2));
+        __m128i s2=_mm_add_epi16(_mm_add_epi16(t2,SSE2_PREV_LANES(t2,t1,1)),SSE2_PREV_LANES(t2,t1,2));
+        /* (sum*factor)>>10 is the high word of (sum<<6)*factor */
+        w0=_mm_add_epi16(w0,_mm_mulhi_epu16(_mm_slli_epi16(s0,6),col0));
+        w1=_mm_add_epi16(w1,_mm_mulhi_epu16(_mm_slli_epi16(s1,6),col1));
+        w2=_mm_add_epi16(w2,_mm_mulhi_epu16(_mm_slli_epi16(s2,6),col2));
+        /* Packing with unsigned saturation limits the values to 255 */
+        _mm_storeu_si128((__m128i *)pos,_mm_packus_epi16(w0,w1));
+        _mm_storel_epi64((__m128i *)(pos+16),_mm_packus_epi16(w2,w2));
+    }
+    blend_row_mul_scalar(dest+3*i,count-i,color);
+}
+
+/**
+ * Multiplies values of pixels in a row with given factors.
+ * AVX2 version, see draw_pixel_mul_offs().
+ * @param dest The first pixel of the row.
+ * @param count Amount of pixels.
+ * @param color Multiply factors.
+ */
+BLEND_TARGET("avx2")
+void blend_row_mul_avx2(unsigned char *dest,int count,const struct PALETTE_ENTRY *color)
+{
+    const short b=color->b;
+    const short g=color->g;
+    const short r=color->r;
+    const __m128i c0=_mm_setr_epi16(b,g,r,b,g,r,b,g);
+    const __m128i c1=_mm_setr_epi16(r,b,g,r,b,g,r,b);
+    const __m128i c2=_mm_setr_epi16(g,r,b,g,r,b,g,r);
+    const __m128i m0=_mm_setr_epi16(-1,0,0,-1,0,0,-1,0);
+    const __m128i m1=_mm_setr_epi16(0,-1,0,0,-1,0,0,-1);
+    const __m128i m2=_mm_setr_epi16(0,0,-1,0,0,-1,0,0);
+    const __m256i zero=_mm256_setzero_si256();
+    const __m256i col0=AVX2_JOIN(c0,c1);
+    const __m256i col1=AVX2_JOIN(c2,c0);
+    const __m256i col2=AVX2_JOIN(c1,c2);
+    /* Lanes of blue components */
+    const __m256i mask0=AVX2_JOIN(m0,m1);
+    const __m256i mask1=AVX2_JOIN(m2,m0);
+    const __m256i mask2=AVX2_JOIN(m1,m2);
+    int i;
+    /* Blocks of 16 pixels, stored in 3 registers */
+    for (i=0;i+16<=count;i+=16)
+    {
+        unsigned char *pos=dest+3*i;
+        __m256i w0=_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)pos));
+        __m256i w1=_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pos+16)));
+        __m256i w2=_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pos+32)));
+        /* Sums of pixel components, in the lanes of blue components */
+        __m256i t0=_mm256_add_epi16(_mm256_add_epi16(w0,AVX2_NEXT_LANES(w0,w1,1)),AVX2_NEXT_LANES(w0,w1,2));
+        __m256i t1=_mm256_add_epi16(_mm256_add_epi16(w1,AVX2_NEXT_LANES(w1,w2,1)),AVX2_NEXT_LANES(w1,w2,2));
+        __m256i t2=_mm256_add_epi16(_mm256_add_epi16(w2,AVX2_NEXT_LANES(w2,zero,1)),AVX2_NEXT_LANES(w2,zero,2));
+        t0=_mm256_and_si256(t0,mask0);
+        t1=_mm256_and_si256(t1,mask1);
+        t2=_mm256_and_si256(t2,mask2);
+        /* Copying the sums to lanes of green and red components */
+        __m256i s0=_mm256_add_epi16(_mm256_add_epi16(t0,AVX2_PREV_LANES(t0,zero,1)),AVX2_PREV_LANES(t0,zero,2));
+        __m256i s1=_mm256_add_epi16(_mm256_add_epi16(t1,AVX2_PREV_LANES(t1,t0,1)),AVX2_PREV_LANES(t1,t0,2));
+        __m256i s2=_mm256_add_epi16(_mm256_add_epi16(t2,AVX2_PREV_LANES(t2,t1,1)),AVX2_PREV_LANES(t2,t1,2));
+        /* (sum*factor)>>10 is the high word of (sum<<6)*factor */
+        w0=_mm256_add_epi16(w0,_mm256_mulhi_epu16(_mm256_slli_epi16(s0,6),col0));
+        w1=_mm256_add_epi16(w1,_mm256_mulhi_epu16(_mm256_slli_epi16(s1,6),col1));
+        w2=_mm256_add_epi16(w2,_mm256_mulhi_epu16(_mm256_slli_epi16(s2,6),col2));
+        /* Packing works within 128-bit halves, so the quadwords must be reordered */
+        _mm256_storeu_si256((__m256i *)pos,_mm256_permute4x64_epi64(_mm256_packus_epi16(w0,w1),0xd8));
+        _mm_storeu_si128((__m128i *)(pos+32),_mm256_castsi256_si128(
+            _mm256_permute4x64_epi64(_mm256_packus_epi16(w2,w2),0xd8)));
+    }
+    if (count-i>=8)
+        blend_row_mul_sse2(dest+3*i,count-i,color);
+    else
+        blend_row_mul_scalar(dest+3*i,count-i,color);
+}
+
+/**
+ * Adds given values to pixels in a row, with saturation.
+ * SSE2 version.
+ * @param dest The first pixel of the row.
+ * @param count Amount of pixels.
+ * @param color Values to sum with.
+ */
+BLEND_TARGET("sse2")
+void blend_row_sum_sse2(unsigned char *dest,int count,const struct PALETTE_ENTRY *color)
+{
+    const char b=color->b;
+    const char g=color->g;
+    const char r=color->r;
+    const __m128i col0=_mm_setr_epi8(b,g,r,b,g,r,b,g,r,b,g,r,b,g,r,b);
+    const __m128i col1=_mm_setr_epi8(g,r,b,g,r,b,g,r,b,g,r,b,g,r,b,g);
+    const __m128i col2=_mm_setr_epi8(r,b,g,r,b,g,r,b,g,r,b,g,r,b,g,r);
+    int i;
+    /* Blocks of 16 pixels, stored in 3 registers */
+    for (i=0;i+16<=count;i+=16)
+    {
+        __m128i *pos=(__m128i *)(dest+3*i);
+        _mm_storeu_si128(pos+0,_mm_adds_epu8(_mm_loadu_si128(pos+0),col0));
+        _mm_storeu_si128(pos+1,_mm_adds_epu8(_mm_loadu_si128(pos+1),col1));
+        _mm_storeu_si128(pos+2,_mm_adds_epu8(_mm_loadu_si128(pos+2),col2));
+    }
+    blend_row_sum_scalar(dest+3*i,count-i,color);
+}
+
+/**
+ * Adds given values to pixels in a row, with saturation.
+ * AVX2 version.
+ * @param dest The first pixel of the row.
+ * @param count Amount of pixels.
+ * @param color Values to sum with.
+ */
+BLEND_TARGET("avx2")
+void blend_row_sum_avx2(unsigned char *dest,int count,const struct PALETTE_ENTRY *color)
+{
+    const char b=color->b;
+    const char g=color->g;
+    const char r=color->r;
+    const __m128i c0=_mm_setr_epi8(b,g,r,b,g,r,b,g,r,b,g,r,b,g,r,b);
+    const __m128i c1=_mm_setr_epi8(g,r,b,g,r,b,g,r,b,g,r,b,g,r,b,g);
+    const __m128i c2=_mm_setr_epi8(r,b,g,r,b,g,r,b,g,r,b,g,r,b,g,r);
+    const __m256i col0=AVX2_JOIN(c0,c1);
+    const __m256i col1=AVX2_JOIN(c2,c0);
+    const __m256i col2=AVX2_JOIN(c1,c2);
+    int i;
+    /* Blocks of 32 pixels, stored in 3 registers */
+    for (i=0;i+32<=count;i+=32)
+    {
+        __m256i *pos=(__m256i *)(dest+3*i);
+        _mm256_storeu_si256(pos+0,_mm256_adds_epu8(_mm256_loadu_si256(pos+0),col0));
+        _mm256_storeu_si256(pos+1,_mm256_adds_epu8(_mm256_loadu_si256(pos+1),col1));
+        _mm256_storeu_si256(pos+2,_mm256_adds_epu8(_mm256_loadu_si256(pos+2),col2));
+    }
+    if (count-i>=16)
+        blend_row_sum_sse2(dest+3*i,count-i,color);
+    else
+        blend_row_sum_scalar(dest+3*i,count-i,color);
+}
+
+/**
+ * Puts a row of palette colors on pixels, using alpha channel.
+ * AVX2 version, see draw_pixel_x4walpha_offs().
+ * Palette colors are gathered for 8 pixels at once, and components
+ * of every 4 pixels are spread to 16-bit lanes within one 128-bit half.
+ * The blended values are truncated to 8 bits, like in the scalar version.
+ * @param dest The first pixel of the row.
+ * @param count Amount of pixels.
+ * @param alpha Alpha values of the placed pixels.
+ * @param data Palette indexes of the placed pixels.
+ * @param pal The palette.
+ */
+BLEND_TARGET("avx2")
+void blend_row_x4walpha_avx2(unsigned char *dest,int count,const unsigned char *alpha,
+    const unsigned char *data,const struct PALETTE_ENTRY *pal)
+{
+    /* Spreading BGR pixels to b,g,r,0 lanes; second half is loaded 4 bytes earlier */
+    const __m256i dest_lo=_mm256_setr_epi8(0,-1,1,-1,2,-1,-1,-1,3,-1,4,-1,5,-1,-1,-1,
+        4,-1,5,-1,6,-1,-1,-1,7,-1,8,-1,9,-1,-1,-1);
+    const __m256i dest_hi=_mm256_setr_epi8(6,-1,7,-1,8,-1,-1,-1,9,-1,10,-1,11,-1,-1,-1,
+        10,-1,11,-1,12,-1,-1,-1,13,-1,14,-1,15,-1,-1,-1);
+    /* Spreading PALETTE_ENTRY colors to b,g,r,0 lanes */
+    const __m256i col_lo=_mm256_setr_epi8(2,-1,1,-1,0,-1,-1,-1,6,-1,5,-1,4,-1,-1,-1,
+        2,-1,1,-1,0,-1,-1,-1,6,-1,5,-1,4,-1,-1,-1);
+    const __m256i col_hi=_mm256_setr_epi8(10,-1,9,-1,8,-1,-1,-1,14,-1,13,-1,12,-1,-1,-1,
+        10,-1,9,-1,8,-1,-1,-1,14,-1,13,-1,12,-1,-1,-1);
+    /* Copying alpha of every pixel to its 3 lanes */
+    const __m256i alph_lo=_mm256_setr_epi8(0,-1,0,-1,0,-1,-1,-1,4,-1,4,-1,4,-1,-1,-1,
+        0,-1,0,-1,0,-1,-1,-1,4,-1,4,-1,4,-1,-1,-1);
+    const __m256i alph_hi=_mm256_setr_epi8(8,-1,8,-1,8,-1,-1,-1,12,-1,12,-1,12,-1,-1,-1,
+        8,-1,8,-1,8,-1,-1,-1,12,-1,12,-1,12,-1,-1,-1);
+    /* Joining b,g,r,0 bytes back into BGR pixels */
+    const __m256i pack=_mm256_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1,
+        0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+    const __m256i full=_mm256_set1_epi16(255);
+    const __m256i lowbyte=_mm256_set1_epi32(255);
+    int i,k;
+    /* Blocks of 8 pixels, 4 in every 128-bit half */
+    for (i=0;i+8<=count;i+=8)
+    {
+        unsigned char *pos=dest+3*i;
+        __m256i d=AVX2_JOIN(_mm_loadu_si128((const __m128i *)pos),
+            _mm_loadu_si128((const __m128i *)(pos+8)));
+        __m256i idx=_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(data+i)));
+        __m256i c=_mm256_i32gather_epi32((const int *)pal,idx,4);
+        __m256i a=_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(alpha+i)));
+        __m256i w[2];
+        w[0]=_mm256_shuffle_epi8(d,dest_lo);
+        w[1]=_mm256_shuffle_epi8(d,dest_hi);
+        for (k=0;k<2;k++)
+        {
+            __m256i cw=_mm256_slli_epi16(_mm256_shuffle_epi8(c,k?col_hi:col_lo),2);
+            __m256i aw=_mm256_shuffle_epi8(a,k?alph_hi:alph_lo);
+            __m256i na=_mm256_sub_epi16(full,aw);
+            /* alpha*value+(255-alpha)*color, in 32-bit lanes */
+            __m256i vlo=_mm256_madd_epi16(_mm256_unpacklo_epi16(w[k],cw),_mm256_unpacklo_epi16(aw,na));
+            __m256i vhi=_mm256_madd_epi16(_mm256_unpackhi_epi16(w[k],cw),_mm256_unpackhi_epi16(aw,na));
+            vlo=_mm256_and_si256(_mm256_srli_epi32(vlo,8),lowbyte);
+            vhi=_mm256_and_si256(_mm256_srli_epi32(vhi,8),lowbyte);
+            w[k]=_mm256_packs_epi32(vlo,vhi);
+        }
+        __m256i res=_mm256_shuffle_epi8(_mm256_packus_epi16(w[0],w[1]),pack);
+        __m128i res_hi=_mm256_extracti128_si256(res,1);
+        /* Every half has 12 bytes; the second one is stored after the first */
+        _mm_storeu_si128((__m128i *)pos,_mm256_castsi256_si128(res));
+        _mm_storel_epi64((__m128i *)(pos+12),res_hi);
+        int last=_mm_cvtsi128_si32(_mm_srli_si128(res_hi,8));
+        memcpy(pos+20,&last,sizeof(int));
+    }
+    blend_row_x4walpha_scalar(dest+3*i,count-i,alpha+i,data+i,pal);
+}
+
+#endif /* BLEND_X86_SIMD */
+
+/**
+ * Multiplies values of pixels in a row with given factors.
+ * Note that this is not clear multiplication, but multiplication+sum.
+ * @param dest The first pixel of the row.
+ * @param count Amount of pixels.
+ * @param color Multiply factors.
+ */
+void blend_row_mul(unsigned char *dest,int count,const struct PALETTE_ENTRY *color)
+{
+#if defined(BLEND_X86_SIMD)
+    /* Rows shorter than one block are faster without preparing registers */
+    short level=blend_get_simd_level();
+    if ((level>=BLEND_SIMD_AVX2)&&(count>=16))
+    {
+        blend_row_mul_avx2(dest,count,color);
+        return;
+    }
+    if ((level>=BLEND_SIMD_SSE2)&&(count>=8))
+    {
+        blend_row_mul_sse2(dest,count,color);
+        return;
+    }
+#endif
+    blend_row_mul_scalar(dest,count,color);
+}
+
+/**
+ * Adds given values to pixels in a row, with saturation.
+ * @param dest The first pixel of the row.
+ * @param count Amount of pixels.
+ * @param color Values to sum with.
+ */
+void blend_row_sum(unsigned char *dest,int count,const struct PALETTE_ENTRY *color)
+{
+#if defined(BLEND_X86_SIMD)
+    short level=blend_get_simd_level();
+    if ((level>=BLEND_SIMD_AVX2)&&(count>=32))
+    {
+        blend_row_sum_avx2(dest,count,color);
+        return;
+    }
+    if ((level>=BLEND_SIMD_SSE2)&&(count>=16))
+    {
+        blend_row_sum_sse2(dest,count,color);
+        return;
+    }
+#endif
+    blend_row_sum_scalar(dest,count,color);
+}
+
+/**
+ * Puts a row of palette colors on pixels, using alpha channel.
+ * There is no SSE2 version; without AVX2 gather and byte shuffles,
+ * palette lookups make it slower than the scalar one.
+ * @param dest The first pixel of the row.
+ * @param count Amount of pixels.
+ * @param alpha Alpha values of the placed pixels.
+ * @param data Palette indexes of the placed pixels.
+ * @param pal The palette.
+ */
+void blend_row_x4walpha(unsigned char *dest,int count,const unsigned char *alpha,
+    const unsigned char *data,const struct PALETTE_ENTRY *pal)
+{
+#if defined(BLEND_X86_SIMD)
+    if ((blend_get_simd_level()>=BLEND_SIMD_AVX2)&&(count>=8))
+    {
+        blend_row_x4walpha_avx2(dest,count,alpha,data,pal);
+        return;
+    }
+#endif
+    blend_row_x4walpha_scalar(dest,count,alpha,data,pal);
+}
+
+#ifdef MAIN_DRAWBLEND
+/* Amount of subtiles in a row of full-size map */
+#define BENCH_MAP_SUBTILES 255
+
+int main_benchmark (char *pname, int rescale, long repeats);
+
+/**
+ * Shows usage if building stand-alone blending benchmark.
+ * @param fname Name of the executable file.
+ * @return Returns 1 on success.
+ */
+short show_usage(char *fname)
+{
+    printf("usage:\n");
+    printf("    %s -b [rescale] [repeats]\n", fname);
+    return 1;
+}
+
+/**
+ * Main function if building stand-alone blending benchmark.
+ * @param argc Command line arguments count.
+ * @param argv Command line arguments vector.
+ * @return Returns 0 on success.
+ */
+int main(int argc, char **argv)
+{
+    printf("\nRGB buffer blending benchmark\n");
+    printf("-------------------------------\n");
+    if ((argc < 2) || (argc > 4) || (strcmp(argv[1], "-b") != 0))
+    {
+        show_usage(*argv);
+        return 1;
+    }
+    return main_benchmark (*argv, (argc>2)?atoi(argv[2]):2, (argc>3)?atol(argv[3]):20);
+}
+
+/**
+ * Fills buffer with pseudo-random bytes.
+ * @param buf The buffer.
+ * @param len Buffer size.
+ * @param seed Starting value of the generator.
+ */
+void bench_fill_random(unsigned char *buf, unsigned long len, unsigned long seed)
+{
+    unsigned long i;
+    for (i=0; i < len; i++)
+    {
+        seed = seed*1103515245 + 12345;
+        buf[i] = (seed >> 16) & 255;
+    }
+}
+
+/**
+ * Blends whole map buffer with given routine at every SIMD level, and
+ * prints the speed. Like in draw_map_on_buffer(), the rows are blended
+ * separately for every subtile.
+ * @param name Name of the routine.
+ * @param op Index of the routine: 0 - mul, 1 - sum, 2 - x4walpha.
+ * @param src Buffer with starting values of the map.
+ * @param work Buffers for results of every SIMD level.
+ * @param size Size of the map buffer, in pixels.
+ * @param subtl_size Size of one subtile, in pixels.
+ * @param pal Palette used for blending.
+ * @param alpha Alpha values, one for every pixel in a map row.
+ * @param data Palette indexes, one for every pixel in a map row.
+ * @param repeats Amount of blending passes at every level.
+ * @return Returns 0 if all levels gave the same result.
+ */
+int bench_blend(const char *name, int op, const unsigned char *src,
+    unsigned char **work, int size, int subtl_size, const struct PALETTE_ENTRY *pal,
+    const unsigned char *alpha, const unsigned char *data, long repeats)
+{
+    static char *const level_names[] = {"scalar", "SSE2", "AVX2"};
+    short max_level = blend_simd_supported();
+    unsigned long buf_len = (unsigned long)size*size*3;
+    clock_t start, elapsed;
+    short level;
+    long i;
+    int x, y, r;
+    for (level=BLEND_SIMD_NONE; level <= max_level; level++)
+    {
+        blend_set_simd_level(level);
+        elapsed = 0;
+        for (i=0; i < repeats; i++)
+        {
+            memcpy(work[level], src, buf_len);
+            start = clock();
+            for (y=0; y < size; y+=subtl_size)
+              for (x=0; x < size; x+=subtl_size)
+                for (r=0; r < subtl_size; r++)
+                {
+                  unsigned char *row = work[level] + ((unsigned long)(y+r)*size + x)*3;
+                  switch (op)
+                  {
+                  case 0:
+                      blend_row_mul(row, subtl_size, &pal[(x+y)%6]);
+                      break;
+                  case 1:
+                      blend_row_sum(row, subtl_size, &pal[(x+y)%6]);
+                      break;
+                  default:
+                      blend_row_x4walpha(row, subtl_size, alpha+x, data+x, pal);
+                      break;
+                  }
+                }
+            elapsed += clock() - start;
+        }
+        if (elapsed < 1)
+            elapsed = 1;
+        printf("%-9s %-7s %9.2f Mpix/s (%ld x %dx%d pixels in %.3f s)\n",
+            name, level_names[level],
+            ((double)size*size*repeats/1000000)*CLOCKS_PER_SEC/elapsed,
+            repeats, size, size, (double)elapsed/CLOCKS_PER_SEC);
+        if ((level > BLEND_SIMD_NONE) && (memcmp(work[0], work[level], buf_len) != 0))
+        {
+            printf("Error: %s %s gave different result than scalar version\n",
+                name, level_names[level]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Benchmarks blending routines on buffer of full-size map.
+ * @param pname Name of the executable file.
+ * @param rescale Scale of textures, as in MAPDRAW_OPTIONS; a subtile
+ *     has 32>>rescale pixels.
+ * @param repeats Amount of blending passes at every level.
+ * @return Returns 0 on success. On error prints a message
+ *     and returns nonzero value.
+ */
+int main_benchmark (char *pname, int rescale, long repeats)
+{
+    struct PALETTE_ENTRY pal[256];
+    unsigned char *src, *work[BLEND_SIMD_AVX2+1];
+    unsigned char *alpha, *data;
+    unsigned long buf_len;
+    int subtl_size, size;
+    int n, result;
+
+    if ((rescale < 0) || (rescale > 5))
+        rescale = 2;
+    if (repeats < 1)
+        repeats = 1;
+    subtl_size = 32 >> rescale;
+    size = BENCH_MAP_SUBTILES*subtl_size;
+    buf_len = (unsigned long)size*size*3;
+    src = malloc(buf_len);
+    alpha = malloc(size);
+    data = malloc(size);
+    for (n=0; n <= BLEND_SIMD_AVX2; n++)
+        work[n] = malloc(buf_len);
+    if ((src==NULL) || (alpha==NULL) || (data==NULL) || (work[0]==NULL)
+     || (work[1]==NULL) || (work[2]==NULL))
+    {
+        perror(pname);
+        return 1;
+    }
+    bench_fill_random(src, buf_len, 1);
+    bench_fill_random(alpha, size, 2);
+    bench_fill_random(data, size, 3);
+    bench_fill_random((unsigned char *)pal, sizeof(pal), 4);
+    printf("Map %dx%d subtiles, %dx%d pixels each\n",
+        BENCH_MAP_SUBTILES, BENCH_MAP_SUBTILES, subtl_size, subtl_size);
+    result = bench_blend("mul", 0, src, work, size, subtl_size, pal, alpha, data, repeats);
+    if (result == 0)
+        result = bench_blend("sum", 1, src, work, size, subtl_size, pal, alpha, data, repeats);
+    if (result == 0)
+        result = bench_blend("x4walpha", 2, src, work, size, subtl_size, pal, alpha, data, repeats);
+    for (n=0; n <= BLEND_SIMD_AVX2; n++)
+        free(work[n]);
+    free(data);
+    free(alpha);
+    free(src);
+    return result;
+}
+#endif
@@ -0,0 +1,55 @@
+/******************************************************************************/
+/** @file draw_blend.h
+ * Blending pixels of RGB buffers.
+ * @par Purpose:
+ *     Header file. Defines exported routines from draw_blend.c
+ * @par Comment:
+ *     None.
+ * @date     17 Oct 2026
+ * @par  Copying and copyrights:
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ */
+/******************************************************************************/
+
+#ifndef ADIKT_DRAWBLEND_H
+#define ADIKT_DRAWBLEND_H
+
+#include "globals.h"
+
+struct PALETTE_ENTRY;
+
+/**
+ * Instruction sets which can be used by blending routines.
+ */
+enum BLEND_SIMD_LEVEL {
+    BLEND_SIMD_NONE     = 0,
+    BLEND_SIMD_SSE2     = 1,
+    BLEND_SIMD_AVX2     = 2,
+    };
+
+/* Routines */
+
+DLLIMPORT short blend_simd_supported(void);
+DLLIMPORT short blend_get_simd_level(void);
+DLLIMPORT short blend_set_simd_level(short level);
+
+void draw_pixel_mul_offs(unsigned char *dest,
+    const unsigned long offset,const struct PALETTE_ENTRY *color);
+void draw_pixel_x4walpha_offs(unsigned char *dest,
+    const unsigned long offset,const unsigned short alpha,
+    const struct PALETTE_ENTRY *color);
+
+void blend_row_mul(unsigned char *dest,int count,const struct PALETTE_ENTRY *color);
+void blend_row_sum(unsigned char *dest,int count,const struct PALETTE_ENTRY *color);
+void blend_row_x4walpha(unsigned char *dest,int count,const unsigned char *alpha,
+    const unsigned char *data,const struct PALETTE_ENTRY *pal);
+
+void blend_row_mul_scalar(unsigned char *dest,int count,const struct PALETTE_ENTRY *color);
+void blend_row_sum_scalar(unsigned char *dest,int count,const struct PALETTE_ENTRY *color);
+void blend_row_x4walpha_scalar(unsigned char *dest,int count,const unsigned char *alpha,
+    const unsigned char *data,const struct PALETTE_ENTRY *pal);
+
+#endif /* ADIKT_DRAWBLEND_H */
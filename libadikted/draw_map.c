@@ -35,8 +35,35 @@
 #include "obj_column_def.h"
 #include "obj_actnpts.h"
 #include "bulcommn.h"
+#include "lbcontext.h"
 #include "arr_utils.h"
 #include "lev_things.h"
+#include "lbthreads.h"
+#include "draw_blend.h"
+
+/* Amount of textures which can be stored in MAPDRAW_DATA atlas */
+#define DRAW_ATLAS_ENTRIES (TEXTURE_COUNT_X*TEXTURE_COUNT_Y)
+/* Maximal size of a band of bitmap drawn at once by generate_map_bitmap() */
+#define MAPDRAW_BAND_SIZE_MAX (16*1024*1024)
+/* Amount of unused draw resources kept in the shared cache */
+#define DRAW_RES_CACHE_UNUSED_MAX 8
+
+/**
+ * Parameters of a thread drawing one band of the map.
+ */
+struct MAPDRAW_THREAD_PARAMS {
+    char *dest;
+    const struct LEVEL *lvl;
+    /* Copy of the drawing data, with drawing rectangle limited to the band */
+    struct MAPDRAW_DATA draw_data;
+    unsigned int anim;
+    short result;
+};
+
+typedef void (*draw_circle_func)(unsigned char *dest,const struct IPOINT_2D dest_pos,
+    const struct IPOINT_2D dest_size,const unsigned int dest_scanln,
+    const struct PALETTE_ENTRY *bcolor,const struct PALETTE_ENTRY *fcolor,
+    int radius);
 
 /**
  * Intensified player colors array.
@@ -172,14 +199,15 @@ const char *palette_fname="palette.dat";
 const char *cube_fname="cube.dat";
 const char *tmapanim_fname="tmapanim.dat";
 
-struct MAPDRAW_DATA *glb_draw_data;
+/* Draw resources shared between MAPDRAW_DATA structures; guarded by lbthreads_lock() */
+static struct DRAW_RESOURCES *draw_res_cache=NULL;
 
 void mdrand_setpos(struct MAPDRAW_DATA *draw_data,int sx,int sy)
 {
     draw_data->rand_subtl.x=sx;
     draw_data->rand_subtl.y=sy;
     draw_data->rand_count=0;
-    glb_draw_data=draw_data;
+    adikt_context_get()->draw_data=draw_data;
 }
 
 unsigned int mdrand_t8(struct MAPDRAW_DATA *draw_data,int tx,int ty,const unsigned int range)
@@ -189,7 +217,7 @@ unsigned int mdrand_t8(struct MAPDRAW_DATA *draw_data,int tx,int ty,const unsign
         draw_data->rand_subtl.x=tx*MAP_SUBNUM_X;
         draw_data->rand_subtl.y=ty*MAP_SUBNUM_Y;
         draw_data->rand_count=0;
-        glb_draw_data=draw_data;
+        adikt_context_get()->draw_data=draw_data;
     }
     int idx=((ty*MAP_SUBNUM_Y)*draw_data->subsize.x + tx*MAP_SUBNUM_X)*sizeof(int)+draw_data->rand_count;
     draw_data->rand_count++;
@@ -203,7 +231,7 @@ unsigned int mdrand_s8(struct MAPDRAW_DATA *draw_data,int sx,int sy,const unsign
         draw_data->rand_subtl.x=sx;
         draw_data->rand_subtl.y=sy;
         draw_data->rand_count=0;
-        glb_draw_data=draw_data;
+        adikt_context_get()->draw_data=draw_data;
     }
     int idx=((sy)*draw_data->subsize.x + sx)*sizeof(int)+draw_data->rand_count;
     draw_data->rand_count++;
@@ -219,14 +247,15 @@ unsigned int mdrand_nx8(struct MAPDRAW_DATA *draw_data,const unsigned int range)
 
 unsigned int mdrand_g8(const unsigned int range)
 {
-    int idx=((glb_draw_data->rand_subtl.y)*glb_draw_data->subsize.x + glb_draw_data->rand_subtl.x)*sizeof(int)+glb_draw_data->rand_count;
-    glb_draw_data->rand_count++;
-    return (glb_draw_data->rand_pool[idx%glb_draw_data->rand_size]%range);
+    struct MAPDRAW_DATA *draw_data=adikt_context_get()->draw_data;
+    int idx=((draw_data->rand_subtl.y)*draw_data->subsize.x + draw_data->rand_subtl.x)*sizeof(int)+draw_data->rand_count;
+    draw_data->rand_count++;
+    return (draw_data->rand_pool[idx%draw_data->rand_size]%range);
 }
 
 void mdrand_g8_waste(const unsigned int num)
 {
-    glb_draw_data->rand_count+=num;
+    adikt_context_get()->draw_data->rand_count+=num;
 }
 
 
@@ -282,47 +311,6 @@ void draw_pixel_exact_offs(unsigned char *dest,
     dest[offset+2]=color->r;
 }
 
-/**
- * Multiplies color of one pixel at given offset of destination buffer.
- * Multiplies PALETTE_ENTRY color values with previous pixel values.
- * @param dest The destination buffer.
- * @param offset Position in destination buffer of the pixel.
- * @param color Pixel color.
- */
-void draw_pixel_mul_offs(unsigned char *dest,
-    const unsigned long offset,const struct PALETTE_ENTRY *color)
-{
-  unsigned short nvalr,nvalg,nvalb;
-  nvalb=(dest[offset+0]);
-  nvalg=(dest[offset+1]);
-  nvalr=(dest[offset+2]);
-  unsigned short sum=nvalr+nvalg+nvalb;
-  dest[offset+0]=min(nvalb+((sum*color->b)>>10),255);
-  dest[offset+1]=min(nvalg+((sum*color->g)>>10),255);
-  dest[offset+2]=min(nvalr+((sum*color->r)>>10),255);
-}
-
-/**
- * Puts color of one pixel at given offset of destination buffer, uses alpha channel.
- * Adds PALETTE_ENTRY color values with previous pixel values, using alpha as factor.
- * @param dest The destination buffer.
- * @param offset Position in destination buffer of the pixel.
- * @param alpha Pixel alpha.
- * @param color Pixel color.
- */
-void draw_pixel_x4walpha_offs(unsigned char *dest,
-    const unsigned long offset,const unsigned short alpha,
-    const struct PALETTE_ENTRY *color)
-{
-  unsigned short nvalr,nvalg,nvalb;
-  nvalb=(dest[offset+0]);
-  nvalg=(dest[offset+1]);
-  nvalr=(dest[offset+2]);
-  dest[offset+0]=(alpha*nvalb+(255-alpha)*(color->b<<2))>>8;
-  dest[offset+1]=(alpha*nvalg+(255-alpha)*(color->g<<2))>>8;
-  dest[offset+2]=(alpha*nvalr+(255-alpha)*(color->r<<2))>>8;
-}
-
 /**
  * Draws filled circle on given buffer.
  * @param dest The destination buffer.
@@ -338,6 +326,7 @@ void draw_circle_fill(unsigned char *dest,const struct IPOINT_2D dest_pos,
     const struct PALETTE_ENTRY *bcolor,const struct PALETTE_ENTRY *fcolor,
     int radius)
 {
+  const struct MAPDRAW_DATA *draw_data=adikt_context_get()->draw_data;
   unsigned long n=0;
   long invradius=(1/(float)radius)*0x10000L;
   int dx=0,dy=radius;
@@ -437,7 +426,7 @@ void draw_circle_fill(unsigned char *dest,const struct IPOINT_2D dest_pos,
         dx++;
         n+=invradius;
         if ((n>>6)>=SIN_ACOS_SIZE) break;
-        dy = (int)((radius * (glb_draw_data->sin_acos[(int)(n>>6)])) >> 16);
+        dy = (int)((radius * (draw_data->sin_acos[(int)(n>>6)])) >> 16);
       }
   }
 } 
@@ -457,6 +446,7 @@ void draw_circle_mul(unsigned char *dest,const struct IPOINT_2D dest_pos,
     const struct PALETTE_ENTRY *bcolor,const struct PALETTE_ENTRY *fcolor,
     int radius)
 {
+  const struct MAPDRAW_DATA *draw_data=adikt_context_get()->draw_data;
   unsigned long n=0;
   long invradius=(1/(float)radius)*0x10000L;
   int dx=0,dy=radius;
@@ -556,7 +546,7 @@ void draw_circle_mul(unsigned char *dest,const struct IPOINT_2D dest_pos,
         dx++;
         n+=invradius;
         if ((n>>6)>=SIN_ACOS_SIZE) break;
-        dy = (int)((radius * (glb_draw_data->sin_acos[(int)(n>>6)])) >> 16);
+        dy = (int)((radius * (draw_data->sin_acos[(int)(n>>6)])) >> 16);
       }
   }
 } 
@@ -575,11 +565,12 @@ short place_sprite_cntr_on_buf_rgb(unsigned char *dest,const struct IPOINT_2D de
     const struct IPOINT_2D dest_size,const unsigned int dest_scanln,
     const struct PALETTE_ENTRY *pal,const struct IMAGEITEM *spr)
 {
-    long dest_idx=((dest_pos.y-(spr->height>>1))*dest_scanln);
+    /* Signed arithmetic, so that sprites crossing top or left border are clipped */
+    long dest_idx=((long)dest_pos.y-(long)(spr->height>>1))*(long)dest_scanln;
     unsigned long src_idx=0;
     unsigned long dest_fullsize=dest_scanln*dest_size.y;
-    unsigned long dest_startx=3*(dest_pos.x-(spr->width>>1));
-    unsigned long dest_maxidx=(dest_size.x-1)*3;
+    long dest_startx=3*((long)dest_pos.x-(long)(spr->width>>1));
+    long dest_maxidx=(dest_size.x-1)*3;
     if (dest_maxidx>=dest_scanln) dest_maxidx=dest_scanln-1;
     int w,h;
     for (h=0;h<spr->height;h++)
@@ -588,23 +579,23 @@ short place_sprite_cntr_on_buf_rgb(unsigned char *dest,const struct IPOINT_2D de
       dest_idx+=dest_scanln;
       src_idx+=spr->width;
     }
+    /* Clipping the sprite columns; the same for every row */
+    long dest_sidx=dest_startx;
+    for (w=0;w<spr->width;w++)
+    {
+        if (dest_sidx>=0) break;
+        dest_sidx+=3;
+    }
+    int count=0;
+    if (dest_sidx<=dest_maxidx)
+        count=min((dest_maxidx-dest_sidx)/3+1,spr->width-w);
     for (;h<spr->height;h++)
     {
       if (dest_idx>=dest_fullsize) break;
-      long dest_sidx=dest_startx;
-      for (w=0;w<spr->width;w++)
-      {
-          if (dest_sidx>=0) break;
-          dest_sidx+=3;
-      }
-      for (;w<spr->width;w++)
-      {
-          if (dest_sidx>dest_maxidx) continue;
-          /* Using multiplication to place colour on the pixel */
-          draw_pixel_x4walpha_offs(dest,dest_idx+dest_sidx,
-              spr->alpha[src_idx+w],&pal[spr->data[src_idx+w]]);
-          dest_sidx+=3;
-      }
+      /* Using multiplication to place colour on the pixels */
+      if (count>0)
+          blend_row_x4walpha(dest+dest_idx+dest_sidx,count,
+              &(spr->alpha[src_idx+w]),&(spr->data[src_idx+w]),pal);
       dest_idx+=dest_scanln;
       src_idx+=spr->width;
     }
@@ -637,18 +628,17 @@ short draw_rect_mul_on_buffer(unsigned char *dest,const struct IPOINT_2D dest_po
 /*    struct IPOINT_2D dest_rect_size=
         {rect_size.x/scale.x+((rect_size.x%scale.x)>0),
          rect_size.y/scale.y+((rect_size.y%scale.y)>0)};*/
-    int i,j;
+    /* Clipping the rectangle columns; the same for every row */
+    int count=0;
+    if ((dest_startx<=dest_maxidx)&&(dest_rect_size.x>0))
+        count=min((dest_maxidx-dest_startx)/3+1,dest_rect_size.x);
+    int j;
     for (j=0;j<dest_rect_size.y;j++)
     {
       if (dest_idx>=dest_fullsize) break;
-      unsigned long dest_sidx=dest_startx;
-      for (i=0;i<dest_rect_size.x;i++)
-      {
-          if (dest_sidx>dest_maxidx) continue;
-          /* Using multiplication to place colour on the pixel */
-          draw_pixel_mul_offs(dest,dest_idx+dest_sidx,pxdata);
-          dest_sidx+=3;
-      }
+      /* Using multiplication to place colour on the pixels */
+      if (count>0)
+          blend_row_mul(dest+dest_idx+dest_startx,count,pxdata);
       dest_idx+=dest_scanln;
     }
     return ERR_NONE;
@@ -672,27 +662,18 @@ short draw_rect_sum_on_buffer(unsigned char *dest,const struct IPOINT_2D dest_po
 {
     unsigned long dest_idx=(dest_pos.y*dest_scanln);
     unsigned long dest_fullsize=dest_scanln*dest_size.y;
-    int i,j;
-    for (j=0;j<rect_size.y;j++)
+    /* Every scale.x pixel of the rectangle is one pixel of buffer */
+    long startx=dest_pos.x;
+    long endx=dest_pos.x+(rect_size.x+scale.x-1)/scale.x;
+    if (startx<0) startx=0;
+    if (endx>dest_size.x) endx=dest_size.x;
+    int j;
+    for (j=0;j<rect_size.y;j+=scale.y)
     {
       if (dest_idx>=dest_fullsize) break;
-      if ((j%scale.y)>0)
-          continue;
-      for (i=0;i<rect_size.x;i++)
-      {
-          if ((i%scale.x)!=0) continue;
-          unsigned long dest_sidx=dest_pos.x+(i/scale.x);
-          if (dest_sidx>=dest_size.x) continue;
-          /* Using sum place colour on the pixel */
-          unsigned char nval;
-          dest_sidx*=3;
-          nval=(dest[dest_idx+dest_sidx+0]);
-          dest[dest_idx+dest_sidx+0]=min(nval+pxdata->b,255);
-          nval=(dest[dest_idx+dest_sidx+1]);
-          dest[dest_idx+dest_sidx+1]=min(nval+pxdata->g,255);
-          nval=(dest[dest_idx+dest_sidx+2]);
-          dest[dest_idx+dest_sidx+2]=min(nval+pxdata->r,255);
-      }
+      /* Using sum place colour on the pixels */
+      if (endx>startx)
+          blend_row_sum(dest+dest_idx+3*startx,endx-startx,pxdata);
       dest_idx+=dest_scanln;
     }
     return ERR_NONE;
@@ -1429,6 +1410,140 @@ short draw_texture_on_buffer_fast_unsafe(unsigned char *dest,const struct IPOINT
             dest_scanln,src,src_pos,src_size,rect_size,pal,scale);
 }
 
+/**
+ * Frees all rescaled textures stored in the atlas of MAPDRAW_DATA.
+ * Should be called when the texture, or its scale, is changed.
+ * @param draw_data The drawing data structure.
+ */
+void free_draw_data_atlas(struct MAPDRAW_DATA *draw_data)
+{
+    if (draw_data->atlas==NULL)
+        return;
+    int i;
+    for (i=0;i<DRAW_ATLAS_ENTRIES;i++)
+    {
+        free(draw_data->atlas[i]);
+        draw_data->atlas[i]=NULL;
+    }
+    draw_data->atlas_rescale=draw_data->rescale;
+}
+
+/**
+ * Returns the texture rescaled and converted to RGB, as stored in atlas.
+ * If there's no such texture in atlas, it is created. Textures are
+ * rescaled with the same functions which are used to draw them directly;
+ * random pixels are selected only once for every texture.
+ * @param draw_data The drawing data structure.
+ * @param texture_pos Coords of the texture, in source textures buffer.
+ * @return Returns the RGB texture with scanline equal to its width,
+ *     or NULL if it cannot be created.
+ */
+unsigned char *get_draw_atlas_texture(struct MAPDRAW_DATA *draw_data,
+    const struct IPOINT_2D texture_pos)
+{
+    unsigned int textr_num;
+    textr_num=(texture_pos.y/TEXTURE_SIZE_Y)*TEXTURE_COUNT_X + (texture_pos.x/TEXTURE_SIZE_X);
+    if ((draw_data->atlas==NULL)||(textr_num>=DRAW_ATLAS_ENTRIES))
+        return NULL;
+    if (draw_data->atlas_rescale!=draw_data->rescale)
+        free_draw_data_atlas(draw_data);
+    if (draw_data->atlas[textr_num]!=NULL)
+        return draw_data->atlas[textr_num];
+    struct IPOINT_2D texture_size={TEXTURE_SIZE_X*TEXTURE_COUNT_X,TEXTURE_SIZE_Y*TEXTURE_COUNT_Y};
+    struct IPOINT_2D single_txtr_size={TEXTURE_SIZE_X,TEXTURE_SIZE_Y};
+    struct IPOINT_2D scale={1<<(draw_data->rescale),1<<(draw_data->rescale)};
+    struct IPOINT_2D scaled_txtr_size={TEXTURE_SIZE_X>>(draw_data->rescale),TEXTURE_SIZE_Y>>(draw_data->rescale)};
+    struct IPOINT_2D atlas_pos={0,0};
+    unsigned char *atlas_txtr;
+    atlas_txtr=(unsigned char *)calloc(scaled_txtr_size.x*scaled_txtr_size.y,3);
+    if (atlas_txtr==NULL)
+        return NULL;
+    /* Random pixels of every texture come from its own position in the pool */
+    struct IPOINT_2D rand_subtl=draw_data->rand_subtl;
+    unsigned int rand_count=draw_data->rand_count;
+    mdrand_setpos(draw_data,textr_num%draw_data->subsize.x,textr_num/draw_data->subsize.x);
+    draw_texture_on_buffer(atlas_txtr,atlas_pos,scaled_txtr_size,scaled_txtr_size.x*3,
+        draw_data->texture,texture_pos,texture_size,single_txtr_size,draw_data->palette,scale);
+    draw_data->rand_subtl=rand_subtl;
+    draw_data->rand_count=rand_count;
+    draw_data->atlas[textr_num]=atlas_txtr;
+    return atlas_txtr;
+}
+
+/**
+ * Creates all textures in the atlas of MAPDRAW_DATA, so that it
+ * can be read by several threads at once.
+ * @param draw_data The drawing data structure.
+ * @return Returns true if all textures are in atlas, false on error.
+ */
+short fill_draw_data_atlas(struct MAPDRAW_DATA *draw_data)
+{
+    struct IPOINT_2D texture_pos;
+    int i;
+    for (i=0;i<DRAW_ATLAS_ENTRIES;i++)
+    {
+        texture_pos.x=(i%TEXTURE_COUNT_X)*TEXTURE_SIZE_X;
+        texture_pos.y=(i/TEXTURE_COUNT_X)*TEXTURE_SIZE_Y;
+        if (get_draw_atlas_texture(draw_data,texture_pos)==NULL)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Draws given texture on RGB buffer, by copying it from the atlas.
+ * Copies the rows of texture which was rescaled before, clipping it
+ * to destination buffer bounds. If the texture cannot be placed in atlas,
+ * draws it directly from source textures.
+ * @param dest The destination buffer.
+ * @param dest_pos Position in destination buffer of the texture top left.
+ * @param dest_size Dimensions of destination buffer.
+ * @param draw_data The drawing data structure.
+ * @param texture_pos Coords of the texture, in source textures buffer.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short draw_texture_from_atlas(unsigned char *dest,const struct IPOINT_2D dest_pos,
+    const struct IPOINT_2D dest_size,struct MAPDRAW_DATA *draw_data,
+    const struct IPOINT_2D texture_pos)
+{
+    struct IPOINT_2D scaled_txtr_size={TEXTURE_SIZE_X>>(draw_data->rescale),TEXTURE_SIZE_Y>>(draw_data->rescale)};
+    const unsigned char *src;
+    src=get_draw_atlas_texture(draw_data,texture_pos);
+    if (src==NULL)
+    {
+        struct IPOINT_2D texture_size={TEXTURE_SIZE_X*TEXTURE_COUNT_X,TEXTURE_SIZE_Y*TEXTURE_COUNT_Y};
+        struct IPOINT_2D single_txtr_size={TEXTURE_SIZE_X,TEXTURE_SIZE_Y};
+        struct IPOINT_2D scale={1<<(draw_data->rescale),1<<(draw_data->rescale)};
+        return draw_texture_on_buffer(dest,dest_pos,dest_size,draw_data->dest_scanln,
+            draw_data->texture,texture_pos,texture_size,single_txtr_size,
+            draw_data->palette,scale);
+    }
+    /* Clipping the texture rectangle to destination buffer */
+    int startx=0;
+    int starty=0;
+    int endx=scaled_txtr_size.x;
+    int endy=scaled_txtr_size.y;
+    if (dest_pos.x<0) startx=-dest_pos.x;
+    if (dest_pos.y<0) starty=-dest_pos.y;
+    if (dest_pos.x+endx>dest_size.x) endx=dest_size.x-dest_pos.x;
+    if (3*(dest_pos.x+endx)>draw_data->dest_scanln) endx=draw_data->dest_scanln/3-dest_pos.x;
+    if (dest_pos.y+endy>dest_size.y) endy=dest_size.y-dest_pos.y;
+    if ((startx>=endx)||(starty>=endy))
+        return ERR_NONE;
+    long src_scanln=3*scaled_txtr_size.x;
+    long dest_idx=(dest_pos.y+starty)*draw_data->dest_scanln + 3*(dest_pos.x+startx);
+    src+=starty*src_scanln + 3*startx;
+    unsigned int row_len=3*(endx-startx);
+    int j;
+    for (j=starty;j<endy;j++)
+    {
+        memcpy(dest+dest_idx,src,row_len);
+        dest_idx+=draw_data->dest_scanln;
+        src+=src_scanln;
+    }
+    return ERR_NONE;
+}
+
 /**
  * Gives texture coords for given texture index.
  * @param texture_pos Destination point for storing coordinates.
@@ -1500,8 +1615,62 @@ short get_top_texture_pos(struct IPOINT_2D *texture_pos,
     return result;
 }
 
+/**
+ * Colorizes slabs drawn on given buffer, depending on their owner and type.
+ * Used after textures of the map are placed on buffer.
+ * @param dest The destination buffer.
+ * @param lvl Source level to draw.
+ * @param draw_data Graphics textures, sprites and options.
+ */
+void draw_map_owners_on_buffer(char *dest,const struct LEVEL *lvl,
+    struct MAPDRAW_DATA *draw_data)
+{
+    struct IPOINT_2D single_txtr_size={TEXTURE_SIZE_X,TEXTURE_SIZE_Y};
+    struct IPOINT_2D dest_size={draw_data->end.x-draw_data->start.x+1,draw_data->end.y-draw_data->start.y+1};
+    struct IPOINT_2D dest_pos;
+    struct IPOINT_2D scale={1<<(draw_data->rescale),1<<(draw_data->rescale)};
+    struct IPOINT_2D scaled_txtr_size={TEXTURE_SIZE_X>>(draw_data->rescale),TEXTURE_SIZE_Y>>(draw_data->rescale)};
+    /* Finding start/end of the drawing area */
+    struct IPOINT_2D start;
+    start.x = draw_data->start.x/scaled_txtr_size.x;
+    start.y = draw_data->start.y/scaled_txtr_size.y;
+    struct IPOINT_2D end;
+    end.x = draw_data->end.x/scaled_txtr_size.x + 1;
+    end.y = draw_data->end.y/scaled_txtr_size.y + 1;
+    int i,j;
+    if (draw_data->ownerpal!=NULL)
+      for (j=0; j<end.y-start.y; j++)
+      {
+      dest_pos.y=j*(scaled_txtr_size.y)-(draw_data->start.y%scaled_txtr_size.y);
+        for (i=0; i<end.x-start.x; i++)
+        {
+          mdrand_setpos(draw_data,start.x+i,start.y+j);
+          dest_pos.x=i*(scaled_txtr_size.x)-(draw_data->start.x%scaled_txtr_size.x);
+          unsigned short slab=get_tile_slab(lvl,(start.x+i)/MAP_SUBNUM_X,(start.y+j)/MAP_SUBNUM_Y);
+          unsigned char owner=get_subtl_owner(lvl,start.x+i,start.y+j);
+          if (slab==SLAB_TYPE_GOLD)
+          {
+            if (draw_data->intnspal!=NULL)
+              draw_rect_mul_on_buffer(dest,dest_pos,dest_size,draw_data->dest_scanln,
+                  single_txtr_size,&(draw_data->intnspal[1]),scale);
+          } else
+          if (slab==SLAB_TYPE_GEMS)
+          {
+            if (draw_data->intnspal!=NULL)
+              draw_rect_mul_on_buffer(dest,dest_pos,dest_size,draw_data->dest_scanln,
+                  single_txtr_size,&(draw_data->intnspal[0]),scale);
+          } else
+          {
+            draw_rect_mul_on_buffer(dest,dest_pos,dest_size,draw_data->dest_scanln,
+                single_txtr_size,&(draw_data->ownerpal[owner%6]),scale);
+          }
+        }
+      }
+}
+
 /**
  * Draws given LEVEL on given buffer, using graphics and options from MAPDRAW_DATA.
+ * Textures are rescaled once, and then copied from the atlas in draw_data.
  * @param dest The destination buffer.
  * @param lvl Source level to draw.
  * @param draw_data Graphics textures, sprites and options.
@@ -1512,20 +1681,17 @@ short draw_map_on_buffer(char *dest,const struct LEVEL *lvl,
     struct MAPDRAW_DATA *draw_data,unsigned int anim)
 {
     /*message_log("  draw_map_on_buffer: Starting");*/
-    struct IPOINT_2D texture_size={TEXTURE_SIZE_X*TEXTURE_COUNT_X,TEXTURE_SIZE_Y*TEXTURE_COUNT_Y};
-    struct IPOINT_2D single_txtr_size={TEXTURE_SIZE_X,TEXTURE_SIZE_Y};
     struct IPOINT_2D dest_size={draw_data->end.x-draw_data->start.x+1,draw_data->end.y-draw_data->start.y+1};
     struct IPOINT_2D texture_pos;
     struct IPOINT_2D dest_pos;
-    struct IPOINT_2D scale={1<<(draw_data->rescale),1<<(draw_data->rescale)};
     struct IPOINT_2D scaled_txtr_size={TEXTURE_SIZE_X>>(draw_data->rescale),TEXTURE_SIZE_Y>>(draw_data->rescale)};
     /* Finding start/end of the drawing area */
     struct IPOINT_2D start;
     start.x = draw_data->start.x/scaled_txtr_size.x;
     start.y = draw_data->start.y/scaled_txtr_size.y;
     struct IPOINT_2D end;
-    end.x = draw_data->end.x/scaled_txtr_size.x + ((draw_data->end.x%scaled_txtr_size.x)>0);
-    end.y = draw_data->end.y/scaled_txtr_size.y + ((draw_data->end.y%scaled_txtr_size.y)>0);
+    end.x = draw_data->end.x/scaled_txtr_size.x + 1;
+    end.y = draw_data->end.y/scaled_txtr_size.y + 1;
     struct IPOINT_2D stile_count={end.x-start.x-1,end.y-start.y-1};
     /* Drawing subtiles */
     int i,j;
@@ -1545,8 +1711,7 @@ short draw_map_on_buffer(char *dest,const struct LEVEL *lvl,
               texture_index_to_texture_pos(&texture_pos,draw_data->cubes,
                   get_clm_entry_base(clmentry),anim);
           dest_pos.x=i*(scaled_txtr_size.x)-(draw_data->start.x%scaled_txtr_size.x);
-          draw_texture_on_buffer(dest,dest_pos,dest_size,draw_data->dest_scanln,draw_data->texture,
-              texture_pos,texture_size,single_txtr_size,draw_data->palette,scale);
+          draw_texture_from_atlas((unsigned char *)dest,dest_pos,dest_size,draw_data,texture_pos);
       }
     }
     for (j=1; j<stile_count.y; j++)
@@ -1565,8 +1730,7 @@ short draw_map_on_buffer(char *dest,const struct LEVEL *lvl,
               texture_index_to_texture_pos(&texture_pos,draw_data->cubes,
                   get_clm_entry_base(clmentry),anim);
           dest_pos.x=-(draw_data->start.x%scaled_txtr_size.x);
-          draw_texture_on_buffer(dest,dest_pos,dest_size,draw_data->dest_scanln,draw_data->texture,
-              texture_pos,texture_size,single_txtr_size,draw_data->palette,scale);
+          draw_texture_from_atlas((unsigned char *)dest,dest_pos,dest_size,draw_data,texture_pos);
       }
       for (i=1; i<stile_count.x; i++)
       {
@@ -1579,8 +1743,7 @@ short draw_map_on_buffer(char *dest,const struct LEVEL *lvl,
               texture_index_to_texture_pos(&texture_pos,draw_data->cubes,
                   get_clm_entry_base(clmentry),anim);
           dest_pos.x=i*(scaled_txtr_size.x)-(draw_data->start.x%scaled_txtr_size.x);
-          draw_texture_on_buffer_unsafe(dest,dest_pos,dest_size,draw_data->dest_scanln,draw_data->texture,
-              texture_pos,texture_size,single_txtr_size,draw_data->palette,scale);
+          draw_texture_from_atlas((unsigned char *)dest,dest_pos,dest_size,draw_data,texture_pos);
       }
       { /* i=stile_count.x */
           mdrand_setpos(draw_data,start.x+i,start.y+j);
@@ -1592,8 +1755,7 @@ short draw_map_on_buffer(char *dest,const struct LEVEL *lvl,
               texture_index_to_texture_pos(&texture_pos,draw_data->cubes,
                   get_clm_entry_base(clmentry),anim);
           dest_pos.x=i*(scaled_txtr_size.x)-(draw_data->start.x%scaled_txtr_size.x);
-          draw_texture_on_buffer(dest,dest_pos,dest_size,draw_data->dest_scanln,draw_data->texture,
-              texture_pos,texture_size,single_txtr_size,draw_data->palette,scale);
+          draw_texture_from_atlas((unsigned char *)dest,dest_pos,dest_size,draw_data,texture_pos);
       }
     }
     { /* j=stile_count.y */
@@ -1611,46 +1773,19 @@ short draw_map_on_buffer(char *dest,const struct LEVEL *lvl,
               texture_index_to_texture_pos(&texture_pos,draw_data->cubes,
                   get_clm_entry_base(clmentry),anim);
           dest_pos.x=i*(scaled_txtr_size.x)-(draw_data->start.x%scaled_txtr_size.x);
-          draw_texture_on_buffer(dest,dest_pos,dest_size,draw_data->dest_scanln,draw_data->texture,
-              texture_pos,texture_size,single_txtr_size,draw_data->palette,scale);
+          draw_texture_from_atlas((unsigned char *)dest,dest_pos,dest_size,draw_data,texture_pos);
       }
     }
     /* Colirizing some slabs */
-    if (draw_data->ownerpal!=NULL)
-      for (j=0; j<end.y-start.y; j++)
-      {
-      dest_pos.y=j*(scaled_txtr_size.y)-(draw_data->start.y%scaled_txtr_size.y);
-        for (i=0; i<end.x-start.x; i++)
-        {
-          mdrand_setpos(draw_data,start.x+i,start.y+j);
-          dest_pos.x=i*(scaled_txtr_size.x)-(draw_data->start.x%scaled_txtr_size.x);
-          unsigned short slab=get_tile_slab(lvl,(start.x+i)/MAP_SUBNUM_X,(start.y+j)/MAP_SUBNUM_Y);
-          unsigned char owner=get_subtl_owner(lvl,start.x+i,start.y+j);
-          if (slab==SLAB_TYPE_GOLD)
-          {
-            if (draw_data->intnspal!=NULL)
-              draw_rect_mul_on_buffer(dest,dest_pos,dest_size,draw_data->dest_scanln,
-                  single_txtr_size,&(draw_data->intnspal[1]),scale);
-          } else
-          if (slab==SLAB_TYPE_GEMS)
-          {
-            if (draw_data->intnspal!=NULL)
-              draw_rect_mul_on_buffer(dest,dest_pos,dest_size,draw_data->dest_scanln,
-                  single_txtr_size,&(draw_data->intnspal[0]),scale);
-          } else
-          {
-            draw_rect_mul_on_buffer(dest,dest_pos,dest_size,draw_data->dest_scanln,
-                single_txtr_size,&(draw_data->ownerpal[owner%6]),scale);
-          }
-        }
-      }
+    draw_map_owners_on_buffer(dest,lvl,draw_data);
       /*message_log("  draw_map_on_buffer: Finished");*/
     return ERR_NONE;
 }
 
 /**
  * Draws given LEVEL on given buffer, using graphics and options from MAPDRAW_DATA.
- * Fast version - but a little less quality on rescaling.
+ * Fast version - textures are copied from the atlas, like in draw_map_on_buffer(),
+ * but slabs aren't colorized.
  * @param dest The destination buffer.
  * @param lvl Source level to draw.
  * @param draw_data Graphics textures, sprites and options.
@@ -1661,20 +1796,17 @@ short draw_map_on_buffer_fast(char *dest,const struct LEVEL *lvl,
     struct MAPDRAW_DATA *draw_data,unsigned int anim)
 {
     /*message_log("  draw_map_on_buffer_fast: Starting");*/
-    struct IPOINT_2D texture_size={TEXTURE_SIZE_X*TEXTURE_COUNT_X,TEXTURE_SIZE_Y*TEXTURE_COUNT_Y};
-    struct IPOINT_2D single_txtr_size={TEXTURE_SIZE_X,TEXTURE_SIZE_Y};
     struct IPOINT_2D dest_size={draw_data->end.x-draw_data->start.x+1,draw_data->end.y-draw_data->start.y+1};
     struct IPOINT_2D texture_pos;
     struct IPOINT_2D dest_pos;
-    struct IPOINT_2D scale={1<<(draw_data->rescale),1<<(draw_data->rescale)};
     struct IPOINT_2D scaled_txtr_size={TEXTURE_SIZE_X>>(draw_data->rescale),TEXTURE_SIZE_Y>>(draw_data->rescale)};
     /* Finding start/end of the drawing area */
     struct IPOINT_2D start;
     start.x = draw_data->start.x/scaled_txtr_size.x;
     start.y = draw_data->start.y/scaled_txtr_size.y;
     struct IPOINT_2D end;
-    end.x = draw_data->end.x/scaled_txtr_size.x + ((draw_data->end.x%scaled_txtr_size.x)>0);
-    end.y = draw_data->end.y/scaled_txtr_size.y + ((draw_data->end.y%scaled_txtr_size.y)>0);
+    end.x = draw_data->end.x/scaled_txtr_size.x + 1;
+    end.y = draw_data->end.y/scaled_txtr_size.y + 1;
     int i,j;
     struct IPOINT_2D tile_count={end.x-start.x-1,end.y-start.y-1};
     dest_pos.y=-(draw_data->start.y%scaled_txtr_size.y);
@@ -1694,8 +1826,7 @@ short draw_map_on_buffer_fast(char *dest,const struct LEVEL *lvl,
           else
               texture_index_to_texture_pos(&texture_pos,draw_data->cubes,
                   get_clm_entry_base(clmentry),anim);
-          draw_texture_on_buffer_fast(dest,dest_pos,dest_size,draw_data->dest_scanln,draw_data->texture,
-              texture_pos,texture_size,single_txtr_size,draw_data->palette,scale);
+          draw_texture_from_atlas((unsigned char *)dest,dest_pos,dest_size,draw_data,texture_pos);
           dest_pos.x+=scaled_txtr_size.x;
       }
       dest_pos.y+=scaled_txtr_size.y;
@@ -1716,8 +1847,7 @@ short draw_map_on_buffer_fast(char *dest,const struct LEVEL *lvl,
           else
               texture_index_to_texture_pos(&texture_pos,draw_data->cubes,
                   get_clm_entry_base(clmentry),anim);
-          draw_texture_on_buffer_fast(dest,dest_pos,dest_size,draw_data->dest_scanln,draw_data->texture,
-              texture_pos,texture_size,single_txtr_size,draw_data->palette,scale);
+          draw_texture_from_atlas((unsigned char *)dest,dest_pos,dest_size,draw_data,texture_pos);
           dest_pos.x+=scaled_txtr_size.x;
       }
       for (i=1; i<tile_count.x; i++)
@@ -1732,8 +1862,7 @@ short draw_map_on_buffer_fast(char *dest,const struct LEVEL *lvl,
           else
               texture_index_to_texture_pos(&texture_pos,draw_data->cubes,
                   get_clm_entry_base(clmentry),anim);
-          draw_texture_on_buffer_fast_unsafe(dest,dest_pos,dest_size,draw_data->dest_scanln,draw_data->texture,
-              texture_pos,texture_size,single_txtr_size,draw_data->palette,scale);
+          draw_texture_from_atlas((unsigned char *)dest,dest_pos,dest_size,draw_data,texture_pos);
           dest_pos.x+=scaled_txtr_size.x;
       }
       { /* i=tile_count.x loop - partial slab */
@@ -1747,8 +1876,7 @@ short draw_map_on_buffer_fast(char *dest,const struct LEVEL *lvl,
           else
               texture_index_to_texture_pos(&texture_pos,draw_data->cubes,
                   get_clm_entry_base(clmentry),anim);
-          draw_texture_on_buffer_fast(dest,dest_pos,dest_size,draw_data->dest_scanln,draw_data->texture,
-              texture_pos,texture_size,single_txtr_size,draw_data->palette,scale);
+          draw_texture_from_atlas((unsigned char *)dest,dest_pos,dest_size,draw_data,texture_pos);
           dest_pos.x+=scaled_txtr_size.x;
       }
       dest_pos.y+=scaled_txtr_size.y;
@@ -1767,8 +1895,7 @@ short draw_map_on_buffer_fast(char *dest,const struct LEVEL *lvl,
           else
               texture_index_to_texture_pos(&texture_pos,draw_data->cubes,
                   get_clm_entry_base(clmentry),anim);
-          draw_texture_on_buffer_fast(dest,dest_pos,dest_size,draw_data->dest_scanln,draw_data->texture,
-              texture_pos,texture_size,single_txtr_size,draw_data->palette,scale);
+          draw_texture_from_atlas((unsigned char *)dest,dest_pos,dest_size,draw_data,texture_pos);
           dest_pos.x+=scaled_txtr_size.x;
       }
       dest_pos.y+=scaled_txtr_size.y;
@@ -1778,76 +1905,457 @@ short draw_map_on_buffer_fast(char *dest,const struct LEVEL *lvl,
 }
 
 /**
- * Gives radius to draw object circle for unranged objects.
- * @param scaled_txtr_size Scaled size of one texture (one subtile).
- * @return Returns circle radius as integer value.
+ * Draws one band of the map. Used as thread function
+ * in parallel map drawing.
+ * @param param Pointer to MAPDRAW_THREAD_PARAMS structure.
  */
-unsigned int get_objcircle_std_radius(const struct IPOINT_2D scaled_txtr_size)
+void draw_map_band_on_buffer(void *param)
 {
-    unsigned int radius;
-    radius=min(scaled_txtr_size.x,scaled_txtr_size.y);
-    if (radius>31)
-        radius=(radius>>3);
-    else
-    if (radius>15)
-        radius=(radius>>3)+(radius>>4);
-    else
-    if (radius>3)
-        radius=2;
-    else
-        radius=1;
-    return radius;
+    struct MAPDRAW_THREAD_PARAMS *thparam=(struct MAPDRAW_THREAD_PARAMS *)param;
+    thparam->result=draw_map_on_buffer(thparam->dest,thparam->lvl,
+        &(thparam->draw_data),thparam->anim);
 }
 
 /**
- * Gives radius to draw object circle for ranged objects.
- * @param scaled_txtr_size Scaled size of one texture (one subtile).
- * @param obj_range Range of the object.
- * @param secscale Second scale, for additional scaling.
- * @return Returns circle radius as integer value.
+ * Draws given LEVEL on given buffer, using several threads.
+ * The drawing rectangle is divided into horizontal bands of whole
+ * subtile rows, and every band is drawn by draw_map_on_buffer() with
+ * its own copy of MAPDRAW_DATA, in a thread with its own context, which
+ * stores the random position used by mdrand_g8(). Random values depend
+ * only on subtile position, so the result is identical to single-threaded
+ * drawing.
+ * @see draw_map_on_buffer
+ * @param dest The destination buffer.
+ * @param lvl Source level to draw.
+ * @param draw_data Graphics textures, sprites and options.
+ * @param anim Number of the animation frame.
+ * @param threads_count Amount of threads to use.
+ * @return Returns ERR_NONE on success, error code on failure.
  */
-unsigned int get_objcircle_ranged_radius(const struct IPOINT_2D scaled_txtr_size,
-    const unsigned int obj_range,const int secscale)
+short draw_map_on_buffer_parallel(char *dest,const struct LEVEL *lvl,
+    struct MAPDRAW_DATA *draw_data,unsigned int anim,int threads_count)
 {
-    unsigned int radius;
-    radius=min(scaled_txtr_size.x,scaled_txtr_size.y);
-    radius=(obj_range*radius)>>(8+secscale);
-    return radius;
+    struct MAPDRAW_THREAD_PARAMS *thparams;
+    void *params[LBTHREADS_MAX_COUNT];
+    int scaled_txtr_y=TEXTURE_SIZE_Y>>(draw_data->rescale);
+    int first_row=draw_data->start.y/scaled_txtr_y;
+    int rows_count=draw_data->end.y/scaled_txtr_y-first_row+1;
+    int band_rows;
+    int n;
+    if (threads_count>LBTHREADS_MAX_COUNT)
+        threads_count=LBTHREADS_MAX_COUNT;
+    if (threads_count>rows_count)
+        threads_count=rows_count;
+    if (threads_count<2)
+        return draw_map_on_buffer(dest,lvl,draw_data,anim);
+    /* Threads may only read the atlas, so it must be complete */
+    if (!fill_draw_data_atlas(draw_data))
+        return draw_map_on_buffer(dest,lvl,draw_data,anim);
+    band_rows=(rows_count+threads_count-1)/threads_count;
+    threads_count=(rows_count+band_rows-1)/band_rows;
+    thparams=(struct MAPDRAW_THREAD_PARAMS *)malloc(threads_count*sizeof(struct MAPDRAW_THREAD_PARAMS));
+    if (thparams==NULL)
+        return draw_map_on_buffer(dest,lvl,draw_data,anim);
+    for (n=0;n<threads_count;n++)
+    {
+        struct MAPDRAW_THREAD_PARAMS *thparam=&thparams[n];
+        int band_start=(first_row+n*band_rows)*scaled_txtr_y;
+        int band_end=(first_row+(n+1)*band_rows)*scaled_txtr_y-1;
+        if (band_start<draw_data->start.y)
+            band_start=draw_data->start.y;
+        if (band_end>draw_data->end.y)
+            band_end=draw_data->end.y;
+        memcpy(&(thparam->draw_data),draw_data,sizeof(struct MAPDRAW_DATA));
+        thparam->draw_data.start.y=band_start;
+        thparam->draw_data.end.y=band_end;
+        thparam->dest=dest+(band_start-draw_data->start.y)*draw_data->dest_scanln;
+        thparam->lvl=lvl;
+        thparam->anim=anim;
+        thparam->result=ERR_NONE;
+        params[n]=thparam;
+    }
+    lbthreads_run(draw_map_band_on_buffer,params,threads_count);
+    short result=ERR_NONE;
+    for (n=0;n<threads_count;n++)
+    {
+        if (thparams[n].result!=ERR_NONE)
+            result=thparams[n].result;
+    }
+    free(thparams);
+    return result;
 }
 
-
 /**
- * Draws things from given LEVEL on given buffer, using graphics and options from MAPDRAW_DATA.
- * @param dest The destination buffer.
- * @param lvl Source level to draw things from.
- * @param draw_data Graphics textures, sprites and options.
- * @return Returns ERR_NONE on success, error code on failure.
+ * Frees the map pyramid of MAPDRAW_DATA.
+ * @param draw_data The drawing data structure.
  */
-short draw_things_on_buffer(char *dest,const struct LEVEL *lvl,struct MAPDRAW_DATA *draw_data)
+void free_draw_data_pyramid(struct MAPDRAW_DATA *draw_data)
 {
-    /*message_log("  draw_things_on_buffer: Starting");*/
-    struct IPOINT_2D scaled_txtr_size={TEXTURE_SIZE_X>>(draw_data->rescale),TEXTURE_SIZE_Y>>(draw_data->rescale)};
-    /* Finding start/end of the drawing area */
-    struct IPOINT_2D start;
-    start.x = draw_data->start.x/scaled_txtr_size.x;
-    start.y = draw_data->start.y/scaled_txtr_size.y;
-    struct IPOINT_2D end;
-    end.x = draw_data->end.x/scaled_txtr_size.x + ((draw_data->end.x%scaled_txtr_size.x)>0);
-    end.y = draw_data->end.y/scaled_txtr_size.y + ((draw_data->end.y%scaled_txtr_size.y)>0);
+    struct MAPDRAW_PYRAMID *pyr=draw_data->pyramid;
+    if (pyr==NULL)
+        return;
+    int k;
+    for (k=0;k<MAPDRAW_PYRAMID_LEVELS;k++)
+        free(pyr->images[k]);
+    free(pyr->txtr_summary);
+    free(pyr);
+    draw_data->pyramid=NULL;
+}
 
-    /*struct IPOINT_2D dest_scaled_size={(end.x-start.x)*scaled_txtr_size.x,(end.y-start.y)*scaled_txtr_size.y};*/
-    struct IPOINT_2D dest_scaled_size={(draw_data->end.x-draw_data->start.x+1),(draw_data->end.y-draw_data->start.y+1)};
-    struct IPOINT_2D dest_pos;
-    /* Looping through coords and placing things - first pass, the background things */
-    int i,j,k;
-    for (j=0; j<end.y-start.y; j++)
+/**
+ * Creates averaged colors of every texture, at resolution of the first
+ * map pyramid level.
+ * @param pyr The map pyramid.
+ * @param draw_data The drawing data structure.
+ * @return Returns true on success, false on failure.
+ */
+short create_pyramid_txtr_summary(struct MAPDRAW_PYRAMID *pyr,const struct MAPDRAW_DATA *draw_data)
+{
+    const int px_size=TEXTURE_SIZE_X>>MAPDRAW_PYRAMID_RESCALE;
+    const int blk_size=1<<MAPDRAW_PYRAMID_RESCALE;
+    const long src_scanln=TEXTURE_SIZE_X*TEXTURE_COUNT_X;
+    pyr->txtr_summary=(unsigned char *)calloc(DRAW_ATLAS_ENTRIES,px_size*px_size*3);
+    if (pyr->txtr_summary==NULL)
+        return false;
+    if (draw_data->texture==NULL)
+        return true;
+    int n,i,j,x,y;
+    for (n=0;n<DRAW_ATLAS_ENTRIES;n++)
     {
-        for (i=0; i<end.x-start.x; i++)
+      const unsigned char *src=draw_data->texture
+          +(n/TEXTURE_COUNT_X)*TEXTURE_SIZE_Y*src_scanln+(n%TEXTURE_COUNT_X)*TEXTURE_SIZE_X;
+      unsigned char *dest=pyr->txtr_summary+n*px_size*px_size*3;
+      for (j=0;j<px_size;j++)
+        for (i=0;i<px_size;i++)
         {
-          mdrand_setpos(draw_data,start.x+i,start.y+j);
-          int last_obj=get_thing_subnums(lvl,start.x+i,start.y+j)-1;
-          for (k=last_obj; k>=0; k--)
-          {
+          unsigned long r=0,g=0,b=0;
+          for (y=j*blk_size;y<(j+1)*blk_size;y++)
+            for (x=i*blk_size;x<(i+1)*blk_size;x++)
+            {
+              const struct PALETTE_ENTRY *pxdata=&draw_data->palette[src[y*src_scanln+x]];
+              r+=pxdata->r; g+=pxdata->g; b+=pxdata->b;
+            }
+          dest[(j*px_size+i)*3+0]=((b<<2)/(blk_size*blk_size));
+          dest[(j*px_size+i)*3+1]=((g<<2)/(blk_size*blk_size));
+          dest[(j*px_size+i)*3+2]=((r<<2)/(blk_size*blk_size));
+        }
+    }
+    return true;
+}
+
+/**
+ * Updates the part of every map pyramid level which shows given subtile.
+ * First level is copied from averaged texture colors, next levels are
+ * averaged from the previous ones.
+ * @param pyr The map pyramid.
+ * @param lvl Source level.
+ * @param draw_data The drawing data structure.
+ * @param sx,sy The subtile to update.
+ * @param anim Number of the animation frame.
+ */
+void update_pyramid_subtile(struct MAPDRAW_PYRAMID *pyr,const struct LEVEL *lvl,
+    struct MAPDRAW_DATA *draw_data,int sx,int sy,unsigned int anim)
+{
+    struct IPOINT_2D texture_pos;
+    unsigned short cube_idx;
+    unsigned char *clmentry;
+    mdrand_setpos(draw_data,sx,sy);
+    clmentry=get_subtile_column(lvl,sx,sy);
+    cube_idx=get_clm_entry_topcube(clmentry);
+    if (cube_idx>0)
+        get_top_texture_pos(&texture_pos,draw_data->cubes,cube_idx,anim);
+    else
+        texture_index_to_texture_pos(&texture_pos,draw_data->cubes,
+            get_clm_entry_base(clmentry),anim);
+    unsigned int textr_num;
+    textr_num=(texture_pos.y/TEXTURE_SIZE_Y)*TEXTURE_COUNT_X + (texture_pos.x/TEXTURE_SIZE_X);
+    if (textr_num>=DRAW_ATLAS_ENTRIES)
+        textr_num=0;
+    int px_size=TEXTURE_SIZE_X>>MAPDRAW_PYRAMID_RESCALE;
+    long scanln=pyr->subsize.x*px_size*3;
+    const unsigned char *src=pyr->txtr_summary+textr_num*px_size*px_size*3;
+    unsigned char *dest=pyr->images[0]+sy*px_size*scanln+sx*px_size*3;
+    int i,j,k;
+    for (j=0;j<px_size;j++)
+        memcpy(dest+j*scanln,src+j*px_size*3,px_size*3);
+    for (k=1;k<MAPDRAW_PYRAMID_LEVELS;k++)
+    {
+        long prev_scanln=scanln;
+        const unsigned char *prev=dest;
+        px_size>>=1;
+        if (px_size<1) break;
+        scanln=pyr->subsize.x*px_size*3;
+        dest=pyr->images[k]+sy*px_size*scanln+sx*px_size*3;
+        for (j=0;j<px_size;j++)
+          for (i=0;i<px_size*3;i++)
+          {
+            const unsigned char *s=prev+(2*j)*prev_scanln+(i/3)*6+(i%3);
+            dest[j*scanln+i]=(s[0]+s[3]+s[prev_scanln]+s[prev_scanln+3]+2)>>2;
+          }
+    }
+}
+
+/**
+ * Updates the map pyramid of MAPDRAW_DATA, creating it if needed.
+ * Only subtiles which were changed since previous update are redrawn,
+ * unless the animation frame, or the whole map, was changed.
+ * @param draw_data The drawing data structure.
+ * @param lvl Source level.
+ * @param anim Number of the animation frame.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short update_draw_pyramid(struct MAPDRAW_DATA *draw_data,const struct LEVEL *lvl,unsigned int anim)
+{
+    struct MAPDRAW_PYRAMID *pyr=draw_data->pyramid;
+    int i,j,k;
+    if ((pyr!=NULL)&&((pyr->subsize.x!=lvl->subsize.x)||(pyr->subsize.y!=lvl->subsize.y)))
+    {
+        free_draw_data_pyramid(draw_data);
+        pyr=NULL;
+    }
+    if (pyr==NULL)
+    {
+        pyr=(struct MAPDRAW_PYRAMID *)calloc(1,sizeof(struct MAPDRAW_PYRAMID));
+        if (pyr==NULL)
+        {
+            message_error("update_draw_pyramid: Cannot allocate memory");
+            return ERR_CANT_MALLOC;
+        }
+        draw_data->pyramid=pyr;
+        pyr->subsize.x=lvl->subsize.x;
+        pyr->subsize.y=lvl->subsize.y;
+        short result=create_pyramid_txtr_summary(pyr,draw_data);
+        int px_size=TEXTURE_SIZE_X>>MAPDRAW_PYRAMID_RESCALE;
+        for (k=0;(k<MAPDRAW_PYRAMID_LEVELS)&&(result);k++)
+        {
+            pyr->images[k]=(unsigned char *)malloc((long)pyr->subsize.x*pyr->subsize.y*px_size*px_size*3);
+            result=(pyr->images[k]!=NULL);
+            px_size>>=1;
+        }
+        if (!result)
+        {
+            free_draw_data_pyramid(draw_data);
+            message_error("update_draw_pyramid: Cannot allocate memory");
+            return ERR_CANT_MALLOC;
+        }
+    }
+    if ((!pyr->valid)||(pyr->anim!=anim)||(pyr->gen<lvl->map_gen))
+    {
+        for (j=0;j<pyr->subsize.y;j++)
+          for (i=0;i<pyr->subsize.x;i++)
+            update_pyramid_subtile(pyr,lvl,draw_data,i,j,anim);
+    } else
+    if (pyr->gen!=lvl->mod_gen)
+    {
+        for (j=0;j<pyr->subsize.y;j++)
+          for (i=0;i<pyr->subsize.x;i++)
+          {
+            if (get_subtl_mod_gen(lvl,i,j)>pyr->gen)
+              update_pyramid_subtile(pyr,lvl,draw_data,i,j,anim);
+          }
+    }
+    pyr->valid=true;
+    pyr->gen=lvl->mod_gen;
+    pyr->anim=anim;
+    return ERR_NONE;
+}
+
+/**
+ * Draws given LEVEL on given buffer, using the map pyramid from MAPDRAW_DATA.
+ * The pyramid is updated first, redrawing only subtiles changed since
+ * previous call; then the map is copied from pyramid level matching
+ * the scale, and slabs are colorized like in draw_map_on_buffer().
+ * Textures are averaged instead of rescaled, so the result differs
+ * slightly from draw_map_on_buffer(). For scales below
+ * MAPDRAW_PYRAMID_RESCALE, draw_map_on_buffer() is used.
+ * @see draw_map_on_buffer
+ * @param dest The destination buffer.
+ * @param lvl Source level to draw.
+ * @param draw_data Graphics textures, sprites and options.
+ * @param anim Number of the animation frame; using the same frame as in
+ *     previous call allows redrawing only changed subtiles.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short draw_map_pyramid_on_buffer(char *dest,const struct LEVEL *lvl,
+    struct MAPDRAW_DATA *draw_data,unsigned int anim)
+{
+    int level=draw_data->rescale-MAPDRAW_PYRAMID_RESCALE;
+    if ((level<0)||(level>=MAPDRAW_PYRAMID_LEVELS))
+        return draw_map_on_buffer(dest,lvl,draw_data,anim);
+    short result;
+    result=update_draw_pyramid(draw_data,lvl,anim);
+    if (result!=ERR_NONE)
+        return draw_map_on_buffer(dest,lvl,draw_data,anim);
+    struct MAPDRAW_PYRAMID *pyr=draw_data->pyramid;
+    struct IPOINT_2D dest_size={draw_data->end.x-draw_data->start.x+1,draw_data->end.y-draw_data->start.y+1};
+    int px_size=(TEXTURE_SIZE_X>>MAPDRAW_PYRAMID_RESCALE)>>level;
+    struct IPOINT_2D img_size={pyr->subsize.x*px_size,pyr->subsize.y*px_size};
+    const unsigned char *src=pyr->images[level];
+    /* Clipping the drawing area to image bounds */
+    int row_len=dest_size.x;
+    if (3*row_len>draw_data->dest_scanln) row_len=draw_data->dest_scanln/3;
+    int copy_len=min(row_len,img_size.x-draw_data->start.x);
+    if (draw_data->start.x<0) copy_len=0;
+    if (copy_len<0) copy_len=0;
+    int j;
+    for (j=0;j<dest_size.y;j++)
+    {
+        unsigned char *dest_row=(unsigned char *)dest+j*draw_data->dest_scanln;
+        int sy=draw_data->start.y+j;
+        if ((sy<0)||(sy>=img_size.y))
+        {
+            memset(dest_row,0,3*row_len);
+            continue;
+        }
+        memcpy(dest_row,src+((long)sy*img_size.x+draw_data->start.x)*3,3*copy_len);
+        if (copy_len<row_len)
+            memset(dest_row+3*copy_len,0,3*(row_len-copy_len));
+    }
+    if (draw_data->ownerpal!=NULL)
+        draw_map_owners_on_buffer(dest,lvl,draw_data);
+    return ERR_NONE;
+}
+
+/**
+ * Gives radius to draw object circle for unranged objects.
+ * @param scaled_txtr_size Scaled size of one texture (one subtile).
+ * @return Returns circle radius as integer value.
+ */
+unsigned int get_objcircle_std_radius(const struct IPOINT_2D scaled_txtr_size)
+{
+    unsigned int radius;
+    radius=min(scaled_txtr_size.x,scaled_txtr_size.y);
+    if (radius>31)
+        radius=(radius>>3);
+    else
+    if (radius>15)
+        radius=(radius>>3)+(radius>>4);
+    else
+    if (radius>3)
+        radius=2;
+    else
+        radius=1;
+    return radius;
+}
+
+/**
+ * Gives radius to draw object circle for ranged objects.
+ * @param scaled_txtr_size Scaled size of one texture (one subtile).
+ * @param obj_range Range of the object.
+ * @param secscale Second scale, for additional scaling.
+ * @return Returns circle radius as integer value.
+ */
+unsigned int get_objcircle_ranged_radius(const struct IPOINT_2D scaled_txtr_size,
+    const unsigned int obj_range,const int secscale)
+{
+    unsigned int radius;
+    radius=min(scaled_txtr_size.x,scaled_txtr_size.y);
+    radius=(obj_range*radius)>>(8+secscale);
+    return radius;
+}
+
+
+/**
+ * Places given sprite on RGB buffer, centered on given position.
+ * Draws only the parts of sprite which are within clipping rectangles.
+ * @param dest The destination buffer.
+ * @param dest_pos Position in destination buffer of the sprite center.
+ * @param dest_scanln Destination buffer scanline lenght.
+ * @param clips Clipping rectangles, in destination buffer coordinates.
+ * @param clips_count Amount of clipping rectangles.
+ * @param pal Sprite palette.
+ * @param spr The sprite to place on buffer.
+ */
+void place_sprite_cntr_on_clips(unsigned char *dest,const struct IPOINT_2D dest_pos,
+    const unsigned int dest_scanln,const struct IRECT_2D *clips,int clips_count,
+    const struct PALETTE_ENTRY *pal,const struct IMAGEITEM *spr)
+{
+    struct IRECT_2D bounds;
+    bounds.l=dest_pos.x-(int)(spr->width>>1);
+    bounds.r=bounds.l+(int)spr->width-1;
+    bounds.t=dest_pos.y-(int)(spr->height>>1);
+    bounds.b=bounds.t+(int)spr->height-1;
+    int n;
+    for (n=0; n<clips_count; n++)
+    {
+        const struct IRECT_2D *clip=&clips[n];
+        if ((bounds.r<clip->l)||(bounds.l>clip->r)||(bounds.b<clip->t)||(bounds.t>clip->b))
+            continue;
+        struct IPOINT_2D clip_pos={dest_pos.x-clip->l,dest_pos.y-clip->t};
+        struct IPOINT_2D clip_size={clip->r-clip->l+1,clip->b-clip->t+1};
+        place_sprite_cntr_on_buf_rgb(dest+clip->t*dest_scanln+3*clip->l,clip_pos,
+            clip_size,dest_scanln,pal,spr);
+    }
+}
+
+/**
+ * Draws a circle on given buffer, using given circle drawing function.
+ * Draws only the parts of circle which are within clipping rectangles.
+ * @param draw_circle The circle drawing function.
+ * @param dest The destination buffer.
+ * @param dest_pos Position in destination buffer of the circle center.
+ * @param dest_scanln Destination buffer scanline lenght.
+ * @param clips Clipping rectangles, in destination buffer coordinates.
+ * @param clips_count Amount of clipping rectangles.
+ * @param bcolor Border color.
+ * @param fcolor Fill color.
+ * @param radius Circle radius.
+ */
+void draw_circle_on_clips(draw_circle_func draw_circle,unsigned char *dest,
+    const struct IPOINT_2D dest_pos,const unsigned int dest_scanln,
+    const struct IRECT_2D *clips,int clips_count,const struct PALETTE_ENTRY *bcolor,
+    const struct PALETTE_ENTRY *fcolor,int radius)
+{
+    int n;
+    for (n=0; n<clips_count; n++)
+    {
+        const struct IRECT_2D *clip=&clips[n];
+        if ((dest_pos.x+radius<clip->l)||(dest_pos.x-radius>clip->r)||
+            (dest_pos.y+radius<clip->t)||(dest_pos.y-radius>clip->b))
+            continue;
+        struct IPOINT_2D clip_pos={dest_pos.x-clip->l,dest_pos.y-clip->t};
+        struct IPOINT_2D clip_size={clip->r-clip->l+1,clip->b-clip->t+1};
+        draw_circle(dest+clip->t*dest_scanln+3*clip->l,clip_pos,
+            clip_size,dest_scanln,bcolor,fcolor,radius);
+    }
+}
+
+/**
+ * Draws things from given LEVEL on given buffer, using graphics and options from MAPDRAW_DATA.
+ * Only pixels within given clipping rectangles are modified; things from
+ * the whole drawing area are considered, so that parts of sprites and circles
+ * which reach into the rectangles are drawn exactly like on full redraw.
+ * @param dest The destination buffer.
+ * @param lvl Source level to draw things from.
+ * @param draw_data Graphics textures, sprites and options.
+ * @param clips Clipping rectangles, in destination buffer coordinates; may not overlap.
+ * @param clips_count Amount of clipping rectangles.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short draw_things_clipped_on_buffer(char *dest,const struct LEVEL *lvl,
+    struct MAPDRAW_DATA *draw_data,const struct IRECT_2D *clips,int clips_count)
+{
+    /*message_log("  draw_things_clipped_on_buffer: Starting");*/
+    struct IPOINT_2D scaled_txtr_size={TEXTURE_SIZE_X>>(draw_data->rescale),TEXTURE_SIZE_Y>>(draw_data->rescale)};
+    /* Finding start/end of the drawing area */
+    struct IPOINT_2D start;
+    start.x = draw_data->start.x/scaled_txtr_size.x;
+    start.y = draw_data->start.y/scaled_txtr_size.y;
+    struct IPOINT_2D end;
+    end.x = draw_data->end.x/scaled_txtr_size.x + ((draw_data->end.x%scaled_txtr_size.x)>0);
+    end.y = draw_data->end.y/scaled_txtr_size.y + ((draw_data->end.y%scaled_txtr_size.y)>0);
+
+    struct IPOINT_2D dest_pos;
+    /* Looping through coords and placing things - first pass, the background things */
+    int i,j,k;
+    for (j=0; j<end.y-start.y; j++)
+    {
+        for (i=0; i<end.x-start.x; i++)
+        {
+          mdrand_setpos(draw_data,start.x+i,start.y+j);
+          int last_obj=get_thing_subnums(lvl,start.x+i,start.y+j)-1;
+          for (k=last_obj; k>=0; k--)
+          {
             unsigned char *thing=get_thing(lvl,start.x+i,start.y+j,k);
             int spr_idx=-1;
             if (is_gold(thing))
@@ -1875,8 +2383,8 @@ short draw_things_on_buffer(char *dest,const struct LEVEL *lvl,struct MAPDRAW_DA
             if ((spr_idx>=0)&&(spr_idx<(draw_data->images->count)))
             {
               struct IMAGEITEM *item=&(draw_data->images->items[spr_idx]);
-              place_sprite_cntr_on_buf_rgb(dest,dest_pos,dest_scaled_size,
-                  draw_data->dest_scanln,draw_data->palette,item);
+              place_sprite_cntr_on_clips((unsigned char *)dest,dest_pos,
+                  draw_data->dest_scanln,clips,clips_count,draw_data->palette,item);
             }
           }
         }
@@ -1914,8 +2422,8 @@ short draw_things_on_buffer(char *dest,const struct LEVEL *lvl,struct MAPDRAW_DA
             if ((spr_idx>=0)&&(spr_idx<(draw_data->images->count)))
             {
               struct IMAGEITEM *item=&(draw_data->images->items[spr_idx]);
-              place_sprite_cntr_on_buf_rgb(dest,dest_pos,dest_scaled_size,
-                  draw_data->dest_scanln,draw_data->palette,item);
+              place_sprite_cntr_on_clips((unsigned char *)dest,dest_pos,
+                  draw_data->dest_scanln,clips,clips_count,draw_data->palette,item);
             }
           }
         }
@@ -1951,12 +2459,12 @@ short draw_things_on_buffer(char *dest,const struct LEVEL *lvl,struct MAPDRAW_DA
               fcolor=&thingcircle_palette_weak[type_idx%THINGCIRCLE_PALETTE_SIZE];
               radius=get_objcircle_ranged_radius(scaled_txtr_size,
                   get_thing_range_adv(obj),0);
-              draw_circle_mul(dest,dest_pos,dest_scaled_size,
-                  draw_data->dest_scanln,bcolor,fcolor,radius);
+              draw_circle_on_clips(draw_circle_mul,(unsigned char *)dest,dest_pos,
+                  draw_data->dest_scanln,clips,clips_count,bcolor,fcolor,radius);
             } else
             {
-              draw_circle_fill(dest,dest_pos,dest_scaled_size,
-                  draw_data->dest_scanln,bcolor,&ecolor,tngradius);
+              draw_circle_on_clips(draw_circle_fill,(unsigned char *)dest,dest_pos,
+                  draw_data->dest_scanln,clips,clips_count,bcolor,&ecolor,tngradius);
             }
           }
           last_obj=get_stlight_subnums(lvl,start.x+i,start.y+j)-1;
@@ -1971,8 +2479,8 @@ short draw_things_on_buffer(char *dest,const struct LEVEL *lvl,struct MAPDRAW_DA
             dest_pos.y+=((unsigned int)get_stlight_subtpos_y(obj)*scaled_txtr_size.y)>>8;
             radius=get_objcircle_ranged_radius(scaled_txtr_size,
                 get_stlight_range_adv(obj),1);
-            draw_circle_mul(dest,dest_pos,dest_scaled_size,
-                draw_data->dest_scanln,bcolor,fcolor,radius);
+            draw_circle_on_clips(draw_circle_mul,(unsigned char *)dest,dest_pos,
+                draw_data->dest_scanln,clips,clips_count,bcolor,fcolor,radius);
           }
           last_obj=get_actnpt_subnums(lvl,start.x+i,start.y+j)-1;
           for (k=last_obj; k>=0; k--)
@@ -1986,16 +2494,285 @@ short draw_things_on_buffer(char *dest,const struct LEVEL *lvl,struct MAPDRAW_DA
             dest_pos.y+=((unsigned int)get_actnpt_subtpos_y(obj)*scaled_txtr_size.y)>>8;
             radius=get_objcircle_ranged_radius(scaled_txtr_size,
                 get_actnpt_range_adv(obj),0);
-            draw_circle_mul(dest,dest_pos,dest_scaled_size,
-                draw_data->dest_scanln,bcolor,fcolor,radius);
+            draw_circle_on_clips(draw_circle_mul,(unsigned char *)dest,dest_pos,
+                draw_data->dest_scanln,clips,clips_count,bcolor,fcolor,radius);
           }
         }
     }
   }
-  /*message_log("  draw_things_on_buffer: Finished");*/
+  /*message_log("  draw_things_clipped_on_buffer: Finished");*/
   return ERR_NONE;
 }
 
+/**
+ * Draws things from given LEVEL on given buffer, using graphics and options from MAPDRAW_DATA.
+ * @param dest The destination buffer.
+ * @param lvl Source level to draw things from.
+ * @param draw_data Graphics textures, sprites and options.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short draw_things_on_buffer(char *dest,const struct LEVEL *lvl,struct MAPDRAW_DATA *draw_data)
+{
+    struct IRECT_2D clip;
+    clip.l=0;
+    clip.r=draw_data->end.x-draw_data->start.x;
+    clip.t=0;
+    clip.b=draw_data->end.y-draw_data->start.y;
+    return draw_things_clipped_on_buffer(dest,lvl,draw_data,&clip,1);
+}
+
+/**
+ * Gives distance, in subtiles, at which changes of a subtile may be visible.
+ * Sprites and circles of things are larger than subtiles on small scale.
+ * Ranged circles are not included - the level marks subtiles within range.
+ * @param draw_data Graphics textures, sprites and options.
+ * @return Returns the distance, in subtiles.
+ */
+int get_draw_damage_margin(const struct MAPDRAW_DATA *draw_data)
+{
+    struct IPOINT_2D scaled_txtr_size={TEXTURE_SIZE_X>>(draw_data->rescale),TEXTURE_SIZE_Y>>(draw_data->rescale)};
+    int extent=get_objcircle_std_radius(scaled_txtr_size);
+    unsigned long i;
+    if (draw_data->images!=NULL)
+      for (i=0; i<draw_data->images->count; i++)
+      {
+        struct IMAGEITEM *item=&(draw_data->images->items[i]);
+        extent=max(extent,(int)(max(item->width,item->height)>>1)+1);
+      }
+    return (extent+min(scaled_txtr_size.x,scaled_txtr_size.y)-1)/min(scaled_txtr_size.x,scaled_txtr_size.y);
+}
+
+/**
+ * Gives distance, in subtiles, at which objects of given level may be
+ * visible when drawn. Unlike get_draw_damage_margin(), includes circles
+ * showing range of objects.
+ * @param lvl Source level.
+ * @param draw_data Graphics textures, sprites and options.
+ * @return Returns the distance, in subtiles.
+ */
+int get_draw_objects_margin(const struct LEVEL *lvl,const struct MAPDRAW_DATA *draw_data)
+{
+    int margin=get_draw_damage_margin(draw_data);
+    if ((draw_data->tngflags&TNGFLG_SHOW_CIRCLES)==0)
+        return margin;
+    unsigned int range=0;
+    int i,j,k;
+    for (j=0; j<lvl->subsize.y; j++)
+      for (i=0; i<lvl->subsize.x; i++)
+      {
+        for (k=get_thing_subnums(lvl,i,j)-1; k>=0; k--)
+        {
+          unsigned char *obj=get_thing(lvl,i,j,k);
+          if (get_thing_type(obj)==THING_TYPE_EFFECTGEN)
+            range=max(range,get_thing_range_adv(obj));
+        }
+        /* Light circles are drawn at half scale */
+        for (k=get_stlight_subnums(lvl,i,j)-1; k>=0; k--)
+          range=max(range,get_stlight_range_adv(get_stlight(lvl,i,j,k))>>1);
+        for (k=get_actnpt_subnums(lvl,i,j)-1; k>=0; k--)
+          range=max(range,get_actnpt_range_adv(get_actnpt(lvl,i,j,k)));
+      }
+    return max(margin,(int)(range>>8)+2);
+}
+
+/**
+ * Finds rectangles in drawing area which have to be redrawn, because
+ * the level was modified since draw_data->drawn_gen.
+ * Subtiles are grouped into rectangles by merging runs of damaged subtiles
+ * in every row with identical runs from the row above.
+ * @param clips Returns allocated array of rectangles, in destination buffer coordinates.
+ * @param clips_count Returns amount of rectangles.
+ * @param lvl Source level.
+ * @param draw_data Graphics textures, sprites and options.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short get_draw_damaged_rects(struct IRECT_2D **clips,int *clips_count,
+    const struct LEVEL *lvl,const struct MAPDRAW_DATA *draw_data)
+{
+    struct IPOINT_2D scaled_txtr_size={TEXTURE_SIZE_X>>(draw_data->rescale),TEXTURE_SIZE_Y>>(draw_data->rescale)};
+    struct IPOINT_2D dest_size={draw_data->end.x-draw_data->start.x+1,draw_data->end.y-draw_data->start.y+1};
+    /* Subtiles visible in the drawing area */
+    struct IPOINT_2D start;
+    start.x = draw_data->start.x/scaled_txtr_size.x;
+    start.y = draw_data->start.y/scaled_txtr_size.y;
+    struct IPOINT_2D end;
+    end.x = min(draw_data->end.x/scaled_txtr_size.x,(int)lvl->subsize.x-1);
+    end.y = min(draw_data->end.y/scaled_txtr_size.y,(int)lvl->subsize.y-1);
+    *clips=NULL;
+    *clips_count=0;
+    if ((end.x<start.x)||(end.y<start.y))
+        return ERR_NONE;
+    /* Changed subtiles outside the area may still be visible in it */
+    int margin=get_draw_damage_margin(draw_data);
+    struct IPOINT_2D area_start={max(start.x-margin,0),max(start.y-margin,0)};
+    struct IPOINT_2D area_end={min(end.x+margin,(int)lvl->subsize.x-1),min(end.y+margin,(int)lvl->subsize.y-1)};
+    int area_w=area_end.x-area_start.x+1;
+    int area_h=area_end.y-area_start.y+1;
+    /* Summed area table of changed subtiles, for checking the margin quickly */
+    unsigned int *sums=calloc((area_w+1)*(area_h+1),sizeof(unsigned int));
+    if (sums==NULL)
+    {
+        message_error("get_draw_damaged_rects: Cannot allocate memory");
+        return ERR_CANT_MALLOC;
+    }
+    int i,j,k;
+    for (j=0; j<area_h; j++)
+    {
+        unsigned int row=0;
+        for (i=0; i<area_w; i++)
+        {
+            if (get_subtl_mod_gen(lvl,area_start.x+i,area_start.y+j)>draw_data->drawn_gen)
+                row++;
+            sums[(j+1)*(area_w+1)+i+1]=sums[j*(area_w+1)+i+1]+row;
+        }
+    }
+    /* Grouping damaged subtiles into rectangles, in subtile coordinates */
+    int rects_alloc=0;
+    struct IRECT_2D *rects=NULL;
+    int rects_count=0;
+    int first_open=0;
+    for (j=start.y; j<=end.y; j++)
+    {
+        int sy1=max(j-margin,area_start.y)-area_start.y;
+        int sy2=min(j+margin,area_end.y)-area_start.y+1;
+        int next_open=rects_count;
+        i=start.x;
+        while (i<=end.x)
+        {
+            int run_start=-1;
+            for (; i<=end.x; i++)
+            {
+                int sx1=max(i-margin,area_start.x)-area_start.x;
+                int sx2=min(i+margin,area_end.x)-area_start.x+1;
+                unsigned int changed=sums[sy2*(area_w+1)+sx2]-sums[sy1*(area_w+1)+sx2]
+                    -sums[sy2*(area_w+1)+sx1]+sums[sy1*(area_w+1)+sx1];
+                if (changed>0)
+                {
+                    if (run_start<0) run_start=i;
+                } else
+                if (run_start>=0)
+                    break;
+            }
+            if (run_start<0) break;
+            /* Extending identical run from previous row, or starting new rectangle */
+            for (k=first_open; k<next_open; k++)
+            {
+                if ((rects[k].l==run_start)&&(rects[k].r==i-1)&&(rects[k].b==j-1))
+                    break;
+            }
+            if (k<next_open)
+            {
+                rects[k].b=j;
+                continue;
+            }
+            if (rects_count>=rects_alloc)
+            {
+                int new_alloc=(rects_alloc>0)?(rects_alloc<<1):16;
+                struct IRECT_2D *new_rects=realloc(rects,new_alloc*sizeof(struct IRECT_2D));
+                if (new_rects==NULL)
+                {
+                    message_error("get_draw_damaged_rects: Cannot allocate memory");
+                    free(rects);
+                    free(sums);
+                    return ERR_CANT_MALLOC;
+                }
+                rects=new_rects;
+                rects_alloc=new_alloc;
+            }
+            rects[rects_count].l=run_start;
+            rects[rects_count].r=i-1;
+            rects[rects_count].t=j;
+            rects[rects_count].b=j;
+            rects_count++;
+        }
+        /* Rectangles which were not extended in this row are closed */
+        while ((first_open<next_open)&&(rects[first_open].b<j))
+            first_open++;
+    }
+    free(sums);
+    /* Converting rectangles into destination buffer coordinates */
+    for (k=0; k<rects_count; k++)
+    {
+        rects[k].l=max(rects[k].l*scaled_txtr_size.x-draw_data->start.x,0);
+        rects[k].r=min((rects[k].r+1)*scaled_txtr_size.x-1-draw_data->start.x,dest_size.x-1);
+        rects[k].t=max(rects[k].t*scaled_txtr_size.y-draw_data->start.y,0);
+        rects[k].b=min((rects[k].b+1)*scaled_txtr_size.y-1-draw_data->start.y,dest_size.y-1);
+    }
+    *clips=rects;
+    *clips_count=rects_count;
+    return ERR_NONE;
+}
+
+/**
+ * Redraws parts of given LEVEL which were changed since previous drawing,
+ * using graphics and options from MAPDRAW_DATA. The buffer must contain
+ * result of the previous call with the same draw_data. Result is the same as
+ * from draw_map_on_buffer() followed by draw_things_on_buffer(), but only
+ * rectangles around subtiles modified since previous call are redrawn.
+ * Changing drawing rectangle, textures, animation frame or thing flags,
+ * or changes affecting the whole map, make the whole area redrawn.
+ * @see level_mark_subtls_changed
+ * @param dest The destination buffer.
+ * @param lvl Source level to draw.
+ * @param draw_data Graphics textures, sprites and options.
+ * @param anim Number of the animation frame.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short draw_map_damaged_on_buffer(char *dest,const struct LEVEL *lvl,
+    struct MAPDRAW_DATA *draw_data,unsigned int anim)
+{
+    /*message_log("  draw_map_damaged_on_buffer: Starting");*/
+    struct IRECT_2D *clips=NULL;
+    int clips_count=0;
+    short result=ERR_INTERNAL;
+    if ((draw_data->drawn_gen>0)&&(draw_data->drawn_gen>=lvl->map_gen)&&
+        (draw_data->drawn_anim==anim)&&(draw_data->drawn_tngflags==draw_data->tngflags))
+    {
+        if (draw_data->drawn_gen==lvl->mod_gen)
+            return ERR_NONE;
+        result=get_draw_damaged_rects(&clips,&clips_count,lvl,draw_data);
+    }
+    if (result!=ERR_NONE)
+    {
+        /* Previous drawing can't be reused - redrawing everything */
+        result=draw_map_on_buffer(dest,lvl,draw_data,anim);
+        if (result==ERR_NONE)
+            result=draw_things_on_buffer(dest,lvl,draw_data);
+    } else
+    {
+        struct IPOINT_2D start=draw_data->start;
+        struct IPOINT_2D end=draw_data->end;
+        int k;
+        /* Drawing map within every rectangle, as if it was whole drawing area */
+        for (k=0; k<clips_count; k++)
+        {
+            draw_data->start.x=start.x+clips[k].l;
+            draw_data->start.y=start.y+clips[k].t;
+            draw_data->end.x=start.x+clips[k].r;
+            draw_data->end.y=start.y+clips[k].b;
+            result=draw_map_on_buffer(dest+clips[k].t*draw_data->dest_scanln+3*clips[k].l,
+                lvl,draw_data,anim);
+            if (result!=ERR_NONE) break;
+        }
+        draw_data->start=start;
+        draw_data->end=end;
+        if (result==ERR_NONE)
+            result=draw_things_clipped_on_buffer(dest,lvl,draw_data,clips,clips_count);
+        free(clips);
+    }
+    if (result==ERR_NONE)
+    {
+        draw_data->drawn_gen=lvl->mod_gen;
+        draw_data->drawn_anim=anim;
+        draw_data->drawn_tngflags=draw_data->tngflags;
+    } else
+    {
+        draw_data->drawn_gen=0;
+    }
+    /*message_log("  draw_map_damaged_on_buffer: Finished");*/
+    return result;
+}
+
 /**
  * Draws text on given buffer, using graphics and options from MAPDRAW_DATA.
  * @param dest The destination buffer.
@@ -2100,6 +2877,7 @@ short set_draw_data_rect(struct MAPDRAW_DATA *draw_data,
     }
     draw_data->rescale=rescale;
     draw_data->dest_scanln=scanline;
+    draw_data->drawn_gen=0;
     return ERR_NONE;
 }
 
@@ -2144,180 +2922,457 @@ short set_draw_data_rect_sl4(struct MAPDRAW_DATA *draw_data,
 }
 
 /**
- * Allocates and fills the MAPDRAW_DATA structure.
- * Loads all data files needed to draw the map.
- * Sets drawing rectangle from (0,0) to bmp_size.
- * @param draw_data Destination structure.
+ * Loads dat/tab pair of images from data files.
+ * @param images Destination images list.
+ * @param data_path Folder with data files.
+ * @param name File name, without extension.
+ * @return Returns true on success, false on failure.
+ */
+short load_draw_resources_images(struct IMAGELIST *images,const char *data_path,
+    const char *name)
+{
+    char *fnames=NULL;
+    char *tabfname=NULL;
+    short result;
+    format_data_fname(&fnames,data_path,"%s.dat",name);
+    format_data_fname(&tabfname,data_path,"%s.tab",name);
+    result = (create_images_dattab_idx(images,fnames,tabfname,0)==ERR_NONE);
+    if (!result)
+        message_error("Error when loading dat/tab pair \"%s\"",fnames);
+    free(fnames);
+    free(tabfname);
+    return result;
+}
+
+/**
+ * Loads texture file with given index into draw resources.
+ * Failure to load the texture isn't fatal - the texture is just left empty.
+ * @param res Destination structure.
+ * @param textr_idx Texture file index.
+ */
+void load_draw_resources_texture(struct DRAW_RESOURCES *res,const int textr_idx)
+{
+    char *fname;
+    format_data_fname(&fname,res->data_path,"tmapa%03d.dat",textr_idx);
+    free(res->texture);
+    res->texture=NULL;
+    res->textr_idx=textr_idx;
+    if (load_texture(&(res->texture),fname)!=ERR_NONE)
+        message_error("Error when loading file \"%s\"",fname);
+    free(fname);
+}
+
+/**
+ * Frees the DRAW_RESOURCES structure and all data it contains.
+ * Doesn't check the reference counter.
+ * @param res The structure to free.
+ */
+void free_draw_resources(struct DRAW_RESOURCES *res)
+{
+    if (res==NULL)
+        return;
+    if (res->images!=NULL)
+        free_dattab_images(res->images);
+    free(res->images);
+    if (res->font0!=NULL)
+        free_dattab_images(res->font0);
+    free(res->font0);
+    if (res->font1!=NULL)
+        free_dattab_images(res->font1);
+    free(res->font1);
+    if (res->cubes!=NULL)
+        free(res->cubes->data);
+    free(res->cubes);
+    free(res->texture);
+    free(res->palette);
+    free(res->data_path);
+    free(res);
+}
+
+/**
+ * Allocates the DRAW_RESOURCES structure and loads data files into it.
+ * The new structure has reference count of 1, and isn't cached.
+ * @param res Returns the new structure.
  * @param opts Drawing options.
- * @param subtl Size of the map, in subtiles.
- * @param bmp_size Ending coords of the drawing rectangle.
  * @param textr_idx Texture file index.
  * @return Returns ERR_NONE on success, error code on failure.
  */
-short load_draw_data(struct MAPDRAW_DATA **draw_data,const struct MAPDRAW_OPTIONS *opts,
-    const struct UPOINT_2D *subtl,const struct IPOINT_2D bmp_size,int textr_idx)
+short load_draw_resources(struct DRAW_RESOURCES **res,const struct MAPDRAW_OPTIONS *opts,
+    int textr_idx)
 {
     short result;
-    (*draw_data) = malloc(sizeof(struct MAPDRAW_DATA));
-    if ((*draw_data) == NULL)
-    {
-        message_error("load_draw_data: Cannot allocate draw_data memory.");
-        return 2;
-    }
-    (*draw_data)->subsize.x=subtl->x;
-    (*draw_data)->subsize.y=subtl->y;
-    (*draw_data)->tngflags=opts->tngflags;
-    unsigned int total_subtiles=(*draw_data)->subsize.x*(*draw_data)->subsize.y;
-    /* Initializing draw_data values */
-    (*draw_data)->cubes=malloc(sizeof(struct CUBES_DATA));
-    (*draw_data)->palette=malloc(256*sizeof(struct PALETTE_ENTRY));
-    (*draw_data)->images=malloc(sizeof(struct IMAGELIST));
-    (*draw_data)->rand_size=total_subtiles*sizeof(int);
-    (*draw_data)->rand_pool=malloc((*draw_data)->rand_size);
-    if ((*draw_data)->cubes != NULL)
+    char *fnames;
+    char name[DISKPATH_SIZE];
+    (*res)=calloc(1,sizeof(struct DRAW_RESOURCES));
+    if ((*res)==NULL)
     {
-        (*draw_data)->cubes->count=0;
-        (*draw_data)->cubes->data=NULL;
+        message_error("load_draw_resources: Out of memory.");
+        return 3;
     }
+    (*res)->large_tngicons=((opts->rescale)<3);
+    (*res)->bmfonts=opts->bmfonts;
+    (*res)->refcount=1;
+    (*res)->data_path=malloc(strlen(opts->data_path)+1);
+    if ((*res)->data_path!=NULL)
+        strcpy((*res)->data_path,opts->data_path);
+    (*res)->cubes=calloc(1,sizeof(struct CUBES_DATA));
+    (*res)->palette=malloc(256*sizeof(struct PALETTE_ENTRY));
+    (*res)->images=calloc(1,sizeof(struct IMAGELIST));
     if (opts->bmfonts&BMFONT_LOAD_SMALL)
-        (*draw_data)->font0=malloc(sizeof(struct IMAGELIST));
-    else
-        (*draw_data)->font0=NULL;
+        (*res)->font0=calloc(1,sizeof(struct IMAGELIST));
     if (opts->bmfonts&BMFONT_LOAD_LARGE)
-        (*draw_data)->font1=malloc(sizeof(struct IMAGELIST));
-    else
-        (*draw_data)->font1=NULL;
-    (*draw_data)->texture=NULL;
-    (*draw_data)->ownerpal=NULL;
-    (*draw_data)->intnspal=NULL;
-    if (((*draw_data)->cubes==NULL) || ((*draw_data)->palette==NULL) ||
-        (((*draw_data)->font0==NULL)&&(opts->bmfonts&BMFONT_LOAD_SMALL)) ||
-        (((*draw_data)->font1==NULL)&&(opts->bmfonts&BMFONT_LOAD_LARGE)) ||
-        ((*draw_data)->images==NULL) || ((*draw_data)->rand_pool==NULL) )
-    {
-        message_error("load_draw_data: Out of memory.");
-        free_draw_data(*draw_data);
-        (*draw_data)=NULL;
-        return 3;
-    }
-    /* Preparing random pool */
-    int i;
-    for (i=0;i<total_subtiles;i++)
+        (*res)->font1=calloc(1,sizeof(struct IMAGELIST));
+    if (((*res)->data_path==NULL) || ((*res)->cubes==NULL) || ((*res)->palette==NULL) ||
+        (((*res)->font0==NULL)&&(opts->bmfonts&BMFONT_LOAD_SMALL)) ||
+        (((*res)->font1==NULL)&&(opts->bmfonts&BMFONT_LOAD_LARGE)) ||
+        ((*res)->images==NULL) )
     {
-        int *rnd_ints=(int *)(*draw_data)->rand_pool;
-        rnd_ints[i]=rand();
+        message_error("load_draw_resources: Out of memory.");
+        free_draw_resources(*res);
+        (*res)=NULL;
+        return 3;
     }
-    (*draw_data)->rand_count=0;
-    /* Setting map drawing rectangle */
-    set_draw_data_rect(*draw_data,0,0,bmp_size.x-1,bmp_size.y-1,bmp_size.x*3,(opts->rescale));
-    /* Loading files needed to draw */
-    char *fnames;
     result=true;
     if (result)
     {
-      message_log(" load_draw_data: Loading \"%s\"",palette_fname);
+      message_log(" load_draw_resources: Loading \"%s\"",palette_fname);
       fnames=NULL;
       result = format_data_fname(&fnames,opts->data_path,palette_fname);
       if (result)
-        result = (load_palette((*draw_data)->palette,fnames)==ERR_NONE);
+        result = (load_palette((*res)->palette,fnames)==ERR_NONE);
       if (!result)
           message_error("Error when loading file \"%s\"",fnames);
       free(fnames);
     }
     if (result)
     {
-      message_log(" load_draw_data: Loading \"%s\"",cube_fname);
+      message_log(" load_draw_resources: Loading \"%s\"",cube_fname);
       fnames=NULL;
       format_data_fname(&fnames,opts->data_path,cube_fname);
-      result = (load_cubedata((*draw_data)->cubes,fnames)==ERR_NONE);
+      result = (load_cubedata((*res)->cubes,fnames)==ERR_NONE);
       if (!result)
           message_error("Error when loading file \"%s\"",fnames);
       free(fnames);
     }
     if (result)
     {
-      message_log(" load_draw_data: Loading \"%s\"",tmapanim_fname);
+      message_log(" load_draw_resources: Loading \"%s\"",tmapanim_fname);
       fnames=NULL;
       format_data_fname(&fnames,opts->data_path,tmapanim_fname);
-      result = (load_textureanim((*draw_data)->cubes,fnames)==ERR_NONE);
+      result = (load_textureanim((*res)->cubes,fnames)==ERR_NONE);
       if (!result)
           message_error("Error when loading file \"%s\"",fnames);
       free(fnames);
     }
     if (result)
     {
-      message_log(" load_draw_data: Loading texture");
-      result = (change_draw_data_texture(*draw_data,opts,textr_idx)==ERR_NONE);
+      message_log(" load_draw_resources: Loading texture");
+      load_draw_resources_texture(*res,textr_idx);
     }
     /* Reading DAT,TAB and extracting images */
     if (result)
     {
-      message_log(" load_draw_data: Loading gui2-0 icons");
-      char *tabfname;
-      fnames=NULL;
-      tabfname=NULL;
-      int large_tngicons=((opts->rescale)<3);
-      format_data_fname(&fnames,opts->data_path,"gui%d-%d-%d.dat",2,0,large_tngicons);
-      format_data_fname(&tabfname,opts->data_path,"gui%d-%d-%d.tab",2,0,large_tngicons);
-      result = (create_images_dattab_idx((*draw_data)->images,fnames,tabfname,0)==ERR_NONE);
-      if (!result)
-          message_error("Error when loading dat/tab pair \"%s\"",fnames);
-      free(fnames);
-      free(tabfname);
+      message_log(" load_draw_resources: Loading gui2-0 icons");
+      sprintf(name,"gui%d-%d-%d",2,0,(*res)->large_tngicons);
+      result = load_draw_resources_images((*res)->images,opts->data_path,name);
     }
     /* Reading font0 DAT,TAB and extracting images */
     if ((result)&&(opts->bmfonts&BMFONT_LOAD_SMALL))
     {
-      message_log(" load_draw_data: Loading small font");
-      char *tabfname;
-      fnames=NULL;
-      tabfname=NULL;
-      /*int large_tngicons=((opts->rescale)<3);*/
-      format_data_fname(&fnames,opts->data_path,"font%d-%d.dat",2,0);
-      format_data_fname(&tabfname,opts->data_path,"font%d-%d.tab",2,0);
-      result = (create_images_dattab_idx((*draw_data)->font0,fnames,tabfname,0)==ERR_NONE);
-      if (!result)
-          message_error("Error when loading dat/tab pair \"%s\"",fnames);
-      free(fnames);
-      free(tabfname);
+      message_log(" load_draw_resources: Loading small font");
+      sprintf(name,"font%d-%d",2,0);
+      result = load_draw_resources_images((*res)->font0,opts->data_path,name);
     }
     /* Reading font1 DAT,TAB and extracting images */
     if ((result)&&(opts->bmfonts&BMFONT_LOAD_LARGE))
     {
-      message_log(" load_draw_data: Loading large font");
-      char *tabfname;
-      fnames=NULL;
-      tabfname=NULL;
-      /*int large_tngicons=((opts->rescale)<3);*/
-      format_data_fname(&fnames,opts->data_path,"font%d-%d.dat",2,1);
-      format_data_fname(&tabfname,opts->data_path,"font%d-%d.tab",2,1);
-      result = (create_images_dattab_idx((*draw_data)->font1,fnames,tabfname,0)==ERR_NONE);
-      if (!result)
-          message_error("Error when loading dat/tab pair \"%s\"",fnames);
-      free(fnames);
-      free(tabfname);
+      message_log(" load_draw_resources: Loading large font");
+      sprintf(name,"font%d-%d",2,1);
+      result = load_draw_resources_images((*res)->font1,opts->data_path,name);
+    }
+    if (!result)
+    {
+        free_draw_resources(*res);
+        (*res)=NULL;
+        return 1;
+    }
+    return ERR_NONE;
+}
+
+/**
+ * Checks if given draw resources were loaded with given options.
+ * @param res The resources to check.
+ * @param opts Drawing options.
+ * @param textr_idx Texture file index.
+ * @return Returns true if the resources can be used with the options.
+ */
+short draw_resources_match(const struct DRAW_RESOURCES *res,
+    const struct MAPDRAW_OPTIONS *opts,int textr_idx)
+{
+    if ((res->textr_idx!=textr_idx)||(res->bmfonts!=opts->bmfonts))
+        return false;
+    if (res->large_tngicons!=((opts->rescale)<3))
+        return false;
+    return (strcmp(res->data_path,opts->data_path)==0);
+}
+
+/**
+ * Removes unused resources from the shared cache, leaving at most
+ * given amount of the most recently added ones. Cache lock must be held.
+ * @param keep_unused Amount of unused resources to keep.
+ */
+void trim_draw_resources_cache(int keep_unused)
+{
+    struct DRAW_RESOURCES **prev=&draw_res_cache;
+    int unused=0;
+    while ((*prev)!=NULL)
+    {
+        struct DRAW_RESOURCES *item=(*prev);
+        if (item->refcount==0)
+        {
+            unused++;
+            if (unused>keep_unused)
+            {
+                (*prev)=item->next;
+                free_draw_resources(item);
+                continue;
+            }
+        }
+        prev=&(item->next);
+    }
+}
+
+/**
+ * Gives draw resources for given options from the shared cache.
+ * If there are no such resources in cache, they are loaded and added to it.
+ * Loading is made without holding the cache lock, so that threads
+ * drawing other maps aren't stopped.
+ * @param res Returns the resources, with increased reference count.
+ * @param opts Drawing options.
+ * @param textr_idx Texture file index.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short acquire_draw_resources(struct DRAW_RESOURCES **res,
+    const struct MAPDRAW_OPTIONS *opts,int textr_idx)
+{
+    struct DRAW_RESOURCES *item;
+    struct DRAW_RESOURCES *loaded;
+    short result;
+    lbthreads_lock();
+    for (item=draw_res_cache; item!=NULL; item=item->next)
+    {
+        if (draw_resources_match(item,opts,textr_idx))
+        {
+            item->refcount++;
+            lbthreads_unlock();
+            (*res)=item;
+            return ERR_NONE;
+        }
+    }
+    lbthreads_unlock();
+    result=load_draw_resources(&loaded,opts,textr_idx);
+    if (result!=ERR_NONE)
+        return result;
+    lbthreads_lock();
+    /* Other thread could have loaded the same resources meanwhile */
+    for (item=draw_res_cache; item!=NULL; item=item->next)
+    {
+        if (draw_resources_match(item,opts,textr_idx))
+            break;
+    }
+    if (item!=NULL)
+    {
+        item->refcount++;
+    } else
+    {
+        item=loaded;
+        loaded=NULL;
+        item->cached=true;
+        item->next=draw_res_cache;
+        draw_res_cache=item;
+        trim_draw_resources_cache(DRAW_RES_CACHE_UNUSED_MAX);
+    }
+    lbthreads_unlock();
+    free_draw_resources(loaded);
+    (*res)=item;
+    return ERR_NONE;
+}
+
+/**
+ * Decreases reference count of draw resources. Resources which are not
+ * cached are freed when they're no longer used; cached resources are kept
+ * until they're removed from the cache.
+ * @param res The resources to release.
+ */
+void release_draw_resources(struct DRAW_RESOURCES *res)
+{
+    if (res==NULL)
+        return;
+    if (!res->cached)
+    {
+        res->refcount--;
+        if (res->refcount==0)
+            free_draw_resources(res);
+        return;
+    }
+    lbthreads_lock();
+    if (res->refcount>0)
+        res->refcount--;
+    lbthreads_unlock();
+}
+
+/**
+ * Frees all draw resources in the shared cache which aren't used
+ * by any MAPDRAW_DATA structure.
+ * @see load_draw_data_shared
+ */
+void free_draw_resources_cache(void)
+{
+    lbthreads_lock();
+    trim_draw_resources_cache(0);
+    lbthreads_unlock();
+}
+
+/**
+ * Makes MAPDRAW_DATA use given draw resources.
+ * @param draw_data Destination structure.
+ * @param res The resources; the reference is taken over by draw_data.
+ */
+void set_draw_data_resources(struct MAPDRAW_DATA *draw_data,struct DRAW_RESOURCES *res)
+{
+    draw_data->res=res;
+    draw_data->cubes=res->cubes;
+    draw_data->texture=res->texture;
+    draw_data->palette=res->palette;
+    draw_data->images=res->images;
+    draw_data->font0=res->font0;
+    draw_data->font1=res->font1;
+    free_draw_data_atlas(draw_data);
+    free_draw_data_pyramid(draw_data);
+    draw_data->drawn_gen=0;
+}
+
+/**
+ * Allocates the MAPDRAW_DATA structure and fills it with everything
+ * except data loaded from files.
+ * Sets drawing rectangle from (0,0) to bmp_size.
+ * @param draw_data Destination structure.
+ * @param opts Drawing options.
+ * @param subtl Size of the map, in subtiles.
+ * @param bmp_size Ending coords of the drawing rectangle.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short init_draw_data(struct MAPDRAW_DATA **draw_data,const struct MAPDRAW_OPTIONS *opts,
+    const struct UPOINT_2D *subtl,const struct IPOINT_2D bmp_size)
+{
+    (*draw_data) = calloc(1,sizeof(struct MAPDRAW_DATA));
+    if ((*draw_data) == NULL)
+    {
+        message_error("init_draw_data: Cannot allocate draw_data memory.");
+        return 2;
+    }
+    (*draw_data)->subsize.x=subtl->x;
+    (*draw_data)->subsize.y=subtl->y;
+    (*draw_data)->tngflags=opts->tngflags;
+    unsigned int total_subtiles=(*draw_data)->subsize.x*(*draw_data)->subsize.y;
+    /* Initializing draw_data values */
+    (*draw_data)->rand_size=total_subtiles*sizeof(int);
+    (*draw_data)->rand_pool=malloc((*draw_data)->rand_size);
+    (*draw_data)->atlas=calloc(DRAW_ATLAS_ENTRIES,sizeof(unsigned char *));
+    (*draw_data)->atlas_rescale=opts->rescale;
+    (*draw_data)->drawn_gen=0;
+    if (((*draw_data)->rand_pool==NULL) || ((*draw_data)->atlas==NULL))
+    {
+        message_error("init_draw_data: Out of memory.");
+        free_draw_data(*draw_data);
+        (*draw_data)=NULL;
+        return 3;
+    }
+    /* Preparing random pool */
+    int i;
+    for (i=0;i<total_subtiles;i++)
+    {
+        int *rnd_ints=(int *)(*draw_data)->rand_pool;
+        rnd_ints[i]=rand();
     }
+    (*draw_data)->rand_count=0;
+    /* Setting map drawing rectangle */
+    set_draw_data_rect(*draw_data,0,0,bmp_size.x-1,bmp_size.y-1,bmp_size.x*3,(opts->rescale));
     /* Preparing constant arrays */
-    if (result)
+    for(i=0;i<SIN_ACOS_SIZE;i++)                 /* create the sin(arccos(x)) table. */
     {
-      message_log(" load_draw_data: Preparing constant arrays");
-      for(i=0;i<SIN_ACOS_SIZE;i++)                 /* create the sin(arccos(x)) table. */
-      {
-        (*draw_data)->sin_acos[i]=sin(acos(((float)i)/SIN_ACOS_SIZE))*0x10000L;
-      }
+      (*draw_data)->sin_acos[i]=sin(acos(((float)i)/SIN_ACOS_SIZE))*0x10000L;
     }
-    if (!result)
+    return ERR_NONE;
+}
+
+/**
+ * Allocates and fills the MAPDRAW_DATA structure.
+ * Loads all data files needed to draw the map.
+ * Sets drawing rectangle from (0,0) to bmp_size.
+ * @param draw_data Destination structure.
+ * @param opts Drawing options.
+ * @param subtl Size of the map, in subtiles.
+ * @param bmp_size Ending coords of the drawing rectangle.
+ * @param textr_idx Texture file index.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short load_draw_data(struct MAPDRAW_DATA **draw_data,const struct MAPDRAW_OPTIONS *opts,
+    const struct UPOINT_2D *subtl,const struct IPOINT_2D bmp_size,int textr_idx)
+{
+    short result;
+    struct DRAW_RESOURCES *res;
+    result=init_draw_data(draw_data,opts,subtl,bmp_size);
+    if (result!=ERR_NONE)
+        return result;
+    result=load_draw_resources(&res,opts,textr_idx);
+    if (result!=ERR_NONE)
     {
         free_draw_data(*draw_data);
         (*draw_data)=NULL;
-        return 1;
+        return result;
+    }
+    set_draw_data_resources(*draw_data,res);
+    return ERR_NONE;
+}
+
+/**
+ * Allocates and fills the MAPDRAW_DATA structure, using data files
+ * from the shared cache. Files are loaded only if no structure was
+ * loaded with the same data path, texture index and options before.
+ * The data is shared read-only, and may be used by many threads at once.
+ * Cached data is kept after the structure is freed; to free it,
+ * use free_draw_resources_cache().
+ * @param draw_data Destination structure.
+ * @param opts Drawing options.
+ * @param subtl Size of the map, in subtiles.
+ * @param bmp_size Ending coords of the drawing rectangle.
+ * @param textr_idx Texture file index.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short load_draw_data_shared(struct MAPDRAW_DATA **draw_data,const struct MAPDRAW_OPTIONS *opts,
+    const struct UPOINT_2D *subtl,const struct IPOINT_2D bmp_size,int textr_idx)
+{
+    short result;
+    struct DRAW_RESOURCES *res;
+    result=init_draw_data(draw_data,opts,subtl,bmp_size);
+    if (result!=ERR_NONE)
+        return result;
+    result=acquire_draw_resources(&res,opts,textr_idx);
+    if (result!=ERR_NONE)
+    {
+        free_draw_data(*draw_data);
+        (*draw_data)=NULL;
+        return result;
     }
+    set_draw_data_resources(*draw_data,res);
     return ERR_NONE;
 }
 
 /**
  * Changes loaded texture in the MAPDRAW_DATA structure.
- * Loads the new texture file from disk into draw_data.
+ * Loads the new texture file from disk into draw_data. If the structure
+ * uses shared data, it is switched to shared data with the new texture.
  * @param draw_data Destination structure.
  * @param opts Drawing options.
  * @param textr_idx New texture file index.
@@ -2326,20 +3381,27 @@ short load_draw_data(struct MAPDRAW_DATA **draw_data,const struct MAPDRAW_OPTION
 short change_draw_data_texture(struct MAPDRAW_DATA *draw_data,
     const struct MAPDRAW_OPTIONS *opts,const int textr_idx)
 {
-  char *fname;
+  struct DRAW_RESOURCES *res=draw_data->res;
   short result;
-  format_data_fname(&fname,opts->data_path,"tmapa%03d.dat",textr_idx);
-  free(draw_data->texture);
-  draw_data->texture=NULL;
-  result = load_texture(&(draw_data->texture),fname);
-  if (result!=ERR_NONE)
-      message_error("Error when loading file \"%s\"",fname);
-  free(fname);
+  if (res==NULL)
+      return ERR_INTERNAL;
+  if (res->cached)
+  {
+      result=acquire_draw_resources(&res,opts,textr_idx);
+      if (result!=ERR_NONE)
+          return result;
+      release_draw_resources(draw_data->res);
+  } else
+  {
+      load_draw_resources_texture(res,textr_idx);
+  }
+  set_draw_data_resources(draw_data,res);
   return ERR_NONE;
 }
 
 /**
  * Frees the MAPDRAW_DATA structure.
+ * Data files shared with other structures are only released.
  * @param draw_data Destination structure.
  * @return Returns ERR_NONE on success, error code on failure.
  */
@@ -2347,14 +3409,11 @@ short free_draw_data(struct MAPDRAW_DATA *draw_data)
 {
   if (draw_data==NULL)
       return ERR_NONE;
-  free_dattab_images(draw_data->images);
-  free(draw_data->images);
-  if (draw_data->cubes != NULL)
-      free(draw_data->cubes->data);
-  free(draw_data->texture);
-  free(draw_data->palette);
-  free(draw_data->cubes);
+  release_draw_resources(draw_data->res);
   free(draw_data->rand_pool);
+  free_draw_data_atlas(draw_data);
+  free(draw_data->atlas);
+  free_draw_data_pyramid(draw_data);
   free(draw_data);
   return ERR_NONE;
 }
@@ -2535,35 +3594,30 @@ short get_thing_with_circle_at(unsigned int *sx,unsigned int *sy,unsigned int *n
       return result;
   }
   /*message_log(" get_thing_with_circle_at: Searching for thing at (%u,%u)",test_ssx,test_ssy);*/
-  /* Searching for nearest thing */
-  unsigned int obj_sx,obj_sy,obj_num;
-  long dist;
-  dist=get_nearest_thing_idx(lvl,test_ssx,test_ssy,&obj_sx,&obj_sy,&obj_num);
-  if (dist<0)
-  {
-      message_info("No thing near subtile (%u,%u)",test_ssx>>8,test_ssy>>8);
-      return ERR_INTERNAL;
-  }
-  /*message_log(" get_thing_with_circle_at: Thing found");*/
   /**
-   * Checking if it is near enough
+   * Only things inside the circle are accepted, so we're searching
+   * for the nearest thing within the radius.
    * Note: it is quite simplified and assumes scale is same in X and Y direction!
    */
   long radius;
   radius=get_objcircle_std_radius(scaled_txtr_size);
   if (radius<3) radius=3;
   radius = ((unsigned long)radius<<8)/scaled_txtr_size.x;
-  /* Equation of a circle */
-  if (dist<=radius)
+  struct OBJECT_INDEX nearest;
+  if (get_nearest_things_list(lvl,test_ssx,test_ssy,radius,&nearest,1)<1)
   {
-      /*message_log(" get_thing_with_circle_at: Thing mets condition");*/
-      *sx=obj_sx;
-      *sy=obj_sy;
-      *num=obj_num;
-      return ERR_NONE;
+      /* Nothing in range; tell the user if the level has no things at all */
+      unsigned int obj_sx,obj_sy,obj_num;
+      if (get_nearest_thing_idx(lvl,test_ssx,test_ssy,&obj_sx,&obj_sy,&obj_num)<0)
+          message_info("No thing near subtile (%u,%u)",test_ssx>>8,test_ssy>>8);
+      /*message_log(" get_thing_with_circle_at: Thing not found");*/
+      return ERR_INTERNAL;
   }
-  /*message_log(" get_thing_with_circle_at: Thing rejected");*/
-  return ERR_INTERNAL;
+  /*message_log(" get_thing_with_circle_at: Thing mets condition");*/
+  *sx=nearest.sx;
+  *sy=nearest.sy;
+  *num=nearest.num;
+  return ERR_NONE;
 }
 
 /**
@@ -2596,35 +3650,30 @@ short get_object_with_circle_at(unsigned int *sx,unsigned int *sy,unsigned int *
       return result;
   }
   /*message_log(" get_object_with_circle_at: Searching for objects at (%u,%u)",test_ssx,test_ssy);*/
-  /* Searching for nearest object */
-  unsigned int obj_sx,obj_sy,obj_num;
-  long dist;
-  dist=get_nearest_object_idx(lvl,test_ssx,test_ssy,&obj_sx,&obj_sy,&obj_num);
-  if (dist<0)
-  {
-      message_info("No object near subtile (%u,%u)",test_ssx>>8,test_ssy>>8);
-      return ERR_INTERNAL;
-  }
-  /*message_log(" get_object_with_circle_at: Object found");*/
   /**
-   * Checking if it is near enough
+   * Only objects inside the circle are accepted, so we're searching
+   * for the nearest object within the radius.
    * Note: it is quite simplified and assumes scale is same in X and Y direction!
    */
   long radius;
   radius=get_objcircle_std_radius(scaled_txtr_size);
   if (radius<3) radius=3;
   radius = ((unsigned long)radius<<8)/scaled_txtr_size.x;
-  /* Equation of a circle */
-  if (dist<=radius)
+  struct OBJECT_INDEX nearest;
+  if (get_nearest_objects_list(lvl,test_ssx,test_ssy,radius,&nearest,1)<1)
   {
-      /*message_log(" get_object_with_circle_at: Object mets condition");*/
-      *sx=obj_sx;
-      *sy=obj_sy;
-      *z=obj_num;
-      return ERR_NONE;
+      /* Nothing in range; tell the user if the level has no objects at all */
+      unsigned int obj_sx,obj_sy,obj_num;
+      if (get_nearest_object_idx(lvl,test_ssx,test_ssy,&obj_sx,&obj_sy,&obj_num)<0)
+          message_info("No object near subtile (%u,%u)",test_ssx>>8,test_ssy>>8);
+      /*message_log(" get_object_with_circle_at: Object not found");*/
+      return ERR_INTERNAL;
   }
-  /*message_log(" get_object_with_circle_at: Object rejected");*/
-  return ERR_INTERNAL;
+  /*message_log(" get_object_with_circle_at: Object mets condition");*/
+  *sx=nearest.sx;
+  *sy=nearest.sy;
+  *z=nearest.num;
+  return ERR_NONE;
 }
 
 /**
@@ -2672,7 +3721,14 @@ short get_full_draw_dimensions_opt(struct IPOINT_2D *gdim,
 /**
  * Generates bitmap representing the current map layout.
  * The result is stored into given file name.
- * Loads all data files every time it's executed.
+ * Data files are loaded into the shared cache when first needed,
+ * and reused when drawing next maps. The cache is kept after drawing;
+ * caller has to release it with free_draw_resources_cache() when
+ * no more bitmaps will be generated.
+ * The map is drawn in bands of subtile rows, starting from the bottom one,
+ * and every band is appended to the file when drawn; so memory usage
+ * doesn't depend on the map size.
+ * @see free_draw_resources_cache
  * @param bmpfname Output bitmap file name.
  * @param lvl Source level to draw map from.
  * @param opts Drawing options.
@@ -2690,38 +3746,70 @@ short generate_map_bitmap(const char *bmpfname,const struct LEVEL *lvl,
     /* Settings to draw whole map */
     bmp_size.x=textr_size.x*lvl->subsize.x;
     bmp_size.y=textr_size.y*lvl->subsize.y;
-    result=load_draw_data(&draw_data,opts,&(lvl->subsize),bmp_size,(int)(lvl->inf%8));
+    result=load_draw_data_shared(&draw_data,opts,&(lvl->subsize),bmp_size,(int)(lvl->inf%8));
     if (result!=ERR_NONE)
         return result;
-    unsigned char *bitmap=NULL;
-    if (result==ERR_NONE)
+    /* Things near a band may reach into it, so bands are drawn with margin */
+    int margin=0;
+    if ((opts->rescale)<5)
+        margin=get_draw_objects_margin(lvl,draw_data);
+    unsigned int scanln=bmp_size.x*3;
+    int band_subtl=MAPDRAW_BAND_SIZE_MAX/(scanln*textr_size.y);
+    if (band_subtl<1) band_subtl=1;
+    if (band_subtl>lvl->subsize.y) band_subtl=lvl->subsize.y;
+    int buf_subtl=min(band_subtl+2*margin,(int)lvl->subsize.y);
+    unsigned char *bitmap;
+    bitmap=(unsigned char *)malloc((long)scanln*buf_subtl*textr_size.y+3);
+    if (bitmap==NULL)
     {
-      bitmap=(unsigned char *)malloc((bmp_size.x*bmp_size.y+1)*3);
-      if (bitmap==NULL)
-      {
-        message_error("generate_map_bitmap: Cannot allocate bitmap memory.");
-        free_draw_data(draw_data);
-        return 2;
-      }
+      message_error("generate_map_bitmap: Cannot allocate bitmap memory.");
+      free_draw_data(draw_data);
+      return 2;
     }
-    if (result==ERR_NONE)
+    FILE *out;
+    out = fopen(bmpfname, "wb");
+    if (out==NULL)
     {
-      result = draw_map_on_buffer(bitmap,lvl,draw_data,rnd(32768));
-      if (result!=ERR_NONE)
-          message_error("Error when drawing map on memory buffer");
+      message_error("Can't open \"%s\" for writing", bmpfname);
+      free(bitmap);
+      free_draw_data(draw_data);
+      return 1;
     }
-    if (result==ERR_NONE)
+    if (write_bmp_fp_24b_header(out,bmp_size.x,bmp_size.y)!=0)
+      result=ERR_CANT_WRITE;
+    unsigned int anim=rnd(32768);
+    int band_start=((lvl->subsize.y-1)/band_subtl)*band_subtl;
+    for (; (band_start>=0)&&(result==ERR_NONE); band_start-=band_subtl)
     {
+      int band_end=min(band_start+band_subtl,(int)lvl->subsize.y)-1;
+      int buf_start=max(band_start-margin,0);
+      int buf_end=min(band_end+margin,(int)lvl->subsize.y-1);
+      set_draw_data_rect(draw_data,0,buf_start*textr_size.y,bmp_size.x-1,
+          (buf_end+1)*textr_size.y-1,scanln,opts->rescale);
+      result = draw_map_on_buffer_parallel(bitmap,lvl,draw_data,anim,opts->threads);
+      if (result!=ERR_NONE)
+      {
+          message_error("Error when drawing map on memory buffer");
+          break;
+      }
       if ((opts->rescale)<5)
         result = draw_things_on_buffer(bitmap,lvl,draw_data);
       if (result!=ERR_NONE)
+      {
           message_error("Error when placing thing sprites on memory buffer");
+          break;
+      }
+      if (write_bmp_fp_24b_rows(out,bmp_size.x,(band_end-band_start+1)*textr_size.y,
+          bitmap+(band_start-buf_start)*textr_size.y*scanln,scanln)!=0)
+        result=ERR_CANT_WRITE;
     }
-    if (result==ERR_NONE)
-    {
-      /*result = write_bitmap_idx(bmpfname, draw_data->palette, bitmap, bmp_size);*/
-      result = write_bitmap_rgb(bmpfname,bitmap,bmp_size);
-    }
+    if ((fclose(out)!=0)&&(result==ERR_NONE))
+      result=ERR_CANT_WRITE;
+    if (result==ERR_CANT_WRITE)
+      message_error("Error when writing \"%s\"", bmpfname);
+    /* Don't leave a truncated bitmap which header claims the whole map */
+    if (result!=ERR_NONE)
+      remove(bmpfname);
     free(bitmap);
     free_draw_data(draw_data);
     message_log(" generate_map_bitmap: Finished");
@@ -47,9 +47,58 @@ struct PALETTE_ENTRY {
     unsigned char o;
 };
 
+/**
+ * Decoded data files needed for drawing.
+ * Can be shared, read-only, by many MAPDRAW_DATA structures.
+ */
+struct DRAW_RESOURCES {
+    /* Options the resources were loaded with */
+    char *data_path;
+    int textr_idx;
+    short large_tngicons;
+    short bmfonts;
+    /* Amount of MAPDRAW_DATA using the resources */
+    unsigned int refcount;
+    /* True if the resources are in the shared cache */
+    short cached;
+    struct CUBES_DATA *cubes;
+    unsigned char *texture;
+    struct PALETTE_ENTRY *palette;
+    struct IMAGELIST *images;
+    struct IMAGELIST *font0;
+    struct IMAGELIST *font1;
+    /* Next item in the shared cache */
+    struct DRAW_RESOURCES *next;
+};
+
+/* Amount of levels in map pyramid; first level is for MAPDRAW_PYRAMID_RESCALE, */
+/* and every next one has half of the previous resolution */
+#define MAPDRAW_PYRAMID_LEVELS 3
+#define MAPDRAW_PYRAMID_RESCALE 3
+
+/**
+ * Images of the whole map at decreasing resolutions, for drawing
+ * zoomed out views of the map without touching every texture.
+ */
+struct MAPDRAW_PYRAMID {
+    /* Level size, in subtiles */
+    struct UPOINT_2D subsize;
+    /* Averaged colors of every texture, at first level resolution */
+    unsigned char *txtr_summary;
+    /* RGB images of the map, with scanline equal to image width */
+    unsigned char *images[MAPDRAW_PYRAMID_LEVELS];
+    /* Level modification generation and animation frame the images show; */
+    /* if not valid, the images have to be fully updated */
+    short valid;
+    unsigned long gen;
+    unsigned int anim;
+};
+
 struct MAPDRAW_DATA {
     /* Level size, in subtiles */
     struct UPOINT_2D subsize;
+    /* Loaded data files; the pointers below point into it */
+    struct DRAW_RESOURCES *res;
     /* Definitions of cubes */
     struct CUBES_DATA *cubes;
     unsigned char *texture;
@@ -74,6 +123,16 @@ struct MAPDRAW_DATA {
     unsigned int rand_count;
     unsigned int rand_size;
     unsigned long sin_acos[SIN_ACOS_SIZE];
+    /* Textures rescaled and converted to RGB, created when first drawn */
+    unsigned char **atlas;
+    short atlas_rescale;
+    /* Level modification generation and options at last drawing, */
+    /* for redrawing changed parts only; zero generation forces full redraw */
+    unsigned long drawn_gen;
+    unsigned int drawn_anim;
+    short drawn_tngflags;
+    /* Map pyramid for zoomed out drawing, created when first drawn */
+    struct MAPDRAW_PYRAMID *pyramid;
 };
 
 /* Disk bitmap drawing */
@@ -86,13 +145,24 @@ DLLIMPORT short generate_map_bitmap_mapfname(struct LEVEL *lvl);
 
 DLLIMPORT short load_draw_data(struct MAPDRAW_DATA **draw_data,const struct MAPDRAW_OPTIONS *opts,
     const struct UPOINT_2D *subtl,const struct IPOINT_2D bmp_size,int textr_idx);
+DLLIMPORT short load_draw_data_shared(struct MAPDRAW_DATA **draw_data,const struct MAPDRAW_OPTIONS *opts,
+    const struct UPOINT_2D *subtl,const struct IPOINT_2D bmp_size,int textr_idx);
 DLLIMPORT short free_draw_data(struct MAPDRAW_DATA *draw_data);
+DLLIMPORT void free_draw_resources_cache(void);
 DLLIMPORT short draw_map_on_buffer(char *dest,const struct LEVEL *lvl,
     struct MAPDRAW_DATA *draw_datam,unsigned int anim);
 DLLIMPORT short draw_map_on_buffer_fast(char *dest,const struct LEVEL *lvl,
     struct MAPDRAW_DATA *draw_data,unsigned int anim);
+DLLIMPORT short draw_map_on_buffer_parallel(char *dest,const struct LEVEL *lvl,
+    struct MAPDRAW_DATA *draw_data,unsigned int anim,int threads_count);
+DLLIMPORT short draw_map_pyramid_on_buffer(char *dest,const struct LEVEL *lvl,
+    struct MAPDRAW_DATA *draw_data,unsigned int anim);
 DLLIMPORT short draw_things_on_buffer(char *dest,const struct LEVEL *lvl,
     struct MAPDRAW_DATA *draw_data);
+short draw_things_clipped_on_buffer(char *dest,const struct LEVEL *lvl,
+    struct MAPDRAW_DATA *draw_data,const struct IRECT_2D *clips,int clips_count);
+DLLIMPORT short draw_map_damaged_on_buffer(char *dest,const struct LEVEL *lvl,
+    struct MAPDRAW_DATA *draw_data,unsigned int anim);
 DLLIMPORT short draw_text_on_buffer(char *dest,const int px,const int py,
     const char *text,struct MAPDRAW_DATA *draw_data,short font);
 
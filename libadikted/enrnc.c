@@ -0,0 +1,811 @@
+/******************************************************************************/
+/** @file enrnc.c
+ * RNC compression support.
+ * @par Purpose:
+ *   Compiled normally, this file exports `rnc_pack', which compresses
+ *   a data block into RNC method 1 format, readable by `rnc_unpack'.
+ *   Compiled with MAIN_ENRNC defined, it's a standalone program which
+ *   will compress the files given in command line, or test the
+ *   compression on them.
+ * @par Comment:
+ *   Matches are found with hash chains; the compression level sets
+ *   how long the chains are searched. Huffman tables are built
+ *   separately for every chunk.
+ * @date     17 Oct 2026
+ * @par  Copying and copyrights:
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ */
+/******************************************************************************/
+
+#ifdef MAIN_ENRNC
+# include <stdio.h>
+# include <time.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERNAL
+#include "lbfileio.h"
+#include "enrnc.h"
+#include "globals.h"
+
+/* Max amount of nodes in Huffman table; some decoders support no more */
+#define RNC_PACK_NODES       16
+/* Max value which can be stored with RNC_PACK_NODES nodes */
+#define RNC_PACK_MAX_VALUE   ((1L<<(RNC_PACK_NODES-1))-1)
+/* Max distance of a match; it is stored as value+1 */
+#define RNC_PACK_WINDOW      (RNC_PACK_MAX_VALUE+1)
+#define RNC_PACK_MIN_MATCH   3
+#define RNC_PACK_MAX_MATCH   0x1000
+#define RNC_PACK_HASH_BITS   15
+#define RNC_PACK_HASH_SIZE   (1<<RNC_PACK_HASH_BITS)
+
+/**
+ * Bit stream writer. Bits are stored in 16-bit words, and literals
+ * are placed right after the word which is being filled - this is
+ * the order in which rnc_unpack() reads them.
+ */
+typedef struct {
+    unsigned char *buf;
+    unsigned long size;         /* size of the buffer */
+    unsigned long pos;          /* where next literal or word goes */
+    unsigned long wpos;         /* position of the word being filled */
+    unsigned long bitbuf;       /* bits of that word */
+    int bitcount;               /* how many bits are in bitbuf */
+    short overflow;             /* set if the buffer was too small */
+} bit_writer;
+
+/**
+ * Huffman code table, used for compression.
+ */
+typedef struct {
+    int num;                   /* number of nodes in the table */
+    unsigned long freq[RNC_PACK_NODES];
+    int codelen[RNC_PACK_NODES];
+    unsigned long code[RNC_PACK_NODES];
+} huf_codes;
+
+/**
+ * A match, with literals which are stored before it.
+ */
+typedef struct {
+    unsigned long lit_pos;
+    unsigned short lit_len;
+    unsigned short posn;       /* match distance-1 */
+    unsigned short length;     /* match length */
+} pack_token;
+
+/**
+ * Hash chains, used for finding matches.
+ */
+typedef struct {
+    const unsigned char *data;
+    unsigned long len;
+    long *head;                /* last position with given hash */
+    long *prev;                /* previous position with the same hash */
+    int max_chain;
+    unsigned long nice_len;
+    short lazy;
+} match_finder;
+
+/**
+ * Parameters of the compression levels.
+ */
+static const struct {
+    int max_chain;             /* positions checked when looking for match */
+    unsigned long nice_len;    /* match length which stops the search */
+    short lazy;                /* check if next position has longer match */
+} pack_levels[RNC_PACK_LEVEL_MAX+1] = {
+    {   0,    0, false},
+    {   2,    8, false},
+    {   4,   16, false},
+    {   8,   32, false},
+    {  16,   32, true},
+    {  32,   64, true},
+    {  64,  128, true},
+    { 256,  256, true},
+    {1024, 1024, true},
+    {4096, RNC_PACK_MAX_MATCH, true},
+};
+
+static void bitw_init (bit_writer *bw, unsigned char *buf, unsigned long size);
+static void bitw_put (bit_writer *bw, unsigned long val, int n);
+static void bitw_put_bytes (bit_writer *bw, const unsigned char *data,
+                   unsigned long n);
+static void bitw_finish (bit_writer *bw);
+static void huf_clear (huf_codes *h);
+static int huf_value_node (unsigned long val);
+static void huf_build (huf_codes *h);
+static void huf_write_table (bit_writer *bw, const huf_codes *h);
+static void huf_write_value (bit_writer *bw, const huf_codes *h,
+                   unsigned long val);
+static void match_insert (match_finder *mf, unsigned long pos);
+static unsigned long match_find (const match_finder *mf, unsigned long pos,
+                   unsigned long *dist);
+static unsigned long mirror (unsigned long x, int n);
+
+#ifdef MAIN_ENRNC
+int main_pack (char *pname, char *iname, int level);
+int main_test (char *pname, char *iname, int level_min, int level_max);
+unsigned char *read_whole_file (char *iname, long *len);
+
+/**
+ * Shows usage if building stand-alone EnRNC tool.
+ * @param fname Name of the executable file.
+ * @return Returns 1 on success.
+ */
+short show_usage(char *fname)
+{
+    printf("usage:\n");
+    printf("    %s [-<level>] <files>\n", fname);
+    printf(" or\n");
+    printf("    %s -t [-<level>] <files>\n", fname);
+    printf("level is 0 to %d, default %d; the -t option tests compression\n",
+        RNC_PACK_LEVEL_MAX, RNC_PACK_LEVEL_DEFAULT);
+    printf("and decompression, without changing the files\n");
+    return 1;
+}
+
+/**
+ * Main function if building stand-alone EnRNC tool.
+ * @param argc Command line arguments count.
+ * @param argv Command line arguments vector.
+ * @return Returns 0 on success.
+ */
+int main(int argc, char **argv)
+{
+    int level_min = -1;
+    int level_max = -1;
+    short test = false;
+    int i;
+
+    printf("\nRNC method 1 files compressor\n");
+    printf("-------------------------------\n");
+
+    for (i=1; i < argc; i++)
+    {
+        if (!strcmp (argv[i], "-t"))
+            test = true;
+        else
+        if ((argv[i][0]=='-') && (argv[i][1]>='0') && (argv[i][1]<='9') && (argv[i][2]=='\0'))
+            level_min = level_max = argv[i][1]-'0';
+        else
+            break;
+    }
+    if (i >= argc)
+    {
+        show_usage(*argv);
+        return 1;
+    }
+    if (level_min < 0)
+    {
+        /* Testing checks all levels, packing uses the default one */
+        level_min = test ? RNC_PACK_LEVEL_STORE : RNC_PACK_LEVEL_DEFAULT;
+        level_max = test ? RNC_PACK_LEVEL_MAX : RNC_PACK_LEVEL_DEFAULT;
+    }
+    for (; i < argc; i++)
+    {
+        if (test)
+        {
+            printf("Testing %s...\n",argv[i]);
+            if (main_test (*argv, argv[i], level_min, level_max))
+                return 1;
+        } else
+        {
+            printf("Compressing %s...\n",argv[i]);
+            if (main_pack (*argv, argv[i], level_min))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Reads whole file into new buffer, which has 8 additional "safe bytes".
+ * @param iname File name of the input file.
+ * @param len Output variable for the file length.
+ * @return Returns the buffer, or NULL on error.
+ */
+unsigned char *read_whole_file (char *iname, long *len)
+{
+    FILE *ifp;
+    unsigned char *buf;
+
+    ifp = fopen(iname, "rb");
+    if (!ifp)
+    {
+        perror(iname);
+        return NULL;
+    }
+    fseek (ifp, 0L, SEEK_END);
+    (*len) = ftell (ifp);
+    rewind (ifp);
+    buf = malloc((*len)+8);
+    if (buf==NULL)
+    {
+        fclose(ifp);
+        perror(iname);
+        return NULL;
+    }
+    memset(buf, 0, (*len)+8);
+    (*len) = fread (buf, 1, (*len), ifp);
+    fclose(ifp);
+    return buf;
+}
+
+/**
+ * Compresses single file if building stand-alone EnRNC tool.
+ * @param pname Name of the program executable.
+ * @param iname File name of the input file; it is replaced.
+ * @param level Compression level.
+ * @return Returns 0 on success. On error prints a message
+ *     and returns nonzero value.
+ */
+int main_pack (char *pname, char *iname, int level)
+{
+    FILE *ofp;
+    long ulen, plen;
+    unsigned char *unpacked, *packed;
+
+    unpacked = read_whole_file (iname, &ulen);
+    if (unpacked==NULL)
+        return 1;
+    if ((ulen >= SIZEOF_RNC_HEADER) && (rnc_ulen (unpacked) >= 0))
+    {
+        printf("File is already compressed\n");
+        free(unpacked);
+        return 0;
+    }
+    packed = malloc(RNC_PACK_BOUND(ulen));
+    if (packed==NULL)
+    {
+        free(unpacked);
+        perror(pname);
+        return 1;
+    }
+    plen = rnc_pack (unpacked, ulen, packed, level);
+    free(unpacked);
+    if (plen < 0)
+    {
+        free(packed);
+        printf("Error: %s\n", rnc_error (plen));
+        return 1;
+    }
+    ofp = fopen(iname, "wb");
+    if (!ofp)
+    {
+        free(packed);
+        perror(iname);
+        return 1;
+    }
+    fwrite (packed, 1, plen, ofp);
+    fclose (ofp);
+    printf("Compressed %ld bytes into %ld\n", ulen, plen);
+    free (packed);
+    return 0;
+}
+
+/**
+ * Tests compression of single file if building stand-alone EnRNC tool.
+ * Compresses the file with every level in range, verifies the header
+ * with rnc_crc(), and checks if rnc_unpack() gives back the same data.
+ * @param pname Name of the program executable.
+ * @param iname File name of the input file.
+ * @param level_min First compression level to test.
+ * @param level_max Last compression level to test.
+ * @return Returns 0 on success. On error prints a message
+ *     and returns nonzero value.
+ */
+int main_test (char *pname, char *iname, int level_min, int level_max)
+{
+    static const unsigned int unpack_flags[] = {RNC_IGNORE_NONE, RNC_SIMPLE_DECODE};
+    long ulen, plen, rlen;
+    unsigned char *unpacked, *packed, *verify;
+    clock_t start, elapsed;
+    int level, n;
+    char *errmsg;
+
+    unpacked = read_whole_file (iname, &ulen);
+    if (unpacked==NULL)
+        return 1;
+    packed = malloc(RNC_PACK_BOUND(ulen)+8);
+    verify = malloc(ulen+8);
+    if ((packed==NULL) || (verify==NULL))
+    {
+        free(unpacked);
+        free(packed);
+        free(verify);
+        perror(pname);
+        return 1;
+    }
+    errmsg = NULL;
+    for (level=level_min; level <= level_max; level++)
+    {
+        memset(packed, 0, RNC_PACK_BOUND(ulen)+8);
+        start = clock();
+        plen = rnc_pack (unpacked, ulen, packed, level);
+        elapsed = clock() - start;
+        if (elapsed < 1)
+            elapsed = 1;
+        if (plen < 0)
+            errmsg = rnc_error (plen);
+        else
+        if ((plen > RNC_PACK_BOUND(ulen)) || (rnc_ulen (packed) != ulen)
+          || (rnc_plen (packed) != plen-SIZEOF_RNC_HEADER))
+            errmsg = "Header lengths invalid";
+        else
+        if (rnc_crc (unpacked, ulen) != read_int16_be_buf(packed+12))
+            errmsg = "Header unpacked data CRC invalid";
+        else
+        if (rnc_crc (packed+SIZEOF_RNC_HEADER, plen-SIZEOF_RNC_HEADER) != read_int16_be_buf(packed+14))
+            errmsg = "Header packed data CRC invalid";
+        for (n=0; (errmsg==NULL) && (n < 2); n++)
+        {
+            memset(verify, 0, ulen+8);
+            rlen = rnc_unpack (packed, verify, unpack_flags[n]);
+            if (rlen < 0)
+                errmsg = rnc_error (rlen);
+            else
+            if ((rlen != ulen) || (memcmp(verify, unpacked, ulen) != 0))
+                errmsg = "Unpacked data differs from the original";
+        }
+        if (errmsg != NULL)
+        {
+            printf("level %d: Error: %s\n", level, errmsg);
+            break;
+        }
+        printf("level %d: %8ld bytes into %8ld (%5.1f%%), %7.2f MB/s\n", level,
+            ulen, plen, (ulen>0)?(100.0*plen/ulen):100.0,
+            ((double)ulen/(1024*1024))*CLOCKS_PER_SEC/elapsed);
+    }
+    free (verify);
+    free (packed);
+    free (unpacked);
+    return (errmsg != NULL);
+}
+
+#endif
+
+/**
+ * Compress a data block into RNC method 1 format.
+ *
+ * @param unpacked Source data buffer.
+ * @param ulen Length of the source data.
+ * @param packed Packed destination data buffer; should have
+ *    at least RNC_PACK_BOUND(ulen) bytes.
+ * @param level Compression level, RNC_PACK_LEVEL_STORE to RNC_PACK_LEVEL_MAX.
+ * @return Returns the packed length, including header,
+ *    or negative error code.
+ */
+long rnc_pack (const void *unpacked, unsigned long ulen, void *packed, int level)
+{
+    const unsigned char *input = (const unsigned char *)unpacked;
+    unsigned char *output = (unsigned char *)packed;
+    pack_token *tokens;
+    match_finder mf;
+    bit_writer bw;
+    huf_codes raw, dist, len;
+    unsigned long pos, lit_start, chunk_end, chunk_pos;
+    unsigned long mlen, mdist, ndist, i;
+    long ntokens, k;
+    long lee, lee_diff, this_diff;
+    short has_match;
+    int chunks;
+
+    if (ulen > (RNC_MAX_FILESIZE))
+        return RNC_HEADER_VAL_ERROR;
+    if (level < RNC_PACK_LEVEL_STORE)
+        level = RNC_PACK_LEVEL_STORE;
+    if (level > RNC_PACK_LEVEL_MAX)
+        level = RNC_PACK_LEVEL_MAX;
+    /* Every match takes at least RNC_PACK_MIN_MATCH bytes of the chunk */
+    tokens = (pack_token *)malloc(sizeof(pack_token)*(RNC_PACK_CHUNK_SIZE/RNC_PACK_MIN_MATCH+2));
+    mf.head = (long *)malloc(sizeof(long)*RNC_PACK_HASH_SIZE);
+    mf.prev = (long *)malloc(sizeof(long)*RNC_PACK_WINDOW);
+    if ((tokens==NULL) || (mf.head==NULL) || (mf.prev==NULL))
+    {
+        free(tokens);
+        free(mf.head);
+        free(mf.prev);
+        return RNC_MALLOC_ERROR;
+    }
+    for (k=0; k < RNC_PACK_HASH_SIZE; k++)
+        mf.head[k] = -1;
+    mf.data = input;
+    mf.len = ulen;
+    mf.max_chain = pack_levels[level].max_chain;
+    mf.nice_len = pack_levels[level].nice_len;
+    mf.lazy = pack_levels[level].lazy;
+
+    bitw_init(&bw, output+SIZEOF_RNC_HEADER, RNC_PACK_BOUND(ulen)-SIZEOF_RNC_HEADER);
+    bitw_put(&bw, 0, 2);                     /* two unused bits */
+    pos = 0;
+    chunk_pos = 0;
+    chunks = 0;
+    lee_diff = 0;
+    has_match = false;
+    while (pos < ulen)
+    {
+        /* Find matches for the chunk */
+        chunk_end = pos + RNC_PACK_CHUNK_SIZE;
+        lit_start = pos;
+        ntokens = 0;
+        while ((pos < ulen) && (pos < chunk_end))
+        {
+            mlen = 0;
+            if (level > RNC_PACK_LEVEL_STORE)
+            {
+                mlen = match_find(&mf, pos, &mdist);
+                match_insert(&mf, pos);
+                /* Lazy matching - if next position has a match longer
+                 * by more than one byte, store a literal instead */
+                if ((mlen > 0) && (mf.lazy) && (mlen < mf.nice_len))
+                {
+                    if (match_find(&mf, pos+1, &ndist) > mlen+1)
+                        mlen = 0;
+                }
+            }
+            if (mlen == 0)
+            {
+                pos++;
+                continue;
+            }
+            tokens[ntokens].lit_pos = lit_start;
+            tokens[ntokens].lit_len = pos-lit_start;
+            tokens[ntokens].posn = mdist-1;
+            tokens[ntokens].length = mlen;
+            ntokens++;
+            for (i=1; i < mlen; i++)
+                match_insert(&mf, pos+i);
+            pos += mlen;
+            lit_start = pos;
+        }
+        /* Prepare Huffman tables */
+        huf_clear(&raw);
+        huf_clear(&dist);
+        huf_clear(&len);
+        for (k=0; k < ntokens; k++)
+        {
+            raw.freq[huf_value_node(tokens[k].lit_len)]++;
+            dist.freq[huf_value_node(tokens[k].posn)]++;
+            len.freq[huf_value_node(tokens[k].length-2)]++;
+        }
+        raw.freq[huf_value_node(pos-lit_start)]++;
+        huf_build(&raw);
+        huf_build(&dist);
+        huf_build(&len);
+        /* Store the chunk */
+        chunk_pos = bw.pos;
+        huf_write_table(&bw, &raw);
+        huf_write_table(&bw, &dist);
+        huf_write_table(&bw, &len);
+        bitw_put(&bw, ntokens+1, 16);
+        for (k=0; k < ntokens; k++)
+        {
+            huf_write_value(&bw, &raw, tokens[k].lit_len);
+            bitw_put_bytes(&bw, input+tokens[k].lit_pos, tokens[k].lit_len);
+            huf_write_value(&bw, &dist, tokens[k].posn);
+            huf_write_value(&bw, &len, tokens[k].length-2);
+            /* Leeway is measured after every match, like in rnc_unpack() */
+            this_diff = (long)(tokens[k].lit_pos + tokens[k].lit_len
+                + tokens[k].length) - (long)bw.pos;
+            if ((!has_match) || (lee_diff < this_diff))
+                lee_diff = this_diff;
+            has_match = true;
+        }
+        huf_write_value(&bw, &raw, pos-lit_start);
+        bitw_put_bytes(&bw, input+lit_start, pos-lit_start);
+        chunks++;
+    }
+    bitw_finish(&bw);
+    /* rnc_unpack() requires at least 6 bytes after start of every chunk */
+    while ((chunks > 0) && (bw.pos < chunk_pos+6))
+        bitw_put_bytes(&bw, (const unsigned char *)"\0", 1);
+    free(tokens);
+    free(mf.head);
+    free(mf.prev);
+
+    /* If matches made the data larger, store it instead */
+    if ((level > RNC_PACK_LEVEL_STORE) && ((bw.overflow)
+      || (bw.pos > ulen+(ulen/RNC_PACK_CHUNK_SIZE+1)*16)))
+        return rnc_pack(unpacked, ulen, packed, RNC_PACK_LEVEL_STORE);
+    if (bw.overflow)
+        return RNC_HUF_EXCEEDS_RANGE;
+
+    /* Writing header */
+    write_int32_be_buf(output, RNC_SIGNATURE_INT);
+    write_int32_be_buf(output+4, ulen);
+    write_int32_be_buf(output+8, bw.pos);
+    write_int16_be_buf(output+12, rnc_crc(input, ulen));
+    write_int16_be_buf(output+14, rnc_crc(output+SIZEOF_RNC_HEADER, bw.pos));
+    lee = 0;
+    if (has_match)
+        lee = (long)bw.pos - (long)ulen + lee_diff;
+    output[16] = (unsigned char)max(min(lee,255),0);
+    output[17] = (unsigned char)(chunks & 0xFF);
+    return bw.pos + SIZEOF_RNC_HEADER;
+}
+
+/**
+ * Initialises a bit writer. The first word is reserved at buffer start.
+ */
+static void bitw_init (bit_writer *bw, unsigned char *buf, unsigned long size)
+{
+    bw->buf = buf;
+    bw->size = size;
+    bw->wpos = 0;
+    bw->pos = 2;
+    bw->bitbuf = 0;
+    bw->bitcount = 0;
+    bw->overflow = (size < bw->pos);
+}
+
+/**
+ * Writes the lowest n bits of val into the bit stream.
+ * When a word is filled, new one is started at current position,
+ * after any literals which were written in the meantime.
+ */
+static void bitw_put (bit_writer *bw, unsigned long val, int n)
+{
+    int k;
+    while (n > 0)
+    {
+        if (bw->bitcount == 16)
+        {
+            bitw_finish(bw);
+            bw->wpos = bw->pos;
+            bw->pos += 2;
+            bw->bitbuf = 0;
+            bw->bitcount = 0;
+            if (bw->pos > bw->size)
+                bw->overflow = true;
+        }
+        k = min(n, 16-bw->bitcount);
+        bw->bitbuf |= (val & ((1UL << k) - 1)) << bw->bitcount;
+        bw->bitcount += k;
+        val >>= k;
+        n -= k;
+    }
+}
+
+/**
+ * Writes literal bytes at current position.
+ */
+static void bitw_put_bytes (bit_writer *bw, const unsigned char *data,
+    unsigned long n)
+{
+    if (bw->pos+n > bw->size)
+        bw->overflow = true;
+    if (!bw->overflow)
+        memcpy(bw->buf+bw->pos, data, n);
+    bw->pos += n;
+}
+
+/**
+ * Stores the word which is being filled.
+ */
+static void bitw_finish (bit_writer *bw)
+{
+    if (bw->wpos+2 <= bw->size)
+        write_int16_le_buf(bw->buf+bw->wpos, bw->bitbuf);
+}
+
+/**
+ * Clears frequencies of a Huffman table.
+ */
+static void huf_clear (huf_codes *h)
+{
+    int i;
+    h->num = 0;
+    for (i=0; i < RNC_PACK_NODES; i++)
+        h->freq[i] = 0;
+}
+
+/**
+ * Returns Huffman table node which stores given value.
+ * Values above 1 are stored as the node and the bits below highest one.
+ */
+static int huf_value_node (unsigned long val)
+{
+    int n = 0;
+    while ((n < RNC_PACK_NODES-1) && (val >= (1UL << n)))
+        n++;
+    return n;
+}
+
+/**
+ * Creates Huffman codes from the node frequencies.
+ * The codes are assigned in the same order as read_huftable() does.
+ * With no more than 16 nodes, codes are never longer than 15 bits,
+ * so the code lengths always fit in 4 bits.
+ */
+static void huf_build (huf_codes *h)
+{
+    unsigned long weight[2*RNC_PACK_NODES];
+    int parent[2*RNC_PACK_NODES];
+    int nodes, leaves, i, k, a, b;
+    unsigned long codeb;
+
+    leaves = 0;
+    for (i=0; i < RNC_PACK_NODES; i++)
+    {
+        h->codelen[i] = 0;
+        weight[i] = h->freq[i];
+        parent[i] = -1;
+        if (h->freq[i] > 0)
+        {
+            h->num = i+1;
+            leaves++;
+        }
+    }
+    if (leaves < 2)
+    {
+        /* Even single code needs one bit; if the table is unused,
+         * it still gets one node */
+        if (h->num == 0)
+            h->num = 1;
+        h->codelen[h->num-1] = 1;
+    } else
+    {
+        /* Join two lightest nodes, until only one tree remains */
+        nodes = RNC_PACK_NODES;
+        for (k=1; k < leaves; k++)
+        {
+            a = b = -1;
+            for (i=0; i < nodes; i++)
+            {
+                if ((parent[i] >= 0) || (weight[i] == 0))
+                    continue;
+                if ((a < 0) || (weight[i] < weight[a]))
+                {
+                    b = a;
+                    a = i;
+                } else
+                if ((b < 0) || (weight[i] < weight[b]))
+                    b = i;
+            }
+            weight[nodes] = weight[a] + weight[b];
+            parent[nodes] = -1;
+            parent[a] = nodes;
+            parent[b] = nodes;
+            nodes++;
+        }
+        for (i=0; i < h->num; i++)
+        {
+            if (h->freq[i] == 0)
+                continue;
+            for (k=i; parent[k] >= 0; k=parent[k])
+                h->codelen[i]++;
+        }
+    }
+    codeb = 0;
+    for (k=1; k < RNC_PACK_NODES; k++)
+    {
+        for (i=0; i < h->num; i++)
+            if (h->codelen[i] == k)
+            {
+                h->code[i] = mirror(codeb, k);
+                codeb++;
+            }
+        codeb <<= 1;
+    }
+}
+
+/**
+ * Writes Huffman table into the bit stream, in format
+ * expected by read_huftable().
+ */
+static void huf_write_table (bit_writer *bw, const huf_codes *h)
+{
+    int i;
+    bitw_put(bw, h->num, 5);
+    for (i=0; i < h->num; i++)
+        bitw_put(bw, h->codelen[i], 4);
+}
+
+/**
+ * Writes a value into the bit stream, using the given Huffman table.
+ */
+static void huf_write_value (bit_writer *bw, const huf_codes *h,
+    unsigned long val)
+{
+    int n = huf_value_node(val);
+    bitw_put(bw, h->code[n], h->codelen[n]);
+    if (n >= 2)
+        bitw_put(bw, val, n-1);
+}
+
+/**
+ * Computes hash of three bytes, for the match finder.
+ */
+static unsigned long match_hash (const unsigned char *p)
+{
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (RNC_PACK_HASH_SIZE-1);
+}
+
+/**
+ * Adds position to the hash chains.
+ */
+static void match_insert (match_finder *mf, unsigned long pos)
+{
+    unsigned long h;
+    if (pos+RNC_PACK_MIN_MATCH > mf->len)
+        return;
+    h = match_hash(mf->data+pos);
+    mf->prev[pos & (RNC_PACK_WINDOW-1)] = mf->head[h];
+    mf->head[h] = pos;
+}
+
+/**
+ * Finds the longest match for given position in previous data.
+ * @param mf The match finder.
+ * @param pos Position in data for which the match is searched.
+ * @param dist Output variable for the match distance.
+ * @return Returns the match length, or 0 if no match was found.
+ */
+static unsigned long match_find (const match_finder *mf, unsigned long pos,
+    unsigned long *dist)
+{
+    const unsigned char *cur = mf->data+pos;
+    const unsigned char *cmp;
+    unsigned long max_len, best_len, n;
+    long cand, next;
+    int chain;
+
+    if (pos+RNC_PACK_MIN_MATCH > mf->len)
+        return 0;
+    max_len = min(mf->len-pos, RNC_PACK_MAX_MATCH);
+    best_len = RNC_PACK_MIN_MATCH-1;
+    chain = mf->max_chain;
+    cand = mf->head[match_hash(cur)];
+    while ((cand >= 0) && (pos-cand <= RNC_PACK_WINDOW) && (chain > 0))
+    {
+        cmp = mf->data+cand;
+        if ((cmp[best_len] == cur[best_len]) && (cmp[0] == cur[0]))
+        {
+            n = 1;
+            while ((n < max_len) && (cmp[n] == cur[n]))
+                n++;
+            if (n > best_len)
+            {
+                best_len = n;
+                (*dist) = pos-cand;
+                if ((n >= mf->nice_len) || (n >= max_len))
+                    break;
+            }
+        }
+        /* Entries older than the window could be overwritten */
+        next = mf->prev[cand & (RNC_PACK_WINDOW-1)];
+        if (next >= cand)
+            break;
+        cand = next;
+        chain--;
+    }
+    if (best_len < RNC_PACK_MIN_MATCH)
+        return 0;
+    return best_len;
+}
+
+/**
+ * Mirror the bottom n bits of x.
+ * @param n Amount of bits to mirror.
+ * @param x The data to mirror.
+ * @return The value of x with proper bits mirrored.
+ */
+static unsigned long mirror (unsigned long x, int n)
+{
+    unsigned long top = 1 << (n-1), bottom = 1;
+    while (top > bottom)
+    {
+        unsigned long mask = top | bottom;
+        unsigned long masked = x & mask;
+        if (masked != 0 && masked != mask)
+            x ^= mask;
+        top >>= 1;
+        bottom <<= 1;
+    }
+    return x;
+}
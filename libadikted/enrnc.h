@@ -0,0 +1,47 @@
+/******************************************************************************/
+/** @file enrnc.h
+ * RNC compression support.
+ * @par Purpose:
+ *     Header file. Defines exported routines from enrnc.c.
+ * @par Comment:
+ *     None.
+ * @date     17 Oct 2026
+ * @par  Copying and copyrights:
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ */
+/******************************************************************************/
+
+#ifndef RNC_ENRNC_H
+#define RNC_ENRNC_H
+
+#include "dernc.h"
+
+/**
+ * Compression levels. Level 0 only stores the data, higher levels
+ * search longer for matches; they're slower, but give smaller files.
+ */
+#define RNC_PACK_LEVEL_STORE    0
+#define RNC_PACK_LEVEL_DEFAULT  6
+#define RNC_PACK_LEVEL_MAX      9
+
+/**
+ * Amount of unpacked bytes compressed in one chunk
+ * (one set of Huffman tables).
+ */
+#define RNC_PACK_CHUNK_SIZE 0x3000
+
+/**
+ * Size of buffer which is always enough for compressed data,
+ * including RNC header, for given unpacked length.
+ */
+#define RNC_PACK_BOUND(len) (SIZEOF_RNC_HEADER+(len)+((len)/RNC_PACK_CHUNK_SIZE+1)*20+16)
+
+/*
+ * Routines
+ */
+long rnc_pack (const void *unpacked, unsigned long ulen, void *packed, int level);
+
+#endif
@@ -34,6 +34,9 @@
 #if !defined(stricmp)
 #define stricmp strcasecmp
 #endif
+#if !defined(strnicmp)
+#define strnicmp strncasecmp
+#endif
 #elif defined(MSDOS)
 #include <dos.h>
 #include <process.h>
@@ -47,6 +50,13 @@
 # define DLLIMPORT __declspec (dllimport)
 #endif
 
+/* Variables which have separate instance in every thread */
+#if defined(_MSC_VER)
+# define THREAD_LOCAL __declspec (thread)
+#else
+# define THREAD_LOCAL __thread
+#endif
+
 /* Basic Definitions */
 
 #if defined(unix) && !defined (GO32)
@@ -133,6 +143,8 @@ struct MAPDRAW_OPTIONS {
     short bmfonts;
     short tngflags;
     char *data_path;
+    /* Amount of threads used for drawing whole map bitmap */
+    short threads;
 };
 
 struct VERIFY_OPTIONS {
@@ -154,6 +166,17 @@ struct LEVOPTIONS {
     short datclm_auto_update;
     /* True means TNG/LGT/APTs are updated automatically */
     short obj_auto_update;
+    /* Amount of threads used when updating DAT/CLM for whole map */
+    short datclm_threads;
+    /* Amount of threads used for reading files when loading map */
+    short load_threads;
+    /* RNC compression level used when saving map files */
+    short save_pack_level;
+    /* Map files which are compressed when saving; MFPACK_* flags */
+    unsigned int save_pack_files;
+    /* True means the compiled script (SCC) is saved with the map, */
+    /* to speed up loading it next time */
+    short save_compiled_script;
     /* File handling variables */
     char *levels_path;
     char *data_path;
@@ -0,0 +1,126 @@
+/******************************************************************************/
+/** @file lbcontext.c
+ * Library state which is kept separately for every context.
+ * @par Purpose:
+ *     Creating contexts and binding them to threads.
+ * @par Comment:
+ *     Allows processing independent levels in parallel, in one process.
+ * @date     17 Oct 2026
+ * @par  Copying and copyrights:
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ */
+/******************************************************************************/
+
+#include "lbcontext.h"
+
+#include "globals.h"
+
+/* Context used by threads which have no context bound */
+struct ADIKT_CONTEXT default_context={NULL,NULL,false,0,NULL,false,1,NULL,NULL};
+/* Context bound to the current thread */
+THREAD_LOCAL struct ADIKT_CONTEXT *bound_context=NULL;
+
+/**
+ * Creates new context. The context has no message log file, and its
+ * random number generator is independent from rand().
+ * @param ctx Double pointer to the ADIKT_CONTEXT structure.
+ * @return Returns true on success, false on error.
+ */
+short adikt_context_new(struct ADIKT_CONTEXT **ctx)
+{
+    (*ctx)=(struct ADIKT_CONTEXT *)malloc(sizeof(struct ADIKT_CONTEXT));
+    if ((*ctx)==NULL)
+        return false;
+    (*ctx)->message_prv=NULL;
+    (*ctx)->message=NULL;
+    (*ctx)->message_hold=false;
+    (*ctx)->message_getcount=0;
+    (*ctx)->msgout_fname=NULL;
+    (*ctx)->rnd_own=true;
+    (*ctx)->rnd_seed=1;
+    (*ctx)->strword_text=NULL;
+    (*ctx)->draw_data=NULL;
+    return true;
+}
+
+/**
+ * Creates new context for work done on behalf of another context,
+ * ie. in a worker thread. The new context logs messages into the same
+ * file as the parent one, but has its own messages and random generator.
+ * @param ctx Double pointer to the ADIKT_CONTEXT structure.
+ * @param parent The context whose log file is used.
+ * @return Returns true on success, false on error.
+ */
+short adikt_context_new_child(struct ADIKT_CONTEXT **ctx,const struct ADIKT_CONTEXT *parent)
+{
+    if (!adikt_context_new(ctx))
+        return false;
+    if (parent->msgout_fname!=NULL)
+    {
+        (*ctx)->msgout_fname=strdup(parent->msgout_fname);
+        if ((*ctx)->msgout_fname==NULL)
+        {
+            adikt_context_free(ctx);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Frees the context and its messages. The context can't be bound
+ * to any thread when it is freed.
+ * @param ctx Double pointer to the ADIKT_CONTEXT structure.
+ */
+void adikt_context_free(struct ADIKT_CONTEXT **ctx)
+{
+    if ((*ctx)==NULL) return;
+    if (bound_context==(*ctx))
+        bound_context=NULL;
+    free((*ctx)->message_prv);
+    free((*ctx)->message);
+    free((*ctx)->msgout_fname);
+    free(*ctx);
+    (*ctx)=NULL;
+}
+
+/**
+ * Binds the context to the current thread. All library functions
+ * called by the thread will use it from now on.
+ * @param ctx The context to bind, or NULL to use the default context.
+ * @return Returns previously bound context (NULL if it was the default one).
+ */
+struct ADIKT_CONTEXT *adikt_context_bind(struct ADIKT_CONTEXT *ctx)
+{
+    struct ADIKT_CONTEXT *prev_ctx=bound_context;
+    if (ctx==&default_context)
+        ctx=NULL;
+    bound_context=ctx;
+    return prev_ctx;
+}
+
+/**
+ * Returns the context used by the current thread.
+ * @return Returns the bound context, or the default one.
+ */
+struct ADIKT_CONTEXT *adikt_context_get(void)
+{
+    if (bound_context!=NULL)
+        return bound_context;
+    return &default_context;
+}
+
+/**
+ * Seeds the context random number generator. If the context was using
+ * rand(), it starts using its own generator.
+ * @param ctx Pointer to the ADIKT_CONTEXT structure.
+ * @param seed The new random seed.
+ */
+void adikt_context_srand(struct ADIKT_CONTEXT *ctx,unsigned long seed)
+{
+    ctx->rnd_own=true;
+    ctx->rnd_seed=seed;
+}
@@ -0,0 +1,53 @@
+/******************************************************************************/
+/** @file lbcontext.h
+ * Library state which is kept separately for every context.
+ * @par Purpose:
+ *     Header file. Defines exported routines from lbcontext.c
+ * @par Comment:
+ *     None.
+ * @date     17 Oct 2026
+ * @par  Copying and copyrights:
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ */
+/******************************************************************************/
+
+#ifndef ADIKT_LBCONTEXT_H
+#define ADIKT_LBCONTEXT_H
+
+#include "globals.h"
+
+struct MAPDRAW_DATA;
+
+/**
+ * State of the library which would otherwise be global.
+ * Every thread uses the context bound to it; threads without bound
+ * context share the default one. Levels processed in separate threads
+ * should each use its own context (see level_bind_context()).
+ */
+struct ADIKT_CONTEXT {
+    /* Message log */
+    char *message_prv;
+    char *message;
+    short message_hold;
+    unsigned int message_getcount;
+    char *msgout_fname;
+    /* Random number generator; if rnd_own is false, rand() is used */
+    short rnd_own;
+    unsigned long rnd_seed;
+    /* Script tokenizer position */
+    const char *strword_text;
+    /* Map drawing data used by mdrand_g8() */
+    struct MAPDRAW_DATA *draw_data;
+  };
+
+DLLIMPORT short adikt_context_new(struct ADIKT_CONTEXT **ctx);
+DLLIMPORT short adikt_context_new_child(struct ADIKT_CONTEXT **ctx,const struct ADIKT_CONTEXT *parent);
+DLLIMPORT void adikt_context_free(struct ADIKT_CONTEXT **ctx);
+DLLIMPORT struct ADIKT_CONTEXT *adikt_context_bind(struct ADIKT_CONTEXT *ctx);
+DLLIMPORT struct ADIKT_CONTEXT *adikt_context_get(void);
+DLLIMPORT void adikt_context_srand(struct ADIKT_CONTEXT *ctx,unsigned long seed);
+
+#endif /* ADIKT_LBCONTEXT_H */
@@ -0,0 +1,165 @@
+/******************************************************************************/
+/** @file lbthreads.c
+ * Library for running work in several threads.
+ * @par Purpose:
+ *   Runs a function in several threads and waits for all of them to finish.
+ * @par Comment:
+ *   Uses Win32 threads on Windows, and POSIX threads everywhere else.
+ * @date     17 Oct 2026
+ * @par  Copying and copyrights:
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ */
+/******************************************************************************/
+
+#include "lbthreads.h"
+
+#include "lbcontext.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#if defined(_WIN32)
+static volatile LONG lbthreads_locked=0;
+#else
+static pthread_mutex_t lbthreads_mutex=PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+struct LBTHREAD_START {
+    lbthread_func func;
+    void *param;
+    /* Context bound to the thread for the time of the call */
+    struct ADIKT_CONTEXT *ctx;
+};
+
+/*
+ * Makes one call, with its own context bound to the current thread.
+ */
+static void lbthread_call(struct LBTHREAD_START *start)
+{
+    struct ADIKT_CONTEXT *prev_ctx=adikt_context_bind(start->ctx);
+    start->func(start->param);
+    adikt_context_bind(prev_ctx);
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI lbthread_start(LPVOID arg)
+#else
+static void *lbthread_start(void *arg)
+#endif
+{
+    lbthread_call((struct LBTHREAD_START *)arg);
+    return 0;
+}
+
+/*
+ * Runs given function once for every parameter, each call in separate
+ * thread, and returns when all the calls are finished. The last call
+ * is made by the calling thread. If a thread can't be created,
+ * its call is made by the calling thread as well.
+ * Every call is made with its own ADIKT_CONTEXT, which logs to the same
+ * file as the context of the calling thread. Calls above the threads
+ * limit, and all calls if the contexts can't be created, are made serially
+ * with the context of the calling thread.
+ * Returns 1 if all threads were created, 0 if any call was made serially.
+ */
+short lbthreads_run(lbthread_func func, void **params, int count)
+{
+    struct LBTHREAD_START start[LBTHREADS_MAX_COUNT];
+#if defined(_WIN32)
+    HANDLE thread[LBTHREADS_MAX_COUNT];
+#else
+    pthread_t thread[LBTHREADS_MAX_COUNT];
+#endif
+    short created[LBTHREADS_MAX_COUNT];
+    short result=1;
+    int threads_count;
+    int i;
+    if (count<1) return 1;
+    /* Calls above the threads limit are made by the calling thread */
+    for (i=LBTHREADS_MAX_COUNT-1;i<count-1;i++)
+        func(params[i]);
+    threads_count=count;
+    if (threads_count>LBTHREADS_MAX_COUNT)
+        threads_count=LBTHREADS_MAX_COUNT;
+    struct ADIKT_CONTEXT *parent_ctx=adikt_context_get();
+    for (i=0;i<threads_count;i++)
+    {
+        start[i].func=func;
+        start[i].param=params[(i<threads_count-1)?i:count-1];
+        if (!adikt_context_new_child(&start[i].ctx,parent_ctx))
+            break;
+    }
+    /* Without own contexts, the calls can't be run concurrently */
+    if (i<threads_count)
+    {
+        while (i>0)
+        {
+            i--;
+            adikt_context_free(&start[i].ctx);
+        }
+        for (i=0;i<threads_count-1;i++)
+            func(params[i]);
+        func(params[count-1]);
+        return 0;
+    }
+    for (i=0;i<threads_count-1;i++)
+    {
+#if defined(_WIN32)
+        thread[i]=CreateThread(NULL,0,lbthread_start,&start[i],0,NULL);
+        created[i]=(thread[i]!=NULL);
+#else
+        created[i]=(pthread_create(&thread[i],NULL,lbthread_start,&start[i])==0);
+#endif
+        if (!created[i])
+        {
+            lbthread_call(&start[i]);
+            result=0;
+        }
+    }
+    lbthread_call(&start[threads_count-1]);
+    for (i=0;i<threads_count-1;i++)
+    {
+        if (!created[i]) continue;
+#if defined(_WIN32)
+        WaitForSingleObject(thread[i],INFINITE);
+        CloseHandle(thread[i]);
+#else
+        pthread_join(thread[i],NULL);
+#endif
+    }
+    for (i=0;i<threads_count;i++)
+        adikt_context_free(&start[i].ctx);
+    return result;
+}
+
+/*
+ * Acquires the library-wide lock, which guards data shared between
+ * threads. The lock is not recursive, and should be held only briefly.
+ */
+void lbthreads_lock(void)
+{
+#if defined(_WIN32)
+    while (InterlockedCompareExchange(&lbthreads_locked,1,0)!=0)
+        Sleep(0);
+#else
+    pthread_mutex_lock(&lbthreads_mutex);
+#endif
+}
+
+/*
+ * Releases the library-wide lock acquired by lbthreads_lock().
+ */
+void lbthreads_unlock(void)
+{
+#if defined(_WIN32)
+    InterlockedExchange(&lbthreads_locked,0);
+#else
+    pthread_mutex_unlock(&lbthreads_mutex);
+#endif
+}
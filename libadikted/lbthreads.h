@@ -0,0 +1,31 @@
+/******************************************************************************/
+/** @file lbthreads.h
+ * Library for running work in several threads.
+ * @par Purpose:
+ *     Header file. Defines exported routines from lbthreads.c
+ * @par Comment:
+ *     Only the simplest fork-join model is supported.
+ * @date     17 Oct 2026
+ * @par  Copying and copyrights:
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ */
+/******************************************************************************/
+
+#ifndef LBTHREADS_H
+#define LBTHREADS_H
+
+/* Maximal amount of threads which can be run at once */
+#define LBTHREADS_MAX_COUNT 64
+
+typedef void (*lbthread_func)(void *param);
+
+/* Routines */
+
+short lbthreads_run(lbthread_func func, void **params, int count);
+void lbthreads_lock(void);
+void lbthreads_unlock(void);
+
+#endif
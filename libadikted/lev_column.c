@@ -26,6 +26,27 @@
 #include "obj_things.h"
 #include "graffiti.h"
 #include "msg_log.h"
+#include "bulcommn.h"
+#include "lbthreads.h"
+
+/* States of tiles generated in parallel DAT/CLM update */
+#define DATCLM_TILE_READY  0
+#define DATCLM_TILE_SERIAL 1
+
+/**
+ * Parameters of a thread used in parallel DAT/CLM update.
+ * Every thread works on a band of tile rows, and keeps the generated
+ * columns in its own buffers.
+ */
+struct DATCLM_THREAD_PARAMS {
+    struct LEVEL *lvl;
+    int ty_first;
+    int ty_last;
+    /* Generated columns, 9 for every tile of the band */
+    struct COLUMN_REC *clm_recs;
+    /* State of every tile of the band */
+    unsigned char *tile_state;
+};
 
 char const INF_STANDARD_LTEXT[]="Standard";
 char const INF_ANCIENT_LTEXT[]="Ancient";
@@ -61,8 +82,12 @@ void set_clm(struct LEVEL *lvl, int num, unsigned int use, int base,
     clmentry = (unsigned char *)(lvl->clm[num]);
     clm_rec=create_column_rec();
     fill_column_rec_sim(clm_rec,use, base, c0, c1, c2, c3, c4, c5, c6, c7);
+    clm_hash_remove(lvl,num);
     set_clm_entry(clmentry, clm_rec);
+    clm_hash_add(lvl,num);
     free_column_rec(clm_rec);
+    /* The column may be used anywhere on the map */
+    level_mark_map_changed(lvl);
 }
 
 /**
@@ -88,8 +113,12 @@ void set_clm_ent_idx(struct LEVEL *lvl,int num, unsigned int use, int permanent,
     clm_rec=create_column_rec();
     fill_column_rec(clm_rec,use, permanent, lintel, height, solid,
              base, orientation, c0, c1, c2, c3, c4, c5, c6, c7);
+    clm_hash_remove(lvl,num);
     set_clm_entry(clmentry, clm_rec);
+    clm_hash_add(lvl,num);
     free_column_rec(clm_rec);
+    /* The column may be used anywhere on the map */
+    level_mark_map_changed(lvl);
 }
 
 /**
@@ -105,22 +134,10 @@ void set_clm_ent_idx(struct LEVEL *lvl,int num, unsigned int use, int permanent,
 int column_find_or_create(struct LEVEL *lvl,struct COLUMN_REC *clm_rec)
 {
   if (clm_rec==NULL) return 0;
-  int num=-1;
+  int num;
   unsigned char *clmentry;
   /* Search for column identical to the one we want */
-  struct COLUMN_REC *clm_rec2;
-  clm_rec2=create_column_rec();
-  for (num=0;num<COLUMN_ENTRIES;num++)
-  {
-      if (clm_entry_is_used(lvl,num))
-      {
-        clmentry = (unsigned char *)(lvl->clm[num]);
-        get_clm_entry(clm_rec2, clmentry);
-        if (compare_column_recs(clm_rec,clm_rec2))
-          break;
-      }
-  }
-  free_column_rec(clm_rec2);
+  num=column_find(lvl,clm_rec);
   /* If no identical column, then create one */
   if ((num<0)||(num>=COLUMN_ENTRIES))
   {
@@ -129,6 +146,8 @@ int column_find_or_create(struct LEVEL *lvl,struct COLUMN_REC *clm_rec)
       {
          clmentry = (unsigned char *)(lvl->clm[num]);
          set_clm_entry(clmentry, clm_rec);
+         clm_hash_remove(lvl,num);
+         clm_hash_add(lvl,num);
       }
   }
   /* Sometimes we may not find the free entry... */
@@ -143,6 +162,120 @@ int column_find_or_create(struct LEVEL *lvl,struct COLUMN_REC *clm_rec)
   return num;
 }
 
+/**
+ * Searches CLM structure for given column.
+ * Uses the CLM hash index; rebuilds the index if it is not valid.
+ * @param lvl Pointer to the LEVEL structure.
+ * @param clm_rec Pointer at searched column.
+ * @return Returns lowest index of used column which consists of cubes
+ *     identical to those from clm_rec parameter, or -1 if not found.
+ */
+int column_find(struct LEVEL *lvl,struct COLUMN_REC *clm_rec)
+{
+  if (clm_rec==NULL) return -1;
+  if (!lvl->clm_hash_valid)
+    clm_hash_rebuild(lvl);
+  struct COLUMN_REC clm_rec2;
+  int bucket;
+  bucket=compute_clm_rec_hash(clm_rec)&(CLM_HASH_BUCKETS-1);
+  int found=-1;
+  int num;
+  for (num=lvl->clm_hash_head[bucket];num>=0;num=lvl->clm_hash_next[num])
+  {
+      if ((found>=0)&&(num>found))
+        continue;
+      if (!clm_entry_is_used(lvl,num))
+        continue;
+      get_clm_entry(&clm_rec2, lvl->clm[num]);
+      if (compare_column_recs(clm_rec,&clm_rec2))
+        found=num;
+  }
+  return found;
+}
+
+/**
+ * Marks the CLM hash index as invalid. It will be rebuilt when
+ * needed. Should be called after CLM entries were changed
+ * without using the lev_column.c functions, ie. after loading.
+ * @param lvl Pointer to the LEVEL structure.
+ */
+void clm_hash_invalidate(struct LEVEL *lvl)
+{
+  lvl->clm_hash_valid=false;
+}
+
+/**
+ * Recreates the CLM hash index from scratch.
+ * All used column entries are placed in the index.
+ * @param lvl Pointer to the LEVEL structure.
+ */
+void clm_hash_rebuild(struct LEVEL *lvl)
+{
+  int i;
+  for (i=0;i<CLM_HASH_BUCKETS;i++)
+    lvl->clm_hash_head[i]=-1;
+  for (i=0;i<COLUMN_ENTRIES;i++)
+  {
+    lvl->clm_hash_next[i]=-1;
+    lvl->clm_hash_bucket[i]=-1;
+  }
+  lvl->clm_hash_valid=true;
+  for (i=0;i<COLUMN_ENTRIES;i++)
+  {
+    if (clm_entry_is_used(lvl,i))
+      clm_hash_add(lvl,i);
+  }
+}
+
+/**
+ * Adds column of given index to the CLM hash index.
+ * Does nothing if the column is already indexed, or if the index
+ * is invalid (it will be rebuilt anyway).
+ * @param lvl Pointer to the LEVEL structure.
+ * @param clmidx Column index.
+ */
+void clm_hash_add(struct LEVEL *lvl, int clmidx)
+{
+  if ((clmidx<0)||(clmidx>=COLUMN_ENTRIES))
+    return;
+  if ((!lvl->clm_hash_valid)||(lvl->clm_hash_bucket[clmidx]>=0))
+    return;
+  struct COLUMN_REC clm_rec;
+  get_clm_entry(&clm_rec, lvl->clm[clmidx]);
+  int bucket;
+  bucket=compute_clm_rec_hash(&clm_rec)&(CLM_HASH_BUCKETS-1);
+  lvl->clm_hash_next[clmidx]=lvl->clm_hash_head[bucket];
+  lvl->clm_hash_head[bucket]=clmidx;
+  lvl->clm_hash_bucket[clmidx]=bucket;
+}
+
+/**
+ * Removes column of given index from the CLM hash index.
+ * Should be called before the column entry content is changed.
+ * @param lvl Pointer to the LEVEL structure.
+ * @param clmidx Column index.
+ */
+void clm_hash_remove(struct LEVEL *lvl, int clmidx)
+{
+  if ((clmidx<0)||(clmidx>=COLUMN_ENTRIES))
+    return;
+  if ((!lvl->clm_hash_valid)||(lvl->clm_hash_bucket[clmidx]<0))
+    return;
+  int *prev;
+  prev=&(lvl->clm_hash_head[lvl->clm_hash_bucket[clmidx]]);
+  while (*prev>=0)
+  {
+    if (*prev==clmidx)
+    {
+      *prev=lvl->clm_hash_next[clmidx];
+      break;
+    }
+    prev=&(lvl->clm_hash_next[*prev]);
+  }
+  lvl->clm_hash_next[clmidx]=-1;
+  lvl->clm_hash_bucket[clmidx]=-1;
+}
+
 /**
  * Tries to find unused entry in CLM structure and returns its index.
  * @param lvl Pointer to the LEVEL structure.
@@ -162,6 +295,28 @@ int column_get_free_index(struct LEVEL *lvl)
   return -1;
 }
 
+/**
+ * Retrieves counters of the column generation cache.
+ * Hits are slabs for which the columns were taken from the cache,
+ * misses are the ones which required generating; uncacheable misses
+ * are the slabs whose columns were generated using random numbers.
+ * @param lvl Pointer to the LEVEL structure.
+ * @param hits Amount of cache hits is returned here.
+ * @param misses Amount of cache misses is returned here.
+ * @param uncacheable Amount of uncacheable misses is returned here.
+ * @return Returns true on success, false if there is no cache.
+ */
+short get_clm_gencache_stats(const struct LEVEL *lvl,unsigned long *hits,
+        unsigned long *misses,unsigned long *uncacheable)
+{
+  if ((lvl==NULL)||(lvl->clm_gen_cache==NULL))
+      return false;
+  (*hits)=lvl->clm_gen_cache->hits;
+  (*misses)=lvl->clm_gen_cache->misses;
+  (*uncacheable)=lvl->clm_gen_cache->uncacheable;
+  return true;
+}
+
 /**
  * Updates DAT, CLM and w?b entries for the whole map. All tiles
  * and subtiles are reset. Additionally, USE values in columns
@@ -170,6 +325,11 @@ int column_get_free_index(struct LEVEL *lvl)
  */
 void update_datclm_for_whole_map(struct LEVEL *lvl)
 {
+    if (lvl->optns.datclm_threads>1)
+    {
+        if (update_datclm_for_whole_map_parallel(lvl,lvl->optns.datclm_threads))
+            return;
+    }
     /*Filling CLM entries with unused, zero-filled ones */
     /*message_log(" update_datclm_for_whole_map: Started"); */
     level_clear_datclm(lvl);
@@ -200,6 +360,162 @@ void update_datclm_for_whole_map(struct LEVEL *lvl)
     update_clm_utilize_counters(lvl);
 }
 
+/**
+ * Generates columns for a band of tiles. Used as thread function
+ * in parallel DAT/CLM update; the LEVEL structure is only read.
+ * Tiles with custom columns, and tiles which require random numbers
+ * to generate, are marked for serial generation.
+ * @param param Pointer to DATCLM_THREAD_PARAMS structure.
+ */
+void update_datclm_band_generate(void *param)
+{
+    struct DATCLM_THREAD_PARAMS *thparam=(struct DATCLM_THREAD_PARAMS *)param;
+    struct LEVEL *lvl=thparam->lvl;
+    unsigned char surr_slb[9];
+    unsigned char surr_own[9];
+    unsigned char *surr_tng[9];
+    struct COLUMN_REC *clm_recs[9];
+    short prev_dry_run=rnd_set_dry_run(true);
+    int i,k,n;
+    for (k=thparam->ty_first;k<=thparam->ty_last;k++)
+      for (i=0;i<lvl->tlsize.x;i++)
+      {
+          int tile_idx=(k-thparam->ty_first)*lvl->tlsize.x+i;
+          if (slab_has_custom_columns(lvl, i, k))
+          {
+              thparam->tile_state[tile_idx]=DATCLM_TILE_SERIAL;
+              continue;
+          }
+          get_slab_surround(surr_slb,surr_own,surr_tng,lvl,i,k);
+          for (n=0;n<9;n++)
+          {
+              clm_recs[n]=&(thparam->clm_recs[tile_idx*9+n]);
+              fill_column_rec(clm_recs[n], 0, 0, 0, 0, 0, 0, 0,
+                  0, 0, 0, 0, 0, 0, 0, 0);
+          }
+          unsigned long rnd_count=get_rnd_calls_count();
+          create_columns_for_slab(clm_recs,&(lvl->optns),surr_slb,surr_own,surr_tng);
+          if (get_rnd_calls_count()!=rnd_count)
+              thparam->tile_state[tile_idx]=DATCLM_TILE_SERIAL;
+          else
+              thparam->tile_state[tile_idx]=DATCLM_TILE_READY;
+      }
+    rnd_set_dry_run(prev_dry_run);
+}
+
+/**
+ * Updates WIB, WLB and FLG entries for a band of tiles.
+ * Used as thread function in parallel DAT/CLM update.
+ * @param param Pointer to DATCLM_THREAD_PARAMS structure.
+ */
+void update_datclm_band_wibflg(void *param)
+{
+    struct DATCLM_THREAD_PARAMS *thparam=(struct DATCLM_THREAD_PARAMS *)param;
+    struct LEVEL *lvl=thparam->lvl;
+    int i,k;
+    for (k=thparam->ty_first;k<=thparam->ty_last;k++)
+      for (i=0;i<lvl->tlsize.x;i++)
+      {
+          update_tile_wib_entries(lvl,i,k);
+          update_tile_wlb_entry(lvl,i,k);
+          update_tile_flg_entries(lvl,i,k);
+      }
+}
+
+/**
+ * Updates DAT, CLM and w?b entries for the whole map, using several threads.
+ * Columns are generated concurrently for bands of tile rows; then they're
+ * merged into CLM in the same order as in the serial update, so that
+ * the result is identical. Slabs which use random numbers for their
+ * columns are generated during the merge, to keep random values unchanged.
+ * @see update_datclm_for_whole_map
+ * @param lvl Pointer to the LEVEL structure.
+ * @param threads_count Amount of threads to use.
+ * @return Returns true on success, false if there was not enough memory
+ *     (the map is not updated then).
+ */
+short update_datclm_for_whole_map_parallel(struct LEVEL *lvl,int threads_count)
+{
+    struct DATCLM_THREAD_PARAMS *thparams;
+    void *params[LBTHREADS_MAX_COUNT];
+    int band_rows;
+    int i,k,n;
+    if (threads_count>LBTHREADS_MAX_COUNT)
+        threads_count=LBTHREADS_MAX_COUNT;
+    if (threads_count>lvl->tlsize.y)
+        threads_count=lvl->tlsize.y;
+    if (threads_count<1)
+        threads_count=1;
+    band_rows=(lvl->tlsize.y+threads_count-1)/threads_count;
+    threads_count=(lvl->tlsize.y+band_rows-1)/band_rows;
+    thparams=(struct DATCLM_THREAD_PARAMS *)malloc(threads_count*sizeof(struct DATCLM_THREAD_PARAMS));
+    if (thparams==NULL)
+    {
+        message_error("update_datclm_for_whole_map_parallel: Cannot allocate memory");
+        return false;
+    }
+    short alloc_ok=true;
+    for (n=0;n<threads_count;n++)
+    {
+        thparams[n].lvl=lvl;
+        thparams[n].ty_first=n*band_rows;
+        thparams[n].ty_last=min((n+1)*band_rows,lvl->tlsize.y)-1;
+        int band_tiles=(thparams[n].ty_last-thparams[n].ty_first+1)*lvl->tlsize.x;
+        thparams[n].clm_recs=(struct COLUMN_REC *)malloc(band_tiles*9*sizeof(struct COLUMN_REC));
+        thparams[n].tile_state=(unsigned char *)malloc(band_tiles*sizeof(unsigned char));
+        if ((thparams[n].clm_recs==NULL)||(thparams[n].tile_state==NULL))
+            alloc_ok=false;
+        params[n]=&thparams[n];
+    }
+    if (!alloc_ok)
+    {
+        message_error("update_datclm_for_whole_map_parallel: Cannot allocate column buffers");
+        for (n=0;n<threads_count;n++)
+        {
+            free(thparams[n].clm_recs);
+            free(thparams[n].tile_state);
+        }
+        free(thparams);
+        return false;
+    }
+    /*Filling CLM entries with unused, zero-filled ones */
+    level_clear_datclm(lvl);
+    add_permanent_columns(lvl);
+    /*Generating columns in threads */
+    lbthreads_run(update_datclm_band_generate,params,threads_count);
+    /*Merging columns into CLM, in the same order as serial update */
+    for (k=0;k<lvl->tlsize.y;k++)
+    {
+      struct DATCLM_THREAD_PARAMS *thparam=&thparams[k/band_rows];
+      for (i=0;i<lvl->tlsize.x;i++)
+      {
+          int tile_idx=(k-thparam->ty_first)*lvl->tlsize.x+i;
+          if (thparam->tile_state[tile_idx]==DATCLM_TILE_SERIAL)
+          {
+              update_datclm_for_slab(lvl, i, k);
+          } else
+          {
+              struct COLUMN_REC *clm_recs[9];
+              for (n=0;n<9;n++)
+                clm_recs[n]=&(thparam->clm_recs[tile_idx*9+n]);
+              set_new_datclm_values(lvl, i, k, clm_recs);
+          }
+      }
+    }
+    for (n=0;n<threads_count;n++)
+    {
+        free(thparams[n].clm_recs);
+        free(thparams[n].tile_state);
+    }
+    /*Setting the 'last column' entries */
+    update_dat_last_column(lvl,SLAB_TYPE_ROCK);
+    /* updating WIB, WLB and FLG entries */
+    lbthreads_run(update_datclm_band_wibflg,params,threads_count);
+    free(thparams);
+    update_clm_utilize_counters(lvl);
+    return true;
+}
+
 /**
  * Updates DAT, CLM and w?b entries for given tile and around it.
  * Updates map tile at given coordinates, and also enties
@@ -293,7 +609,7 @@ void update_datclm_for_slab(struct LEVEL *lvl, int tx, int ty)
   struct COLUMN_REC *clm_recs[9];
   for (i=0;i<9;i++)
     clm_recs[i]=create_column_rec();
-  create_columns_for_slab(clm_recs,&(lvl->optns),surr_slb,surr_own,surr_tng);
+  create_columns_for_slab_cached(lvl->clm_gen_cache,clm_recs,&(lvl->optns),surr_slb,surr_own,surr_tng);
   /*Custom columns, and graffiti */
   if (slab_has_custom_columns(lvl, tx, ty))
     update_custom_columns_for_slab(clm_recs,lvl,tx,ty);
@@ -456,6 +772,7 @@ void clm_utilize_dec(struct LEVEL *lvl, int clmidx)
   if ((lvl->clm_utilize[clmidx]<1)&&(get_clm_entry_permanent(clmentry)==0))
   {
     lvl->clm_utilize[clmidx]=0;
+    clm_hash_remove(lvl,clmidx);
     clear_clm_entry(clmentry);
   }
 }
@@ -476,6 +793,8 @@ void clm_utilize_inc(struct LEVEL *lvl, int clmidx)
   clmentry=lvl->clm[clmidx];
   if (clmentry!=NULL)
     clm_entry_use_inc(clmentry);
+  /* The entry may have just became used */
+  clm_hash_add(lvl,clmidx);
 }
 
 /**
@@ -533,14 +852,17 @@ void update_clm_utilize_counters(struct LEVEL *lvl)
       lvl->clm_utilize[clmidx]=0;
   }
   /*Now count "utilize" of all columns */
-  int cx,cy;
-  for (cy=0; cy < lvl->subsize.y; cy++)
-    for (cx=0; cx < lvl->subsize.x; cx++)
-    {
-      clmidx=get_dat_subtile(lvl, cx, cy);
+  unsigned short *dat=get_dat_layer(lvl);
+  unsigned long i;
+  for (i=0; i < lvl->subsize.x*lvl->subsize.y; i++)
+  {
+      /* Same conversion as in get_dat_subtile() */
+      clmidx=(0x10000-dat[i])&0x0ffff;
       if ((clmidx>=0)&&(clmidx<COLUMN_ENTRIES))
         lvl->clm_utilize[clmidx]++;
-    }
+  }
+  /* Set of used columns has changed */
+  clm_hash_invalidate(lvl);
 }
 
 /**
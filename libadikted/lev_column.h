@@ -19,6 +19,8 @@
 #define ADIKT_LEVCOLMN_H
 
 #define INF_MAX_INDEX 7
+/* Amount of buckets in CLM hash index; must be power of 2 */
+#define CLM_HASH_BUCKETS 4096
 
 struct LEVEL;
 struct COLUMN_REC;
@@ -34,7 +36,17 @@ DLLIMPORT void set_clm(struct LEVEL *lvl, int num, unsigned int use, int base,
         int c0, int c1, int c2, int c3, int c4, int c5, int c6, int c7);
 
 DLLIMPORT int column_find_or_create(struct LEVEL *lvl,struct COLUMN_REC *clm_rec);
+DLLIMPORT int column_find(struct LEVEL *lvl,struct COLUMN_REC *clm_rec);
 DLLIMPORT int column_get_free_index(struct LEVEL *lvl);
+
+/* CLM hash index, used for fast columns searching */
+DLLIMPORT void clm_hash_invalidate(struct LEVEL *lvl);
+DLLIMPORT void clm_hash_rebuild(struct LEVEL *lvl);
+void clm_hash_add(struct LEVEL *lvl, int clmidx);
+void clm_hash_remove(struct LEVEL *lvl, int clmidx);
+/* Column generation cache, used to skip generating columns for identical slabs */
+DLLIMPORT short get_clm_gencache_stats(const struct LEVEL *lvl,unsigned long *hits,
+        unsigned long *misses,unsigned long *uncacheable);
 DLLIMPORT short columns_verify(struct LEVEL *lvl, char *err_msg,struct IPOINT_2D *errpt);
 
 DLLIMPORT unsigned int get_dat_subtile(const struct LEVEL *lvl, const unsigned int sx, const unsigned int sy);
@@ -46,6 +58,9 @@ DLLIMPORT short find_dat_entry(const struct LEVEL *lvl, int *sx, int *sy, const
 DLLIMPORT short dat_verify(struct LEVEL *lvl, char *err_msg,struct IPOINT_2D *errpt);
 
 DLLIMPORT void update_datclm_for_whole_map(struct LEVEL *lvl);
+DLLIMPORT short update_datclm_for_whole_map_parallel(struct LEVEL *lvl,int threads_count);
+void update_datclm_band_generate(void *param);
+void update_datclm_band_wibflg(void *param);
 DLLIMPORT void update_datclm_for_square_radius1(struct LEVEL *lvl, int tx, int ty);
 DLLIMPORT void update_datclm_for_square(struct LEVEL *lvl, int tx_first, int tx_last,
     int ty_first, int ty_last);
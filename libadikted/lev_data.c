@@ -28,6 +28,8 @@
 #include "obj_column.h"
 #include "lev_script.h"
 #include "draw_map.h"
+#include "lev_files.h"
+#include "enrnc.h"
 #include "msg_log.h"
 #include "lbfileio.h"
 #include "lev_column.h"
@@ -35,7 +37,10 @@
 #include "lev_things.h"
 #include "obj_actnpts.h"
 #include "bulcommn.h"
+#include "memarena.h"
 #include "arr_utils.h"
+#include "mempool.h"
+#include "lbcontext.h"
 
 const int idir_subtl_x[]={
     0, 1, 2,
@@ -112,96 +117,55 @@ short level_init(struct LEVEL **lvl_ptr,short map_version,struct UPOINT_3D *lvl_
     }
     lvl->clm_hdr=(unsigned char *)malloc(SIZEOF_DK_CLM_HEADER);
     lvl->clm_utilize=(unsigned int *)malloc(COLUMN_ENTRIES*sizeof(unsigned int *));
+    lvl->clm_hash_head=(int *)malloc(CLM_HASH_BUCKETS*sizeof(int));
+    lvl->clm_hash_next=(int *)malloc(COLUMN_ENTRIES*sizeof(int));
+    lvl->clm_hash_bucket=(int *)malloc(COLUMN_ENTRIES*sizeof(int));
+    if ((lvl->clm_hash_head==NULL)||(lvl->clm_hash_next==NULL)||(lvl->clm_hash_bucket==NULL))
+    {
+        message_error("level_init: Cannot alloc clm hash index");
+        return false;
+    }
+    lvl->clm_hash_valid=false;
   }
   { /*allocating SLB structures */
-    int i;
-    lvl->slb = (unsigned short **)malloc(lvl->tlsize.y*sizeof(unsigned short *));
+    lvl->slb = (unsigned short *)malloc(lvl->tlsize.x*lvl->tlsize.y*sizeof(unsigned short));
     if (lvl->slb==NULL)
     {
         message_error("level_init: Cannot alloc slb memory");
         return false;
     }
-    for (i=0; i < lvl->tlsize.y; i++)
-    {
-      lvl->slb[i] = (unsigned short *)malloc(lvl->tlsize.x*sizeof(unsigned short));
-      if (lvl->slb[i]==NULL)
-      {
-        message_error("level_init: Cannot alloc slb entries");
-        return false;
-      }
-    }
   }
   { /*allocating OWN structures */
-    int i;
-    lvl->own = (unsigned char **)malloc(lvl->subsize.y*sizeof(char *));
+    lvl->own = (unsigned char *)malloc(lvl->subsize.x*lvl->subsize.y*sizeof(unsigned char));
     if (lvl->own==NULL)
     {
         message_error("level_init: Cannot alloc own memory");
         return false;
     }
-    for (i=0; i < lvl->subsize.y; i++)
-    {
-      lvl->own[i] = (unsigned char *)malloc(lvl->subsize.x*sizeof(char));
-      if (lvl->own[i]==NULL)
-      {
-        message_error("level_init: Cannot alloc own entries");
-        return false;
-      }
-    }
   }
   { /*allocating DAT structures */
-    lvl->dat= (unsigned short **)malloc(lvl->subsize.y*sizeof(short *));
+    lvl->dat = (unsigned short *)malloc(lvl->subsize.x*lvl->subsize.y*sizeof(unsigned short));
     if (lvl->dat==NULL)
     {
         message_error("level_init: Cannot alloc dat memory");
         return false;
     }
-    int i;
-    for (i=0; i < lvl->subsize.y; i++)
-    {
-      lvl->dat[i]= (unsigned short *)malloc(lvl->subsize.x*sizeof(unsigned short));
-      if (lvl->dat[i]==NULL)
-      {
-        message_error("level_init: Cannot alloc dat entries");
-        return false;
-      }
-    }
   }
   { /*allocating WIB structures */
-    lvl->wib= (unsigned char **)malloc(lvl->subsize.y*sizeof(char *));
+    lvl->wib = (unsigned char *)malloc(lvl->subsize.x*lvl->subsize.y*sizeof(unsigned char));
     if (lvl->wib==NULL)
     {
         message_error("level_init: Cannot alloc wib memory");
         return false;
     }
-    int i;
-    for (i=0; i < lvl->subsize.y; i++)
-    {
-      lvl->wib[i]= (unsigned char *)malloc(lvl->subsize.x*sizeof(char));
-      if (lvl->wib[i]==NULL)
-      {
-        message_error("level_init: Cannot alloc wib entries");
-        return false;
-      }
-    }
   }
   { /*allocating FLG structures */
-    lvl->flg= (unsigned short **)malloc(lvl->subsize.y*sizeof(short *));
+    lvl->flg = (unsigned short *)malloc(lvl->subsize.x*lvl->subsize.y*sizeof(unsigned short));
     if (lvl->flg==NULL)
     {
         message_error("level_init: Cannot alloc flg memory");
         return false;
     }
-    int i;
-    for (i=0; i < lvl->subsize.y; i++)
-    {
-      lvl->flg[i]= (unsigned short *)malloc(lvl->subsize.x*sizeof(unsigned short));
-      if (lvl->flg[i]==NULL)
-      {
-        message_error("level_init: Cannot alloc flg entries");
-        return false;
-      }
-    }
   }
   {
     int i;
@@ -281,22 +245,67 @@ short level_init(struct LEVEL **lvl_ptr,short map_version,struct UPOINT_3D *lvl_
       }
     }
   }
-  { /*Allocating WLB structure */
-    lvl->wlb = (unsigned char **)malloc(lvl->tlsize.y*sizeof(unsigned char *));
+  { /*Allocating WLB structures */
+    lvl->wlb = (unsigned char *)malloc(lvl->tlsize.x*lvl->tlsize.y*sizeof(unsigned char));
     if (lvl->wlb==NULL)
     {
         message_error("level_init: Cannot alloc wlb memory");
         return false;
     }
-    int i;
-    for (i=0; i<lvl->tlsize.y; i++)
+  }
+  { /*Allocating update transaction structures */
+    lvl->update_trans_depth=0;
+    lvl->dirty_tiles=(unsigned char *)malloc(lvl->tlsize.x*lvl->tlsize.y*sizeof(unsigned char));
+    if (lvl->dirty_tiles==NULL)
     {
-      lvl->wlb[i]=(unsigned char *)malloc(lvl->tlsize.x*sizeof(unsigned char));
-      if (lvl->wlb[i]==NULL)
-      {
-        message_error("level_init: Cannot alloc wlb entries");
+        message_error("level_init: Cannot alloc dirty tiles memory");
+        return false;
+    }
+    memset(lvl->dirty_tiles,0,lvl->tlsize.x*lvl->tlsize.y*sizeof(unsigned char));
+  }
+  { /*Allocating modification generations */
+    lvl->mod_gen=0;
+    lvl->map_gen=0;
+    lvl->subtl_gen=(unsigned long *)malloc(lvl->subsize.x*lvl->subsize.y*sizeof(unsigned long));
+    if (lvl->subtl_gen==NULL)
+    {
+        message_error("level_init: Cannot alloc modification generations");
+        return false;
+    }
+    memset(lvl->subtl_gen,0,lvl->subsize.x*lvl->subsize.y*sizeof(unsigned long));
+  }
+  { /*Allocating object search buckets */
+    lvl->bucket_size.x=(lvl->tlsize.x+OBJ_BUCKET_TILES-1)/OBJ_BUCKET_TILES;
+    lvl->bucket_size.y=(lvl->tlsize.y+OBJ_BUCKET_TILES-1)/OBJ_BUCKET_TILES;
+    lvl->tng_bucket_nums=(unsigned int *)malloc(lvl->bucket_size.x*lvl->bucket_size.y*sizeof(unsigned int));
+    lvl->obj_bucket_nums=(unsigned int *)malloc(lvl->bucket_size.x*lvl->bucket_size.y*sizeof(unsigned int));
+    if ((lvl->tng_bucket_nums==NULL) || (lvl->obj_bucket_nums==NULL))
+    {
+        message_error("level_init: Cannot alloc object buckets");
+        return false;
+    }
+  }
+  { /*Allocating column generation cache */
+    if (!clm_gencache_new(&(lvl->clm_gen_cache)))
+    {
+        message_error("level_init: Cannot alloc column generation cache");
+        return false;
+    }
+  }
+  { /*Allocating library context */
+    if (!adikt_context_new(&(lvl->ctx)))
+    {
+        message_error("level_init: Cannot alloc library context");
+        return false;
+    }
+  }
+  { /*Allocating object record pools */
+    if ((!mempool_new(&(lvl->tng_pool),SIZEOF_DK_TNG_REC,256)) ||
+        (!mempool_new(&(lvl->apt_pool),SIZEOF_DK_APT_REC,64)) ||
+        (!mempool_new(&(lvl->lgt_pool),SIZEOF_DK_LGT_REC,64)))
+    {
+        message_error("level_init: Cannot alloc object pools");
         return false;
-      }
     }
   }
   { /* allocating script structures */
@@ -393,6 +402,11 @@ short level_clear_options(struct LEVOPTIONS *optns)
     optns->frail_columns=true;
     optns->datclm_auto_update=true;
     optns->obj_auto_update=true;
+    optns->datclm_threads=1;
+    optns->load_threads=4;
+    optns->save_pack_level=RNC_PACK_LEVEL_DEFAULT;
+    optns->save_pack_files=MFPACK_NONE;
+    optns->save_compiled_script=false;
     optns->levels_path=NULL;
     optns->data_path=NULL;
     optns->load_redundant_objects=true;
@@ -401,6 +415,7 @@ short level_clear_options(struct LEVOPTIONS *optns)
     optns->picture.data_path=NULL;
     optns->picture.bmfonts=BMFONT_DONT_LOAD;
     optns->picture.tngflags=TNGFLG_NONE;
+    optns->picture.threads=4;
     optns->script.level_spaces=4;
     return ERR_NONE;
 }
@@ -480,6 +495,8 @@ short level_clear_tng(struct LEVEL *lvl)
   for (i=0; i<lvl->tlsize.y; i++)
       for (j=0; j<lvl->tlsize.x; j++)
           lvl->tng_apt_lgt_nums[i][j]=0;
+  memset(lvl->tng_bucket_nums,0,lvl->bucket_size.x*lvl->bucket_size.y*sizeof(unsigned int));
+  memset(lvl->obj_bucket_nums,0,lvl->bucket_size.x*lvl->bucket_size.y*sizeof(unsigned int));
 
   /*Clearing related stats variables */
   lvl->stats.hero_gates_count=0;
@@ -573,6 +590,8 @@ short level_clear_datclm(struct LEVEL *lvl)
     clmentry = (unsigned char *)(lvl->clm[0]);
     fill_column_rec_sim(clm_rec,lvl->clm_utilize[0], 0,  0, 0, 0, 0, 0, 0, 0, 0);
     set_clm_entry(clmentry, clm_rec);
+    /* Column contents changed in bulk - the index must be rebuilt */
+    clm_hash_invalidate(lvl);
 
     #if 0
     /* filling with zeros again is now not needed, */
@@ -640,8 +659,9 @@ short level_clear_info(struct LEVEL *lvl)
     lvl->info.ver_rel=0;
     int name_len=strlen(default_map_name)+10;
     char *name_text=malloc(name_len);
+    struct tm creat_tm;
     if (name_text!=NULL)
-        strftime(name_text,name_len, default_map_name, localtime(&(lvl->info.creat_date)) );
+        strftime(name_text,name_len, default_map_name, localtime_safe(&(lvl->info.creat_date),&creat_tm) );
     lvl->info.name_text=name_text;
     lvl->info.desc_text=NULL;
     lvl->info.author_text=NULL;
@@ -660,6 +680,10 @@ short level_clear_script(struct LEVEL *lvl)
     lvl->script.list=NULL;
     lvl->script.txt=NULL;
     lvl->script.lines_count=0;
+    lvl->script.arena=NULL;
+    lvl->script.txt_arena=NULL;
+    lvl->script.verif=NULL;
+    lvl->script.code=NULL;
     /* Zeroing DK_SCRIPT_PARAMETERS struct */
     return level_clear_script_param(&(lvl->script.par));
 }
@@ -736,41 +760,28 @@ short level_clear_other(struct LEVEL *lvl)
     /*const int arr_entries_x=lvl->tlsize.x*MAP_SUBNUM_X;
     const int arr_entries_y=lvl->tlsize.y*MAP_SUBNUM_Y;*/
 
-    int i;
-    for (i=0; i < lvl->tlsize.y; i++)
-    {
-      if (lvl->slb[i]!=NULL)
-        memset(lvl->slb[i],0,lvl->tlsize.x*sizeof(unsigned short));
-    }
-    for (i=0; i < lvl->subsize.y; i++)
-    {
-      if (lvl->own[i]!=NULL)
-        memset(lvl->own[i],PLAYER_UNSET,lvl->subsize.x*sizeof(char));
-    }
-
-    for (i=0; i < lvl->subsize.y; i++)
-    {
-      if (lvl->dat[i]!=NULL)
-        memset(lvl->dat[i],0,lvl->subsize.x*sizeof(unsigned short));
-    }
-
-    for (i=0; i < lvl->subsize.y; i++)
-    {
-      if (lvl->wib[i]!=NULL)
-        memset(lvl->wib[i],COLUMN_WIB_SKEW,lvl->subsize.x*sizeof(char));
-    }
-
-    for (i=0; i < lvl->subsize.y; i++)
-    {
-      if (lvl->flg[i]!=NULL)
-        memset(lvl->flg[i],0,lvl->subsize.x*sizeof(unsigned short));
-    }
-
-    for (i=0; i < lvl->tlsize.y; i++)
-    {
-      if (lvl->wlb[i]!=NULL)
-        memset(lvl->wlb[i],0,lvl->tlsize.x*sizeof(char));
-    }
+    const unsigned int tl_entries=lvl->tlsize.x*lvl->tlsize.y;
+    const unsigned int sub_entries=lvl->subsize.x*lvl->subsize.y;
+    unsigned int i;
+    if (lvl->slb!=NULL)
+      memset(lvl->slb,0,tl_entries*sizeof(unsigned short));
+    if (lvl->own!=NULL)
+      memset(lvl->own,PLAYER_UNSET,sub_entries*sizeof(unsigned char));
+    if (lvl->dat!=NULL)
+      memset(lvl->dat,0,sub_entries*sizeof(unsigned short));
+    if (lvl->wib!=NULL)
+      memset(lvl->wib,COLUMN_WIB_SKEW,sub_entries*sizeof(unsigned char));
+    if (lvl->flg!=NULL)
+      memset(lvl->flg,0,sub_entries*sizeof(unsigned short));
+    if (lvl->wlb!=NULL)
+      memset(lvl->wlb,0,tl_entries*sizeof(unsigned char));
+    /* An open transaction stays open; its owner still has to commit it */
+    if (lvl->update_trans_depth>0)
+      message_log("  level_clear_other: map update transaction is open while clearing");
+    if (lvl->dirty_tiles!=NULL)
+      memset(lvl->dirty_tiles,0,tl_entries*sizeof(unsigned char));
+    clm_gencache_clear(lvl->clm_gen_cache);
+    level_mark_map_changed(lvl);
     
     /* INF file is easy */
     lvl->inf=0x00;
@@ -861,49 +872,19 @@ short level_deinit(struct LEVEL **lvl_ptr)
     const int arr_entries_y=lvl->tlsize.y*MAP_SUBNUM_Y;
 
 /*    message_log(" level_deinit: Freeing SLB structure"); */
-    if (lvl->slb!=NULL)
-    {
-      int i;
-      for (i=0; i<lvl->tlsize.y; i++)
-          free(lvl->slb[i]);
-      free(lvl->slb);
-    }
+    free(lvl->slb);
 
 /*    message_log(" level_deinit: Freeing OWN structure"); */
-    if (lvl->own!=NULL)
-    {
-      int i;
-      for (i=0; i<lvl->subsize.y; i++)
-          free(lvl->own[i]);
-      free(lvl->own);
-    }
+    free(lvl->own);
 
 /*    message_log(" level_deinit: Freeing DAT structure"); */
-    if (lvl->dat!=NULL)
-    {
-      int i;
-      for (i=0; i<lvl->subsize.y; i++)
-          free(lvl->dat[i]);
-      free (lvl->dat);
-    }
+    free(lvl->dat);
 
 /*    message_log(" level_deinit: Freeing WIB structure"); */
-    if (lvl->wib!=NULL)
-    {
-      int i;
-      for (i=0; i<lvl->subsize.y; i++)
-          free(lvl->wib[i]);
-      free (lvl->wib);
-    }
+    free(lvl->wib);
 
 /*    message_log(" level_deinit: Freeing FLG structure"); */
-    if (lvl->flg!=NULL)
-    {
-      int i;
-      for (i=0; i<lvl->subsize.y; i++)
-          free(lvl->flg[i]);
-      free (lvl->flg);
-    }
+    free(lvl->flg);
 
 /*    message_log(" level_deinit: Freeing \"things\" structure"); */
     if (lvl->tng_apt_lgt_nums!=NULL)
@@ -960,6 +941,18 @@ short level_deinit(struct LEVEL **lvl_ptr)
       free(lvl->lgt_subnums);
     }
 
+    free(lvl->tng_bucket_nums);
+    free(lvl->obj_bucket_nums);
+    free(lvl->dirty_tiles);
+    free(lvl->subtl_gen);
+    clm_gencache_free(&(lvl->clm_gen_cache));
+    adikt_context_free(&(lvl->ctx));
+
+/*    message_log(" level_deinit: Freeing object pools"); */
+    mempool_free(&(lvl->tng_pool));
+    mempool_free(&(lvl->apt_pool));
+    mempool_free(&(lvl->lgt_pool));
+
 /*    message_log(" level_deinit: Freeing column structure"); */
     if (lvl->clm!=NULL)
     {
@@ -969,16 +962,13 @@ short level_deinit(struct LEVEL **lvl_ptr)
       free(lvl->clm);
       free(lvl->clm_hdr);
       free(lvl->clm_utilize);
+      free(lvl->clm_hash_head);
+      free(lvl->clm_hash_next);
+      free(lvl->clm_hash_bucket);
     }
 
 /*    message_log(" level_deinit: Freeing WLB structure"); */
-    if (lvl->wlb!=NULL)
-    {
-      int i;
-      for (i=0; i<lvl->tlsize.y; i++)
-          free(lvl->wlb[i]);
-      free(lvl->wlb);
-    }
+    free(lvl->wlb);
 
     level_free_script_param(&(lvl->script.par));
 
@@ -1008,6 +998,20 @@ short level_deinit(struct LEVEL **lvl_ptr)
     return true;
 }
 
+/**
+ * Binds the level context to the current thread. Messages, random numbers
+ * and other library state will be kept in the level context until another
+ * context is bound. Independent levels can be processed in parallel
+ * if every thread binds context of its level.
+ * @param lvl Pointer to the LEVEL structure.
+ * @return Returns previously bound context, to be restored
+ *     with adikt_context_bind().
+ */
+struct ADIKT_CONTEXT *level_bind_context(struct LEVEL *lvl)
+{
+    return adikt_context_bind(lvl->ctx);
+}
+
 /**
  * Frees "things" structure for storing level. Disposes only data pointers,
  * the array structure remains intact (as after level_init(), but values
@@ -1023,17 +1027,31 @@ short level_free_tng(struct LEVEL *lvl)
     /*Freeing object arrays */
     if ((lvl->tng_subnums!=NULL) && (lvl->tng_lookup!=NULL))
     {
-      int cx,cy,k;
+      int cx,cy;
+      unsigned int k;
       for (cx=0; cx<arr_entries_x; cx++)
       {
           for (cy=0; cy<arr_entries_y; cy++)
           {
-            int last_idx=lvl->tng_subnums[cx][cy]-1;
-            for (k=last_idx; k >=0; k--)
-                thing_del(lvl,cx, cy, k);
+            unsigned int obj_num=lvl->tng_subnums[cx][cy];
+            for (k=0; k<obj_num; k++)
+            {
+              unsigned char *obj=lvl->tng_lookup[cx][cy][k];
+              update_thing_stats(lvl,obj,-1);
+              /* Records from the pool are released all at once below */
+              if (!mempool_owns(lvl->tng_pool,obj))
+                  free(obj);
+            }
+            free(lvl->tng_lookup[cx][cy]);
+            lvl->tng_lookup[cx][cy]=NULL;
+            lvl->tng_subnums[cx][cy]=0;
+            lvl->tng_apt_lgt_nums[cx/MAP_SUBNUM_X][cy/MAP_SUBNUM_Y]-=obj_num;
+            update_object_buckets(lvl,cx,cy,OBJECT_TYPE_THING,-(int)obj_num);
           }
       }
+      lvl->tng_total_count=0;
     }
+    mempool_clear(lvl->tng_pool);
   return true;
 }
 
@@ -1052,17 +1070,30 @@ short level_free_apt(struct LEVEL *lvl)
     /*Freeing object arrays */
     if ((lvl->apt_subnums!=NULL) && (lvl->apt_lookup!=NULL))
     {
-      int cx,cy,k;
+      int cx,cy;
+      unsigned int k;
       for (cx=0; cx<arr_entries_x; cx++)
       {
           for (cy=0; cy<arr_entries_y; cy++)
           {
-            int last_idx=lvl->apt_subnums[cx][cy]-1;
-            for (k=last_idx; k >=0; k--)
-                actnpt_del(lvl,cx, cy, k);
+            unsigned int obj_num=lvl->apt_subnums[cx][cy];
+            for (k=0; k<obj_num; k++)
+            {
+              unsigned char *obj=lvl->apt_lookup[cx][cy][k];
+              /* Records from the pool are released all at once below */
+              if (!mempool_owns(lvl->apt_pool,obj))
+                  free(obj);
+            }
+            free(lvl->apt_lookup[cx][cy]);
+            lvl->apt_lookup[cx][cy]=NULL;
+            lvl->apt_subnums[cx][cy]=0;
+            lvl->tng_apt_lgt_nums[cx/MAP_SUBNUM_X][cy/MAP_SUBNUM_Y]-=obj_num;
+            update_object_buckets(lvl,cx,cy,OBJECT_TYPE_ACTNPT,-(int)obj_num);
           }
       }
+      lvl->apt_total_count=0;
     }
+    mempool_clear(lvl->apt_pool);
   return true;
 }
 
@@ -1075,15 +1106,15 @@ short level_free_apt(struct LEVEL *lvl)
  */
 short level_free_txt(struct LEVEL *lvl)
 {
-  int idx=lvl->script.lines_count;
-  while (idx>0)
-  {
-    idx--;
-    free(lvl->script.txt[idx]);
-    free(lvl->script.list[idx]);
-  }
-  free(lvl->script.txt);
-  free(lvl->script.list);
+  script_code_free(&(lvl->script));
+  /* Lines and commands are released with the arenas; only parameters */
+  /* allocated outside of the arena have to be freed separately */
+  script_commands_free_params(&(lvl->script));
+  lvl->script.txt=NULL;
+  lvl->script.list=NULL;
+  memarena_free(&(lvl->script.arena));
+  memarena_free(&(lvl->script.txt_arena));
+  script_verify_cache_free(&(lvl->script.verif));
   lvl->script.lines_count=0;
   return true;
 }
@@ -1124,17 +1155,30 @@ short level_free_lgt(struct LEVEL *lvl)
     /*Freeing object arrays */
     if ((lvl->lgt_subnums!=NULL) && (lvl->lgt_lookup!=NULL))
     {
-      int cx,cy,k;
+      int cx,cy;
+      unsigned int k;
       for (cx=0; cx<arr_entries_x; cx++)
       {
           for (cy=0; cy<arr_entries_y; cy++)
           {
-            int last_idx=lvl->lgt_subnums[cx][cy]-1;
-            for (k=last_idx; k >=0; k--)
-                stlight_del(lvl,cx, cy, k);
+            unsigned int obj_num=lvl->lgt_subnums[cx][cy];
+            for (k=0; k<obj_num; k++)
+            {
+              unsigned char *obj=lvl->lgt_lookup[cx][cy][k];
+              /* Records from the pool are released all at once below */
+              if (!mempool_owns(lvl->lgt_pool,obj))
+                  free(obj);
+            }
+            free(lvl->lgt_lookup[cx][cy]);
+            lvl->lgt_lookup[cx][cy]=NULL;
+            lvl->lgt_subnums[cx][cy]=0;
+            lvl->tng_apt_lgt_nums[cx/MAP_SUBNUM_X][cy/MAP_SUBNUM_Y]-=obj_num;
+            update_object_buckets(lvl,cx,cy,OBJECT_TYPE_STLIGHT,-(int)obj_num);
           }
       }
+      lvl->lgt_total_count=0;
     }
+    mempool_clear(lvl->lgt_pool);
   return true;
 }
 
@@ -1761,6 +1805,97 @@ short level_generate_random_extension(struct LEVEL *lvl,char *ret_msg)
   return false;
 }
 
+/**
+ * Updates amount of objects in the search bucket containing given subtile.
+ * Should be called whenever an object is added or removed from LEVEL.
+ * @param lvl Pointer to the LEVEL structure.
+ * @param sx,sy Subtile at which the object is.
+ * @param obj_type Type of the object, one of OBJECT_TYPE_* values.
+ * @param delta Value to be added to the amount of objects.
+ */
+void update_object_buckets(struct LEVEL *lvl,unsigned int sx,unsigned int sy,
+    short obj_type,int delta)
+{
+    unsigned int bx=sx/(MAP_SUBNUM_X*OBJ_BUCKET_TILES);
+    unsigned int by=sy/(MAP_SUBNUM_Y*OBJ_BUCKET_TILES);
+    if ((bx>=lvl->bucket_size.x)||(by>=lvl->bucket_size.y)) return;
+    unsigned int idx=by*lvl->bucket_size.x+bx;
+    lvl->obj_bucket_nums[idx]+=delta;
+    if (obj_type==OBJECT_TYPE_THING)
+      lvl->tng_bucket_nums[idx]+=delta;
+}
+
+/**
+ * Gives amount of objects in given search bucket.
+ * @param lvl Pointer to the LEVEL structure.
+ * @param bx,by Index of the bucket.
+ * @param obj_type OBJECT_TYPE_THING to count things only,
+ *     OBJECT_TYPE_NONE to count all objects.
+ * @return Amount of objects in the bucket.
+ */
+unsigned int get_object_bucket_nums(const struct LEVEL *lvl,
+    unsigned int bx,unsigned int by,short obj_type)
+{
+    if ((bx>=lvl->bucket_size.x)||(by>=lvl->bucket_size.y)) return 0;
+    if (obj_type==OBJECT_TYPE_THING)
+      return lvl->tng_bucket_nums[by*lvl->bucket_size.x+bx];
+    return lvl->obj_bucket_nums[by*lvl->bucket_size.x+bx];
+}
+
+/**
+ * Adds a pointer at end of an object list, enlarging the list if needed.
+ * Lists grow in powers of two, so memory is reallocated only when
+ * the amount of items reaches one.
+ * @param list Pointer to the list of objects; may point to NULL list.
+ * @param count Amount of objects currently in the list.
+ * @param obj The object to add.
+ * @return Returns true on success, false on error.
+ */
+short object_list_add(unsigned char ***list,unsigned int count,unsigned char *obj)
+{
+    /* Zero or power of two means the list is full */
+    if ((count&(count-1))==0)
+    {
+      unsigned int capacity=(count==0)?1:2*count;
+      unsigned char **new_list;
+      new_list=(unsigned char **)realloc(*list,capacity*sizeof(unsigned char *));
+      if (new_list==NULL)
+        return false;
+      (*list)=new_list;
+    }
+    (*list)[count]=obj;
+    return true;
+}
+
+/**
+ * Removes a pointer from an object list, shrinking the list if possible.
+ * Does not free the object itself.
+ * @param list Pointer to the list of objects.
+ * @param count Amount of objects currently in the list.
+ * @param num Index of the object to remove.
+ */
+void object_list_remove(unsigned char ***list,unsigned int count,unsigned int num)
+{
+    unsigned int i;
+    if (num >= count)
+      return;
+    count--;
+    for (i=num; i < count; i++)
+      (*list)[i]=(*list)[i+1];
+    if (count==0)
+    {
+      free(*list);
+      (*list)=NULL;
+    } else
+    if ((count&(count-1))==0)
+    {
+      unsigned char **new_list;
+      new_list=(unsigned char **)realloc(*list,count*sizeof(unsigned char *));
+      if (new_list!=NULL)
+        (*list)=new_list;
+    }
+}
+
 /**
  * Returns thing data for thing at given position.
  * @param lvl Pointer to the LEVEL structure.
@@ -1797,29 +1932,26 @@ int thing_add(struct LEVEL *lvl,unsigned char *thing)
     unsigned int x, y;
     x = get_thing_subtile_x(thing)%arr_entries_x;
     y = get_thing_subtile_y(thing)%arr_entries_y;
-    lvl->tng_total_count++;
     /*setting TNG entries */
-    lvl->tng_subnums[x][y]++;
-    lvl->tng_apt_lgt_nums[(x/MAP_SUBNUM_X)][(y/MAP_SUBNUM_Y)]++;
-    if (lvl->tng_lookup[x][y]==NULL)
-      lvl->tng_lookup[x][y]=(unsigned char **)malloc(sizeof(char *));
-    else
-      lvl->tng_lookup[x][y]=(unsigned char **)realloc(lvl->tng_lookup[x][y],
-                          lvl->tng_subnums[x][y]*sizeof(char *));
-    if (lvl->tng_lookup[x][y]==NULL)
+    int new_idx=lvl->tng_subnums[x][y];
+    if (!object_list_add(&(lvl->tng_lookup[x][y]),new_idx,thing))
     {
         message_error("thing_add: Cannot alloc tng entry");
         return -1;
     }
-    int new_idx=lvl->tng_subnums[x][y]-1;
-    lvl->tng_lookup[x][y][new_idx]=thing;
+    lvl->tng_total_count++;
+    lvl->tng_subnums[x][y]++;
+    lvl->tng_apt_lgt_nums[(x/MAP_SUBNUM_X)][(y/MAP_SUBNUM_Y)]++;
+    update_object_buckets(lvl,x,y,OBJECT_TYPE_THING,1);
     update_thing_stats(lvl,thing,1);
+    level_mark_object_changed(lvl,x,y,(get_thing_type(thing)==THING_TYPE_EFFECTGEN)?
+        get_thing_range_adv(thing):0);
     return new_idx;
 }
 
 /**
  * Removes given thing from the LEVEL structure, updates counter variables.
- * Also frees memory allocated for the thing.
+ * Also frees memory allocated for the thing, or returns it to the pool.
  * @param lvl Pointer to the LEVEL structure.
  * @param sx,sy Subtile at which the thing is.
  * @param num Index of thing on the subtile.
@@ -1831,10 +1963,12 @@ void thing_del(struct LEVEL *lvl,unsigned int sx, unsigned int sy, unsigned int
     unsigned int arr_entries_y=lvl->tlsize.y*MAP_SUBNUM_Y;
     /*Bounding position */
     if ((sx>=arr_entries_x)||(sy>=arr_entries_y)) return;
+    if (num >= lvl->tng_subnums[sx][sy]) return;
     unsigned char *thing;
     thing = lvl->tng_lookup[sx][sy][num];
     thing_drop(lvl,sx,sy,num);
-    free(thing);
+    if (!mempool_release(lvl->tng_pool,thing))
+      free(thing);
 }
 
 /**
@@ -1852,19 +1986,18 @@ void thing_drop(struct LEVEL *lvl,unsigned int sx, unsigned int sy, unsigned int
     unsigned int arr_entries_y=lvl->tlsize.y*MAP_SUBNUM_Y;
     /*Bounding position */
     if ((sx>=arr_entries_x)||(sy>=arr_entries_y)) return;
-    int i;
     if (num >= lvl->tng_subnums[sx][sy])
       return;
     lvl->tng_total_count--;
     unsigned char *thing;
     thing = lvl->tng_lookup[sx][sy][num];
     update_thing_stats(lvl,thing,-1);
-    for (i=num; i < lvl->tng_subnums[sx][sy]-1; i++)
-      lvl->tng_lookup[sx][sy][i]=lvl->tng_lookup[sx][sy][i+1];
+    level_mark_object_changed(lvl,sx,sy,(get_thing_type(thing)==THING_TYPE_EFFECTGEN)?
+        get_thing_range_adv(thing):0);
+    object_list_remove(&(lvl->tng_lookup[sx][sy]),lvl->tng_subnums[sx][sy],num);
     lvl->tng_subnums[sx][sy]--;
     lvl->tng_apt_lgt_nums[sx/3][sy/3]--;
-    lvl->tng_lookup[sx][sy]=(unsigned char **)realloc(lvl->tng_lookup[sx][sy], 
-                        lvl->tng_subnums[sx][sy]*sizeof(char *));
+    update_object_buckets(lvl,sx,sy,OBJECT_TYPE_THING,-1);
 }
 
 /**
@@ -1919,30 +2052,24 @@ int actnpt_add(struct LEVEL *lvl,unsigned char *actnpt)
     unsigned int x, y;
     x = get_actnpt_subtile_x(actnpt)%arr_entries_x;
     y = get_actnpt_subtile_y(actnpt)%arr_entries_y;
-    lvl->apt_total_count++;
     /*setting APT entries */
-    unsigned int apt_snum=get_actnpt_subnums(lvl,x,y);
-    apt_snum++;
-    lvl->apt_subnums[x][y]=apt_snum;
-    lvl->tng_apt_lgt_nums[(x/MAP_SUBNUM_X)][(y/MAP_SUBNUM_Y)]++;
-    if (lvl->apt_lookup[x][y]==NULL)
-      lvl->apt_lookup[x][y]=(unsigned char **)malloc(sizeof(char *));
-    else
-      lvl->apt_lookup[x][y]=(unsigned char **)realloc(lvl->apt_lookup[x][y],
-                          apt_snum*sizeof(char *));
-    if (lvl->apt_lookup[x][y]==NULL)
+    unsigned int new_idx=get_actnpt_subnums(lvl,x,y);
+    if (!object_list_add(&(lvl->apt_lookup[x][y]),new_idx,actnpt))
     {
         message_error("actnpt_add: Cannot allocate memory");
         return -1;
     }
-    unsigned int new_idx=apt_snum-1;
-    lvl->apt_lookup[x][y][new_idx]=actnpt;
+    lvl->apt_total_count++;
+    lvl->apt_subnums[x][y]=new_idx+1;
+    lvl->tng_apt_lgt_nums[(x/MAP_SUBNUM_X)][(y/MAP_SUBNUM_Y)]++;
+    update_object_buckets(lvl,x,y,OBJECT_TYPE_ACTNPT,1);
+    level_mark_object_changed(lvl,x,y,get_actnpt_range_adv(actnpt));
     return new_idx;
 }
 
 /**
  * Removes given action point from the LEVEL structure. Updates counter variables.
- * Also frees memory allocated for the action point.
+ * Also frees memory allocated for the action point, or returns it to the pool.
  * @param lvl Pointer to the LEVEL structure.
  * @param sx,sy Subtile at which the action point is.
  * @param num Index of action point on the subtile.
@@ -1960,15 +2087,13 @@ void actnpt_del(struct LEVEL *lvl,unsigned int sx, unsigned int sy, unsigned int
     lvl->apt_total_count--;
     unsigned char *actnpt;
     actnpt = lvl->apt_lookup[sx][sy][num];
-    free(actnpt);
-    int i;
-    apt_snum--;
-    for (i=num; i < apt_snum; i++)
-      lvl->apt_lookup[sx][sy][i]=lvl->apt_lookup[sx][sy][i+1];
-    lvl->apt_subnums[sx][sy]=apt_snum;
+    level_mark_object_changed(lvl,sx,sy,get_actnpt_range_adv(actnpt));
+    if (!mempool_release(lvl->apt_pool,actnpt))
+      free(actnpt);
+    object_list_remove(&(lvl->apt_lookup[sx][sy]),apt_snum,num);
+    lvl->apt_subnums[sx][sy]=apt_snum-1;
     lvl->tng_apt_lgt_nums[sx/MAP_SUBNUM_X][sy/MAP_SUBNUM_Y]--;
-    lvl->apt_lookup[sx][sy]=(unsigned char **)realloc(lvl->apt_lookup[sx][sy], 
-                        apt_snum*sizeof(char *));
+    update_object_buckets(lvl,sx,sy,OBJECT_TYPE_ACTNPT,-1);
 }
 
 /**
@@ -2023,30 +2148,24 @@ int stlight_add(struct LEVEL *lvl,unsigned char *stlight)
     unsigned int x, y;
     x = get_stlight_subtile_x(stlight)%arr_entries_x;
     y = get_stlight_subtile_y(stlight)%arr_entries_y;
-    lvl->lgt_total_count++;
     /*setting LGT entries */
-    unsigned int lgt_snum=lvl->lgt_subnums[x][y];
-    lgt_snum++;
-    lvl->lgt_subnums[x][y]=lgt_snum;
-    lvl->tng_apt_lgt_nums[(x/MAP_SUBNUM_X)][(y/MAP_SUBNUM_Y)]++;
-    if (lvl->lgt_lookup[x][y]==NULL)
-      lvl->lgt_lookup[x][y]=(unsigned char **)malloc(sizeof(char *));
-    else
-      lvl->lgt_lookup[x][y]=(unsigned char **)realloc(lvl->lgt_lookup[x][y],
-                          lgt_snum*sizeof(char *));
-    if (lvl->lgt_lookup[x][y]==NULL)
+    unsigned int new_idx=lvl->lgt_subnums[x][y];
+    if (!object_list_add(&(lvl->lgt_lookup[x][y]),new_idx,stlight))
     {
         message_error("stlight_add: Cannot allocate memory");
         return -1;
     }
-    unsigned int new_idx=lgt_snum-1;
-    lvl->lgt_lookup[x][y][new_idx]=stlight;
+    lvl->lgt_total_count++;
+    lvl->lgt_subnums[x][y]=new_idx+1;
+    lvl->tng_apt_lgt_nums[(x/MAP_SUBNUM_X)][(y/MAP_SUBNUM_Y)]++;
+    update_object_buckets(lvl,x,y,OBJECT_TYPE_STLIGHT,1);
+    level_mark_object_changed(lvl,x,y,get_stlight_range_adv(stlight));
     return new_idx;
 }
 
 /**
  * Removes given static light from the LEVEL structure. Updates counter variables.
- * Also frees memory allocated for the static light.
+ * Also frees memory allocated for the static light, or returns it to the pool.
  * @param lvl Pointer to the LEVEL structure.
  * @param sx,sy Subtile at which the static light is.
  * @param num Index of static light on the subtile.
@@ -2062,18 +2181,15 @@ void stlight_del(struct LEVEL *lvl,unsigned int sx, unsigned int sy, unsigned in
     if (num >= lgt_snum)
       return;
     lvl->lgt_total_count--;
-    /* commented due to -Wunused-but-set-variable
     unsigned char *stlight;
-    stlight = lvl->lgt_lookup[sx][sy][num];*/
-    free(lvl->lgt_lookup[sx][sy][num]);
-    int i;
-    lgt_snum--;
-    for (i=num; i < lgt_snum; i++)
-      lvl->lgt_lookup[sx][sy][i]=lvl->lgt_lookup[sx][sy][i+1];
-    lvl->lgt_subnums[sx][sy]=lgt_snum;
+    stlight = lvl->lgt_lookup[sx][sy][num];
+    level_mark_object_changed(lvl,sx,sy,get_stlight_range_adv(stlight));
+    if (!mempool_release(lvl->lgt_pool,stlight))
+      free(stlight);
+    object_list_remove(&(lvl->lgt_lookup[sx][sy]),lgt_snum,num);
+    lvl->lgt_subnums[sx][sy]=lgt_snum-1;
     lvl->tng_apt_lgt_nums[sx/MAP_SUBNUM_X][sy/MAP_SUBNUM_Y]--;
-    lvl->lgt_lookup[sx][sy]=(unsigned char **)realloc(lvl->lgt_lookup[sx][sy], 
-                        lgt_snum*sizeof(char *));
+    update_object_buckets(lvl,sx,sy,OBJECT_TYPE_STLIGHT,-1);
 }
 
 /**
@@ -2260,7 +2376,7 @@ short get_subtl_wib(struct LEVEL *lvl, unsigned int sx, unsigned int sy)
     /*Bounding position */
     sx %= lvl->subsize.x;
     sy %= lvl->subsize.y;
-    return lvl->wib[sx][sy];
+    return lvl->wib[sy*lvl->subsize.x+sx];
 }
 
 /**
@@ -2274,7 +2390,7 @@ void set_subtl_wib(struct LEVEL *lvl, unsigned int sx, unsigned int sy, short nv
     /*Bounding position */
     if ((sx>=lvl->subsize.x)||(sy>=lvl->subsize.y))
         return;
-    lvl->wib[sx][sy]=nval;
+    lvl->wib[sy*lvl->subsize.x+sx]=nval;
 }
 
 /**
@@ -2288,7 +2404,7 @@ short get_tile_wlb(struct LEVEL *lvl, unsigned int tx, unsigned int ty)
     /*Bounding position */
     tx %= lvl->tlsize.x;
     ty %= lvl->tlsize.y;
-    return lvl->wlb[tx][ty];
+    return lvl->wlb[ty*lvl->tlsize.x+tx];
 }
 
 /**
@@ -2301,7 +2417,7 @@ void set_tile_wlb(struct LEVEL *lvl, unsigned int tx, unsigned int ty, short nva
 {
     /*Bounding position */
     if ((tx>=lvl->tlsize.x)||(ty>=lvl->tlsize.y)) return;
-    lvl->wlb[tx][ty]=nval;
+    lvl->wlb[ty*lvl->tlsize.x+tx]=nval;
 }
 
 /**
@@ -2315,7 +2431,7 @@ unsigned char get_subtl_owner(const struct LEVEL *lvl, unsigned int sx, unsigned
     /*Bounding position */
     sx %= lvl->subsize.x;
     sy %= lvl->subsize.y;
-    return lvl->own[sx][sy];
+    return lvl->own[sy*lvl->subsize.x+sx];
 }
 
 /**
@@ -2328,7 +2444,9 @@ void set_subtl_owner(struct LEVEL *lvl, unsigned int sx, unsigned int sy, unsign
 {
     /*Bounding position */
     if ((sx>=lvl->subsize.x)||(sy>=lvl->subsize.y)) return;
-    lvl->own[sx][sy]=nval;
+    if (lvl->own[sy*lvl->subsize.x+sx]==nval) return;
+    lvl->own[sy*lvl->subsize.x+sx]=nval;
+    level_mark_subtls_changed(lvl,sx,sx,sy,sy);
 }
 
 /**
@@ -2368,7 +2486,7 @@ unsigned short get_tile_slab(const struct LEVEL *lvl, unsigned int tx, unsigned
     if (lvl->slb==NULL) return SLAB_TYPE_ROCK;
     /*Bounding position */
     if ((tx>=lvl->tlsize.x)||(ty>=lvl->tlsize.y)) return SLAB_TYPE_ROCK;
-    return lvl->slb[tx][ty];
+    return lvl->slb[ty*lvl->tlsize.x+tx];
 }
 
 /**
@@ -2383,7 +2501,11 @@ void set_tile_slab(struct LEVEL *lvl, unsigned int tx, unsigned int ty, unsigned
 {
     /*Bounding position */
     if ((tx>=lvl->tlsize.x)||(ty>=lvl->tlsize.y)) return;
-    lvl->slb[tx][ty]=nval;
+    if (lvl->slb[ty*lvl->tlsize.x+tx]==nval) return;
+    lvl->slb[ty*lvl->tlsize.x+tx]=nval;
+    /* Slab type affects colorizing of the whole tile */
+    level_mark_subtls_changed(lvl,tx*MAP_SUBNUM_X,tx*MAP_SUBNUM_X+MAP_SUBNUM_X-1,
+        ty*MAP_SUBNUM_Y,ty*MAP_SUBNUM_Y+MAP_SUBNUM_Y-1);
 }
 
 /**
@@ -2396,7 +2518,7 @@ unsigned int get_dat_val(const struct LEVEL *lvl, const unsigned int sx, const u
 {
     if (lvl->dat==NULL) return 0;
     if ((sx>=lvl->subsize.x)||(sy>=lvl->subsize.y)) return 0;
-    return lvl->dat[sx][sy];
+    return lvl->dat[sy*lvl->subsize.x+sx];
 }
 
 /**
@@ -2410,7 +2532,9 @@ void set_dat_val(struct LEVEL *lvl, int sx, int sy, unsigned int d)
 {
     if (lvl->dat==NULL) return;
     if ((sx<0)||(sy<0)||(sx>=lvl->subsize.x)||(sy>=lvl->subsize.y)) return;
-    lvl->dat[sx][sy]=d;
+    if (lvl->dat[sy*lvl->subsize.x+sx]==d) return;
+    lvl->dat[sy*lvl->subsize.x+sx]=d;
+    level_mark_subtls_changed(lvl,sx,sx,sy,sy);
 }
 
 /**
@@ -2423,7 +2547,7 @@ unsigned short get_subtl_flg(struct LEVEL *lvl, unsigned int sx, unsigned int sy
 {
     if (lvl->flg==NULL) return 0;
     if ((sx>=lvl->subsize.x)||(sy>=lvl->subsize.y)) return 0;
-    return lvl->flg[sx][sy];
+    return lvl->flg[sy*lvl->subsize.x+sx];
 }
 
 /**
@@ -2436,7 +2560,76 @@ void set_subtl_flg(struct LEVEL *lvl, unsigned int sx, unsigned int sy,unsigned
 {
     if (lvl->flg==NULL) return;
     if ((sx>=lvl->subsize.x)||(sy>=lvl->subsize.y)) return;
-    lvl->flg[sx][sy]=nval;
+    lvl->flg[sy*lvl->subsize.x+sx]=nval;
+}
+
+/**
+ * Returns the whole SLB layer, for direct processing.
+ * The layer consists of tlsize.x*tlsize.y entries, stored row by row;
+ * slab of tile (tx,ty) is at index ty*tlsize.x+tx.
+ * @param lvl Pointer to the LEVEL structure.
+ * @return Returns the layer, or NULL if it is not allocated.
+ */
+unsigned short *get_slab_layer(const struct LEVEL *lvl)
+{
+    return lvl->slb;
+}
+
+/**
+ * Returns the whole OWN layer, for direct processing.
+ * The layer consists of subsize.x*subsize.y entries, stored row by row;
+ * owner of subtile (sx,sy) is at index sy*subsize.x+sx.
+ * @param lvl Pointer to the LEVEL structure.
+ * @return Returns the layer, or NULL if it is not allocated.
+ */
+unsigned char *get_owner_layer(const struct LEVEL *lvl)
+{
+    return lvl->own;
+}
+
+/**
+ * Returns the whole WIB layer, for direct processing.
+ * The layer consists of subsize.x*subsize.y entries, stored row by row.
+ * @param lvl Pointer to the LEVEL structure.
+ * @return Returns the layer, or NULL if it is not allocated.
+ */
+unsigned char *get_wib_layer(const struct LEVEL *lvl)
+{
+    return lvl->wib;
+}
+
+/**
+ * Returns the whole WLB layer, for direct processing.
+ * The layer consists of tlsize.x*tlsize.y entries, stored row by row.
+ * @param lvl Pointer to the LEVEL structure.
+ * @return Returns the layer, or NULL if it is not allocated.
+ */
+unsigned char *get_wlb_layer(const struct LEVEL *lvl)
+{
+    return lvl->wlb;
+}
+
+/**
+ * Returns the whole FLG layer, for direct processing.
+ * The layer consists of subsize.x*subsize.y entries, stored row by row.
+ * @param lvl Pointer to the LEVEL structure.
+ * @return Returns the layer, or NULL if it is not allocated.
+ */
+unsigned short *get_flg_layer(const struct LEVEL *lvl)
+{
+    return lvl->flg;
+}
+
+/**
+ * Returns the whole DAT layer, for direct processing.
+ * The layer consists of subsize.x*subsize.y raw DAT values, stored
+ * row by row. Use get_dat_subtile() to convert them into column indices.
+ * @param lvl Pointer to the LEVEL structure.
+ * @return Returns the layer, or NULL if it is not allocated.
+ */
+unsigned short *get_dat_layer(const struct LEVEL *lvl)
+{
+    return lvl->dat;
 }
 
 /**
@@ -3113,6 +3306,224 @@ short get_level_objstats_textln(struct LEVEL *lvl,char *stat_buf,const int line_
     }
 }
 
+/**
+ * Starts a map update transaction. Until the transaction is commited,
+ * user_set_* functions only change the map and mark changed tiles;
+ * graphics and objects are updated once, when the transaction ends.
+ * Transactions may be nested - only the outermost commit makes the update.
+ * @see level_update_commit
+ * @param lvl Pointer to the LEVEL structure.
+ * @return Returns true on success, false on error.
+ */
+short level_update_begin(struct LEVEL *lvl)
+{
+  if ((lvl==NULL)||(lvl->dirty_tiles==NULL))
+      return false;
+  lvl->update_trans_depth++;
+  return true;
+}
+
+/**
+ * Tells if a map update transaction is open.
+ * @param lvl Pointer to the LEVEL structure.
+ * @return Returns true if the updates are postponed, false otherwise.
+ */
+short level_update_in_progress(const struct LEVEL *lvl)
+{
+  if (lvl==NULL) return false;
+  return (lvl->update_trans_depth>0);
+}
+
+/**
+ * Marks tiles as changed within update transaction.
+ * The tiles, and the area around them, will be updated on commit.
+ * @param lvl Pointer to the LEVEL structure.
+ * @param tx_first,ty_first Top left of the changed rectangle.
+ * @param tx_last,ty_last Bottom right of the changed rectangle.
+ */
+void level_update_mark_tiles(struct LEVEL *lvl, int tx_first, int tx_last,
+    int ty_first, int ty_last)
+{
+  if ((lvl==NULL)||(lvl->dirty_tiles==NULL)) return;
+  int i,k;
+  for (k=max(ty_first,0);k<=ty_last;k++)
+  {
+    if (k>=lvl->tlsize.y) break;
+    for (i=max(tx_first,0);i<=tx_last;i++)
+    {
+      if (i>=lvl->tlsize.x) break;
+      lvl->dirty_tiles[k*lvl->tlsize.x+i]|=DIRTY_TILE_CHANGED;
+    }
+  }
+}
+
+/**
+ * Marks subtiles as changed, so that views of the map redraw them.
+ * Setters of the level call it by themselves; it only needs to be called
+ * after modifying level data directly, ie. changing things in place.
+ * @see draw_map_damaged_on_buffer
+ * @param lvl Pointer to the LEVEL structure.
+ * @param sx_first,sy_first Top left of the changed rectangle.
+ * @param sx_last,sy_last Bottom right of the changed rectangle.
+ */
+void level_mark_subtls_changed(struct LEVEL *lvl, int sx_first, int sx_last,
+    int sy_first, int sy_last)
+{
+  if ((lvl==NULL)||(lvl->subtl_gen==NULL)) return;
+  int i,k;
+  lvl->mod_gen++;
+  for (k=max(sy_first,0);k<=sy_last;k++)
+  {
+    if (k>=lvl->subsize.y) break;
+    unsigned long *gen=lvl->subtl_gen+k*lvl->subsize.x;
+    for (i=max(sx_first,0);i<=sx_last;i++)
+    {
+      if (i>=lvl->subsize.x) break;
+      gen[i]=lvl->mod_gen;
+    }
+  }
+}
+
+/**
+ * Marks the whole map as changed, so that views of the map are redrawn.
+ * To be used after changes which may affect any subtile, ie. loading
+ * a layer or modifying a column.
+ * @param lvl Pointer to the LEVEL structure.
+ */
+void level_mark_map_changed(struct LEVEL *lvl)
+{
+  if (lvl==NULL) return;
+  lvl->mod_gen++;
+  lvl->map_gen=lvl->mod_gen;
+}
+
+/**
+ * Gives generation of the last change of given subtile.
+ * A subtile was changed since given moment if its generation is
+ * larger than value of mod_gen in the LEVEL at that moment.
+ * @param lvl Pointer to the LEVEL structure.
+ * @param sx,sy Map subtile to check.
+ * @return Returns generation of the last change.
+ */
+unsigned long get_subtl_mod_gen(const struct LEVEL *lvl, unsigned int sx, unsigned int sy)
+{
+  if ((sx>=lvl->subsize.x)||(sy>=lvl->subsize.y)||(lvl->subtl_gen==NULL))
+    return lvl->map_gen;
+  return max(lvl->subtl_gen[sy*lvl->subsize.x+sx],lvl->map_gen);
+}
+
+/**
+ * Marks subtiles affected by an object as changed. Objects with range
+ * have a circle drawn around, so all subtiles within range are marked.
+ * @param lvl Pointer to the LEVEL structure.
+ * @param sx,sy Subtile at which the object is.
+ * @param range Object range, in 1/256 of subtile; 0 for objects without range.
+ */
+void level_mark_object_changed(struct LEVEL *lvl, unsigned int sx, unsigned int sy,
+    unsigned int range)
+{
+  int dist=0;
+  if (range>0)
+    dist=(range>>8)+1;
+  level_mark_subtls_changed(lvl,(int)sx-dist,(int)sx+dist,(int)sy-dist,(int)sy+dist);
+}
+
+/**
+ * Marks subtiles affected by a thing as changed. Has to be called after
+ * modifying the thing in place, and before modifying its position or range.
+ * @param lvl Pointer to the LEVEL structure.
+ * @param thing The thing which was, or will be changed.
+ */
+void level_mark_thing_changed(struct LEVEL *lvl, const unsigned char *thing)
+{
+  level_mark_object_changed(lvl,get_thing_subtile_x(thing),get_thing_subtile_y(thing),
+      (get_thing_type(thing)==THING_TYPE_EFFECTGEN)?get_thing_range_adv(thing):0);
+}
+
+/**
+ * Ends a map update transaction. If this is the outermost transaction,
+ * updates objects, DAT/CLM and W?B/FLG entries of all tiles changed
+ * since level_update_begin(). Every tile is updated only once, even
+ * if it was changed, or was near to changes, many times.
+ * Updated area is the same as if every change was updated separately -
+ * tiles in radius 1 from the changes, and W?B/FLG entries in radius 2.
+ * @see level_update_begin
+ * @param lvl Pointer to the LEVEL structure.
+ * @return Returns true on success, false on error.
+ */
+short level_update_commit(struct LEVEL *lvl)
+{
+  if ((lvl==NULL)||(lvl->update_trans_depth<=0))
+  {
+      message_error("level_update_commit: No transaction to commit");
+      return false;
+  }
+  lvl->update_trans_depth--;
+  if (lvl->update_trans_depth>0)
+      return true;
+  const int tl_x=lvl->tlsize.x;
+  const int tl_y=lvl->tlsize.y;
+  unsigned char *dirty=lvl->dirty_tiles;
+  int i,k,di,dk;
+  short changed=false;
+  /* Marking the area around changed tiles */
+  for (k=0;k<tl_y;k++)
+    for (i=0;i<tl_x;i++)
+    {
+      if ((dirty[k*tl_x+i]&DIRTY_TILE_CHANGED)==0)
+          continue;
+      changed=true;
+      for (dk=-2;dk<=2;dk++)
+        for (di=-2;di<=2;di++)
+        {
+          if ((i+di<0) || (k+dk<0) || (i+di>=tl_x) || (k+dk>=tl_y))
+              continue;
+          dirty[(k+dk)*tl_x+(i+di)]|=DIRTY_TILE_RADIUS2;
+          if ((abs(di)<=1) && (abs(dk)<=1))
+              dirty[(k+dk)*tl_x+(i+di)]|=DIRTY_TILE_RADIUS1;
+        }
+    }
+  if (!changed)
+      return true;
+  /* Now update the marked tiles, in the same order as single update does */
+  if (get_obj_auto_update(lvl))
+  {
+    for (k=0;k<tl_y;k++)
+      for (i=0;i<tl_x;i++)
+        if (dirty[k*tl_x+i]&DIRTY_TILE_RADIUS1)
+          update_clmaffective_obj_for_slab(lvl,i,k);
+  }
+  if (get_datclm_auto_update(lvl))
+  {
+    for (k=0;k<tl_y;k++)
+      for (i=0;i<tl_x;i++)
+        if (dirty[k*tl_x+i]&DIRTY_TILE_RADIUS1)
+          update_datclm_for_slab(lvl,i,k);
+    /* updating WIB (animation) entries - wider update is requred */
+    for (k=0;k<tl_y;k++)
+      for (i=0;i<tl_x;i++)
+        if (dirty[k*tl_x+i]&DIRTY_TILE_RADIUS2)
+          update_tile_wib_entries(lvl,i,k);
+    /* updating WLB and FLG entries */
+    for (k=0;k<tl_y;k++)
+      for (i=0;i<tl_x;i++)
+        if (dirty[k*tl_x+i]&DIRTY_TILE_RADIUS2)
+        {
+          update_tile_wlb_entry(lvl,i,k);
+          update_tile_flg_entries(lvl,i,k);
+        }
+  }
+  if (get_obj_auto_update(lvl))
+  {
+    for (k=0;k<tl_y;k++)
+      for (i=0;i<tl_x;i++)
+        if (dirty[k*tl_x+i]&DIRTY_TILE_RADIUS1)
+          update_things_subpos_and_height_for_slab(lvl,i,k);
+  }
+  memset(dirty,0,tl_x*tl_y*sizeof(unsigned char));
+  return true;
+}
+
 /**
  * Puts a new slab on map. Updates level graphics, things and statistics.
  * @see set_tile_slab
@@ -3128,6 +3539,11 @@ short user_set_slab(struct LEVEL *lvl, unsigned int tx, unsigned int ty, unsigne
   /* Update user commands statistics */
   inc_info_usr_slbchng_count(lvl);
   /* Update the level graphics */
+  if (level_update_in_progress(lvl))
+  {
+      level_update_mark_tiles(lvl,tx,tx,ty,ty);
+      return true;
+  }
   if (get_obj_auto_update(lvl))
       update_obj_for_square_radius1(lvl,tx,ty);
   if (get_datclm_auto_update(lvl))
@@ -3152,6 +3568,11 @@ short user_set_tile_owner(struct LEVEL *lvl, unsigned int tx, unsigned int ty, u
   /* Update user commands statistics */
   inc_info_usr_slbchng_count(lvl);
   /* Update the level graphics */
+  if (level_update_in_progress(lvl))
+  {
+      level_update_mark_tiles(lvl,tx,tx,ty,ty);
+      return true;
+  }
   if (get_obj_auto_update(lvl))
       update_obj_for_square_radius1(lvl,tx,ty);
   if (get_datclm_auto_update(lvl))
@@ -3188,6 +3609,11 @@ short user_set_slab_rect(struct LEVEL *lvl, unsigned int startx, unsigned int en
           set_tile_slab(lvl,tile_x,tile_y,nslab);
           inc_info_usr_slbchng_count(lvl);
       }
+    if (level_update_in_progress(lvl))
+    {
+      level_update_mark_tiles(lvl, startx, endx, starty, endy);
+      return true;
+    }
     if (get_obj_auto_update(lvl))
       update_obj_for_square(lvl, startx-1, endx+1, starty-1, endy+1);
     if (get_datclm_auto_update(lvl))
@@ -3222,6 +3648,11 @@ short user_set_owner_rect(struct LEVEL *lvl, unsigned int startx, unsigned int e
           set_tile_owner(lvl,tile_x,tile_y,nown);
           inc_info_usr_slbchng_count(lvl);
       }
+    if (level_update_in_progress(lvl))
+    {
+      level_update_mark_tiles(lvl, startx, endx, starty, endy);
+      return true;
+    }
     if (get_obj_auto_update(lvl))
       update_obj_for_square(lvl, startx-1, endx+1, starty-1, endy+1);
     if (get_datclm_auto_update(lvl))
@@ -3258,6 +3689,11 @@ short user_set_slabown_rect(struct LEVEL *lvl, unsigned int startx, unsigned int
           set_tile_owner(lvl,tile_x,tile_y,nown);
           inc_info_usr_slbchng_count(lvl);
       }
+    if (level_update_in_progress(lvl))
+    {
+      level_update_mark_tiles(lvl, startx, endx, starty, endy);
+      return true;
+    }
     if (get_obj_auto_update(lvl))
       update_obj_for_square(lvl, startx-1, endx+1, starty-1, endy+1);
     if (get_datclm_auto_update(lvl))
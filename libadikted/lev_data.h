@@ -20,6 +20,13 @@
 
 #include "globals.h"
 
+struct MEMORY_POOL;
+struct MEMORY_ARENA;
+struct SCRIPT_VERIFY_CACHE;
+struct DK_SCRIPT_CODE;
+struct CLM_GEN_CACHE;
+struct ADIKT_CONTEXT;
+
 /* Map size definitions */
 
 #define MAP_SIZE_DKSTD_X 85
@@ -28,6 +35,12 @@
 #define MAP_SUBNUM_H 8
 #define MAP_SUBNUM_X 3
 #define MAP_SUBNUM_Y 3
+/* Flags used for marking tiles in update transaction */
+#define DIRTY_TILE_CHANGED 0x01
+#define DIRTY_TILE_RADIUS1 0x02
+#define DIRTY_TILE_RADIUS2 0x04
+/* Size of a bucket used for searching nearest objects, in tiles */
+#define OBJ_BUCKET_TILES 4
 #define COLUMN_ENTRIES 2048
 
 /**
@@ -228,6 +241,15 @@ struct DK_SCRIPT {
     struct DK_SCRIPT_PARAMETERS par;
     char **txt;  /* The whole script stored as txt */
     int lines_count;
+    /* Memory for the decomposed commands and their parameters; */
+    /* it is reset whenever the whole script is decomposed again */
+    struct MEMORY_ARENA *arena;
+    /* Memory for the text lines, and for the lines and commands arrays */
+    struct MEMORY_ARENA *txt_arena;
+    /* Verification results, for re-checking only changed lines */
+    struct SCRIPT_VERIFY_CACHE *verif;
+    /* Compiled commands, or NULL if not compiled since last change */
+    struct DK_SCRIPT_CODE *code;
 };
 
 /**
@@ -296,22 +318,29 @@ struct LEVEL {
     char *fname;
     /*map file name (for saving) */
     char *savfname;
-    /*Slab file - tile type definitions, size MAP_SIZE_Y x MAP_SIZE_X */
-    unsigned short **slb;
-    /*Owners file - subtile owner index, size arr_entries_y+1 x arr_entries_x+1 */
-    unsigned char **own;
-    /*Vibration file - subtile animation indices, size arr_entries_y+1 x arr_entries_x+1 */
-    unsigned char **wib;
+    /* Note: per-tile and per-subtile layers are stored in single, contiguous */
+    /* memory blocks, row by row; entry (x,y) has index y*size.x+x. */
+    /*Slab file - tile type definitions, size tlsize.y x tlsize.x */
+    unsigned short *slb;
+    /*Owners file - subtile owner index, size subsize.y x subsize.x */
+    unsigned char *own;
+    /*Vibration file - subtile animation indices, size subsize.y x subsize.x */
+    unsigned char *wib;
     /*WLB file - some additional info about water and lava tiles, */
-    /* size MAP_SIZE_Y x MAP_SIZE_X, not always present */
-    unsigned char **wlb;
-    /*Flag file - size arr_entries_y+1 x arr_entries_x+1 */
-    unsigned short **flg;
+    /* size tlsize.y x tlsize.x, not always present */
+    unsigned char *wlb;
+    /*Flag file - size subsize.y x subsize.x */
+    unsigned short *flg;
     /*Column file - constant-size array of entries used for displaying tiles, */
     /* size COLUMN_ENTRIES x SIZEOF_DK_CLM_REC */
     unsigned char **clm;
     /*How many DAT entries points at every column */
     unsigned int *clm_utilize;
+    /*Hash index of used columns by content, for fast column searching */
+    int *clm_hash_head;   /* First column in every hash bucket, or -1 */
+    int *clm_hash_next;   /* Next column in the same bucket, or -1 */
+    int *clm_hash_bucket; /* Bucket of every column, or -1 if not indexed */
+    short clm_hash_valid; /* If false, the index must be rebuilt before use */
     /*Column file header */
     unsigned char *clm_hdr;
     /*Texture information file - one byte file, identifies texture pack index */
@@ -337,10 +366,26 @@ struct LEVEL {
 
     unsigned short **tng_apt_lgt_nums;    /* Number of all objects in a tile */
 
+    /* Note: lists in *_lookup arrays grow in powers of two; their capacity */
+    /* is the smallest power of two not lower than the *_subnums value. */
+    /*Pools of object records; objects created by the library are allocated */
+    /* from them, objects added by caller may still come from malloc() */
+    struct MEMORY_POOL *apt_pool;
+    struct MEMORY_POOL *tng_pool;
+    struct MEMORY_POOL *lgt_pool;
+
+    /*Index for searching objects near given point; the map is divided into */
+    /* buckets of OBJ_BUCKET_TILES x OBJ_BUCKET_TILES tiles, and amount of */
+    /* objects is kept for every bucket, so that empty areas may be skipped. */
+    /* Arrays size bucket_size.y x bucket_size.x */
+    struct UPOINT_2D bucket_size;
+    unsigned int *tng_bucket_nums; /* Number of things in a bucket */
+    unsigned int *obj_bucket_nums; /* Number of all objects in a bucket */
+
     /* DAT file contains indices of columns for each subtile */
     /* Its content stores a graphic for whole map */
-    /* Size arr_entries_y+1 x arr_entries_x+1 (there is single rock column at end) */
-    unsigned short **dat;
+    /* Size subsize.y x subsize.x (there is single rock column at end) */
+    unsigned short *dat;
 
     /* Elements that are not part of DK levels, but are importand for Adikted */
     /* Level statistics */
@@ -356,6 +401,27 @@ struct LEVEL {
     unsigned int cust_clm_count;
     struct DK_GRAFFITI **graffiti;
     unsigned int graffiti_count;
+    /* Map update transaction; while it is open, graphics and objects */
+    /* are not updated after slab changes - changed tiles are marked */
+    /* in dirty_tiles, and updated at once when the transaction ends */
+    short update_trans_depth;
+    /* Flags of tiles changed during transaction, size tlsize.y x tlsize.x */
+    unsigned char *dirty_tiles;
+    /* Modification generations, for redrawing only changed parts of the map */
+    /* and for caches of data computed from the level. mod_gen is increased */
+    /* by every change; it is stored in subtl_gen for changed subtiles, or */
+    /* in map_gen if the change affects the whole map. Setters of the level */
+    /* do it by themselves; after modifying level data in place, ie. things */
+    /* got with get_thing(), level_mark_*_changed() has to be called, */
+    /* otherwise caches comparing mod_gen would use outdated data */
+    unsigned long mod_gen;
+    unsigned long map_gen;
+    /* Generation of last change of every subtile, size subsize.y x subsize.x */
+    unsigned long *subtl_gen;
+    /* Columns generated for slab surroundings, reused for identical ones */
+    struct CLM_GEN_CACHE *clm_gen_cache;
+    /* Library state used when the level is processed in its own thread */
+    struct ADIKT_CONTEXT *ctx;
   };
 
 extern const char default_map_name[];
@@ -364,6 +430,7 @@ extern const char default_map_name[];
 DLLIMPORT short level_init(struct LEVEL **lvl_ptr,short map_version,struct UPOINT_3D *lvl_size);
 /* frees object for storing map */
 DLLIMPORT short level_deinit(struct LEVEL **lvl_ptr);
+DLLIMPORT struct ADIKT_CONTEXT *level_bind_context(struct LEVEL *lvl);
 DLLIMPORT short level_set_options(struct LEVEL *lvl,struct LEVOPTIONS *optns);
 DLLIMPORT struct LEVOPTIONS *level_get_options(struct LEVEL *lvl);
 DLLIMPORT short level_set_mapdraw_options(struct LEVEL *lvl,struct MAPDRAW_OPTIONS *mdrwopts);
@@ -399,6 +466,14 @@ DLLIMPORT struct DK_SCRIPT_PARAMETERS *level_get_script_param(struct LEVEL *lvl)
 
 DLLIMPORT void free_map(struct LEVEL *lvl);
 
+short object_list_add(unsigned char ***list,unsigned int count,unsigned char *obj);
+void object_list_remove(unsigned char ***list,unsigned int count,unsigned int num);
+
+void update_object_buckets(struct LEVEL *lvl,unsigned int sx,unsigned int sy,
+    short obj_type,int delta);
+DLLIMPORT unsigned int get_object_bucket_nums(const struct LEVEL *lvl,
+    unsigned int bx,unsigned int by,short obj_type);
+
 DLLIMPORT char *get_thing(const struct LEVEL *lvl,unsigned int sx,unsigned int sy,unsigned int num);
 DLLIMPORT int thing_add(struct LEVEL *lvl,unsigned char *thing);
 DLLIMPORT void thing_del(struct LEVEL *lvl,unsigned int sx,unsigned int sy,unsigned int num);
@@ -449,6 +524,18 @@ DLLIMPORT short user_set_owner_rect(struct LEVEL *lvl, unsigned int startx, unsi
 
 DLLIMPORT unsigned short get_tile_slab(const struct LEVEL *lvl, unsigned int tx, unsigned int ty);
 DLLIMPORT void set_tile_slab(struct LEVEL *lvl, unsigned int tx, unsigned int ty, unsigned short nval);
+DLLIMPORT short level_update_begin(struct LEVEL *lvl);
+DLLIMPORT short level_update_commit(struct LEVEL *lvl);
+DLLIMPORT short level_update_in_progress(const struct LEVEL *lvl);
+DLLIMPORT void level_update_mark_tiles(struct LEVEL *lvl, int tx_first, int tx_last,
+    int ty_first, int ty_last);
+DLLIMPORT void level_mark_subtls_changed(struct LEVEL *lvl, int sx_first, int sx_last,
+    int sy_first, int sy_last);
+DLLIMPORT void level_mark_map_changed(struct LEVEL *lvl);
+DLLIMPORT void level_mark_object_changed(struct LEVEL *lvl, unsigned int sx, unsigned int sy,
+    unsigned int range);
+DLLIMPORT void level_mark_thing_changed(struct LEVEL *lvl, const unsigned char *thing);
+DLLIMPORT unsigned long get_subtl_mod_gen(const struct LEVEL *lvl, unsigned int sx, unsigned int sy);
 DLLIMPORT short user_set_slab(struct LEVEL *lvl, unsigned int tx, unsigned int ty, unsigned short nslab);
 DLLIMPORT short user_set_slab_rect(struct LEVEL *lvl, unsigned int startx, unsigned int endx,
     unsigned int starty, unsigned int endy, unsigned short nslab);
@@ -461,6 +548,14 @@ DLLIMPORT void set_dat_val(struct LEVEL *lvl, int sx, int sy, unsigned int d);
 DLLIMPORT unsigned short get_subtl_flg(struct LEVEL *lvl, unsigned int sx, unsigned int sy);
 DLLIMPORT void set_subtl_flg(struct LEVEL *lvl, unsigned int sx, unsigned int sy,unsigned short nval);
 
+/* Raw access to whole layers, for functions which process all entries */
+DLLIMPORT unsigned short *get_slab_layer(const struct LEVEL *lvl);
+DLLIMPORT unsigned char *get_owner_layer(const struct LEVEL *lvl);
+DLLIMPORT unsigned char *get_wib_layer(const struct LEVEL *lvl);
+DLLIMPORT unsigned char *get_wlb_layer(const struct LEVEL *lvl);
+DLLIMPORT unsigned short *get_flg_layer(const struct LEVEL *lvl);
+DLLIMPORT unsigned short *get_dat_layer(const struct LEVEL *lvl);
+
 DLLIMPORT short set_lvl_fname(struct LEVEL *lvl,char *fname);
 DLLIMPORT short format_lvl_fname(struct LEVEL *lvl,char *namefmt);
 DLLIMPORT char *get_lvl_fname(struct LEVEL *lvl);
@@ -23,17 +23,22 @@
 #include "globals.h"
 #include "arr_utils.h"
 #include "memfile.h"
+#include "mempool.h"
+#include "memarena.h"
 #include "obj_column_def.h"
 #include "obj_slabs.h"
 #include "obj_things.h"
 #include "bulcommn.h"
 #include "obj_column.h"
 #include "lev_data.h"
+#include "lev_column.h"
 #include "lev_script.h"
 #include "msg_log.h"
 #include "lbfileio.h"
 #include "lev_script.h"
 #include "lev_things.h"
+#include "lbthreads.h"
+#include "enrnc.h"
 
 /**
  * Level file load/write function type definition.
@@ -96,6 +101,155 @@ char *levfile_error(int errcode)
    return warnings[1];
 }
 
+/* Files read in advance by the map loading in current thread */
+THREAD_LOCAL struct MAPFILE_PREFETCH_LIST *mapfiles_prefetched=NULL;
+
+/**
+ * Reads a map file into new MEMORY_FILE. If the file was already read
+ * by mapfiles_prefetch(), the prefetched content is used.
+ * @param mem Double pointer to MEMORY_FILE structure, which will contain the file.
+ * @param fname The input file name.
+ * @return Returns MFILE_OK, or negative error code.
+ *     On error, the *mem is set to NULL.
+ */
+short mapfile_read(struct MEMORY_FILE **mem,const char *fname)
+{
+    struct MAPFILE_PREFETCH_LIST *list=mapfiles_prefetched;
+    int i;
+    if (list!=NULL)
+    {
+      for (i=0;i<list->count;i++)
+      {
+        struct MAPFILE_PREFETCH *item=&(list->items[i]);
+        if ((item->fname==NULL)||(strcmp(item->fname,fname)!=0))
+          continue;
+        /* Every prefetched file is used only once */
+        (*mem)=item->mem;
+        item->mem=NULL;
+        free(item->fname);
+        item->fname=NULL;
+        return item->result;
+      }
+    }
+    return memfile_mapnew(mem,fname,MAX_FILE_SIZE);
+}
+
+/**
+ * Creates name of a map file with given extension, from name of another
+ * file of the same map.
+ * @param fname Name of a map file, with extension.
+ * @param fext Extension of the new file name.
+ * @return Returns the new file name, which should be freed; NULL on error.
+ */
+char *mapfile_name_with_ext(const char *fname,const char *fext)
+{
+    int len=strlen(fname);
+    int i=len;
+    while ((i>0)&&(fname[i-1]!='.')&&(fname[i-1]!='/')&&(fname[i-1]!='\\'))
+        i--;
+    /* Without extension, the new one is just added */
+    if ((i==0)||(fname[i-1]!='.'))
+        i=len+1;
+    char *nfname=(char *)malloc(i+strlen(fext)+1);
+    if (nfname==NULL)
+        return NULL;
+    memcpy(nfname,fname,i-1);
+    nfname[i-1]='.';
+    strcpy(nfname+i,fext);
+    return nfname;
+}
+
+/**
+ * Reads the map files assigned to one thread.
+ * Used as thread function by mapfiles_prefetch().
+ * @param param Pointer to MAPFILE_PREFETCH_LIST structure.
+ */
+void mapfiles_prefetch_read(void *param)
+{
+    struct MAPFILE_PREFETCH_LIST *list=(struct MAPFILE_PREFETCH_LIST *)param;
+    int i;
+    for (i=list->first;i<list->count;i+=list->step)
+    {
+      struct MAPFILE_PREFETCH *item=&(list->items[i]);
+      if (item->fname==NULL)
+        continue;
+      item->result=memfile_mapnew(&(item->mem),item->fname,MAX_FILE_SIZE);
+      if (item->result==MFILE_OK)
+        memfile_prefault(item->mem);
+    }
+}
+
+/**
+ * Reads and decompresses map files with given extensions, using several
+ * threads. The files are later taken by mapfile_read(), when the list
+ * is set as mapfiles_prefetched.
+ * @param lvl Pointer to the LEVEL structure.
+ * @param list The list to fill with read files.
+ * @param fexts Extensions of the map files.
+ * @param count Amount of the extensions.
+ * @return Returns true if the files were read, false on error
+ *     (the list is then empty and the files are read by load functions).
+ */
+short mapfiles_prefetch(struct LEVEL *lvl,struct MAPFILE_PREFETCH_LIST *list,
+    const char *fexts[],int count)
+{
+    struct MAPFILE_PREFETCH_LIST *thlists;
+    void *params[LBTHREADS_MAX_COUNT];
+    int threads_count;
+    int i;
+    list->items=NULL;
+    list->count=0;
+    threads_count=min(min(lvl->optns.load_threads,count),LBTHREADS_MAX_COUNT);
+    if (threads_count<2)
+      return false;
+    list->items=(struct MAPFILE_PREFETCH *)malloc(count*sizeof(struct MAPFILE_PREFETCH));
+    thlists=(struct MAPFILE_PREFETCH_LIST *)malloc(threads_count*sizeof(struct MAPFILE_PREFETCH_LIST));
+    if ((list->items==NULL)||(thlists==NULL))
+    {
+      free(list->items);
+      free(thlists);
+      list->items=NULL;
+      return false;
+    }
+    list->count=count;
+    for (i=0;i<count;i++)
+    {
+      list->items[i].mem=NULL;
+      list->items[i].result=MFILE_INTERNAL;
+      list->items[i].fname=(char *)malloc(strlen(lvl->fname)+strlen(fexts[i])+3);
+      if (list->items[i].fname!=NULL)
+        sprintf(list->items[i].fname, "%s.%s", lvl->fname, fexts[i]);
+    }
+    for (i=0;i<threads_count;i++)
+    {
+      thlists[i].items=list->items;
+      thlists[i].count=count;
+      thlists[i].first=i;
+      thlists[i].step=threads_count;
+      params[i]=&thlists[i];
+    }
+    lbthreads_run(mapfiles_prefetch_read,params,threads_count);
+    free(thlists);
+    return true;
+}
+
+/**
+ * Frees the prefetched files which weren't used.
+ * @param list The list filled by mapfiles_prefetch().
+ */
+void mapfiles_prefetch_free(struct MAPFILE_PREFETCH_LIST *list)
+{
+    int i;
+    for (i=0;i<list->count;i++)
+    {
+      memfile_free(&(list->items[i].mem));
+      free(list->items[i].fname);
+    }
+    free(list->items);
+    list->items=NULL;
+    list->count=0;
+}
+
 /*
  * Old way of reading various files; not used anymore.
  * This function reads what Jon Skeet named "subtile format".
@@ -185,7 +339,7 @@ short load_tng(struct LEVEL *lvl,char *fname)
     /*Reading file */
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
     /* Checking file size */
@@ -205,9 +359,17 @@ short load_tng(struct LEVEL *lvl,char *fname)
         result=WARN_BAD_COUNT;
     }
     /*Read tng entries */
+    if ((tng_num>0)&&(!mempool_reserve(lvl->tng_pool,tng_num)))
+    { memfile_free(&mem); return ERR_CANT_MALLOC; }
     for (i=0; i < tng_num; i++)
     {
-      unsigned char *thing = create_thing_empty();
+      unsigned char *thing = mempool_alloc(lvl->tng_pool);
+      if (thing==NULL)
+      {
+        message_error("Cannot allocate mem for loading things");
+        memfile_free(&mem);
+        return ERR_CANT_MALLOC;
+      }
       int offs=SIZEOF_DK_TNG_REC*i+SIZEOF_DK_TNG_HEADER;
       memcpy(thing, mem->content+offs, SIZEOF_DK_TNG_REC);
       thing_add(lvl,thing);
@@ -235,7 +397,7 @@ short load_clm(struct LEVEL *lvl,char *fname)
     /*Reading file */
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
     /* Checking file size */
@@ -252,6 +414,8 @@ short load_clm(struct LEVEL *lvl,char *fname)
       int offs=SIZEOF_DK_CLM_REC*i+SIZEOF_DK_CLM_HEADER;
       memcpy(lvl->clm[i], mem->content+offs, SIZEOF_DK_CLM_REC);
     }
+    clm_hash_invalidate(lvl);
+    level_mark_map_changed(lvl);
     memfile_free(&mem);
     return ERR_NONE;
 }
@@ -272,7 +436,7 @@ short load_apt(struct LEVEL *lvl,char *fname)
     /*Reading file */
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
     /* Checking file size */
@@ -291,12 +455,15 @@ short load_apt(struct LEVEL *lvl,char *fname)
           apt_num=(mem->len-SIZEOF_DK_APT_HEADER)/SIZEOF_DK_APT_REC;
         result=WARN_BAD_COUNT;
     }
+    if ((apt_num>0)&&(!mempool_reserve(lvl->apt_pool,apt_num)))
+    { memfile_free(&mem); return ERR_CANT_MALLOC; }
     for (i=0; i < apt_num; i++)
     {
-      actnpt=(unsigned char *)malloc(SIZEOF_DK_APT_REC);
+      actnpt=mempool_alloc(lvl->apt_pool);
       if (actnpt==NULL)
       {
         message_error("Cannot allocate mem for loading action points");
+        memfile_free(&mem);
         return ERR_CANT_MALLOC;
       }
       memcpy (actnpt, mem->content+SIZEOF_DK_APT_REC*i+SIZEOF_DK_APT_HEADER, SIZEOF_DK_APT_REC);
@@ -322,7 +489,7 @@ short load_inf(struct LEVEL *lvl,char *fname)
     message_log("  load_inf: started");
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
     /*If wrong filesize - pannic */
@@ -344,7 +511,7 @@ short load_vsn(struct LEVEL *lvl,char *fname)
     message_log("  load_vsn: started");
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
     /*If wrong filesize - pannic */
@@ -372,23 +539,14 @@ short load_wib(struct LEVEL *lvl,char *fname)
     /*Loading the file */
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
     /* Checking file size */
     if ((mem->len!=lvl->subsize.x*lvl->subsize.y))
     { memfile_free(&mem); return ERR_FILE_BADDATA; }
-    /*Reading WIB entries */
-    int sx, sy;
-    unsigned long addr;
-    for (sy=0; sy<lvl->subsize.y; sy++)
-    {
-      addr = sy*lvl->subsize.x;
-      for (sx=0; sx<lvl->subsize.x; sx++)
-      {
-          set_subtl_wib(lvl,sx,sy,mem->content[addr+sx]);
-      }
-    }
+    /*Reading WIB entries; file layout is the same as in memory */
+    memcpy(get_wib_layer(lvl),mem->content,mem->len);
     memfile_free(&mem);
     return ERR_NONE;
   /* Old way */
@@ -414,29 +572,27 @@ short load_slb(struct LEVEL *lvl,char *fname)
         char *name_text=malloc(name_len);
         if (name_text!=NULL)
         {
-            strftime(name_text,name_len, default_map_name, localtime(&(lvl->info.creat_date)) );
+            struct tm creat_tm;
+            strftime(name_text,name_len, default_map_name, localtime_safe(&(lvl->info.creat_date),&creat_tm) );
             set_lif_name_text(lvl,name_text);
         }
     }
     /*Reading file */
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
     /* Checking file size */
     if ((mem->len != 2*lvl->tlsize.x*lvl->tlsize.y))
     { memfile_free(&mem); return ERR_FILE_BADDATA; }
     /*Loading the entries */
-    int i, k;
-    unsigned long addr=0;
-    for (i=0; i<lvl->tlsize.y; i++)
-    {
-      addr = 2*lvl->tlsize.x*i;
-      for (k=0; k<lvl->tlsize.x; k++)
-          set_tile_slab(lvl,k,i,read_int16_le_buf(mem->content+addr+k*2));
-    }
+    unsigned short *slb=get_slab_layer(lvl);
+    unsigned long i;
+    for (i=0; i<lvl->tlsize.x*lvl->tlsize.y; i++)
+        slb[i]=read_int16_le_buf(mem->content+i*2);
     memfile_free(&mem);
+    level_mark_map_changed(lvl);
     /*message_log("  load_slb: finished"); */
     return ERR_NONE;
     /*The old way - left as an antic */
@@ -455,24 +611,16 @@ short load_own(struct LEVEL *lvl,char *fname)
     /*Reading file */
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
     /* Checking file size */
     if ((mem->len!=lvl->subsize.x*lvl->subsize.y))
     { memfile_free(&mem); return ERR_FILE_BADDATA; }
-    /*Reading entries */
-    int sx, sy;
-    unsigned long addr;
-    for (sy=0; sy<lvl->subsize.y; sy++)
-    {
-      addr = sy*lvl->subsize.x;
-      for (sx=0; sx<lvl->subsize.x; sx++)
-      {
-          set_subtl_owner(lvl,sx,sy,mem->content[addr+sx]);
-      }
-    }
+    /*Reading entries; file layout is the same as in memory */
+    memcpy(get_owner_layer(lvl),mem->content,mem->len);
     memfile_free(&mem);
+    level_mark_map_changed(lvl);
     return ERR_NONE;
     /*Old way */
     /*return load_subtile(lvl->own, fname, 65536, MAP_SIZE_Y, MAP_SIZE_X,256, 3, 0, 3, 0);  */
@@ -491,7 +639,7 @@ short load_dat(struct LEVEL *lvl,char *fname)
     const unsigned int line_len=2*lvl->subsize.x;
     /*Loading the file */
     struct MEMORY_FILE *mem;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
     /*message_log("  load_dat: after memfile_readnew"); */
@@ -499,22 +647,53 @@ short load_dat(struct LEVEL *lvl,char *fname)
     { memfile_free(&mem); return ERR_FILE_BADDATA; }
     /*Reading DAT entries */
     /*message_log("  load_dat: Reading DAT entries"); */
-    int sx, sy;
-    unsigned char *addr;
-    for (sy=0; sy<lvl->subsize.y; sy++)
-    {
-      addr = mem->content+sy*line_len;
-      for (sx=0; sx<lvl->subsize.x; sx++)
-      {
-          set_dat_val(lvl,sx,sy,read_int16_le_buf(addr+sx*2));
-      }
-    }
+    unsigned short *dat=get_dat_layer(lvl);
+    unsigned long i;
+    for (i=0; i<lvl->subsize.x*lvl->subsize.y; i++)
+        dat[i]=read_int16_le_buf(mem->content+i*2);
     /*message_log("  load_dat: Reading entries finished"); */
     memfile_free(&mem);
+    level_mark_map_changed(lvl);
     /*message_log("  load_dat: Loaded file memory freed"); */
     return ERR_NONE;
 }
 
+/**
+ * Reads compiled script, stored next to the TXT script file, into
+ * LEVEL structure. The compiled script is used only if it was compiled
+ * from the same TXT file content.
+ * @param lvl Pointer to the LEVEL structure.
+ * @param txt_fname Name of the TXT script file.
+ * @param txt_mem The TXT script file content.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short load_scc(struct LEVEL *lvl,const char *txt_fname,const struct MEMORY_FILE *txt_mem)
+{
+    char *fname;
+    fname=mapfile_name_with_ext(txt_fname,"scc");
+    if (fname==NULL)
+        return ERR_CANT_MALLOC;
+    struct MEMORY_FILE *mem;
+    short result;
+    result = mapfile_read(&mem,fname);
+    free(fname);
+    if (result != MFILE_OK)
+        return result;
+    struct DK_SCRIPT_CODE *code=(struct DK_SCRIPT_CODE *)mem->content;
+    /* The TXT content is hashed only if there's a compiled script to compare */
+    if ((!script_code_check(code,mem->len,&(lvl->optns.script)))||
+        (code->ops_count!=lvl->script.lines_count)||
+        (code->txt_hash!=script_data_hash(txt_mem->content,txt_mem->len)))
+    {
+        message_log("  load_scc: compiled script is outdated");
+        memfile_free(&mem);
+        return ERR_FILE_BADDATA;
+    }
+    script_code_free(&(lvl->script));
+    lvl->script.code=(struct DK_SCRIPT_CODE *)memfile_leave_content(&mem);
+    return ERR_NONE;
+}
+
 /**
  * Reads the TXT script file into LEVEL structure.
  * @param lvl Pointer to the LEVEL structure.
@@ -528,7 +707,7 @@ short load_txt(struct LEVEL *lvl,char *fname)
     /*Loading the file */
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
 /*    message_log("  load_txt: file readed"); */
@@ -546,8 +725,19 @@ short load_txt(struct LEVEL *lvl,char *fname)
       lines_count++;
       if (ptr!=NULL) ptr++;
     }
-    lvl->script.txt=(char **)malloc(lines_count*sizeof(unsigned char *));
-    lvl->script.list=(struct DK_SCRIPT_COMMAND **)malloc(lines_count*sizeof(struct DK_SCRIPT_COMMAND *));
+    /* Lines, with the lines and commands arrays, are stored in one arena block */
+    if (lvl->script.txt_arena==NULL)
+        memarena_new(&(lvl->script.txt_arena),0);
+    else
+        memarena_reset(lvl->script.txt_arena);
+    unsigned char *lines_buf;
+    lines_buf=(unsigned char *)memarena_alloc(lvl->script.txt_arena,
+        lines_count*(sizeof(unsigned char *)+sizeof(struct DK_SCRIPT_COMMAND *))+mem->len+lines_count);
+    if (lines_buf==NULL)
+    { memfile_free(&mem); return ERR_CANT_MALLOC; }
+    lvl->script.txt=(char **)lines_buf;
+    lvl->script.list=(struct DK_SCRIPT_COMMAND **)(lvl->script.txt+lines_count);
+    unsigned char *txtptr=(unsigned char *)(lvl->script.list+lines_count);
     ptr=mem->content;
     int currline;
     currline=0;
@@ -563,30 +753,30 @@ short load_txt(struct LEVEL *lvl,char *fname)
       int linelen=(char *)nptr-(char *)ptr;
       /*At end, skip control characters and spaces too */
       while ((linelen>0)&&((unsigned char)ptr[linelen-1]<=0x20)) linelen--;
-      lvl->script.txt[currline]=(unsigned char *)malloc((linelen+1)*sizeof(unsigned char));
+      lvl->script.txt[currline]=(char *)txtptr;
       lvl->script.list[currline]=NULL; /* decompose_script() will allocate memory for it */
-      memcpy(lvl->script.txt[currline],ptr,linelen);
-      lvl->script.txt[currline][linelen]='\0';
+      memcpy(txtptr,ptr,linelen);
+      txtptr[linelen]='\0';
+      txtptr+=linelen+1;
       ptr=nptr+1;
       currline++;
     }
 /*    message_log("  load_txt: deleting empty lines"); */
     int nonempty_lines=lines_count-1;
-    /* Delete empty lines at end */
+    /* Delete empty lines at end; their memory is left in the arena */
     while ((nonempty_lines>=0)&&((lvl->script.txt[nonempty_lines][0])=='\0'))
       nonempty_lines--;
-    currline=lines_count-1;
-    while (currline>nonempty_lines)
-    {
-      free(lvl->script.txt[currline]);
-      currline--;
-    }
     lines_count=nonempty_lines+1;
-    lvl->script.txt=(char **)realloc(lvl->script.txt,lines_count*sizeof(unsigned char *));
-    lvl->script.list=(struct DK_SCRIPT_COMMAND **)realloc(lvl->script.list,lines_count*sizeof(struct DK_SCRIPT_COMMAND *));
     lvl->script.lines_count=lines_count;
+    /* If compiled script matches the text, there's no need to analyze it */
+    result=load_scc(lvl,fname,mem);
     memfile_free(&mem);
-    decompose_script(&(lvl->script),&(lvl->optns.script));
+    if ((result!=ERR_NONE)||
+        (!script_code_to_decomposed(&(lvl->script),&(lvl->optns.script))))
+    {
+        decompose_script(&(lvl->script),&(lvl->optns.script));
+        script_compile(&(lvl->script),&(lvl->optns.script));
+    }
     script_decomposed_to_params(&(lvl->script),&(lvl->optns.script));
     return ERR_NONE;
 }
@@ -607,7 +797,7 @@ short load_lgt(struct LEVEL *lvl,char *fname)
     /*Reading file */
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
     /* Checking file size */
@@ -628,13 +818,16 @@ short load_lgt(struct LEVEL *lvl,char *fname)
           lgt_num=(mem->len-SIZEOF_DK_LGT_HEADER)/SIZEOF_DK_LGT_REC;
         result=WARN_BAD_COUNT;
     }
+    if ((lgt_num>0)&&(!mempool_reserve(lvl->lgt_pool,lgt_num)))
+    { memfile_free(&mem); return ERR_CANT_MALLOC; }
     int i;
     for (i=0; i<lgt_num; i++)
     {
-      stlight=(unsigned char *)malloc(SIZEOF_DK_LGT_REC);
+      stlight=mempool_alloc(lvl->lgt_pool);
       if (stlight==NULL)
       {
         message_error("Cannot allocate mem for loading static lights");
+        memfile_free(&mem);
         return ERR_CANT_MALLOC;
       }
       memcpy (stlight, mem->content+SIZEOF_DK_LGT_REC*i+SIZEOF_DK_LGT_HEADER, SIZEOF_DK_LGT_REC);
@@ -663,19 +856,14 @@ short load_wlb(struct LEVEL *lvl,char *fname)
     /*Reading file */
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
     /*If wrong filesize - don't load */
     if (mem->len != lvl->tlsize.x*lvl->tlsize.y)
     { memfile_free(&mem); return ERR_FILE_BADDATA; }
-    int i,j;
-    for (i=0;i<lvl->tlsize.y;i++)
-      for (j=0;j<lvl->tlsize.x;j++)
-      {
-        int mempos=i*lvl->tlsize.x+j;
-        lvl->wlb[j][i]=mem->content[mempos];
-      }
+    /* File layout is the same as in memory */
+    memcpy(get_wlb_layer(lvl),mem->content,mem->len);
     memfile_free(&mem);
     return ERR_NONE;
 }
@@ -694,23 +882,17 @@ short load_flg(struct LEVEL *lvl,char *fname)
     /*Loading the file */
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
         return result;
     /* Checking file size */
     if ((mem->len!=line_len*lvl->subsize.y))
     { memfile_free(&mem); return ERR_FILE_BADDATA; }
     /*Reading entries */
-    int sx, sy;
-    unsigned long addr;
-    for (sy=0; sy<lvl->subsize.y; sy++)
-    {
-      addr = sy*line_len;
-      for (sx=0; sx<lvl->subsize.x; sx++)
-      {
-          set_subtl_flg(lvl,sx,sy,read_int16_le_buf(mem->content+addr+sx*2));
-      }
-    }
+    unsigned short *flg=get_flg_layer(lvl);
+    unsigned long i;
+    for (i=0; i<lvl->subsize.x*lvl->subsize.y; i++)
+        flg[i]=read_int16_le_buf(mem->content+i*2);
     memfile_free(&mem);
     return ERR_NONE;
 }
@@ -833,7 +1015,7 @@ short script_load_and_execute_file(struct LEVEL *lvl,char *fname,char *err_msg)
     /*Loading the file */
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
     {
         strncpy(err_msg,memfile_error(result),LINEMSG_SIZE);
@@ -858,7 +1040,7 @@ short load_text_file(char ***lines,int *lines_count,char *fname)
     /*Loading the file */
     struct MEMORY_FILE *mem;
     short result;
-    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    result = mapfile_read(&mem,fname);
     if (result != MFILE_OK)
     { return result; }
 /*    message_log("  load_text_file: file readed"); */
@@ -954,14 +1136,7 @@ short write_own(struct LEVEL *lvl,char *fname)
     if (fp==NULL)
       return ERR_CANT_OPENWR;
     /*Writing data */
-    int sx,sy;
-    for (sy=0; sy<lvl->subsize.y; sy++)
-    {
-      for (sx=0; sx<lvl->subsize.x; sx++)
-      {
-          fputc (get_subtl_owner(lvl,sx,sy), fp);
-      }
-    }
+    fwrite(get_owner_layer(lvl), lvl->subsize.x*lvl->subsize.y, 1, fp);
     fclose (fp);
     return ERR_NONE;
 }
@@ -1058,12 +1233,7 @@ short write_wib(struct LEVEL *lvl,char *fname)
     fp = fopen (fname, "wb");
     if (fp==NULL)
       return ERR_CANT_OPENWR;
-    int i, j;
-    for (i=0; i < lvl->subsize.y; i++)
-    {
-      for (j=0; j<lvl->subsize.x; j++)
-          fputc (get_subtl_wib(lvl,j,i), fp);
-    }
+    fwrite(get_wib_layer(lvl), lvl->subsize.x*lvl->subsize.y, 1, fp);
     fclose (fp);
     return ERR_NONE;
 }
@@ -1197,6 +1367,62 @@ short write_txt(struct LEVEL *lvl,char *fname)
     return write_text_file(lvl->script.txt,lvl->script.lines_count,fname);
 }
 
+/**
+ * Writes the compiled TXT script from LEVEL structure into disk.
+ * The script lines are compiled again, so that the compiled script
+ * always matches TXT file written from the same lines.
+ * save_dk1_map() writes it only if save_compiled_script option is set.
+ * @see load_scc
+ * @param lvl Pointer to the LEVEL structure.
+ * @param fname Destination file name.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short write_scc(struct LEVEL *lvl,char *fname)
+{
+    message_log(" write_scc: starting");
+    const int lines_count=lvl->script.lines_count;
+    struct MEMORY_ARENA *arena;
+    if (!memarena_new(&arena,0))
+        return ERR_CANT_MALLOC;
+    struct DK_SCRIPT_COMMAND **cmds;
+    cmds=(struct DK_SCRIPT_COMMAND **)memarena_alloc(arena,
+        lines_count*(sizeof(struct DK_SCRIPT_COMMAND *)+sizeof(struct DK_SCRIPT_COMMAND)));
+    if (cmds==NULL)
+    {
+        memarena_free(&arena);
+        return ERR_CANT_MALLOC;
+    }
+    struct DK_SCRIPT_COMMAND *cmd=(struct DK_SCRIPT_COMMAND *)(cmds+lines_count);
+    int i;
+    for (i=0;i<lines_count;i++,cmd++)
+    {
+        script_command_clear(cmd);
+        cmd->arena=arena;
+        decompose_script_command(cmd,lvl->script.txt[i],&(lvl->optns.script));
+        cmds[i]=cmd;
+    }
+    struct DK_SCRIPT_CODE *code;
+    code=script_code_compile(cmds,lines_count,&(lvl->optns.script));
+    memarena_free(&arena);
+    if (code==NULL)
+        return ERR_CANT_MALLOC;
+    code->txt_hash=script_lines_hash(lvl->script.txt,lines_count);
+    code->code_hash=script_code_hash(code);
+    FILE *fp;
+    fp = fopen (fname, "wb");
+    if (fp==NULL)
+    {
+        free(code);
+        return ERR_CANT_OPENWR;
+    }
+    short result=ERR_NONE;
+    if (fwrite(code,code->size,1,fp)!=1)
+        result=ERR_CANT_WRITE;
+    fclose(fp);
+    free(code);
+    return result;
+}
+
 /**
  * Writes the LGT file from LEVEL structure into disk.
  * @param lvl Pointer to the LEVEL structure.
@@ -1246,12 +1472,7 @@ short write_wlb(struct LEVEL *lvl,char *fname)
     fp = fopen (fname, "wb");
     if (fp==NULL)
       return ERR_CANT_OPENWR;
-    int i, j;
-    for (i=0; i < lvl->tlsize.y; i++)
-    {
-      for (j=0; j < lvl->tlsize.x; j++)
-          fputc(lvl->wlb[j][i], fp);
-    }
+    fwrite(get_wlb_layer(lvl), lvl->tlsize.x*lvl->tlsize.y, 1, fp);
     fclose(fp);
     return ERR_NONE;
 }
@@ -1335,8 +1556,9 @@ short write_nfo(struct LEVEL *lvl,char *fname)
     if ((lvl->info.editor_text!=NULL)&&(lvl->info.editor_text[0]!='\0'))
         sprintf(line+strlen(line),", Editor: %s",lvl->info.editor_text);
     strcat(line,", Created on ");
+    struct tm creat_tm;
     strftime(line+strlen(line),LINEMSG_SIZE/2, "%d %b %Y",
-        gmtime(&lvl->info.creat_date) );
+        gmtime_safe(&lvl->info.creat_date,&creat_tm) );
     text_file_linecp_add(&lines,&lines_count,line);
     strcpy(line,"Keepers: ");
     /*Clearing array for storing players heart count */
@@ -1443,16 +1665,95 @@ short write_text_file(char **lines,int lines_count,char *fname)
     return ERR_NONE;
 }
 
+/**
+ * Compresses a file which was already written, replacing it with
+ * RNC-packed version. The packed data goes to a temporary file first,
+ * and replaces the original only when it was written completely.
+ * @param fname Name of the file to compress.
+ * @param level RNC compression level.
+ * @return Returns ERR_NONE on success, error code on failure.
+ */
+short pack_mapfile(const char *fname,short level)
+{
+    struct MEMORY_FILE *mem;
+    short result;
+    result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+    if (result != MFILE_OK)
+        return result;
+    unsigned char *packed;
+    packed = (unsigned char *)malloc(RNC_PACK_BOUND(mem->len));
+    if (packed==NULL)
+    {
+        memfile_free(&mem);
+        return ERR_CANT_MALLOC;
+    }
+    long plen;
+    plen = rnc_pack(mem->content,mem->len,packed,level);
+    memfile_free(&mem);
+    if (plen<0)
+    {
+        free(packed);
+        /* Packer errors aren't library error codes */
+        switch (plen)
+        {
+        case RNC_MALLOC_ERROR:
+            return ERR_CANT_MALLOC;
+        case RNC_HEADER_VAL_ERROR:
+            /* The file is too large to be packed */
+            return ERR_FILE_BADDATA;
+        default:
+            return ERR_INTERNAL;
+        }
+    }
+    /* Write to a temporary file, so the raw one survives a failed write */
+    char *tmpfname;
+    tmpfname = (char *)malloc(strlen(fname)+5);
+    if (tmpfname==NULL)
+    {
+        free(packed);
+        return ERR_CANT_MALLOC;
+    }
+    sprintf(tmpfname,"%s.tmp",fname);
+    FILE *fp;
+    fp = fopen (tmpfname, "wb");
+    if (fp==NULL)
+    {
+        free(tmpfname);
+        free(packed);
+        return ERR_CANT_OPENWR;
+    }
+    result=ERR_NONE;
+    if (fwrite(packed,plen,1,fp)!=1)
+        result=ERR_CANT_WRITE;
+    if (fclose(fp)!=0)
+        result=ERR_CANT_WRITE;
+    free(packed);
+    if (result==ERR_NONE)
+    {
+        /* On Windows, rename() won't replace an existing file */
+        remove(fname);
+        if (rename(tmpfname,fname)!=0)
+            result=ERR_CANT_WRITE;
+    }
+    if (result!=ERR_NONE)
+        remove(tmpfname);
+    free(tmpfname);
+    return result;
+}
+
 /**
  * Saves any map file, showing error/warning message if it is required.
  * @param lvl Pointer to the LEVEL structure.
  * @param fext Extension of destination file name.
  * @param write_file The writing function.
+ * @param pack_flag The MFPACK_* flag of the file; if it is set in level
+ *     options, the file is RNC-compressed after writing.
  * @param saved_files Saved files counter. Incremented if save is successful.
  * @param result Result value. Set to error code if error occures, otherwise left unchanged.
  * @return Returns ERR_NONE on success, error code on failure.
  */
-short save_mapfile(struct LEVEL *lvl,char *mfname,char *fext,mapfile_io_func write_file,int *saved_files,short *result)
+short save_mapfile(struct LEVEL *lvl,char *mfname,char *fext,mapfile_io_func write_file,
+    unsigned int pack_flag,int *saved_files,short *result)
 {
   short file_result;
   char *fname;
@@ -1466,6 +1767,13 @@ short save_mapfile(struct LEVEL *lvl,char *mfname,char *fext,mapfile_io_func wri
   }
   sprintf (fname, "%s.%s", mfname,fext);
   file_result=write_file(lvl,fname);
+  if ((file_result>=ERR_NONE)&&((lvl->optns.save_pack_files&pack_flag)!=0))
+  {
+      short pack_result;
+      pack_result=pack_mapfile(fname,lvl->optns.save_pack_level);
+      if (pack_result<ERR_NONE)
+          file_result=pack_result;
+  }
   if (file_result==ERR_NONE)
   {
       (*saved_files)++;
@@ -1505,35 +1813,42 @@ short save_dk1_map(struct LEVEL *lvl)
     short result=ERR_NONE;
     int saved_files=0;
     int total_files=0;
-    save_mapfile(lvl,lvl->savfname,"slb",write_slb,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"slb",write_slb,MFPACK_SLB,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"own",write_own,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"own",write_own,MFPACK_OWN,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"dat",write_dat,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"dat",write_dat,MFPACK_DAT,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"clm",write_clm,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"clm",write_clm,MFPACK_CLM,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"tng",write_tng,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"tng",write_tng,MFPACK_TNG,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"apt",write_apt,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"apt",write_apt,MFPACK_APT,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"wib",write_wib,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"wib",write_wib,MFPACK_WIB,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"inf",write_inf,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"inf",write_inf,MFPACK_INF,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"txt",write_txt,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"txt",write_txt,MFPACK_TXT,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"lgt",write_lgt,&saved_files,&result);
+    /* Compiled script only speeds up loading; it's not an error if it can't be saved */
+    if (lvl->optns.save_compiled_script)
+    {
+      short scc_result=ERR_NONE;
+      int scc_saved=0;
+      save_mapfile(lvl,lvl->savfname,"scc",write_scc,MFPACK_NONE,&scc_saved,&scc_result);
+    }
+    save_mapfile(lvl,lvl->savfname,"lgt",write_lgt,MFPACK_LGT,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"wlb",write_wlb,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"wlb",write_wlb,MFPACK_WLB,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"flg",write_flg,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"flg",write_flg,MFPACK_FLG,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"lif",write_lif,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"lif",write_lif,MFPACK_LIF,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"vsn",write_vsn,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"vsn",write_vsn,MFPACK_VSN,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"adi",write_adi_script,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"adi",write_adi_script,MFPACK_ADI,&saved_files,&result);
     total_files++;
 
     if ((result==ERR_NONE)||(strlen(lvl->fname)<1))
@@ -1551,7 +1866,7 @@ short save_nfo_file(struct LEVEL *lvl)
     message_log(" save_dk1_map: started");
     int saved_files=0;
     short result=ERR_NONE;
-    return save_mapfile(lvl,lvl->fname,"nfo",write_nfo,&saved_files,&result);
+    return save_mapfile(lvl,lvl->fname,"nfo",write_nfo,MFPACK_NONE,&saved_files,&result);
 }
 
 /**
@@ -1576,36 +1891,36 @@ short save_dke_map(struct LEVEL *lvl)
       message_error("Error: Save not supported for extender map format");
       result=ERR_INTERNAL;
 /*
-    save_mapfile(lvl,"slb",write_slb,&saved_files,&result);
+    save_mapfile(lvl,"slb",write_slb,MFPACK_SLB,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,"own",write_own,&saved_files,&result);
+    save_mapfile(lvl,"own",write_own,MFPACK_OWN,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,"dat",write_dat,&saved_files,&result);
+    save_mapfile(lvl,"dat",write_dat,MFPACK_DAT,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,"clm",write_clm,&saved_files,&result);
+    save_mapfile(lvl,"clm",write_clm,MFPACK_CLM,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,"tng",write_tng,&saved_files,&result);
+    save_mapfile(lvl,"tng",write_tng,MFPACK_TNG,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,"apt",write_apt,&saved_files,&result);
+    save_mapfile(lvl,"apt",write_apt,MFPACK_APT,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,"wib",write_wib,&saved_files,&result);
+    save_mapfile(lvl,"wib",write_wib,MFPACK_WIB,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,"inf",write_inf,&saved_files,&result);
+    save_mapfile(lvl,"inf",write_inf,MFPACK_INF,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,"txt",write_txt,&saved_files,&result);
+    save_mapfile(lvl,"txt",write_txt,MFPACK_TXT,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,"lgt",write_lgt,&saved_files,&result);
+    save_mapfile(lvl,"lgt",write_lgt,MFPACK_LGT,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,"wlb",write_wlb,&saved_files,&result);
+    save_mapfile(lvl,"wlb",write_wlb,MFPACK_WLB,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,"flg",write_flg,&saved_files,&result);
+    save_mapfile(lvl,"flg",write_flg,MFPACK_FLG,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,"lif",write_lif,&saved_files,&result);
+    save_mapfile(lvl,"lif",write_lif,MFPACK_LIF,&saved_files,&result);
     total_files++;
 */
-    save_mapfile(lvl,lvl->savfname,"vsn",write_vsn,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"vsn",write_vsn,MFPACK_VSN,&saved_files,&result);
     total_files++;
-    save_mapfile(lvl,lvl->savfname,"adi",write_adi_script,&saved_files,&result);
+    save_mapfile(lvl,lvl->savfname,"adi",write_adi_script,MFPACK_ADI,&saved_files,&result);
     total_files++;
 
     if ((result==ERR_NONE)||(strlen(lvl->fname)<1))
@@ -1781,7 +2096,7 @@ short load_mapfile_msg(struct LEVEL *lvl,char *fext,mapfile_iomsg_func load_file
   err_msg[0]='\0';
   /*Loading the file */
   struct MEMORY_FILE *mem;
-  file_result = memfile_readnew(&mem,fname,MAX_FILE_SIZE);
+  file_result = mapfile_read(&mem,fname);
   if (file_result != MFILE_OK)
   {
       if (flags&LFF_IGNORE_CANNOT_LOAD)
@@ -1872,6 +2187,13 @@ short load_dk1_map(struct LEVEL *lvl)
   int loaded_files=0;
   /*int total_files=0;
   short file_result;*/
+  /* Read all files at once; they're parsed in the same order as before */
+  static const char *prefetch_fexts[]={"slb","own","tng","dat","apt",
+      "lgt","clm","wib","txt","inf","wlb","flg","lif","vsn","adi"};
+  struct MAPFILE_PREFETCH_LIST prefetch;
+  if (mapfiles_prefetch(lvl,&prefetch,prefetch_fexts,
+      sizeof(prefetch_fexts)/sizeof(prefetch_fexts[0])))
+      mapfiles_prefetched=&prefetch;
   /* Crucial files */
   if (result>=ERR_NONE)
       load_mapfile(lvl,"slb",load_slb,&loaded_files,&result,LFF_IGNORE_NONE);
@@ -1906,6 +2228,8 @@ short load_dk1_map(struct LEVEL *lvl)
       load_mapfile(lvl,"vsn",load_vsn,&loaded_files,&result,LFF_IGNORE_WITHOUT_WARN);
   if (result>=ERR_NONE)
       load_mapfile_msg(lvl,"adi",script_load_and_execute,&loaded_files,&result,LFF_IGNORE_WITHOUT_WARN);
+  mapfiles_prefetched=NULL;
+  mapfiles_prefetch_free(&prefetch);
 
   if (result<ERR_NONE)
   {
@@ -55,6 +55,49 @@ enum LEVEL_FILE_FLAGS {
     LFF_DONT_EVEN_WARN            = 0x0004,
     };
 
+/**
+ * Map file which is read before its load function is called.
+ */
+struct MAPFILE_PREFETCH {
+    char *fname;
+    struct MEMORY_FILE *mem;
+    short result;
+    };
+
+/**
+ * List of map files read in advance, and part of it assigned to one thread.
+ */
+struct MAPFILE_PREFETCH_LIST {
+    struct MAPFILE_PREFETCH *items;
+    int count;
+    /* Index of first item read by the thread, and step between items */
+    int first;
+    int step;
+    };
+
+/**
+ * Flags selecting map files which are RNC-compressed when saving.
+ */
+enum MAPFILE_PACK_FLAGS {
+    MFPACK_NONE     = 0x0000,
+    MFPACK_SLB      = 0x0001,
+    MFPACK_OWN      = 0x0002,
+    MFPACK_DAT      = 0x0004,
+    MFPACK_CLM      = 0x0008,
+    MFPACK_TNG      = 0x0010,
+    MFPACK_APT      = 0x0020,
+    MFPACK_WIB      = 0x0040,
+    MFPACK_INF      = 0x0080,
+    MFPACK_TXT      = 0x0100,
+    MFPACK_LGT      = 0x0200,
+    MFPACK_WLB      = 0x0400,
+    MFPACK_FLG      = 0x0800,
+    MFPACK_LIF      = 0x1000,
+    MFPACK_VSN      = 0x2000,
+    MFPACK_ADI      = 0x4000,
+    MFPACK_ALL      = 0x7fff,
+    };
+
 #define LFF_IGNORE_NONE (0)
 #define LFF_IGNORE_ALL (LFF_IGNORE_INTERNAL|LFF_IGNORE_CANNOT_LOAD)
 #define LFF_IGNORE_WITHOUT_WARN (LFF_IGNORE_INTERNAL|LFF_IGNORE_CANNOT_LOAD|LFF_DONT_EVEN_WARN)
@@ -80,4 +123,12 @@ DLLIMPORT short write_def_tng_source(struct LEVEL *lvl,char *fname);
 
 DLLIMPORT char *levfile_error(int errcode);
 
+short mapfile_read(struct MEMORY_FILE **mem,const char *fname);
+char *mapfile_name_with_ext(const char *fname,const char *fext);
+void mapfiles_prefetch_read(void *param);
+short mapfiles_prefetch(struct LEVEL *lvl,struct MAPFILE_PREFETCH_LIST *list,
+    const char *fexts[],int count);
+void mapfiles_prefetch_free(struct MAPFILE_PREFETCH_LIST *list);
+short pack_mapfile(const char *fname,short level);
+
 #endif /* ADIKT_LEVFILES_H */
@@ -28,6 +28,10 @@
 #include "lev_things.h"
 #include "obj_actnpts.h"
 #include "msg_log.h"
+#include "lbcontext.h"
+#include "bulcommn.h"
+#include "lbthreads.h"
+#include "memarena.h"
 
 /* Conditional statements */
 const char if_cmdtext[]="IF";
@@ -525,6 +529,29 @@ short script_param_to_int(int *val,const char *param)
     n_read=sscanf(param+2,"%x",val);
   } else
   {
+    /* Words which aren't numbers, and short numbers, are checked */
+    /* without sscanf(), which is slow; results are the same */
+    const char *ptr=param;
+    while (isspace((unsigned char)*ptr))
+      ptr++;
+    short negative=(*ptr=='-');
+    if ((*ptr=='-')||(*ptr=='+'))
+      ptr++;
+    if (!isdigit((unsigned char)*ptr))
+      return false;
+    int num=0;
+    int digits=0;
+    while ((digits<9)&&(isdigit((unsigned char)*ptr)))
+    {
+      num=num*10+(*ptr-'0');
+      digits++;
+      ptr++;
+    }
+    if (!isdigit((unsigned char)*ptr))
+    {
+      (*val)=negative?-num:num;
+      return true;
+    }
     n_read=sscanf(param,"%d",val);
   }
   return (n_read==1);
@@ -826,9 +853,10 @@ short string_is_decimal_number(const char *str,const short allow_sign)
   return true;
 }
 
-short script_cmd_verify_arg_actnpt(__attribute__((unused)) struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,
+short script_cmd_verify_arg_actnpt(struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,
         const char *param,const short allow_herogate,const short allow_plyrheart)
 {
+    scverif->flags|=SVF_USES_OBJECTS;
     if (allow_plyrheart)
     {
       int cmd_idx;
@@ -1275,10 +1303,11 @@ short script_cmd_verify_arg_party_objectv(__attribute__((unused)) struct SCRIPT_
     return true;
 }
 
-short script_cmd_verify_arg_party_name(__attribute__((unused)) struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,
+short script_cmd_verify_arg_party_name(struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,
         const char *param,const short create_new,int *party_idx)
 {
     int i;
+    scverif->flags|=SVF_USES_PARTYS;
     if (create_new)
     {
         i=0;
@@ -1292,7 +1321,9 @@ short script_cmd_verify_arg_party_name(__attribute__((unused)) struct SCRIPT_VER
             sprintf(err_msg,"Amount of partys in script exceeds %d",MAX_PARTYS);
             return false;
         }
-        scverif->partys[i]=strdup(param);
+        /* Names are not copied - they're kept in the script commands */
+        scverif->partys[i]=param;
+        scverif->flags|=SVF_ADDS_PARTY;
         (*party_idx)=i;
     } else
     {
@@ -1474,7 +1505,7 @@ short script_cmd_verify_arg_specval(__attribute__((unused)) struct SCRIPT_VERIFY
     return false;
 }
 
-short script_cmd_verify_condit(__attribute__((unused)) struct SCRIPT_VERIFY_DATA *scverif,
+short script_cmd_verify_condit(struct SCRIPT_VERIFY_DATA *scverif,
     char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
 {
     int plyr_idx;
@@ -1718,7 +1749,7 @@ short script_cmd_verify_condit(__attribute__((unused)) struct SCRIPT_VERIFY_DATA
     return VERIF_OK;
 }
 
-short script_cmd_verify_party(__attribute__((unused)) struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
+short script_cmd_verify_party(struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
 {
     int i;
     int plyr_idx;
@@ -1988,7 +2019,7 @@ short script_cmd_verify_party(__attribute__((unused)) struct SCRIPT_VERIFY_DATA
     return VERIF_OK;
 }
 
-short script_cmd_verify_avail(__attribute__((unused)) struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
+short script_cmd_verify_avail(struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
 {
     int plyr_idx;
     int crtr_idx;
@@ -2149,7 +2180,7 @@ short script_cmd_verify_avail(__attribute__((unused)) struct SCRIPT_VERIFY_DATA
     return VERIF_OK;
 }
 
-short script_cmd_verify_custobj(__attribute__((unused)) struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
+short script_cmd_verify_custobj(struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
 {
     int plyr_idx;
     int i;
@@ -2321,7 +2352,7 @@ short script_cmd_verify_custobj(__attribute__((unused)) struct SCRIPT_VERIFY_DAT
     return VERIF_OK;
 }
 
-short script_cmd_verify_setup(__attribute__((unused)) struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
+short script_cmd_verify_setup(struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
 {
     int obj_type;
     int i;
@@ -2548,7 +2579,7 @@ short script_cmd_verify_setup(__attribute__((unused)) struct SCRIPT_VERIFY_DATA
     return VERIF_OK;
 }
 
-short script_cmd_verify_triger(__attribute__((unused)) struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
+short script_cmd_verify_triger(struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
 {
     int plyr_idx;
     int i;
@@ -2644,7 +2675,7 @@ short script_cmd_verify_triger(__attribute__((unused)) struct SCRIPT_VERIFY_DATA
     return VERIF_OK;
 }
 
-short script_cmd_verify_crtradj(__attribute__((unused)) struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
+short script_cmd_verify_crtradj(struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
 {
     int i;
     int plyr_idx;
@@ -2847,94 +2878,283 @@ short txt_verify(const struct LEVEL *lvl, char *err_msg,struct IPOINT_2D *errpt)
     return result;
 }
 
+/*
+ * Verifies single script command, updating the verification state.
+ * Returns VERIF_ERROR, VERIF_WARN or VERIF_OK
+ */
+short script_command_verify(struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,
+    int *err_param,const struct DK_SCRIPT_COMMAND *cmd)
+{
+    switch (cmd->group)
+    {
+    case CMD_CONDIT:
+        return script_cmd_verify_condit(scverif,err_msg,err_param,cmd);
+    case CMD_PARTY:
+        return script_cmd_verify_party(scverif,err_msg,err_param,cmd);
+    case CMD_AVAIL:
+        return script_cmd_verify_avail(scverif,err_msg,err_param,cmd);
+    case CMD_CUSTOBJ:
+        return script_cmd_verify_custobj(scverif,err_msg,err_param,cmd);
+    case CMD_SETUP:
+        return script_cmd_verify_setup(scverif,err_msg,err_param,cmd);
+    case CMD_TRIGER:
+        return script_cmd_verify_triger(scverif,err_msg,err_param,cmd);
+    case CMD_CRTRADJ:
+        return script_cmd_verify_crtradj(scverif,err_msg,err_param,cmd);
+    case CMD_COMMNT:
+        return script_cmd_verify_commnt(scverif,err_msg,err_param,cmd);
+    case CMD_OBSOLT:
+        return script_cmd_verify_obsol(scverif,err_msg,err_param,cmd);
+    case CMD_UNKNOWN:
+        sprintf(err_msg,"Unrecognized script command");
+        return VERIF_WARN;
+    case CMD_ADIKTED:
+        sprintf(err_msg,"%s specific command used in DK script",PROGRAM_NAME);
+        return VERIF_WARN;
+    default:
+        sprintf(err_msg,"Internal - bad script command group");
+        return VERIF_WARN;
+    }
+}
+
+/*
+ * Sets the amount of lines in verification cache; if it changes,
+ * all lines are marked as changed.
+ */
+short script_verify_cache_resize(struct SCRIPT_VERIFY_CACHE *cache,int lines_count)
+{
+    if (cache->lines_count==lines_count)
+        return true;
+    struct SCRIPT_VERIFY_LINE *lines;
+    lines=(struct SCRIPT_VERIFY_LINE *)realloc(cache->lines,(lines_count+1)*sizeof(struct SCRIPT_VERIFY_LINE));
+    if (lines==NULL)
+    {
+        message_error("script_verify_cache_resize: Cannot allocate memory");
+        return false;
+    }
+    cache->lines=lines;
+    cache->lines_count=lines_count;
+    int i;
+    for (i=0; i<lines_count; i++)
+    {
+        lines[i].verify_needed=true;
+        lines[i].result=VERIF_OK;
+        lines[i].err_param=ERR_SCRIPTPARAM_WHOLE;
+        lines[i].flags=SVF_NONE;
+        lines[i].level=0;
+        lines[i].level_delta=0;
+        lines[i].ifs_delta=0;
+        lines[i].nest_needed=true;
+        lines[i].nest=0;
+    }
+    cache->nest_end=0;
+    return true;
+}
+
+/*
+ * Frees data inside verification cache, and clears it.
+ */
+void script_verify_cache_clear(struct SCRIPT_VERIFY_CACHE *cache)
+{
+    free(cache->lines);
+    cache->lines=NULL;
+    cache->lines_count=-1;
+    free(cache->herogts);
+    cache->herogts=NULL;
+    cache->herogts_count=0;
+    free(cache->actnpts);
+    cache->actnpts=NULL;
+    cache->actnpts_count=0;
+    cache->objs_valid=false;
+    cache->objs_gen=0;
+    cache->nest_end=0;
+}
+
+/*
+ * Prepares verification cache of given script, marking all lines as changed.
+ * Creates the cache if it doesn't exist.
+ */
+short script_verify_cache_reset(struct DK_SCRIPT *script)
+{
+    if (script==NULL) return false;
+    if (script->verif==NULL)
+    {
+        script->verif=(struct SCRIPT_VERIFY_CACHE *)malloc(sizeof(struct SCRIPT_VERIFY_CACHE));
+        if (script->verif==NULL)
+        {
+            message_error("script_verify_cache_reset: Cannot allocate memory");
+            return false;
+        }
+        script->verif->lines=NULL;
+        script->verif->herogts=NULL;
+        script->verif->actnpts=NULL;
+    }
+    script_verify_cache_clear(script->verif);
+    return script_verify_cache_resize(script->verif,script->lines_count);
+}
+
+/*
+ * Frees verification cache of a script.
+ */
+void script_verify_cache_free(struct SCRIPT_VERIFY_CACHE **cache)
+{
+    if ((*cache)!=NULL)
+    {
+        script_verify_cache_clear(*cache);
+        free(*cache);
+    }
+    (*cache)=NULL;
+}
+
+/*
+ * Lists hero gates and action points of the level, unless they were listed
+ * since last level modification. Sets 'changed' if they're different than
+ * the ones listed before.
+ */
+short script_verify_cache_update_objects(const struct LEVEL *lvl,
+    struct SCRIPT_VERIFY_CACHE *cache,char *err_msg,short *changed)
+{
+    (*changed)=false;
+    if ((cache->objs_valid)&&(cache->objs_gen==lvl->mod_gen))
+        return true;
+    unsigned char *herogts;
+    unsigned int herogts_count=256;
+    if (!create_herogate_number_used_arr(lvl,&herogts,&herogts_count))
+    {
+        sprintf(err_msg,"hero gates");
+        return false;
+    }
+    unsigned char *actnpts;
+    unsigned int actnpts_count=256;
+    if (!create_actnpt_number_used_arr(lvl,&actnpts,&actnpts_count))
+    {
+        free(herogts);
+        sprintf(err_msg,"action points");
+        return false;
+    }
+    if ((!cache->objs_valid)||(herogts_count!=cache->herogts_count)||
+        (actnpts_count!=cache->actnpts_count)||
+        (memcmp(herogts,cache->herogts,herogts_count)!=0)||
+        (memcmp(actnpts,cache->actnpts,actnpts_count)!=0))
+      (*changed)=true;
+    free(cache->herogts);
+    free(cache->actnpts);
+    cache->herogts=herogts;
+    cache->herogts_count=herogts_count;
+    cache->actnpts=actnpts;
+    cache->actnpts_count=actnpts_count;
+    cache->objs_gen=lvl->mod_gen;
+    cache->objs_valid=true;
+    return true;
+}
+
 /*
  * Verifies TXT entries. Returns VERIF_ERROR,
  * VERIF_WARN or VERIF_OK
+ * Lines which weren't changed since previous call are not verified again,
+ * unless they depend on something which was changed. Note that the cache
+ * inside script is updated, so the level shouldn't be verified by two
+ * threads at once.
  */
 short dkscript_verify(const struct LEVEL *lvl, char *err_msg,int *err_line,int *err_param)
 {
+    const struct DK_SCRIPT *script=&(lvl->script);
+    struct SCRIPT_VERIFY_CACHE tmp_cache;
+    struct SCRIPT_VERIFY_CACHE *cache=script->verif;
+    /* If there's no cache in the script, use a temporary one */
+    if (cache==NULL)
+    {
+        tmp_cache.lines=NULL;
+        tmp_cache.herogts=NULL;
+        tmp_cache.actnpts=NULL;
+        script_verify_cache_clear(&tmp_cache);
+        cache=&tmp_cache;
+    }
     char child_err_msg[LINEMSG_SIZE];
     child_err_msg[0]='\0';
-    struct SCRIPT_VERIFY_DATA scverif;
-    scverif.dnhearts_count=0;
-    scverif.herogts_count=256;
-    if (!create_herogate_number_used_arr(lvl,&(scverif.herogts),&(scverif.herogts_count)))
-        sprintf(child_err_msg,"hero gates");
-    scverif.actnpts_count=256;
-    if (!create_actnpt_number_used_arr(lvl,&(scverif.actnpts),&(scverif.actnpts_count)))
-        sprintf(child_err_msg,"action points");
-    if (child_err_msg[0]!='\0')
+    short objs_changed;
+    if (!script_verify_cache_update_objects(lvl,cache,child_err_msg,&objs_changed))
     {
         sprintf(err_msg,"Internal - cannot list %s to verify script",child_err_msg);
+        if (cache==&tmp_cache)
+            script_verify_cache_clear(&tmp_cache);
+        return VERIF_WARN;
+    }
+    if (!script_verify_cache_resize(cache,script->lines_count))
+    {
+        sprintf(err_msg,"Internal - cannot allocate memory to verify script");
+        if (cache==&tmp_cache)
+            script_verify_cache_clear(&tmp_cache);
         return VERIF_WARN;
     }
+    struct SCRIPT_VERIFY_DATA scverif;
+    scverif.dnhearts=NULL;
+    scverif.dnhearts_count=0;
+    scverif.herogts=cache->herogts;
+    scverif.herogts_count=cache->herogts_count;
+    scverif.actnpts=cache->actnpts;
+    scverif.actnpts_count=cache->actnpts_count;
     scverif.level=0;
     scverif.total_ifs=0;
     scverif.total_in_pool=0;
-    scverif.partys=(char **)malloc((MAX_PARTYS+1)*sizeof(char *));
-    if (scverif.partys==NULL)
-    {
-      message_error("txt_verify: Cannot allocate memory");
-      return VERIF_WARN;
-    }
+    const char *partys[MAX_PARTYS+1];
+    scverif.partys=partys;
     int i;
     for (i=0; i<(MAX_PARTYS+1); i++)
-      scverif.partys[i]=NULL;
+      partys[i]=NULL;
+    int partys_count=0;
+    short partys_changed=false;
 
     short result=VERIF_OK;
-    /*Sweeping through TXT entries */
-    for (i=0; i<lvl->script.lines_count; i++)
-    {
-        struct DK_SCRIPT_COMMAND *cmd;
-        cmd=lvl->script.list[i];
-        switch (cmd->group)
+    /*Sweeping through TXT entries; unchanged lines only update the state */
+    for (i=0; i<script->lines_count; i++)
+    {
+        const struct DK_SCRIPT_COMMAND *cmd;
+        cmd=script->list[i];
+        struct SCRIPT_VERIFY_LINE *vline=&(cache->lines[i]);
+        short verify=vline->verify_needed;
+        /* Conditional commands check the nesting depth */
+        if ((cmd->group==CMD_CONDIT)&&(vline->level!=scverif.level))
+            verify=true;
+        if ((objs_changed)&&(vline->flags&SVF_USES_OBJECTS))
+            verify=true;
+        if ((partys_changed)&&(vline->flags&SVF_USES_PARTYS))
+            verify=true;
+        /* Error message isn't cached, so first failed line is verified again */
+        if ((result==VERIF_OK)&&(vline->result!=VERIF_OK))
+            verify=true;
+        if (verify)
+        {
+            int prev_level=scverif.level;
+            int prev_ifs=scverif.total_ifs;
+            short prev_flags=vline->flags;
+            vline->err_param=ERR_SCRIPTPARAM_WHOLE;
+            scverif.flags=SVF_NONE;
+            vline->result=script_command_verify(&scverif,child_err_msg,&(vline->err_param),cmd);
+            vline->flags=scverif.flags;
+            vline->level=prev_level;
+            vline->level_delta=scverif.level-prev_level;
+            vline->ifs_delta=scverif.total_ifs-prev_ifs;
+            vline->verify_needed=false;
+            /* Partys used by next lines may have changed */
+            if ((prev_flags|vline->flags)&SVF_ADDS_PARTY)
+                partys_changed=true;
+        } else
         {
-        case CMD_CONDIT:
-            result=script_cmd_verify_condit(&scverif,child_err_msg,err_param,cmd);
-            break;
-        case CMD_PARTY:
-            result=script_cmd_verify_party(&scverif,child_err_msg,err_param,cmd);
-            break;
-        case CMD_AVAIL:
-            result=script_cmd_verify_avail(&scverif,child_err_msg,err_param,cmd);
-            break;
-        case CMD_CUSTOBJ:
-            result=script_cmd_verify_custobj(&scverif,child_err_msg,err_param,cmd);
-            break;
-        case CMD_SETUP:
-            result=script_cmd_verify_setup(&scverif,child_err_msg,err_param,cmd);
-            break;
-        case CMD_TRIGER:
-            result=script_cmd_verify_triger(&scverif,child_err_msg,err_param,cmd);
-            break;
-        case CMD_CRTRADJ:
-            result=script_cmd_verify_crtradj(&scverif,child_err_msg,err_param,cmd);
-            break;
-        case CMD_COMMNT:
-            result=script_cmd_verify_commnt(&scverif,child_err_msg,err_param,cmd);
-            break;
-        case CMD_OBSOLT:
-            result=script_cmd_verify_obsol(&scverif,child_err_msg,err_param,cmd);
-            break;
-        case CMD_UNKNOWN:
-            sprintf(child_err_msg,"Unrecognized script command");
-            result=VERIF_WARN;
-            break;
-        case CMD_ADIKTED:
-            sprintf(child_err_msg,"%s specific command used in DK script",PROGRAM_NAME);
-            result=VERIF_WARN;
-            break;
-        default:
-            sprintf(child_err_msg,"Internal - bad script command group");
-            result=VERIF_WARN;
-            break;
+            scverif.level+=vline->level_delta;
+            scverif.total_ifs+=vline->ifs_delta;
+            if (vline->flags&SVF_ADDS_PARTY)
+                partys[partys_count]=(const char *)cmd->params[0];
         }
-        /* If error found - break the for loop */
-        if (result!=VERIF_OK)
+        if (vline->flags&SVF_ADDS_PARTY)
+            partys_count++;
+        /* If error found - remember the first one */
+        if ((result==VERIF_OK)&&(vline->result!=VERIF_OK))
         {
+            result=vline->result;
             sprintf(err_msg,"%s at line %d.",child_err_msg,i+1);
             *err_line=i;
-            break;
+            *err_param=vline->err_param;
         }
     }
     const int max_condit_if=48;
@@ -2951,15 +3171,123 @@ short dkscript_verify(const struct LEVEL *lvl, char *err_msg,int *err_line,int *
           sprintf(err_msg,"Amount of ENDIFs is larger than of IF statements");
         result=VERIF_WARN;
     }
-    /*Freeing structure and returning */
-    for (i=0; i<16; i++)
-      free(scverif.partys[i]);
-    free(scverif.partys);
-    free(scverif.actnpts);
-    free(scverif.herogts);
+    if (cache==&tmp_cache)
+        script_verify_cache_clear(&tmp_cache);
     return result;
 }
 
+/*
+ * Marks script line as changed, so that it will be verified again
+ * and its nesting level recomputed. Compiled code of the script
+ * no longer matches the commands, so it is dropped.
+ */
+short script_line_changed(struct DK_SCRIPT *script,const int line)
+{
+    if ((script==NULL)||(line<0)||(line>=script->lines_count))
+        return false;
+    script_code_free(script);
+    struct SCRIPT_VERIFY_CACHE *cache=script->verif;
+    if ((cache==NULL)||(cache->lines_count!=script->lines_count))
+        return true;
+    cache->lines[line].verify_needed=true;
+    cache->lines[line].nest_needed=true;
+    return true;
+}
+
+/*
+ * Replaces text of a script line, and decomposes it again.
+ * Parameters of the previous command stay in the script arena
+ * until the whole script is decomposed again.
+ */
+short script_line_set(struct DK_SCRIPT *script,const int line,
+    const char *text,const struct SCRIPT_OPTIONS *optns)
+{
+    if ((script==NULL)||(text==NULL)) return false;
+    if ((line<0)||(line>=script->lines_count)) return false;
+    if (!script_line_text_store(script,line,text))
+    {
+        message_error("script_line_set: Cannot allocate memory");
+        return false;
+    }
+    struct DK_SCRIPT_COMMAND *cmd=script->list[line];
+    if (cmd==NULL)
+    {
+        cmd=script_commands_alloc(script,1);
+        script->list[line]=cmd;
+        if (cmd==NULL) return false;
+    } else
+    {
+        script_command_free_params(cmd);
+        script_command_clear(cmd);
+        cmd->arena=script->arena;
+    }
+    decompose_script_command(cmd,script->txt[line],optns);
+    return script_line_changed(script,line);
+}
+
+/*
+ * Stores copy of the text as given script line. Lines are kept in the script
+ * text arena; place of the previous line is reused if the new text fits in it.
+ */
+short script_line_text_store(struct DK_SCRIPT *script,const int line,const char *text)
+{
+    unsigned int len=strlen(text);
+    char *ntext=script->txt[line];
+    if ((ntext==NULL)||(len>strlen(ntext)))
+    {
+        if ((script->txt_arena==NULL)&&(!memarena_new(&(script->txt_arena),0)))
+            return false;
+        ntext=memarena_alloc(script->txt_arena,len+1);
+        if (ntext==NULL)
+            return false;
+    }
+    memmove(ntext,text,len+1);
+    script->txt[line]=ntext;
+    return true;
+}
+
+/*
+ * Frees parameters of the script commands which aren't stored in the script
+ * arena, ie. after script_command_renew(). Has to be called before
+ * the commands are dropped with the arena.
+ */
+void script_commands_free_params(struct DK_SCRIPT *script)
+{
+    if (script->list==NULL)
+        return;
+    int i;
+    for (i=0;i<script->lines_count;i++)
+    {
+        if (script->list[i]!=NULL)
+          script_command_free_params(script->list[i]);
+    }
+}
+
+/*
+ * Allocates given amount of cleared commands in the script arena.
+ * The commands are released with the arena, when the whole script
+ * is decomposed again.
+ */
+struct DK_SCRIPT_COMMAND *script_commands_alloc(struct DK_SCRIPT *script,const int count)
+{
+    if ((script->arena==NULL)&&(!memarena_new(&(script->arena),0)))
+        return NULL;
+    struct DK_SCRIPT_COMMAND *cmds;
+    cmds=(struct DK_SCRIPT_COMMAND *)memarena_alloc(script->arena,count*sizeof(struct DK_SCRIPT_COMMAND));
+    if (cmds==NULL)
+    {
+        message_error("script_commands_alloc: Cannot allocate memory");
+        return NULL;
+    }
+    int i;
+    for (i=0;i<count;i++)
+    {
+        script_command_clear(&cmds[i]);
+        cmds[i].arena=script->arena;
+    }
+    return cmds;
+}
+
 short execute_script_line(struct LEVEL *lvl,char *line,char *err_msg)
 {
     struct DK_SCRIPT_COMMAND *cmd;
@@ -3006,45 +3334,93 @@ short decompose_script(struct DK_SCRIPT *script,const struct SCRIPT_OPTIONS *opt
 {
   if (script==NULL) return false;
   message_log("  decompose_script: %d lines to analyze",script->lines_count);
+  /* All parameters are decomposed again, so the old ones can be dropped */
+  script_code_free(script);
+  script_commands_free_params(script);
+  if (script->arena!=NULL)
+    memarena_reset(script->arena);
+  struct DK_SCRIPT_COMMAND *cmds;
+  cmds=script_commands_alloc(script,script->lines_count);
   int i;
   for (i=0;i<script->lines_count;i++)
   {
       /*message_log("  decompose_script: line %3d",i); */
-      struct DK_SCRIPT_COMMAND *cmd=script->list[i];
-      script_command_renew(&cmd);
+      if (cmds==NULL)
+      {
+          script->list[i]=NULL;
+          continue;
+      }
+      struct DK_SCRIPT_COMMAND *cmd=&cmds[i];
       decompose_script_command(cmd,script->txt[i],optns);
-      /*This is needed because script_command_renew() could change the pointer */
       script->list[i]=cmd;
   }
-  return true;
+  script_verify_cache_reset(script);
+  return (cmds!=NULL);
 }
 
 short recompose_script(struct DK_SCRIPT *script,const struct SCRIPT_OPTIONS *optns)
 {
   if (script==NULL) return false;
   int i;
+  short result=true;
   for (i=0;i<script->lines_count;i++)
   {
       char *nline;
       nline=recompose_script_command(script->list[i],optns);
-      free(script->txt[i]);
       if (nline!=NULL)
-        script->txt[i]=nline;
-      else
-        script->txt[i]=strdup("");
+      {
+        result&=script_line_text_store(script,i,nline);
+        free(nline);
+      } else
+      {
+        result&=script_line_text_store(script,i,"");
+      }
   }
-  return true;
+  return result;
 }
 
+/*
+ * Sets nesting level of every script command. If the script has verification
+ * cache, only lines starting at the first changed one are updated, until
+ * the nesting depth becomes the same as before the change.
+ */
 short recompute_script_levels(struct DK_SCRIPT *script)
 {
   if (script==NULL) return false;
+  struct SCRIPT_VERIFY_CACHE *cache=script->verif;
+  if ((cache!=NULL)&&(!script_verify_cache_resize(cache,script->lines_count)))
+      cache=NULL;
   int i;
+  int first=0;
+  int last=script->lines_count-1;
   int lev=0;
   short result=true;
-  for (i=0;i<script->lines_count;i++)
+  if (cache!=NULL)
+  {
+      first=script->lines_count;
+      last=-1;
+      for (i=0;i<script->lines_count;i++)
+      {
+          if (cache->lines[i].nest_needed)
+          {
+              if (i<first) first=i;
+              last=i;
+          }
+      }
+      if (first<script->lines_count)
+        lev=cache->lines[first].nest;
+  }
+  for (i=first;i<script->lines_count;i++)
   {
       struct DK_SCRIPT_COMMAND *cmd=script->list[i];
+      if (cache!=NULL)
+      {
+          /* After changed lines, stop when nesting gets the same as before */
+          if ((i>last)&&(cache->lines[i].nest==lev))
+            break;
+          cache->lines[i].nest=lev;
+          cache->lines[i].nest_needed=false;
+      }
       switch (cmd->group)
       {
       case CMD_CONDIT:
@@ -3071,9 +3447,17 @@ short recompute_script_levels(struct DK_SCRIPT *script)
       if (lev<0)
         result=false;
   }
-  if (lev!=0)
-    result=false;
-  return result;
+  if (cache==NULL)
+    return result&&(lev==0);
+  if ((first<script->lines_count)&&(i>=script->lines_count))
+    cache->nest_end=lev;
+  /* Nesting depth after every line must be non-negative */
+  for (i=1;i<script->lines_count;i++)
+  {
+      if (cache->lines[i].nest<0)
+        return false;
+  }
+  return (cache->nest_end==0);
 }
 
 int get_script_command_level(const char *text,const struct SCRIPT_OPTIONS *optns)
@@ -3105,10 +3489,61 @@ int get_script_command_level(const char *text,const struct SCRIPT_OPTIONS *optns
 }
 
 /*
- * Analyzes single decomposed script command and adjusts DK_SCRIPT_PARAMETERS;
+ * Returns index of given operand of compiled command, in the keyword array
+ * searched by cmd_index. If the operand was recognized to be in a different
+ * group, the array is searched for the operand text.
+ */
+int script_operand_cmd_index(const struct DK_SCRIPT_CODE *code,const struct SCRIPT_OPCODE *op,
+    const int num,const int group,func_cmd_index cmd_index)
+{
+    if ((num<0)||(num>=op->operands_count))
+        return -1;
+    const struct SCRIPT_OPERAND *opnd=script_code_operands(code)+op->operands+num;
+    if (opnd->group==group)
+        return opnd->index;
+    return cmd_index(script_code_strings(code)+opnd->text);
+}
+
+/*
+ * Gives numeric value of given operand of compiled command;
+ * works like script_param_to_int() for the operand text.
+ */
+short script_operand_to_int(int *val,const struct DK_SCRIPT_CODE *code,
+    const struct SCRIPT_OPCODE *op,const int num)
+{
+    if ((num<0)||(num>=op->operands_count))
+        return false;
+    const struct SCRIPT_OPERAND *opnd=script_code_operands(code)+op->operands+num;
+    if ((opnd->group==CMD_SPECIAL)&&(opnd->index==SPEC_NUMBER))
+    {
+        (*val)=opnd->value;
+        return true;
+    }
+    return script_param_to_int(val,script_code_strings(code)+opnd->text);
+}
+
+/*
+ * Returns group and index of given operand of compiled command,
+ * like recognize_script_word_group_and_idx() for the operand text.
+ */
+int script_operand_group_and_idx(int *index,const struct DK_SCRIPT_CODE *code,
+    const struct SCRIPT_OPCODE *op,const int num)
+{
+    if ((num<0)||(num>=op->operands_count))
+    {
+        (*index)=-1;
+        return CMD_UNKNOWN;
+    }
+    const struct SCRIPT_OPERAND *opnd=script_code_operands(code)+op->operands+num;
+    (*index)=opnd->index;
+    return opnd->group;
+}
+
+/*
+ * Analyzes single compiled script command and adjusts DK_SCRIPT_PARAMETERS;
  */
-short script_decomposed_to_params_cmd_condit(struct DK_SCRIPT_PARAMETERS *par,
-    struct DK_SCRIPT_COMMAND *cmd, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
+short script_code_to_params_op_condit(struct DK_SCRIPT_PARAMETERS *par,
+    const struct DK_SCRIPT_CODE *code,const struct SCRIPT_OPCODE *op, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
 {
     int plyr_idx;
     /*int conditvar_type;*/
@@ -3117,20 +3552,20 @@ short script_decomposed_to_params_cmd_condit(struct DK_SCRIPT_PARAMETERS *par,
     int cmpvar_idx;
     int opertr_idx;
     int actnpt_num;
-    switch (cmd->index)
+    switch (op->index)
     {
     case COND_IF:
         par->end_level++;
-        if (cmd->param_count<4)
+        if (op->operands_count<4)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
-        opertr_idx=operator_cmd_index(cmd->params[2]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
+        opertr_idx=script_operand_cmd_index(code,op,2,CMD_OPERATR,operator_cmd_index);
         if ((plyr_idx<0)||(opertr_idx<0))
             return false;
         conditvar_idx=-1;
         cmpvar_idx=-1;
-        /*conditvar_type=*/recognize_script_word_group_and_idx(&conditvar_idx,cmd->params[1],true);
-        /*cmpvar_type=*/recognize_script_word_group_and_idx(&cmpvar_idx,cmd->params[3],true);
+        /*conditvar_type=*/script_operand_group_and_idx(&conditvar_idx,code,op,1);
+        /*cmpvar_type=*/script_operand_group_and_idx(&cmpvar_idx,code,op,3);
         if ((conditvar_idx<0)||(cmpvar_idx<0))
             return false;
 /*TODO */
@@ -3138,16 +3573,16 @@ short script_decomposed_to_params_cmd_condit(struct DK_SCRIPT_PARAMETERS *par,
         break;
     case IF_AVAILABLE:
         par->end_level++;
-        if (cmd->param_count<4)
+        if (op->operands_count<4)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
-        opertr_idx=operator_cmd_index(cmd->params[2]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
+        opertr_idx=script_operand_cmd_index(code,op,2,CMD_OPERATR,operator_cmd_index);
         if ((plyr_idx<0)||(opertr_idx<0))
             return false;
         conditvar_idx=-1;
         cmpvar_idx=-1;
-        /*conditvar_type=*/recognize_script_word_group_and_idx(&conditvar_idx,cmd->params[1],true);
-        /*cmpvar_type=*/recognize_script_word_group_and_idx(&cmpvar_idx,cmd->params[3],true);
+        /*conditvar_type=*/script_operand_group_and_idx(&conditvar_idx,code,op,1);
+        /*cmpvar_type=*/script_operand_group_and_idx(&cmpvar_idx,code,op,3);
         if ((conditvar_idx<0)||(cmpvar_idx<0))
             return false;
 /*TODO */
@@ -3155,11 +3590,11 @@ short script_decomposed_to_params_cmd_condit(struct DK_SCRIPT_PARAMETERS *par,
         break;
     case IF_ACTNPT:
         par->end_level++;
-        if (cmd->param_count<2)
+        if (op->operands_count<2)
             return false;
-        if (!script_param_to_int(&actnpt_num,cmd->params[0]))
+        if (!script_operand_to_int(&actnpt_num,code,op,0))
             return false;
-        plyr_idx=players_cmd_index(cmd->params[1]);
+        plyr_idx=script_operand_cmd_index(code,op,1,CMD_PLAYER,players_cmd_index);
         if (plyr_idx<0)
             return false;
 /*TODO */
@@ -3177,11 +3612,12 @@ short script_decomposed_to_params_cmd_condit(struct DK_SCRIPT_PARAMETERS *par,
 }
 
 /*
- * Analyzes single decomposed script command and adjusts DK_SCRIPT_PARAMETERS;
+ * Analyzes single compiled script command and adjusts DK_SCRIPT_PARAMETERS;
  * This one is used for commands inside a conditional loop
  */
-short script_decomposed_to_params_cmd_blockbody(__attribute__((unused)) struct DK_SCRIPT_PARAMETERS *par,
-    __attribute__((unused)) struct DK_SCRIPT_COMMAND *cmd, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
+short script_code_to_params_op_blockbody(__attribute__((unused)) struct DK_SCRIPT_PARAMETERS *par,
+    __attribute__((unused)) const struct DK_SCRIPT_CODE *code,
+    __attribute__((unused)) const struct SCRIPT_OPCODE *op, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
 {
 /*TODO! */
 /* As for now, just add those commands to "rest" list. */
@@ -3189,10 +3625,11 @@ short script_decomposed_to_params_cmd_blockbody(__attribute__((unused)) struct D
 }
 
 /*
- * Analyzes single decomposed script command and adjusts DK_SCRIPT_PARAMETERS;
+ * Analyzes single compiled script command and adjusts DK_SCRIPT_PARAMETERS;
  */
-short script_decomposed_to_params_cmd_party(__attribute__((unused)) struct DK_SCRIPT_PARAMETERS *par,
-    __attribute__((unused)) struct DK_SCRIPT_COMMAND *cmd, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
+short script_code_to_params_op_party(__attribute__((unused)) struct DK_SCRIPT_PARAMETERS *par,
+    __attribute__((unused)) const struct DK_SCRIPT_CODE *code,
+    __attribute__((unused)) const struct SCRIPT_OPCODE *op, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
 {
 /*TODO! */
 /* As for now, just add those commands to "rest" list. */
@@ -3200,10 +3637,10 @@ short script_decomposed_to_params_cmd_party(__attribute__((unused)) struct DK_SC
 }
 
 /*
- * Analyzes single decomposed script command and adjusts DK_SCRIPT_PARAMETERS;
+ * Analyzes single compiled script command and adjusts DK_SCRIPT_PARAMETERS;
  */
-short script_decomposed_to_params_cmd_avail(struct DK_SCRIPT_PARAMETERS *par,
-    struct DK_SCRIPT_COMMAND *cmd, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
+short script_code_to_params_op_avail(struct DK_SCRIPT_PARAMETERS *par,
+    const struct DK_SCRIPT_CODE *code,const struct SCRIPT_OPCODE *op, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
 {
     int plyr_idx;
     int object_idx;
@@ -3211,18 +3648,18 @@ short script_decomposed_to_params_cmd_avail(struct DK_SCRIPT_PARAMETERS *par,
     int amount;
     short available;
     int i;
-    switch (cmd->index)
+    switch (op->index)
     {
     case ROOM_AVAIL:
-        if (cmd->param_count<4)
+        if (op->operands_count<4)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
-        object_idx=room_cmd_index(cmd->params[1]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
+        object_idx=script_operand_cmd_index(code,op,1,CMD_ROOM,room_cmd_index);
         if ((plyr_idx<0)||(object_idx<0))
             return false;
-        if (!script_param_to_int(&logic_val,cmd->params[2]))
+        if (!script_operand_to_int(&logic_val,code,op,2))
             return false;
-        if (!script_param_to_int(&amount,cmd->params[3]))
+        if (!script_operand_to_int(&amount,code,op,3))
             return false;
         if (amount)
             available=AVAIL_INSTANT;
@@ -3245,15 +3682,15 @@ short script_decomposed_to_params_cmd_avail(struct DK_SCRIPT_PARAMETERS *par,
         }
         break;
     case CREATR_AVAIL:
-        if (cmd->param_count<4)
+        if (op->operands_count<4)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
-        object_idx=creatures_cmd_index(cmd->params[1]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
+        object_idx=script_operand_cmd_index(code,op,1,CMD_CREATR,creatures_cmd_index);
         if ((plyr_idx<0)||(object_idx<0))
             return false;
-        if (!script_param_to_int(&logic_val,cmd->params[2]))
+        if (!script_operand_to_int(&logic_val,code,op,2))
             return false;
-        if (!script_param_to_int(&amount,cmd->params[3]))
+        if (!script_operand_to_int(&amount,code,op,3))
             return false;
         if (amount)
             available=AVAIL_INSTANT;
@@ -3276,15 +3713,15 @@ short script_decomposed_to_params_cmd_avail(struct DK_SCRIPT_PARAMETERS *par,
         }
         break;
     case MAGIC_AVAIL:
-        if (cmd->param_count<4)
+        if (op->operands_count<4)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
-        object_idx=spell_cmd_index(cmd->params[1]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
+        object_idx=script_operand_cmd_index(code,op,1,CMD_SPELL,spell_cmd_index);
         if ((plyr_idx<0)||(object_idx<0))
             return false;
-        if (!script_param_to_int(&logic_val,cmd->params[2]))
+        if (!script_operand_to_int(&logic_val,code,op,2))
             return false;
-        if (!script_param_to_int(&amount,cmd->params[3]))
+        if (!script_operand_to_int(&amount,code,op,3))
             return false;
         if (amount)
             available=AVAIL_INSTANT;
@@ -3307,15 +3744,15 @@ short script_decomposed_to_params_cmd_avail(struct DK_SCRIPT_PARAMETERS *par,
         }
         break;
     case TRAP_AVAIL:
-        if (cmd->param_count<4)
+        if (op->operands_count<4)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
-        object_idx=trap_cmd_index(cmd->params[1]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
+        object_idx=script_operand_cmd_index(code,op,1,CMD_TRAP,trap_cmd_index);
         if ((plyr_idx<0)||(object_idx<0))
             return false;
-        if (!script_param_to_int(&logic_val,cmd->params[2]))
+        if (!script_operand_to_int(&logic_val,code,op,2))
             return false;
-        if (!script_param_to_int(&amount,cmd->params[3]))
+        if (!script_operand_to_int(&amount,code,op,3))
             return false;
         if (plyr_idx<PLAYERS_COUNT)
         {
@@ -3335,15 +3772,15 @@ short script_decomposed_to_params_cmd_avail(struct DK_SCRIPT_PARAMETERS *par,
         }
        break;
     case DOOR_AVAIL:
-        if (cmd->param_count<4)
+        if (op->operands_count<4)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
-        object_idx=door_cmd_index(cmd->params[1]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
+        object_idx=script_operand_cmd_index(code,op,1,CMD_DOOR,door_cmd_index);
         if ((plyr_idx<0)||(object_idx<0))
             return false;
-        if (!script_param_to_int(&logic_val,cmd->params[2]))
+        if (!script_operand_to_int(&logic_val,code,op,2))
             return false;
-        if (!script_param_to_int(&amount,cmd->params[3]))
+        if (!script_operand_to_int(&amount,code,op,3))
             return false;
         if (plyr_idx<PLAYERS_COUNT)
         {
@@ -3368,42 +3805,43 @@ short script_decomposed_to_params_cmd_avail(struct DK_SCRIPT_PARAMETERS *par,
   return true;
 }
 /*
- * Analyzes single decomposed script command and adjusts DK_SCRIPT_PARAMETERS;
+ * Analyzes single compiled script command and adjusts DK_SCRIPT_PARAMETERS;
  */
-short script_decomposed_to_params_cmd_custobj(__attribute__((unused)) struct DK_SCRIPT_PARAMETERS *par,
-    __attribute__((unused)) struct DK_SCRIPT_COMMAND *cmd, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
+short script_code_to_params_op_custobj(__attribute__((unused)) struct DK_SCRIPT_PARAMETERS *par,
+    __attribute__((unused)) const struct DK_SCRIPT_CODE *code,
+    __attribute__((unused)) const struct SCRIPT_OPCODE *op, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
 {
 /*TODO */
 /* As for now, just add those commands to "rest" list. */
   return true;
 }
 /*
- * Analyzes single decomposed script command and adjusts DK_SCRIPT_PARAMETERS;
+ * Analyzes single compiled script command and adjusts DK_SCRIPT_PARAMETERS;
  */
-short script_decomposed_to_params_cmd_setup(struct DK_SCRIPT_PARAMETERS *par,
-    struct DK_SCRIPT_COMMAND *cmd, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
+short script_code_to_params_op_setup(struct DK_SCRIPT_PARAMETERS *par,
+    const struct DK_SCRIPT_CODE *code,const struct SCRIPT_OPCODE *op, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
 {
     int i;
     int plyr_idx;
     int plyr2_idx;
     int amount;
     int type_idx;
-    switch (cmd->index)
+    switch (op->index)
     {
     case SET_GEN_SPEED:
-        if (cmd->param_count<1)
+        if (op->operands_count<1)
             return false;
-        if (!script_param_to_int(&amount,cmd->params[0]))
+        if (!script_operand_to_int(&amount,code,op,0))
             return false;
         par->portal_gen_speed=amount;
         break;
     case START_MONEY:
-        if (cmd->param_count<2)
+        if (op->operands_count<2)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
         if (plyr_idx<0)
             return false;
-        if (!script_param_to_int(&amount,cmd->params[1]))
+        if (!script_operand_to_int(&amount,code,op,1))
             return false;
         if (plyr_idx<PLAYERS_COUNT)
         {
@@ -3419,12 +3857,12 @@ short script_decomposed_to_params_cmd_setup(struct DK_SCRIPT_PARAMETERS *par,
         }
         break;
     case COMP_PLAYER:
-        if (cmd->param_count<2)
+        if (op->operands_count<2)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
         if (plyr_idx<0)
             return false;
-        if (!script_param_to_int(&amount,cmd->params[1]))
+        if (!script_operand_to_int(&amount,code,op,1))
             return false;
         if (plyr_idx<PLAYERS_COUNT)
         {
@@ -3440,10 +3878,10 @@ short script_decomposed_to_params_cmd_setup(struct DK_SCRIPT_PARAMETERS *par,
         }
         break;
     case ALLY_PLAYERS:
-        if (cmd->param_count<2)
+        if (op->operands_count<2)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
-        plyr2_idx=players_cmd_index(cmd->params[1]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
+        plyr2_idx=script_operand_cmd_index(code,op,1,CMD_PLAYER,players_cmd_index);
         if ((plyr_idx<0)||(plyr2_idx<0))
             return false;
         if ((plyr_idx<PLAYERS_COUNT)&&(plyr2_idx<PLAYERS_COUNT))
@@ -3456,19 +3894,19 @@ short script_decomposed_to_params_cmd_setup(struct DK_SCRIPT_PARAMETERS *par,
         }
         break;
     case SET_HATE:
-        if (cmd->param_count<3)
+        if (op->operands_count<3)
             return false;
         /*TODO */
 /* As for now, just add those commands to "rest" list. */
         return false;
         break;
     case RESEARCH:
-        if (cmd->param_count<4)
+        if (op->operands_count<4)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
         if (plyr_idx<0)
             return false;
-        type_idx=objtype_cmd_index(cmd->params[1]);
+        type_idx=script_operand_cmd_index(code,op,1,CMD_OBJTYPE,objtype_cmd_index);
         if (type_idx<0)
             return false;
         /*TODO */
@@ -3476,9 +3914,9 @@ short script_decomposed_to_params_cmd_setup(struct DK_SCRIPT_PARAMETERS *par,
         return false;
         break;
     case SET_COMPUTER_GLOBALS:
-        if (cmd->param_count<7)
+        if (op->operands_count<7)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
         if ((plyr_idx<0))
             return false;
         /*TODO */
@@ -3486,9 +3924,9 @@ short script_decomposed_to_params_cmd_setup(struct DK_SCRIPT_PARAMETERS *par,
         return false;
         break;
     case SET_COMPUTER_CHECKS:
-        if (cmd->param_count<7)
+        if (op->operands_count<7)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
         if ((plyr_idx<0))
             return false;
         /*TODO */
@@ -3496,9 +3934,9 @@ short script_decomposed_to_params_cmd_setup(struct DK_SCRIPT_PARAMETERS *par,
         return false;
         break;
     case SET_COMPUTER_EVENT:
-        if (cmd->param_count<4)
+        if (op->operands_count<4)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
         if ((plyr_idx<0))
             return false;
         /*TODO */
@@ -3506,9 +3944,9 @@ short script_decomposed_to_params_cmd_setup(struct DK_SCRIPT_PARAMETERS *par,
         return false;
         break;
     case SET_COMPUTER_PROCESS:
-        if (cmd->param_count<7)
+        if (op->operands_count<7)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
         if ((plyr_idx<0))
             return false;
         /*TODO */
@@ -3516,12 +3954,12 @@ short script_decomposed_to_params_cmd_setup(struct DK_SCRIPT_PARAMETERS *par,
         return false;
         break;
     case MAX_CREATURES:
-        if (cmd->param_count<2)
+        if (op->operands_count<2)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
         if ((plyr_idx<0))
             return false;
-        if (!script_param_to_int(&amount,cmd->params[1]))
+        if (!script_operand_to_int(&amount,code,op,1))
             return false;
         if (plyr_idx<PLAYERS_COUNT)
         {
@@ -3542,20 +3980,21 @@ short script_decomposed_to_params_cmd_setup(struct DK_SCRIPT_PARAMETERS *par,
   return true;
 }
 /*
- * Analyzes single decomposed script command and adjusts DK_SCRIPT_PARAMETERS;
+ * Analyzes single compiled script command and adjusts DK_SCRIPT_PARAMETERS;
  */
-short script_decomposed_to_params_cmd_triger(__attribute__((unused)) struct DK_SCRIPT_PARAMETERS *par,
-    __attribute__((unused)) struct DK_SCRIPT_COMMAND *cmd, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
+short script_code_to_params_op_triger(__attribute__((unused)) struct DK_SCRIPT_PARAMETERS *par,
+    __attribute__((unused)) const struct DK_SCRIPT_CODE *code,
+    __attribute__((unused)) const struct SCRIPT_OPCODE *op, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
 {
 /*TODO */
 /* As for now, just add those commands to "rest" list. */
   return true;
 }
 /*
- * Analyzes single decomposed script command and adjusts DK_SCRIPT_PARAMETERS;
+ * Analyzes single compiled script command and adjusts DK_SCRIPT_PARAMETERS;
  */
-short script_decomposed_to_params_cmd_crtradj(struct DK_SCRIPT_PARAMETERS *par,
-    struct DK_SCRIPT_COMMAND *cmd, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
+short script_code_to_params_op_crtradj(struct DK_SCRIPT_PARAMETERS *par,
+    const struct DK_SCRIPT_CODE *code,const struct SCRIPT_OPCODE *op, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
 {
     int i;
     int plyr_idx;
@@ -3563,33 +4002,33 @@ short script_decomposed_to_params_cmd_crtradj(struct DK_SCRIPT_PARAMETERS *par,
     int crtr2_idx;
     int logic_val;
     int amount;
-    switch (cmd->index)
+    switch (op->index)
     {
     case DEAD_CREATURES_RET_TO_POOL:
-        if (cmd->param_count<1)
+        if (op->operands_count<1)
             return false;
-        if (!script_param_to_int(&logic_val,cmd->params[0]))
+        if (!script_operand_to_int(&logic_val,code,op,0))
             return false;
         par->dead_return_to_pool=(logic_val!=0);
         break;
     case ADD_CREATR_TO_POOL:
-        if (cmd->param_count<2)
+        if (op->operands_count<2)
             return false;
-        crtr_idx=creatures_cmd_index(cmd->params[0]);
+        crtr_idx=script_operand_cmd_index(code,op,0,CMD_CREATR,creatures_cmd_index);
         if (crtr_idx<0)
             return false;
-        if (!script_param_to_int(&amount,cmd->params[1]))
+        if (!script_operand_to_int(&amount,code,op,1))
             return false;
         par->creature_pool[crtr_idx]=amount;
         break;
     case SET_CREATR_MAX_LEVEL:
-        if (cmd->param_count<3)
+        if (op->operands_count<3)
             return false;
-        plyr_idx=players_cmd_index(cmd->params[0]);
-        crtr_idx=creatures_cmd_index(cmd->params[1]);
+        plyr_idx=script_operand_cmd_index(code,op,0,CMD_PLAYER,players_cmd_index);
+        crtr_idx=script_operand_cmd_index(code,op,1,CMD_CREATR,creatures_cmd_index);
         if ((plyr_idx<0)||(crtr_idx<0))
             return false;
-        if (!script_param_to_int(&amount,cmd->params[2]))
+        if (!script_operand_to_int(&amount,code,op,2))
             return false;
         if (plyr_idx<PLAYERS_COUNT)
         {
@@ -3605,50 +4044,50 @@ short script_decomposed_to_params_cmd_crtradj(struct DK_SCRIPT_PARAMETERS *par,
         }
         break;
     case SET_CREATR_STRENGTH:
-        if (cmd->param_count<2)
+        if (op->operands_count<2)
             return false;
-        crtr_idx=creatures_cmd_index(cmd->params[0]);
+        crtr_idx=script_operand_cmd_index(code,op,0,CMD_CREATR,creatures_cmd_index);
         if (crtr_idx<0)
             return false;
-        if (!script_param_to_int(&amount,cmd->params[1]))
+        if (!script_operand_to_int(&amount,code,op,1))
             return false;
         /*TODO */
         break;
     case SET_CREATR_HEALTH:
-        if (cmd->param_count<2)
+        if (op->operands_count<2)
             return false;
-        crtr_idx=creatures_cmd_index(cmd->params[0]);
+        crtr_idx=script_operand_cmd_index(code,op,0,CMD_CREATR,creatures_cmd_index);
         if (crtr_idx<0)
             return false;
-        if (!script_param_to_int(&amount,cmd->params[1]))
+        if (!script_operand_to_int(&amount,code,op,1))
             return false;
         /*TODO */
         break;
     case SET_CREATR_ARMOUR:
-        if (cmd->param_count<2)
+        if (op->operands_count<2)
             return false;
-        crtr_idx=creatures_cmd_index(cmd->params[0]);
+        crtr_idx=script_operand_cmd_index(code,op,0,CMD_CREATR,creatures_cmd_index);
         if (crtr_idx<0)
             return false;
-        if (!script_param_to_int(&amount,cmd->params[1]))
+        if (!script_operand_to_int(&amount,code,op,1))
             return false;
         /*TODO */
         break;
     case SET_CREATR_FEAR:
-        if (cmd->param_count<2)
+        if (op->operands_count<2)
             return false;
-        crtr_idx=creatures_cmd_index(cmd->params[0]);
+        crtr_idx=script_operand_cmd_index(code,op,0,CMD_CREATR,creatures_cmd_index);
         if (crtr_idx<0)
             return false;
-        if (!script_param_to_int(&amount,cmd->params[1]))
+        if (!script_operand_to_int(&amount,code,op,1))
             return false;
         /*TODO */
         break;
     case CREATR_SWAP:
-        if (cmd->param_count<2)
+        if (op->operands_count<2)
             return false;
-        crtr_idx=creatures_cmd_index(cmd->params[0]);
-        crtr2_idx=creatures_cmd_index(cmd->params[1]);
+        crtr_idx=script_operand_cmd_index(code,op,0,CMD_CREATR,creatures_cmd_index);
+        crtr2_idx=script_operand_cmd_index(code,op,1,CMD_CREATR,creatures_cmd_index);
         if ((crtr_idx<0)||(crtr2_idx<0))
             return false;
         /*TODO */
@@ -3660,29 +4099,29 @@ short script_decomposed_to_params_cmd_crtradj(struct DK_SCRIPT_PARAMETERS *par,
 }
 
 /*
- * Analyzes single decomposed script command and adjusts DK_SCRIPT_PARAMETERS;
+ * Analyzes single compiled script command and adjusts DK_SCRIPT_PARAMETERS;
  */
-short script_decomposed_to_params_cmd(struct DK_SCRIPT_PARAMETERS *par,
-    struct DK_SCRIPT_COMMAND *cmd,const struct SCRIPT_OPTIONS *optns)
+short script_code_to_params_op(struct DK_SCRIPT_PARAMETERS *par,
+    const struct DK_SCRIPT_CODE *code,const struct SCRIPT_OPCODE *op,const struct SCRIPT_OPTIONS *optns)
 {
   if (par->end_level==0)
   {
-    switch (cmd->group)
+    switch (op->group)
     {
     case CMD_CONDIT:
-            return script_decomposed_to_params_cmd_condit(par,cmd,optns);
+            return script_code_to_params_op_condit(par,code,op,optns);
     case CMD_PARTY:
-            return script_decomposed_to_params_cmd_party(par,cmd,optns);
+            return script_code_to_params_op_party(par,code,op,optns);
     case CMD_AVAIL:
-            return script_decomposed_to_params_cmd_avail(par,cmd,optns);
+            return script_code_to_params_op_avail(par,code,op,optns);
     case CMD_CUSTOBJ:
-            return script_decomposed_to_params_cmd_custobj(par,cmd,optns);
+            return script_code_to_params_op_custobj(par,code,op,optns);
     case CMD_SETUP:
-            return script_decomposed_to_params_cmd_setup(par,cmd,optns);
+            return script_code_to_params_op_setup(par,code,op,optns);
     case CMD_TRIGER:
-            return script_decomposed_to_params_cmd_triger(par,cmd,optns);
+            return script_code_to_params_op_triger(par,code,op,optns);
     case CMD_CRTRADJ:
-            return script_decomposed_to_params_cmd_crtradj(par,cmd,optns);
+            return script_code_to_params_op_crtradj(par,code,op,optns);
     case CMD_COMMNT:
             return true;
     case CMD_OBSOLT:
@@ -3694,30 +4133,63 @@ short script_decomposed_to_params_cmd(struct DK_SCRIPT_PARAMETERS *par,
     }
   } else
   {
-      return script_decomposed_to_params_cmd_blockbody(par,cmd,optns);
+      return script_code_to_params_op_blockbody(par,code,op,optns);
   }
 }
 
 /*
- * Converts decomposed script commands into DK_SCRIPT_PARAMETERS;
+ * Converts compiled script commands into DK_SCRIPT_PARAMETERS;
  * automatically clears (but not allocates) DK_SCRIPT_PARAMETERS struct at start.
  */
-short script_decomposed_to_params(struct DK_SCRIPT *script,const struct SCRIPT_OPTIONS *optns)
+short script_code_to_params(struct DK_SCRIPT_PARAMETERS *par,
+    const struct DK_SCRIPT_CODE *code,const struct SCRIPT_OPTIONS *optns)
 {
-  if (script==NULL) return false;
+  if ((par==NULL)||(code==NULL)) return false;
   short result;
   /* Clearing the struct */
-  result=level_clear_script_param(&(script->par));
-  int i;
+  result=level_clear_script_param(par);
+  const struct SCRIPT_OPCODE *ops=script_code_ops(code);
+  unsigned int i;
   /* Now filling */
-  for (i=0;i<script->lines_count;i++)
+  for (i=0;i<code->ops_count;i++)
   {
-      /*message_log("  script_decomposed_to_params: recognizing line %d",i); */
-      result&=script_decomposed_to_params_cmd(&(script->par),script->list[i],optns);
+      result&=script_code_to_params_op(par,code,&ops[i],optns);
   }
   return result;
 }
 
+/*
+ * Analyzes single decomposed script command and adjusts DK_SCRIPT_PARAMETERS;
+ * the command is compiled before analyzing.
+ */
+short script_decomposed_to_params_cmd(struct DK_SCRIPT_PARAMETERS *par,
+    struct DK_SCRIPT_COMMAND *cmd,const struct SCRIPT_OPTIONS *optns)
+{
+  struct DK_SCRIPT_CODE *code;
+  code=script_code_compile(&cmd,1,optns);
+  if (code==NULL) return false;
+  short result;
+  result=script_code_to_params_op(par,code,script_code_ops(code),optns);
+  free(code);
+  return result;
+}
+
+/*
+ * Converts decomposed script commands into DK_SCRIPT_PARAMETERS;
+ * automatically clears (but not allocates) DK_SCRIPT_PARAMETERS struct at start.
+ * The script is compiled first, unless it was compiled since last change.
+ */
+short script_decomposed_to_params(struct DK_SCRIPT *script,const struct SCRIPT_OPTIONS *optns)
+{
+  if (script==NULL) return false;
+  if ((script->code==NULL)&&(!script_compile(script,optns)))
+  {
+      level_clear_script_param(&(script->par));
+      return false;
+  }
+  return script_code_to_params(&(script->par),script->code,optns);
+}
+
 short script_params_to_decomposed(__attribute__((unused)) struct DK_SCRIPT *script, __attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
 {
 /*TODO */
@@ -3726,17 +4198,29 @@ short script_params_to_decomposed(__attribute__((unused)) struct DK_SCRIPT *scri
   return false;
 }
 
-short script_strword_pos( char const **ptr, unsigned int *ptr_len, const char *str, const short whole_rest )
+
+/*
+ * Starts tokenizing given text; the text is not copied, so it must stay
+ * unchanged while the tokenizer is used.
+ */
+void script_tokenizer_init(struct SCRIPT_TOKENIZER *tok,const char *str)
 {
-  static const char *text;
-  if (str!=NULL)
-  {
-    text=str;
-  }
+  tok->text=str;
+}
+
+/*
+ * Finds next word in text given to the tokenizer. Returns pointer to
+ * the word inside the text and its length, without copying anything.
+ * If whole_rest is true, returns the whole remaining text as one word.
+ * Returns false if there are no more words.
+ */
+short script_token_next(struct SCRIPT_TOKENIZER *tok,char const **ptr,unsigned int *ptr_len,const short whole_rest)
+{
+  const char *text=tok->text;
   if (text==NULL)
   {
     (*ptr_len)=0;
-/*    message_log("  script_strword_pos: end of text"); */
+/*    message_log("  script_token_next: end of text"); */
     return false;
   }
   int len;
@@ -3747,21 +4231,21 @@ short script_strword_pos( char const **ptr, unsigned int *ptr_len, const char *s
       if (text[0]=='\0')
       {
         (*ptr_len)=0;
-        text=NULL;
-/*          message_log("  script_strword_pos: line empty"); */
+        tok->text=NULL;
+/*          message_log("  script_token_next: line empty"); */
         return false;
       }
       text++;
     }
   } while (len==0);
   int text_len;
-  text_len=strlen(text);
   if (whole_rest)
   {
+    text_len=strlen(text);
     (*ptr)=text;
     (*ptr_len)=text_len;
-/*    message_log("  script_strword_pos: returning whole \"%s\"",text); */
-    text=NULL;
+/*    message_log("  script_token_next: returning whole \"%s\"",text); */
+    tok->text=NULL;
     return true;
   }
   /* So now we're sure that first character is not a token. */
@@ -3784,6 +4268,7 @@ short script_strword_pos( char const **ptr, unsigned int *ptr_len, const char *s
     char quot_chr[2];
     quot_chr[0]=text[0];
     quot_chr[1]='\0';
+    text_len=strlen(text);
     len=1;
     do {
       len=strcspn( text+len, quot_chr );
@@ -3802,11 +4287,25 @@ short script_strword_pos( char const **ptr, unsigned int *ptr_len, const char *s
   }
   (*ptr)=text;
   (*ptr_len)=len;
-  text+=len;
+  tok->text=text+len;
   return true;
 }
 
-char *script_strword( const char *str, const short whole_rest )
+short script_strword_pos( char const **ptr, unsigned int *ptr_len, const char *str, const short whole_rest )
+{
+  /* Position in text is kept in context, so that threads don't share it */
+  struct ADIKT_CONTEXT *ctx=adikt_context_get();
+  struct SCRIPT_TOKENIZER tok;
+  if (str!=NULL)
+    script_tokenizer_init(&tok,str);
+  else
+    script_tokenizer_init(&tok,ctx->strword_text);
+  short result=script_token_next(&tok,ptr,ptr_len,whole_rest);
+  ctx->strword_text=tok.text;
+  return result;
+}
+
+char *script_strword( const char *str, const short whole_rest )
 {
   const char *ptr;
   unsigned int len;
@@ -3825,209 +4324,330 @@ char *script_strword( const char *str, const short whole_rest )
 }
 
 /*
- * Returns group and index of a script word
+ * Keyword arrays recognized by recognize_script_word_group_and_idx(),
+ * in the order in which groups are checked. Words shorter than min_len
+ * are not recognized, like in the *_cmd_index() functions.
  */
-int recognize_script_word_group_and_idx(int *index,const char *wordtxt,const short is_parameter)
+struct SCRIPT_KEYWORD_GROUP {
+    int group;
+    const char **arr;
+    int count;
+    int min_len;
+};
+
+#define SCRIPT_KEYWORD_GROUP_ARR(group,arr,min_len) {group,arr,sizeof(arr)/sizeof(char *),min_len}
+
+const struct SCRIPT_KEYWORD_GROUP script_param_keyword_groups[]={
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_COMP,cmd_comp_plyr_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_PLAYER,cmd_players_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_OPERATR,cmd_operator_arr,1),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_OBJTYPE,cmd_objtype_arr,1),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_VARIBL,cmd_variabl_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_TIMER,cmd_timer_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_FLAG,cmd_flag_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_PAROBJ,cmd_party_objectv_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_CREATR,cmd_creatures_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_DOOR,cmd_doors_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_TRAP,cmd_traps_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_SPELL,cmd_spells_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_ROOM,cmd_rooms_arr,2),
+    };
+
+const struct SCRIPT_KEYWORD_GROUP script_cmd_keyword_groups[]={
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_ADIKTED,cmd_adikted_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_CONDIT,cmd_condit_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_PARTY,cmd_party_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_AVAIL,cmd_avail_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_CUSTOBJ,cmd_custobj_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_SETUP,cmd_setup_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_TRIGER,cmd_triger_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_CRTRADJ,cmd_crtradj_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_OBSOLT,cmd_obsolt_arr,2),
+    SCRIPT_KEYWORD_GROUP_ARR(CMD_COMMNT,cmd_commnt_arr,1),
+    };
+
+/*
+ * Hash tables of script keywords, created from the keyword arrays
+ * when first needed. Open addressing is used, and the tables are kept
+ * at most 1/4 full, so most words are found in one probe.
+ */
+struct SCRIPT_KEYWORD_ENTRY {
+    const char *text;
+    unsigned int len;
+    int group;
+    int index;
+};
+
+struct SCRIPT_KEYWORD_HASH {
+    struct SCRIPT_KEYWORD_ENTRY *entries;
+    unsigned int mask;
+};
+
+static struct SCRIPT_KEYWORD_HASH script_keywords[2];
+/* Written only under lbthreads_lock() */
+static short script_keywords_ready=false;
+/* Set in every thread which has seen the tables ready under the lock; */
+/* the lock makes sure the thread sees the tables fully written, */
+/* so it can use them without locking since then */
+static THREAD_LOCAL short script_keywords_seen=false;
+
+/*
+ * Returns case-insensitive hash of given word.
+ */
+unsigned long script_keyword_hash(const char *word,unsigned int len)
 {
-  int cmd_idx;
-  if (is_parameter)
+  unsigned long hash=2166136261UL;
+  unsigned int i;
+  for (i=0;i<len;i++)
   {
-    cmd_idx=comp_plyr_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_COMP;
-    }
-    cmd_idx=players_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_PLAYER;
-    }
-    cmd_idx=operator_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_OPERATR;
-    }
-    cmd_idx=objtype_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_OBJTYPE;
-    }
-    cmd_idx=variabl_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_VARIBL;
-    }
-    cmd_idx=timer_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_TIMER;
-    }
-    cmd_idx=flag_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_FLAG;
-    }
-    cmd_idx=party_objectv_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_PAROBJ;
-    }
-    cmd_idx=creatures_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_CREATR;
-    }
-    cmd_idx=door_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_DOOR;
-    }
-    cmd_idx=trap_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_TRAP;
-    }
-    cmd_idx=spell_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_SPELL;
-    }
-    cmd_idx=room_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_ROOM;
-    }
-    cmd_idx=special_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_SPECIAL;
+    hash^=(unsigned char)toupper((unsigned char)word[i]);
+    hash*=16777619UL;
+  }
+  return hash^(hash>>15);
+}
+
+/*
+ * Fills keywords hash with words from given groups. If a word is in more
+ * than one array, the first occurence is kept - like when the arrays
+ * are searched one by one.
+ */
+short script_keyword_hash_fill(struct SCRIPT_KEYWORD_HASH *kwhash,
+    const struct SCRIPT_KEYWORD_GROUP *groups,int groups_count)
+{
+  int words_count=1;
+  int n,i;
+  for (n=0;n<groups_count;n++)
+    words_count+=groups[n].count;
+  unsigned int size=16;
+  while (size<4*words_count)
+    size<<=1;
+  kwhash->entries=(struct SCRIPT_KEYWORD_ENTRY *)calloc(size,sizeof(struct SCRIPT_KEYWORD_ENTRY));
+  if (kwhash->entries==NULL)
+    return false;
+  kwhash->mask=size-1;
+  for (n=0;n<groups_count;n++)
+    for (i=0;i<groups[n].count;i++)
+    {
+      const char *text=groups[n].arr[i];
+      unsigned int len=strlen(text);
+      if (len<groups[n].min_len)
+        continue;
+      unsigned int pos=script_keyword_hash(text,len)&kwhash->mask;
+      while (kwhash->entries[pos].text!=NULL)
+      {
+        if ((kwhash->entries[pos].len==len)&&(strnicmp(kwhash->entries[pos].text,text,len)==0))
+          break;
+        pos=(pos+1)&kwhash->mask;
+      }
+      if (kwhash->entries[pos].text!=NULL)
+        continue;
+      kwhash->entries[pos].text=text;
+      kwhash->entries[pos].len=len;
+      kwhash->entries[pos].group=groups[n].group;
+      kwhash->entries[pos].index=i;
     }
-  } else
+  return true;
+}
+
+/*
+ * Creates the script keywords hash tables, if they don't exist yet.
+ */
+short script_keywords_prepare(void)
+{
+  if (script_keywords_seen)
+    return true;
+  lbthreads_lock();
+  if (!script_keywords_ready)
   {
-    cmd_idx=adikted_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_ADIKTED;
-    }
-    cmd_idx=condit_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_CONDIT;
-    }
-    cmd_idx=party_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_PARTY;
-    }
-    cmd_idx=avail_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_AVAIL;
-    }
-    cmd_idx=custobj_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_CUSTOBJ;
-    }
-    cmd_idx=setup_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_SETUP;
-    }
-    cmd_idx=triger_cmd_index(wordtxt);
-    if (cmd_idx>=0)
+    short result;
+    result=script_keyword_hash_fill(&script_keywords[0],script_cmd_keyword_groups,
+        sizeof(script_cmd_keyword_groups)/sizeof(struct SCRIPT_KEYWORD_GROUP));
+    if (result)
+      result=script_keyword_hash_fill(&script_keywords[1],script_param_keyword_groups,
+          sizeof(script_param_keyword_groups)/sizeof(struct SCRIPT_KEYWORD_GROUP));
+    if (result)
+    {
+      /* Special value is checked after all parameter arrays */
+      struct SCRIPT_KEYWORD_HASH *kwhash=&script_keywords[1];
+      unsigned int len=strlen(random_cmdtext);
+      unsigned int pos=script_keyword_hash(random_cmdtext,len)&kwhash->mask;
+      while ((kwhash->entries[pos].text!=NULL)&&(stricmp(kwhash->entries[pos].text,random_cmdtext)!=0))
+        pos=(pos+1)&kwhash->mask;
+      if (kwhash->entries[pos].text==NULL)
+      {
+        kwhash->entries[pos].text=random_cmdtext;
+        kwhash->entries[pos].len=len;
+        kwhash->entries[pos].group=CMD_SPECIAL;
+        kwhash->entries[pos].index=SPEC_RANDOM;
+      }
+      script_keywords_ready=true;
+    } else
     {
-      *index=cmd_idx;
-      return CMD_TRIGER;
+      free(script_keywords[0].entries);
+      script_keywords[0].entries=NULL;
+      free(script_keywords[1].entries);
+      script_keywords[1].entries=NULL;
     }
-    cmd_idx=crtradj_cmd_index(wordtxt);
-    if (cmd_idx>=0)
+  }
+  script_keywords_seen=script_keywords_ready;
+  lbthreads_unlock();
+  return script_keywords_seen;
+}
+
+/*
+ * Returns signature of the script keyword arrays; compiled script
+ * is valid only with the same keywords it was compiled with.
+ */
+unsigned long script_keywords_signature(void)
+{
+  /* Computed once in every thread, so it needs no locking */
+  static THREAD_LOCAL unsigned long keywords_sign=0;
+  if (keywords_sign!=0)
+    return keywords_sign;
+  const struct SCRIPT_KEYWORD_GROUP *groups[2]={script_cmd_keyword_groups,script_param_keyword_groups};
+  const int groups_count[2]={
+      sizeof(script_cmd_keyword_groups)/sizeof(struct SCRIPT_KEYWORD_GROUP),
+      sizeof(script_param_keyword_groups)/sizeof(struct SCRIPT_KEYWORD_GROUP)};
+  struct SCRIPT_HASH shash;
+  script_hash_init(&shash);
+  int k,n,i;
+  for (k=0;k<2;k++)
+    for (n=0;n<groups_count[k];n++)
+    {
+      script_hash_add(&shash,&(groups[k][n].group),sizeof(int));
+      script_hash_add(&shash,&(groups[k][n].min_len),sizeof(int));
+      for (i=0;i<groups[k][n].count;i++)
+        script_hash_add(&shash,groups[k][n].arr[i],strlen(groups[k][n].arr[i])+1);
+    }
+  keywords_sign=script_hash_end(&shash);
+  return keywords_sign;
+}
+
+/*
+ * Returns group and index of a script word given as text slice,
+ * which doesn't have to be terminated by null character.
+ */
+int recognize_script_word_slice(int *index,const char *word,unsigned int len,const short is_parameter)
+{
+  return recognize_script_word_value(index,NULL,word,len,is_parameter);
+}
+
+/*
+ * Returns group and index of a script word given as text slice. If the word
+ * is a number, and value isn't NULL, the value of its beginning is also set.
+ */
+int recognize_script_word_value(int *index,int *value,const char *word,unsigned int len,const short is_parameter)
+{
+  if ((word==NULL)||(len==0))
+  {
+    if (!is_parameter)
     {
-      *index=cmd_idx;
-      return CMD_CRTRADJ;
+      *index=EMPTYLN;
+      return CMD_COMMNT;
     }
-    cmd_idx=obsolt_cmd_index(wordtxt);
-    if (cmd_idx>=0)
+    *index=-1;
+    return CMD_UNKNOWN;
+  }
+  if (!script_keywords_prepare())
+  {
+    message_error("recognize_script_word_slice: Cannot allocate memory");
+    *index=-1;
+    return CMD_UNKNOWN;
+  }
+  const struct SCRIPT_KEYWORD_HASH *kwhash=&script_keywords[is_parameter?1:0];
+  unsigned int pos=script_keyword_hash(word,len)&kwhash->mask;
+  while (kwhash->entries[pos].text!=NULL)
+  {
+    const struct SCRIPT_KEYWORD_ENTRY *entry=&kwhash->entries[pos];
+    if ((entry->len==len)&&(strnicmp(entry->text,word,len)==0))
     {
-      *index=cmd_idx;
-      return CMD_OBSOLT;
+      *index=entry->index;
+      return entry->group;
     }
-    cmd_idx=commnt_cmd_index(wordtxt);
-    if (cmd_idx>=0)
-    {
-      *index=cmd_idx;
-      return CMD_COMMNT;
+    pos=(pos+1)&kwhash->mask;
+  }
+  /* Numbers are special parameter values */
+  if (is_parameter)
+  {
+    /* Only beginning of the word decides whether it is a number */
+    char numtxt[16];
+    int val;
+    if (len>=sizeof(numtxt))
+      len=sizeof(numtxt)-1;
+    memcpy(numtxt,word,len);
+    numtxt[len]='\0';
+    if (script_param_to_int(&val,numtxt))
+    {
+      if (value!=NULL)
+        *value=val;
+      *index=SPEC_NUMBER;
+      return CMD_SPECIAL;
     }
   }
   *index=-1;
   return CMD_UNKNOWN;
 }
 
+/*
+ * Returns group and index of a script word
+ */
+int recognize_script_word_group_and_idx(int *index,const char *wordtxt,const short is_parameter)
+{
+  if (wordtxt==NULL)
+    return recognize_script_word_slice(index,NULL,0,is_parameter);
+  return recognize_script_word_slice(index,wordtxt,strlen(wordtxt),is_parameter);
+}
+
 short decompose_script_command(struct DK_SCRIPT_COMMAND *cmd,const char *text,const struct SCRIPT_OPTIONS *optns)
 {
   if ((cmd==NULL)||(text==NULL)) return false;
   /*Decomposing the string into single parameters - getting first (command name) */
-  char *wordtxt;
+  struct SCRIPT_TOKENIZER tok;
+  const char *wordptr;
+  unsigned int wordlen;
   cmd->level=get_script_command_level(text,optns);
-  wordtxt = script_strword(text,false);
+  script_tokenizer_init(&tok,text);
+  if (!script_token_next(&tok,&wordptr,&wordlen,false))
+  {
+      wordptr=NULL;
+      wordlen=0;
+  }
   int cmd_idx;
-  cmd->group=recognize_script_word_group_and_idx(&cmd_idx,wordtxt,false);
+  cmd->group=recognize_script_word_slice(&cmd_idx,wordptr,wordlen,false);
   cmd->index=cmd_idx;
   if (cmd->index<0)
   {
       cmd->group=CMD_UNKNOWN;
-      message_log("  decompose_script_command: \"%s\" not recognized",wordtxt);
-      free(wordtxt);
-      script_command_param_add(cmd,strdup(text));
+      message_log("  decompose_script_command: \"%.*s\" not recognized",(int)wordlen,wordptr);
+      script_command_param_add_slice(cmd,text,strlen(text));
       return false;
   }
-  free(wordtxt);
   /*Decomposing the string into parameters - in this case, treat the rest as one parameter */
   if (cmd->group==CMD_COMMNT)
   {
-      wordtxt = script_strword(NULL,true);
-/*      message_log("  decompose_script_command: got comment \"%s\"",wordtxt); */
-      script_command_param_add(cmd,wordtxt);
+      script_command_params_add_words(cmd,&tok,true);
   } else
   /*Decomposing the string into single parameters - getting the rest of parameters */
   {
-    while (wordtxt != NULL)
-    {
-      wordtxt = script_strword(NULL,false);
-/*      message_log("  decompose_script_command: got parameter \"%s\"",wordtxt); */
-      script_command_param_add(cmd,wordtxt);
-    }
+      script_command_params_add_words(cmd,&tok,false);
   }
   return true;
 }
 
 /*
  * Adds param as next script command parameter for cmd; adds direct pointer,
- * without duplicatidg the param pointer.
+ * without duplicatidg the param pointer. If parameters of the command are
+ * stored in an arena, the param is copied there and freed instead.
  */
 short script_command_param_add(struct DK_SCRIPT_COMMAND *cmd,char *param)
 {
     if ((cmd==NULL)||(param==NULL)) return false;
+    if (cmd->arena!=NULL)
+    {
+        short result=script_command_param_add_slice(cmd,param,strlen(param));
+        free(param);
+        return result;
+    }
     int param_idx=cmd->param_count;
     cmd->params=realloc(cmd->params,(param_idx+1)*sizeof(char *));
     cmd->params[param_idx]=param;
@@ -4035,6 +4655,507 @@ short script_command_param_add(struct DK_SCRIPT_COMMAND *cmd,char *param)
     return true;
 }
 
+/*
+ * Adds copy of len characters at ptr as next script command parameter.
+ */
+short script_command_param_add_slice(struct DK_SCRIPT_COMMAND *cmd,const char *ptr,unsigned int len)
+{
+    if ((cmd==NULL)||(ptr==NULL)) return false;
+    unsigned char *wordtxt;
+    if (cmd->arena==NULL)
+    {
+        wordtxt=malloc(len+1);
+        if (wordtxt==NULL)
+        {
+            message_error("script_command_param_add_slice: cannot allocate memory");
+            return false;
+        }
+        memcpy(wordtxt,ptr,len);
+        wordtxt[len]='\0';
+        return script_command_param_add(cmd,(char *)wordtxt);
+    }
+    int param_idx=cmd->param_count;
+    unsigned char **params;
+    params=memarena_alloc(cmd->arena,(param_idx+1)*sizeof(char *)+len+1);
+    if (params==NULL)
+        return false;
+    if (param_idx>0)
+        memcpy(params,cmd->params,param_idx*sizeof(char *));
+    wordtxt=(unsigned char *)(params+param_idx+1);
+    memcpy(wordtxt,ptr,len);
+    wordtxt[len]='\0';
+    params[param_idx]=wordtxt;
+    cmd->params=params;
+    cmd->param_count=param_idx+1;
+    return true;
+}
+
+/*
+ * Adds all words remaining in tok as next script command parameters.
+ * If parameters of the command are stored in an arena, the words are
+ * placed in a single arena block, together with the parameters array.
+ */
+short script_command_params_add_words(struct DK_SCRIPT_COMMAND *cmd,
+    const struct SCRIPT_TOKENIZER *words,const short whole_rest)
+{
+    if ((cmd==NULL)||(words==NULL)) return false;
+    struct SCRIPT_TOKENIZER tok;
+    const char *ptr;
+    unsigned int len;
+    short result=true;
+    tok=*words;
+    if (cmd->arena==NULL)
+    {
+        while (script_token_next(&tok,&ptr,&len,whole_rest))
+          result&=script_command_param_add_slice(cmd,ptr,len);
+        return result;
+    }
+    /* Counting the words first, to allocate memory only once */
+    int count=0;
+    unsigned long total_len=0;
+    while (script_token_next(&tok,&ptr,&len,whole_rest))
+    {
+        count++;
+        total_len+=len+1;
+    }
+    if (count==0)
+        return true;
+    int param_idx=cmd->param_count;
+    unsigned char **params;
+    params=memarena_alloc(cmd->arena,(param_idx+count)*sizeof(char *)+total_len);
+    if (params==NULL)
+        return false;
+    if (param_idx>0)
+        memcpy(params,cmd->params,param_idx*sizeof(char *));
+    unsigned char *wordtxt=(unsigned char *)(params+param_idx+count);
+    tok=*words;
+    while (script_token_next(&tok,&ptr,&len,whole_rest))
+    {
+        memcpy(wordtxt,ptr,len);
+        wordtxt[len]='\0';
+        params[param_idx]=wordtxt;
+        param_idx++;
+        wordtxt+=len+1;
+    }
+    cmd->params=params;
+    cmd->param_count=param_idx;
+    return result;
+}
+
+/*
+ * Returns opcodes area of compiled script.
+ */
+struct SCRIPT_OPCODE *script_code_ops(const struct DK_SCRIPT_CODE *code)
+{
+  return (struct SCRIPT_OPCODE *)(code+1);
+}
+
+/*
+ * Returns operands area of compiled script.
+ */
+struct SCRIPT_OPERAND *script_code_operands(const struct DK_SCRIPT_CODE *code)
+{
+  return (struct SCRIPT_OPERAND *)(script_code_ops(code)+code->ops_count);
+}
+
+/*
+ * Returns strings area of compiled script.
+ */
+char *script_code_strings(const struct DK_SCRIPT_CODE *code)
+{
+  return (char *)(script_code_operands(code)+code->operands_count);
+}
+
+/*
+ * Compiles given decomposed commands into new DK_SCRIPT_CODE block.
+ * Returns the block, which should be freed with free(), or NULL on error.
+ */
+struct DK_SCRIPT_CODE *script_code_compile(struct DK_SCRIPT_COMMAND **cmds,int cmds_count,
+    const struct SCRIPT_OPTIONS *optns)
+{
+  unsigned long operands_count=0;
+  unsigned long strings_size=0;
+  int i,k;
+  /* Counting the operands first, to allocate memory only once */
+  for (i=0;i<cmds_count;i++)
+  {
+      const struct DK_SCRIPT_COMMAND *cmd=cmds[i];
+      if (cmd==NULL) continue;
+      operands_count+=cmd->param_count;
+      for (k=0;k<cmd->param_count;k++)
+        strings_size+=strlen((char *)cmd->params[k])+1;
+  }
+  unsigned long size;
+  size=sizeof(struct DK_SCRIPT_CODE)+cmds_count*sizeof(struct SCRIPT_OPCODE)
+      +operands_count*sizeof(struct SCRIPT_OPERAND)+strings_size;
+  struct DK_SCRIPT_CODE *code=(struct DK_SCRIPT_CODE *)malloc(size);
+  if (code==NULL)
+  {
+      message_error("script_code_compile: Cannot allocate memory");
+      return NULL;
+  }
+  memcpy(code->magic,SCRIPT_CODE_MAGIC,sizeof(code->magic));
+  code->version=SCRIPT_CODE_VERSION;
+  code->byte_order=SCRIPT_CODE_BYTE_ORDER;
+  code->layout=SCRIPT_CODE_LAYOUT;
+  code->size=size;
+  code->keywords_hash=script_keywords_signature();
+  code->level_spaces=optns->level_spaces;
+  code->txt_hash=0;
+  code->ops_count=cmds_count;
+  code->operands_count=operands_count;
+  code->strings_size=strings_size;
+  struct SCRIPT_OPCODE *op=script_code_ops(code);
+  struct SCRIPT_OPERAND *opnd=script_code_operands(code);
+  char *strings=script_code_strings(code);
+  unsigned int operand=0;
+  unsigned int text=0;
+  for (i=0;i<cmds_count;i++,op++)
+  {
+      const struct DK_SCRIPT_COMMAND *cmd=cmds[i];
+      op->operands=operand;
+      if (cmd==NULL)
+      {
+          op->group=CMD_UNKNOWN;
+          op->index=-1;
+          op->level=0;
+          op->operands_count=0;
+          continue;
+      }
+      op->group=cmd->group;
+      op->index=cmd->index;
+      op->level=cmd->level;
+      op->operands_count=cmd->param_count;
+      for (k=0;k<cmd->param_count;k++,opnd++)
+      {
+          const char *param=(char *)cmd->params[k];
+          unsigned int len=strlen(param);
+          int idx;
+          opnd->value=0;
+          opnd->group=recognize_script_word_value(&idx,&(opnd->value),param,len,true);
+          if (idx<0)
+            opnd->group=CMD_UNKNOWN;
+          opnd->index=idx;
+          /* Only short numbers were read whole when recognizing */
+          if ((opnd->group==CMD_SPECIAL)&&(idx==SPEC_NUMBER)&&(len>15))
+            script_param_to_int(&(opnd->value),param);
+          opnd->text=text;
+          memcpy(strings+text,param,len+1);
+          text+=len+1;
+      }
+      operand+=cmd->param_count;
+  }
+  code->code_hash=0;
+  return code;
+}
+
+/*
+ * Returns hash of the areas following header of compiled script.
+ */
+unsigned long script_code_hash(const struct DK_SCRIPT_CODE *code)
+{
+  return script_data_hash(code+1,code->size-sizeof(struct DK_SCRIPT_CODE));
+}
+
+/*
+ * Checks whether given group and index are a valid script keyword.
+ */
+short script_keyword_valid(const int group,const int index,const short is_parameter)
+{
+  if (group==CMD_UNKNOWN)
+      return (index==-1);
+  if ((is_parameter)&&(group==CMD_SPECIAL))
+      return (index==SPEC_RANDOM)||(index==SPEC_NUMBER);
+  const struct SCRIPT_KEYWORD_GROUP *groups;
+  int groups_count;
+  if (is_parameter)
+  {
+      groups=script_param_keyword_groups;
+      groups_count=sizeof(script_param_keyword_groups)/sizeof(struct SCRIPT_KEYWORD_GROUP);
+  } else
+  {
+      groups=script_cmd_keyword_groups;
+      groups_count=sizeof(script_cmd_keyword_groups)/sizeof(struct SCRIPT_KEYWORD_GROUP);
+  }
+  int n;
+  for (n=0;n<groups_count;n++)
+  {
+      if (groups[n].group==group)
+        return (index>=0)&&(index<groups[n].count);
+  }
+  return false;
+}
+
+/*
+ * Checks whether compiled script of given length, read from a file,
+ * is correct and was compiled with the same keywords and options.
+ */
+short script_code_check(const struct DK_SCRIPT_CODE *code,unsigned long len,
+    const struct SCRIPT_OPTIONS *optns)
+{
+  if ((code==NULL)||(len<sizeof(struct DK_SCRIPT_CODE)))
+      return false;
+  if (memcmp(code->magic,SCRIPT_CODE_MAGIC,sizeof(code->magic))!=0)
+      return false;
+  if ((code->version!=SCRIPT_CODE_VERSION)||(code->byte_order!=SCRIPT_CODE_BYTE_ORDER)||
+      (code->layout!=SCRIPT_CODE_LAYOUT)||(code->size!=len))
+      return false;
+  if ((code->level_spaces!=optns->level_spaces)||(code->keywords_hash!=script_keywords_signature()))
+      return false;
+  /* Every area has to fit inside the block */
+  unsigned long areas_len=len-sizeof(struct DK_SCRIPT_CODE);
+  if (code->ops_count>areas_len/sizeof(struct SCRIPT_OPCODE))
+      return false;
+  areas_len-=code->ops_count*sizeof(struct SCRIPT_OPCODE);
+  if (code->operands_count>areas_len/sizeof(struct SCRIPT_OPERAND))
+      return false;
+  areas_len-=code->operands_count*sizeof(struct SCRIPT_OPERAND);
+  if (code->strings_size!=areas_len)
+      return false;
+  if (code->code_hash!=script_code_hash(code))
+      return false;
+  const char *strings=script_code_strings(code);
+  if ((code->strings_size>0)&&(strings[code->strings_size-1]!='\0'))
+      return false;
+  const struct SCRIPT_OPCODE *ops=script_code_ops(code);
+  unsigned int i;
+  for (i=0;i<code->ops_count;i++)
+  {
+      const struct SCRIPT_OPCODE *op=&ops[i];
+      if ((op->level<0)||(op->operands_count<0))
+          return false;
+      if ((op->operands>code->operands_count)||(op->operands_count>code->operands_count-op->operands))
+          return false;
+      if (!script_keyword_valid(op->group,op->index,false))
+          return false;
+  }
+  const struct SCRIPT_OPERAND *opnds=script_code_operands(code);
+  for (i=0;i<code->operands_count;i++)
+  {
+      const struct SCRIPT_OPERAND *opnd=&opnds[i];
+      if (opnd->text>=code->strings_size)
+          return false;
+      if (!script_keyword_valid(opnd->group,opnd->index,true))
+          return false;
+  }
+  return true;
+}
+
+/*
+ * Compiles decomposed commands of the script, replacing its previous
+ * compiled code. The commands are linked to their compiled operands,
+ * so their parameters don't have to be recognized again.
+ */
+short script_compile(struct DK_SCRIPT *script,const struct SCRIPT_OPTIONS *optns)
+{
+  if (script==NULL) return false;
+  struct DK_SCRIPT_CODE *code;
+  code=script_code_compile(script->list,script->lines_count,optns);
+  if (code==NULL) return false;
+  script_code_free(script);
+  script->code=code;
+  const struct SCRIPT_OPCODE *ops=script_code_ops(code);
+  const struct SCRIPT_OPERAND *opnds=script_code_operands(code);
+  int i;
+  for (i=0;i<script->lines_count;i++)
+  {
+      if (script->list[i]!=NULL)
+        script->list[i]->operands=opnds+ops[i].operands;
+  }
+  return true;
+}
+
+/*
+ * Creates decomposed commands of the script from its compiled code,
+ * without analyzing the script text. The commands parameters are placed
+ * in the script arena, in one block.
+ */
+short script_code_to_decomposed(struct DK_SCRIPT *script,__attribute__((unused)) const struct SCRIPT_OPTIONS *optns)
+{
+  if ((script==NULL)||(script->code==NULL)) return false;
+  const struct DK_SCRIPT_CODE *code=script->code;
+  if (code->ops_count!=script->lines_count)
+      return false;
+  /* All commands are replaced, so the old ones can be dropped */
+  script_commands_free_params(script);
+  if (script->arena!=NULL)
+    memarena_reset(script->arena);
+  struct DK_SCRIPT_COMMAND *cmds;
+  cmds=script_commands_alloc(script,code->ops_count);
+  unsigned char **params=NULL;
+  if (cmds!=NULL)
+    params=memarena_alloc(script->arena,code->operands_count*sizeof(char *)+code->strings_size);
+  const struct SCRIPT_OPCODE *ops=script_code_ops(code);
+  const struct SCRIPT_OPERAND *opnds=script_code_operands(code);
+  unsigned char *strings=NULL;
+  if (params!=NULL)
+  {
+      strings=(unsigned char *)(params+code->operands_count);
+      memcpy(strings,script_code_strings(code),code->strings_size);
+  }
+  unsigned int i,k;
+  for (i=0;i<code->ops_count;i++)
+  {
+      if (params==NULL)
+      {
+          script->list[i]=NULL;
+          continue;
+      }
+      struct DK_SCRIPT_COMMAND *cmd=&cmds[i];
+      script->list[i]=cmd;
+      const struct SCRIPT_OPCODE *op=&ops[i];
+      cmd->group=op->group;
+      cmd->index=op->index;
+      cmd->level=op->level;
+      cmd->operands=opnds+op->operands;
+      if (op->operands_count>0)
+      {
+          cmd->params=params+op->operands;
+          for (k=0;k<op->operands_count;k++)
+            cmd->params[k]=strings+opnds[op->operands+k].text;
+          cmd->param_count=op->operands_count;
+      }
+  }
+  script_verify_cache_reset(script);
+  return (params!=NULL);
+}
+
+/*
+ * Frees compiled code of the script, unlinking the commands from it.
+ */
+void script_code_free(struct DK_SCRIPT *script)
+{
+  if ((script==NULL)||(script->code==NULL)) return;
+  int i;
+  for (i=0;i<script->lines_count;i++)
+  {
+      if (script->list[i]!=NULL)
+        script->list[i]->operands=NULL;
+  }
+  free(script->code);
+  script->code=NULL;
+}
+
+/*
+ * Mixes 4-byte block into the hash; uses MurmurHash3 steps, so the hash
+ * is fast, and 32-bit regardless of the platform - it can be stored in files.
+ */
+unsigned long script_hash_block(unsigned long hash,unsigned long k)
+{
+  k=(k*0xcc9e2d51UL)&0xffffffffUL;
+  k=((k<<15)|(k>>17))&0xffffffffUL;
+  k=(k*0x1b873593UL)&0xffffffffUL;
+  hash^=k;
+  hash=((hash<<13)|(hash>>19))&0xffffffffUL;
+  return (hash*5+0xe6546b64UL)&0xffffffffUL;
+}
+
+/*
+ * Starts computing a hash of data given in one or more parts.
+ */
+void script_hash_init(struct SCRIPT_HASH *shash)
+{
+  shash->hash=0;
+  shash->tail=0;
+  shash->tail_len=0;
+  shash->total_len=0;
+}
+
+/*
+ * Adds next part of the data to the hash.
+ */
+void script_hash_add(struct SCRIPT_HASH *shash,const void *data,unsigned long len)
+{
+  const unsigned char *ptr=(const unsigned char *)data;
+  shash->total_len+=len;
+  /* Completing the block started by previous part */
+  while ((shash->tail_len>0)&&(len>0))
+  {
+    shash->tail|=((unsigned long)*ptr)<<(8*shash->tail_len);
+    shash->tail_len++;
+    ptr++;
+    len--;
+    if (shash->tail_len==4)
+    {
+      shash->hash=script_hash_block(shash->hash,shash->tail);
+      shash->tail=0;
+      shash->tail_len=0;
+    }
+  }
+  while (len>=4)
+  {
+    unsigned long k=ptr[0]|(ptr[1]<<8)|(ptr[2]<<16)|(((unsigned long)ptr[3])<<24);
+    shash->hash=script_hash_block(shash->hash,k);
+    ptr+=4;
+    len-=4;
+  }
+  while (len>0)
+  {
+    shash->tail|=((unsigned long)*ptr)<<(8*shash->tail_len);
+    shash->tail_len++;
+    ptr++;
+    len--;
+  }
+}
+
+/*
+ * Finishes computing the hash, and returns it.
+ */
+unsigned long script_hash_end(struct SCRIPT_HASH *shash)
+{
+  unsigned long hash=shash->hash;
+  if (shash->tail_len>0)
+  {
+    unsigned long k=shash->tail;
+    k=(k*0xcc9e2d51UL)&0xffffffffUL;
+    k=((k<<15)|(k>>17))&0xffffffffUL;
+    k=(k*0x1b873593UL)&0xffffffffUL;
+    hash^=k;
+  }
+  hash^=(shash->total_len&0xffffffffUL);
+  hash^=(hash>>16);
+  hash=(hash*0x85ebca6bUL)&0xffffffffUL;
+  hash^=(hash>>13);
+  hash=(hash*0xc2b2ae35UL)&0xffffffffUL;
+  hash^=(hash>>16);
+  return hash;
+}
+
+/*
+ * Returns hash of given data.
+ */
+unsigned long script_data_hash(const void *data,unsigned long len)
+{
+  struct SCRIPT_HASH shash;
+  script_hash_init(&shash);
+  script_hash_add(&shash,data,len);
+  return script_hash_end(&shash);
+}
+
+/*
+ * Returns hash of text lines, the same as hash of a file
+ * written from the lines by write_text_file().
+ */
+unsigned long script_lines_hash(char **lines,int lines_count)
+{
+  struct SCRIPT_HASH shash;
+  script_hash_init(&shash);
+  int last_line=lines_count-1;
+  int i;
+  for (i=0;i<last_line;i++)
+  {
+    script_hash_add(&shash,lines[i],strlen(lines[i]));
+    script_hash_add(&shash,"\r\n",2);
+  }
+  if (last_line>=0)
+  {
+    script_hash_add(&shash,lines[last_line],strlen(lines[last_line]));
+    if (lines[last_line][0]!='\0')
+      script_hash_add(&shash,"\r\n",2);
+  }
+  return script_hash_end(&shash);
+}
+
 short is_no_bracket_command(int group,int cmdidx)
 {
     switch (group)
@@ -4150,10 +5271,34 @@ short renew_cmd_param(const struct DK_SCRIPT_COMMAND *cmd, const unsigned int pa
   char *wordtxt=cmd->params[param_idx];
   int par_idx;
   int par_group;
-  par_group=recognize_script_word_group_and_idx(&par_idx,wordtxt,true);
+  /* Compiled commands have their parameters already recognized */
+  if (cmd->operands!=NULL)
+  {
+      par_group=cmd->operands[param_idx].group;
+      par_idx=cmd->operands[param_idx].index;
+  } else
+  {
+      par_group=recognize_script_word_group_and_idx(&par_idx,wordtxt,true);
+  }
   if (par_idx<0)
       return false;
   const char *nword=script_cmd_text(par_group,par_idx,wordtxt);
+  if (strcmp(nword,wordtxt)==0)
+      return false;
+  int len=strlen(nword);
+  if (cmd->arena!=NULL)
+  {
+      /* Arena memory can't be freed; reuse the old place if possible */
+      if (len>strlen(wordtxt))
+      {
+          wordtxt=memarena_alloc(cmd->arena,len+1);
+          if (wordtxt==NULL)
+              return false;
+      }
+      strcpy(wordtxt,nword);
+      cmd->params[param_idx]=(unsigned char *)wordtxt;
+      return true;
+  }
   wordtxt=strdup(nword);
   if (wordtxt==NULL)
       return false;
@@ -4942,6 +6087,8 @@ void script_command_clear(struct DK_SCRIPT_COMMAND *cmd)
     cmd->index=-1;
     cmd->params=NULL;
     cmd->param_count=0;
+    cmd->arena=NULL;
+    cmd->operands=NULL;
 }
 
 /*
@@ -4949,10 +6096,22 @@ void script_command_clear(struct DK_SCRIPT_COMMAND *cmd)
  */
 void script_command_free(struct DK_SCRIPT_COMMAND *cmd)
 {
+    script_command_free_params(cmd);
+    free(cmd);
+}
+
+/*
+ * Frees parameters of given DK_SCRIPT_COMMAND, unless they're stored
+ * in an arena; arena memory is released with the whole arena.
+ */
+void script_command_free_params(struct DK_SCRIPT_COMMAND *cmd)
+{
+    if (cmd->arena!=NULL)
+        return;
     int i;
     for (i=cmd->param_count-1;i>=0;i--)
         free(cmd->params[i]);
-    free(cmd);
+    free(cmd->params);
 }
 
 /*
@@ -4967,9 +6126,7 @@ void script_command_renew(struct DK_SCRIPT_COMMAND **cmd)
       (*cmd)=script_command_create();
       return;
     }
-    int i;
-    for (i=(*cmd)->param_count-1;i>=0;i--)
-        free((*cmd)->params[i]);
+    script_command_free_params(*cmd);
     script_command_clear(*cmd);
 }
 
@@ -5034,13 +6191,14 @@ short add_stats_to_script(char ***lines,int *lines_count,struct LEVEL *lvl)
         max_len=max(max_len,strlen(lvl->info.author_text)+strlen(lvl->info.editor_text)+(LINEMSG_SIZE>>1));
     line=(char *)malloc(max_len*sizeof(char));
     tmp=(char *)malloc(max_len*sizeof(char));
-    unsigned long curr_time=time(NULL);
+    time_t curr_time=time(NULL);
+    struct tm curr_tm;
     /* Script header */
     tmp2=prepare_short_fname(lvl->savfname,24);
     sprintf(line,"%s %s script file for %s",rem_cmdtext,PROGRAM_NAME,tmp2);
     free(tmp2);
     text_file_linecp_add(lines,lines_count,line);
-    strftime(tmp,LINEMSG_SIZE/2, "%d %b %Y, %H:%M:%S", localtime(&curr_time) );
+    strftime(tmp,LINEMSG_SIZE/2, "%d %b %Y, %H:%M:%S", localtime_safe(&curr_time,&curr_tm) );
     sprintf(line,"%s %s %s",rem_cmdtext,"Automatically generated on",tmp);
     text_file_linecp_add(lines,lines_count,line);
     text_file_linecp_add(lines,lines_count,"");
@@ -325,6 +325,9 @@ enum object_available {
     AVAIL_INSTANT      = 0x002,
 };
 
+struct MEMORY_ARENA;
+struct SCRIPT_OPERAND;
+
 struct DK_SCRIPT_COMMAND {
     int group;  /* To which command group this one belongs */
     int index;  /* Specific command index inside the group */
@@ -332,6 +335,83 @@ struct DK_SCRIPT_COMMAND {
     int param_count;  /* Count of the parameters */
     int level;  /* amount of opened loops; 0 means main block */
                 /* (regulates how much empty spaces to add before the command) */
+    struct MEMORY_ARENA *arena; /* Arena owning the parameters, or NULL */
+                /* if every parameter is allocated separately */
+    const struct SCRIPT_OPERAND *operands; /* Compiled parameters inside */
+                /* DK_SCRIPT_CODE of the script, or NULL if not compiled */
+  };
+
+/* Compiled script format; the version has to be increased whenever */
+/* layout of the compiled script or the hash function changes */
+#define SCRIPT_CODE_MAGIC "ADSC"
+#define SCRIPT_CODE_VERSION 2
+/* Compiled script is stored as it is in memory; byte order and sizes */
+/* of the structures are stored too, so that files written on a different */
+/* platform are rejected */
+#define SCRIPT_CODE_BYTE_ORDER 0x01020304
+#define SCRIPT_CODE_LAYOUT ((sizeof(struct DK_SCRIPT_CODE)<<16)| \
+    (sizeof(struct SCRIPT_OPCODE)<<8)|sizeof(struct SCRIPT_OPERAND))
+
+/*
+ * Parameter of a compiled script command. Keywords are stored with
+ * the group and index they were recognized as, numbers with their value.
+ */
+struct SCRIPT_OPERAND {
+    short group;  /* Recognized parameter group, or CMD_UNKNOWN */
+    short index;  /* Index inside the group, or -1 */
+    int value;    /* Value of SPEC_NUMBER operand */
+    unsigned int text; /* Offset of the parameter text in strings area */
+  };
+
+/*
+ * State of a hash computed by script_hash_add(), allowing the data
+ * to be given in parts.
+ */
+struct SCRIPT_HASH {
+    unsigned long hash;
+    unsigned long tail; /* Bytes which don't make a whole block yet */
+    unsigned int tail_len;
+    unsigned long total_len;
+  };
+
+/*
+ * Compiled script command.
+ */
+struct SCRIPT_OPCODE {
+    short group;
+    short index;
+    short level;
+    short operands_count;
+    unsigned int operands; /* Index of the first operand */
+  };
+
+/*
+ * Compiled script. The header is followed by opcodes, operands and
+ * strings areas, all in one memory block. Offsets are used instead
+ * of pointers, so the block can be written to disk and read back as it is.
+ */
+struct DK_SCRIPT_CODE {
+    char magic[4];
+    unsigned int version;
+    unsigned int byte_order; /* SCRIPT_CODE_BYTE_ORDER */
+    unsigned int layout; /* SCRIPT_CODE_LAYOUT */
+    unsigned int size; /* Size of the whole block, in bytes */
+    unsigned int keywords_hash; /* Signature of the script keyword arrays */
+    unsigned int level_spaces;  /* SCRIPT_OPTIONS used when compiling */
+    unsigned int txt_hash; /* Hash of the TXT file, set when saving */
+    unsigned int code_hash; /* Hash of the areas following the header, */
+                            /* set when saving */
+    unsigned int ops_count;
+    unsigned int operands_count;
+    unsigned int strings_size;
+  };
+
+/*
+ * Position of script_token_next() inside text; allows tokenizing
+ * many lines at once, without sharing any state.
+ */
+struct SCRIPT_TOKENIZER {
+    const char *text;
   };
 
 struct SCRIPT_VERIFY_DATA {
@@ -344,7 +424,49 @@ struct SCRIPT_VERIFY_DATA {
     int level;
     int total_ifs;
     int total_in_pool;
-    char **partys;
+    const char **partys;
+    short flags; /* SCRIPT_VERIFY_FLAGS of the currently verified command */
+  };
+
+enum SCRIPT_VERIFY_FLAGS {
+    SVF_NONE         = 0x00,
+    SVF_USES_OBJECTS = 0x01, /* depends on action points and hero gates */
+    SVF_USES_PARTYS  = 0x02, /* depends on partys created before */
+    SVF_ADDS_PARTY   = 0x04,
+};
+
+/*
+ * Verification result of a single script line, and its effect on
+ * the verification of next lines.
+ */
+struct SCRIPT_VERIFY_LINE {
+    short verify_needed; /* the line was changed since it was verified */
+    short result;
+    int err_param;
+    short flags;
+    int level;       /* nesting depth before the line, when verified */
+    int level_delta; /* change of nesting depth made by the line */
+    int ifs_delta;   /* amount of IF statements in the line */
+    short nest_needed; /* the line was changed since recompute_script_levels() */
+    int nest;        /* nesting depth before the line, from recompute_script_levels() */
+  };
+
+/*
+ * Cached verification of the whole script; allows re-checking only
+ * the changed lines and lines whose dependencies have changed.
+ */
+struct SCRIPT_VERIFY_CACHE {
+    struct SCRIPT_VERIFY_LINE *lines;
+    int lines_count;
+    /* Hero gates and action points on map, listed at LEVEL mod_gen objs_gen */
+    unsigned char *herogts;
+    unsigned int herogts_count;
+    unsigned char *actnpts;
+    unsigned int actnpts_count;
+    short objs_valid;
+    unsigned long objs_gen;
+    /* Nesting depth after the last line, from recompute_script_levels() */
+    int nest_end;
   };
 
 struct DK_SCRIPT;
@@ -364,11 +486,33 @@ DLLIMPORT char *recompose_script_command(const struct DK_SCRIPT_COMMAND *cmd,con
 short renew_cmd_param(const struct DK_SCRIPT_COMMAND *cmd,const unsigned int param_idx,
     const struct SCRIPT_OPTIONS *optns);
 int recognize_script_word_group_and_idx(int *index,const char *wordtxt,const short is_parameter);
+int recognize_script_word_slice(int *index,const char *word,unsigned int len,const short is_parameter);
+int recognize_script_word_value(int *index,int *value,const char *word,unsigned int len,const short is_parameter);
 /* Converting between decomposed commands and DK_SCRIPT_PARAMETERS struct */
 DLLIMPORT short script_decomposed_to_params_cmd(struct DK_SCRIPT_PARAMETERS *par,
     struct DK_SCRIPT_COMMAND *cmd,const struct SCRIPT_OPTIONS *optns);
 DLLIMPORT short script_decomposed_to_params(struct DK_SCRIPT *script,const struct SCRIPT_OPTIONS *optns);
 DLLIMPORT short script_params_to_decomposed(struct DK_SCRIPT *script,const struct SCRIPT_OPTIONS *optns);
+/* Compiled script */
+struct DK_SCRIPT_CODE *script_code_compile(struct DK_SCRIPT_COMMAND **cmds,int cmds_count,
+    const struct SCRIPT_OPTIONS *optns);
+short script_code_check(const struct DK_SCRIPT_CODE *code,unsigned long len,
+    const struct SCRIPT_OPTIONS *optns);
+struct SCRIPT_OPCODE *script_code_ops(const struct DK_SCRIPT_CODE *code);
+struct SCRIPT_OPERAND *script_code_operands(const struct DK_SCRIPT_CODE *code);
+char *script_code_strings(const struct DK_SCRIPT_CODE *code);
+DLLIMPORT short script_compile(struct DK_SCRIPT *script,const struct SCRIPT_OPTIONS *optns);
+DLLIMPORT short script_code_to_decomposed(struct DK_SCRIPT *script,const struct SCRIPT_OPTIONS *optns);
+DLLIMPORT short script_code_to_params(struct DK_SCRIPT_PARAMETERS *par,
+    const struct DK_SCRIPT_CODE *code,const struct SCRIPT_OPTIONS *optns);
+DLLIMPORT void script_code_free(struct DK_SCRIPT *script);
+void script_hash_init(struct SCRIPT_HASH *shash);
+void script_hash_add(struct SCRIPT_HASH *shash,const void *data,unsigned long len);
+unsigned long script_hash_end(struct SCRIPT_HASH *shash);
+unsigned long script_data_hash(const void *data,unsigned long len);
+unsigned long script_lines_hash(char **lines,int lines_count);
+unsigned long script_keywords_signature(void);
+unsigned long script_code_hash(const struct DK_SCRIPT_CODE *code);
 /*Functions for Adikted script execution */
 DLLIMPORT short execute_script_line(struct LEVEL *lvl,char *line,char *err_msg);
 DLLIMPORT short add_stats_to_script(char ***lines,int *lines_count,struct LEVEL *lvl);
@@ -377,6 +521,17 @@ DLLIMPORT short add_custom_clms_to_script(char ***lines,int *lines_count,struct
 /*Functions - verification */
 DLLIMPORT short dkscript_verify(const struct LEVEL *lvl, char *err_msg,int *err_line,int *err_param);
 DLLIMPORT short txt_verify(const struct LEVEL *lvl, char *err_msg,struct IPOINT_2D *errpt);
+short script_command_verify(struct SCRIPT_VERIFY_DATA *scverif,char *err_msg,
+    int *err_param,const struct DK_SCRIPT_COMMAND *cmd);
+short script_verify_cache_reset(struct DK_SCRIPT *script);
+void script_verify_cache_free(struct SCRIPT_VERIFY_CACHE **cache);
+/*Functions for editing single lines */
+DLLIMPORT short script_line_set(struct DK_SCRIPT *script,const int line,
+    const char *text,const struct SCRIPT_OPTIONS *optns);
+DLLIMPORT short script_line_changed(struct DK_SCRIPT *script,const int line);
+short script_line_text_store(struct DK_SCRIPT *script,const int line,const char *text);
+struct DK_SCRIPT_COMMAND *script_commands_alloc(struct DK_SCRIPT *script,const int count);
+void script_commands_free_params(struct DK_SCRIPT *script);
 
 /*Working with text files */
 DLLIMPORT void text_file_free(char **lines,int lines_count);
@@ -471,10 +626,15 @@ DLLIMPORT const char *party_objectv_cmd_text(int cmdidx);
 
 /*Other lower level functions */
 DLLIMPORT short script_command_param_add(struct DK_SCRIPT_COMMAND *cmd,char *param);
+DLLIMPORT short script_command_param_add_slice(struct DK_SCRIPT_COMMAND *cmd,
+    const char *ptr,unsigned int len);
+DLLIMPORT short script_command_params_add_words(struct DK_SCRIPT_COMMAND *cmd,
+    const struct SCRIPT_TOKENIZER *words,const short whole_rest);
 DLLIMPORT void script_command_clear(struct DK_SCRIPT_COMMAND *cmd);
 DLLIMPORT struct DK_SCRIPT_COMMAND *script_command_create(void);
 DLLIMPORT void script_command_renew(struct DK_SCRIPT_COMMAND **cmd);
 DLLIMPORT void script_command_free(struct DK_SCRIPT_COMMAND *cmd);
+DLLIMPORT void script_command_free_params(struct DK_SCRIPT_COMMAND *cmd);
 DLLIMPORT char *get_orientation_shortname(unsigned short orient);
 DLLIMPORT char *get_font_longname(unsigned short font);
 DLLIMPORT short script_param_to_int(int *val,const char *param);
@@ -484,6 +644,9 @@ DLLIMPORT short is_no_bracket_command(int group,int cmdidx);
 DLLIMPORT char *script_strword( const char *str, const short whole_rest );
 DLLIMPORT short script_strword_pos( char const **ptr, unsigned int *ptr_len,
     const char *str, const short whole_rest );
+DLLIMPORT void script_tokenizer_init(struct SCRIPT_TOKENIZER *tok,const char *str);
+DLLIMPORT short script_token_next(struct SCRIPT_TOKENIZER *tok,char const **ptr,
+    unsigned int *ptr_len,const short whole_rest);
 
 /*Lower level - executing commands */
 DLLIMPORT short execute_adikted_command(struct LEVEL *lvl,struct DK_SCRIPT_COMMAND *cmd,char *err_msg);
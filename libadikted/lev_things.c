@@ -20,6 +20,7 @@
 
 #include "globals.h"
 #include <limits.h>
+#include <math.h>
 #include "lev_data.h"
 #include "obj_slabs.h"
 #include "obj_things.h"
@@ -2045,7 +2046,12 @@ short update_things_subpos_and_height_for_slab(struct LEVEL *lvl, int tx, int ty
           for (i=last_thing; i>=0; i--)
           {
             char *thing=get_thing(lvl,sx,sy,i);
+            unsigned char sub_x=get_thing_subtpos_x(thing);
+            unsigned char sub_y=get_thing_subtpos_y(thing);
             result&=update_thing_subpos_and_height(clm_height,thing);
+            /* Thing is modified in place, so the change must be marked */
+            if ((sub_x!=get_thing_subtpos_x(thing))||(sub_y!=get_thing_subtpos_y(thing)))
+              level_mark_object_changed(lvl,sx,sy,0);
           }
      }
     return result;
@@ -2179,6 +2185,233 @@ short subtl_in_effectgen_range(struct LEVEL *lvl,unsigned int sx,unsigned int sy
     return false;
 }
 
+/*
+ * Computes distance between given point and a rectangle, in "_adv" form.
+ * The rectangle includes its starting coordinates, but not the ending ones.
+ * Used to skip whole areas when searching for objects.
+ */
+unsigned long get_rect_distance_adv(const int ssx,const int ssy,
+    const int x_start,const int y_start,const int x_end,const int y_end)
+{
+    int dx,dy;
+    if (ssx<x_start) dx=x_start-ssx; else
+    if (ssx>=x_end)  dx=ssx-x_end+1; else
+      dx=0;
+    if (ssy<y_start) dy=y_start-ssy; else
+    if (ssy>=y_end)  dy=ssy-y_end+1; else
+      dy=0;
+    float dist_sqr=((float)dx*dx)+((float)dy*dy);
+    return sqrt(dist_sqr);
+}
+
+/*
+ * Puts object into list of nearest objects, sorted by distance.
+ * If the list is full, the farthest object is dropped.
+ * Objects at equal distance are kept in the order they were found.
+ */
+void nearest_objects_list_add(struct OBJECT_INDEX *list,unsigned int *count,
+    const unsigned int max_count,const unsigned int sx,const unsigned int sy,
+    const unsigned int num,const unsigned long dist)
+{
+    unsigned int pos;
+    pos=*count;
+    if (pos>=max_count)
+    {
+      if (dist>=list[max_count-1].dist) return;
+      pos=max_count-1;
+    } else
+    {
+      (*count)++;
+    }
+    while ((pos>0) && (list[pos-1].dist>dist))
+    {
+      list[pos]=list[pos-1];
+      pos--;
+    }
+    list[pos].sx=sx;
+    list[pos].sy=sy;
+    list[pos].num=num;
+    list[pos].dist=dist;
+}
+
+/*
+ * Searches objects in single tile, adding the near ones to sorted list.
+ */
+void nearest_objects_search_tile(const struct LEVEL *lvl,
+    const unsigned int ssx,const unsigned int ssy,
+    const unsigned int tx,const unsigned int ty,const unsigned long max_dist,
+    const short obj_type,struct OBJECT_INDEX *list,unsigned int *count,
+    const unsigned int max_count)
+{
+    unsigned int sx,sy;
+    for (sy=ty*MAP_SUBNUM_Y;sy<(ty+1)*MAP_SUBNUM_Y;sy++)
+      for (sx=tx*MAP_SUBNUM_X;sx<(tx+1)*MAP_SUBNUM_X;sx++)
+      {
+        unsigned int num,num_limit;
+        unsigned long dist;
+        if (obj_type==OBJECT_TYPE_THING)
+          num_limit=get_thing_subnums(lvl,sx,sy);
+        else
+          num_limit=get_object_subnums(lvl,sx,sy);
+        for (num=0;num<num_limit;num++)
+        {
+            if (obj_type==OBJECT_TYPE_THING)
+            {
+                dist=get_thing_distance_adv((unsigned char *)get_thing(lvl,sx,sy,num),ssx,ssy);
+            } else
+            {
+                unsigned char *obj;
+                obj=get_object(lvl,sx,sy,num);
+                switch (get_object_type(lvl,sx,sy,num))
+                {
+                case OBJECT_TYPE_THING:
+                    dist=get_thing_distance_adv(obj,ssx,ssy);
+                    break;
+                case OBJECT_TYPE_ACTNPT:
+                    dist=get_actnpt_distance_adv(obj,ssx,ssy);
+                    break;
+                case OBJECT_TYPE_STLIGHT:
+                    dist=get_stlight_distance_adv(obj,ssx,ssy);
+                    break;
+                default:
+                    dist=ULONG_MAX;
+                    break;
+                }
+            }
+            if (dist<=max_dist)
+              nearest_objects_list_add(list,count,max_count,sx,sy,num,dist);
+        }
+      }
+}
+
+/*
+ * Searches for objects nearest to given position, using the search buckets
+ * stored in LEVEL. Buckets are visited in rings around the position,
+ * and the search stops when next ring can't contain anything nearer
+ * than the objects already found. Empty buckets and tiles are skipped,
+ * so there's no need to sweep empty areas of the map subtile by subtile.
+ * @param lvl Pointer to the LEVEL structure.
+ * @param ssx,ssy Source position, subtile<<8 + subtile_pos.
+ * @param max_dist Maximal distance of returned objects.
+ * @param obj_type OBJECT_TYPE_THING to search things only,
+ *     OBJECT_TYPE_NONE to search all objects.
+ * @param list The list which will be filled with object indices.
+ * @param max_count Size of the list.
+ * @return Returns amount of objects placed in the list.
+ */
+unsigned int get_nearest_objects_in_buckets(const struct LEVEL *lvl,
+    const unsigned int ssx,const unsigned int ssy,const unsigned long max_dist,
+    const short obj_type,struct OBJECT_INDEX *list,const unsigned int max_count)
+{
+    const int bucket_adv_x=(OBJ_BUCKET_TILES*MAP_SUBNUM_X)<<8;
+    const int bucket_adv_y=(OBJ_BUCKET_TILES*MAP_SUBNUM_Y)<<8;
+    const int tile_adv_x=MAP_SUBNUM_X<<8;
+    const int tile_adv_y=MAP_SUBNUM_Y<<8;
+    unsigned int count=0;
+    if ((lvl==NULL)||(list==NULL)||(max_count<1)) return 0;
+    int bx_start,by_start;
+    bx_start=ssx/bucket_adv_x;
+    by_start=ssy/bucket_adv_y;
+    if (bx_start>=(int)lvl->bucket_size.x) bx_start=lvl->bucket_size.x-1;
+    if (by_start>=(int)lvl->bucket_size.y) by_start=lvl->bucket_size.y-1;
+    int range,range_limit;
+    range_limit=max(lvl->bucket_size.x,lvl->bucket_size.y);
+    for (range=0; range<range_limit; range++)
+    {
+        unsigned long best_dist;
+        if (count<max_count)
+          best_dist=max_dist;
+        else
+          best_dist=list[max_count-1].dist;
+        /* Every bucket in this ring is at least that far */
+        if ((range>0) && ((unsigned long)(range-1)*min(bucket_adv_x,bucket_adv_y) > best_dist))
+            break;
+        int bx,by;
+        for (by=by_start-range;by<=by_start+range;by++)
+        {
+          if ((by<0)||(by>=(int)lvl->bucket_size.y)) continue;
+          for (bx=bx_start-range;bx<=bx_start+range;bx++)
+          {
+            if ((bx<0)||(bx>=(int)lvl->bucket_size.x)) continue;
+            /* Only the ring border; inner buckets were checked before */
+            if ((by!=by_start-range)&&(by!=by_start+range)&&
+                (bx!=bx_start-range)&&(bx!=bx_start+range))
+                continue;
+            if (get_object_bucket_nums(lvl,bx,by,obj_type)==0)
+                continue;
+            if (count>=max_count)
+              best_dist=list[max_count-1].dist;
+            if (get_rect_distance_adv(ssx,ssy,bx*bucket_adv_x,by*bucket_adv_y,
+                (bx+1)*bucket_adv_x,(by+1)*bucket_adv_y) > best_dist)
+                continue;
+            unsigned int tx,ty;
+            for (ty=by*OBJ_BUCKET_TILES;ty<(by+1)*OBJ_BUCKET_TILES;ty++)
+            {
+              if (ty>=lvl->tlsize.y) break;
+              for (tx=bx*OBJ_BUCKET_TILES;tx<(bx+1)*OBJ_BUCKET_TILES;tx++)
+              {
+                if (tx>=lvl->tlsize.x) break;
+                if (get_object_tilnums(lvl,tx,ty)==0)
+                    continue;
+                if (count>=max_count)
+                  best_dist=list[max_count-1].dist;
+                if (get_rect_distance_adv(ssx,ssy,tx*tile_adv_x,ty*tile_adv_y,
+                    (tx+1)*tile_adv_x,(ty+1)*tile_adv_y) > best_dist)
+                    continue;
+                nearest_objects_search_tile(lvl,ssx,ssy,tx,ty,max_dist,
+                    obj_type,list,&count,max_count);
+              }
+            }
+          }
+        }
+    }
+    return count;
+}
+
+/*
+ * Returns list of things nearest to given position, sorted by distance.
+ * The position is expected to be in "_adv" form, which is subtile<<8 + subtile_pos.
+ * Every entry in the list can be used to get the thing data
+ * like this: get_thing(lvl,list[i].sx,list[i].sy,list[i].num).
+ * @see get_nearest_thing_idx
+ * @param lvl Pointer to the LEVEL structure.
+ * @param ssx,ssy Source position, subtile<<8 + subtile_pos.
+ * @param max_dist Maximal distance of returned things; use ULONG_MAX
+ *     for no limit.
+ * @param list The list which will be filled with thing indices.
+ * @param max_count Size of the list; no more than max_count things are returned.
+ * @return Returns amount of things placed in the list.
+ */
+unsigned int get_nearest_things_list(const struct LEVEL *lvl,
+    const unsigned int ssx,const unsigned int ssy,const unsigned long max_dist,
+    struct OBJECT_INDEX *list,const unsigned int max_count)
+{
+    return get_nearest_objects_in_buckets(lvl,ssx,ssy,max_dist,
+        OBJECT_TYPE_THING,list,max_count);
+}
+
+/*
+ * Returns list of objects nearest to given position, sorted by distance.
+ * The position is expected to be in "_adv" form, which is subtile<<8 + subtile_pos.
+ * Every entry in the list can be used to get the object data
+ * like this: get_object(lvl,list[i].sx,list[i].sy,list[i].num).
+ * @see get_nearest_object_idx
+ * @param lvl Pointer to the LEVEL structure.
+ * @param ssx,ssy Source position, subtile<<8 + subtile_pos.
+ * @param max_dist Maximal distance of returned objects; use ULONG_MAX
+ *     for no limit.
+ * @param list The list which will be filled with object indices.
+ * @param max_count Size of the list; no more than max_count objects are returned.
+ * @return Returns amount of objects placed in the list.
+ */
+unsigned int get_nearest_objects_list(const struct LEVEL *lvl,
+    const unsigned int ssx,const unsigned int ssy,const unsigned long max_dist,
+    struct OBJECT_INDEX *list,const unsigned int max_count)
+{
+    return get_nearest_objects_in_buckets(lvl,ssx,ssy,max_dist,
+        OBJECT_TYPE_NONE,list,max_count);
+}
+
 /*
  * Returns tile coords and thing number for a thing nearest to given position.
  * The position is expected to be in "_adv" form, which is subtile<<8 + subtile_pos.
@@ -2196,122 +2429,16 @@ long get_nearest_thing_idx(const struct LEVEL *lvl,
     const unsigned int ssx,const unsigned int ssy,
     unsigned int *sx,unsigned int *sy,unsigned int *num)
 {
-/*    message_log(" get_nearest_thing_idx: Searching for thing near (%u,%u)",ssx>>8,ssy>>8); */
-    if (lvl==NULL) return -1;
-    int range;
-    unsigned int best_sx, best_sy;
-    int best_num;
-    unsigned long best_dist;
-    best_sx=0;best_sy=0;best_num=-1;best_dist=ULONG_MAX;
-    short found_previously=0;
-    int range_limit=max(lvl->subsize.x,lvl->subsize.y);
-    /* Searching for objects - first at close distance, then increase range */
-    for (range=0; range<range_limit; range++)
-    {
-        int test_sx,test_sy;
-        int test_num;
-        unsigned long test_dist;
-        /* Preparing sweep bounds for given range */
-        int sx_llimit,sx_hlimit;
-        int sy_llimit,sy_hlimit;
-        sx_llimit=(ssx>>8)-range;
-        sx_hlimit=(ssx>>8)+range;
-        sy_llimit=(ssy>>8)-range;
-        sy_hlimit=(ssy>>8)+range;
-        if (sx_llimit>=(int)lvl->subsize.x) sx_llimit=lvl->subsize.x-1;
-        if (sx_llimit<0) sx_llimit=0;
-        if (sx_hlimit>=(int)lvl->subsize.x) sx_hlimit=lvl->subsize.x-1;
-        if (sx_hlimit<0) sx_hlimit=0;
-        if (sy_llimit>=(int)lvl->subsize.y) sy_llimit=lvl->subsize.y-1;
-        if (sy_llimit<0) sy_llimit=0;
-        if (sy_hlimit>=(int)lvl->subsize.y) sy_hlimit=lvl->subsize.y-1;
-        if (sy_hlimit<0) sy_hlimit=0;
-        /* Remember if we have found something previously */
-        if (best_num>=0) found_previously=1;
-        /* Now we can sweep the borders for things */
-        for (test_sy=sy_llimit;test_sy<=sy_hlimit;test_sy++)
-        {
-            int num_limit;
-            /*Do two times: for test_sx=sx_llimit and test_sx=sx_hlimit */
-            test_sx=sx_llimit;
-/*    message_log(" get_nearest_thing_idx: Searching subtile (%u,%u)",test_sx,test_sy); */
-            num_limit=get_thing_subnums(lvl,test_sx,test_sy);
-            for (test_num=0;test_num<=num_limit;test_num++)
-            {
-                unsigned char *thing=get_thing(lvl,test_sx,test_sy,test_num);
-                test_dist=get_thing_distance_adv(thing,ssx,ssy);
-                if (test_dist<best_dist)
-                {
-                  best_sx=test_sx;
-                  best_sy=test_sy;
-                  best_num=test_num;
-                  best_dist=test_dist;
-                }
-            }
-            test_sx=sx_hlimit;
-/*    message_log(" get_nearest_thing_idx: Searching subtile (%u,%u)",test_sx,test_sy); */
-            num_limit=get_thing_subnums(lvl,test_sx,test_sy);
-            for (test_num=0;test_num<=num_limit;test_num++)
-            {
-                unsigned char *thing=get_thing(lvl,test_sx,test_sy,test_num);
-                test_dist=get_thing_distance_adv(thing,ssx,ssy);
-                if (test_dist<best_dist)
-                {
-                  best_sx=test_sx;
-                  best_sy=test_sy;
-                  best_num=test_num;
-                  best_dist=test_dist;
-                }
-            }
-        }
-        for (test_sx=sx_llimit+1;test_sx<sx_hlimit;test_sx++)
-        {
-            int num_limit;
-            /* Repeat the previous loop, but for test_sy=sy_llimit and test_sy=sy_hlimit */
-            test_sy=sy_llimit;
-/*    message_log(" get_nearest_thing_idx: Searching subtile (%u,%u)",test_sx,test_sy); */
-            num_limit=get_thing_subnums(lvl,test_sx,test_sy);
-            for (test_num=0;test_num<=num_limit;test_num++)
-            {
-                unsigned char *thing=get_thing(lvl,test_sx,test_sy,test_num);
-                test_dist=get_thing_distance_adv(thing,ssx,ssy);
-                if (test_dist<best_dist)
-                {
-                  best_sx=test_sx;
-                  best_sy=test_sy;
-                  best_num=test_num;
-                  best_dist=test_dist;
-                }
-            }
-            test_sy=sy_hlimit;
-/*    message_log(" get_nearest_thing_idx: Searching subtile (%u,%u)",test_sx,test_sy); */
-            num_limit=get_thing_subnums(lvl,test_sx,test_sy);
-            for (test_num=0;test_num<=num_limit;test_num++)
-            {
-                unsigned char *thing=get_thing(lvl,test_sx,test_sy,test_num);
-                test_dist=get_thing_distance_adv(thing,ssx,ssy);
-                if (test_dist<best_dist)
-                {
-                  best_sx=test_sx;
-                  best_sy=test_sy;
-                  best_num=test_num;
-                  best_dist=test_dist;
-                }
-            }
-        }
-        /* If we found sonething in previous turn, then we won't get anything better */
-        if (found_previously) break;
-    }
-    if (best_num<0)
+    struct OBJECT_INDEX nearest;
+    if (get_nearest_things_list(lvl,ssx,ssy,ULONG_MAX,&nearest,1)<1)
     {
         /*message_log(" get_nearest_thing_idx: Nothing found"); */
         return -1;
     }
-    /*message_log(" get_nearest_thing_idx: Returning thing at distance %u",best_dist); */
-    *sx=best_sx;
-    *sy=best_sy;
-    *num=best_num;
-    return best_dist;
+    *sx=nearest.sx;
+    *sy=nearest.sy;
+    *num=nearest.num;
+    return nearest.dist;
 }
 
 /*
@@ -2331,180 +2458,14 @@ long get_nearest_object_idx(const struct LEVEL *lvl,
     const unsigned int ssx,const unsigned int ssy,
     unsigned int *sx,unsigned int *sy,unsigned int *z)
 {
-/*    message_log(" get_nearest_object_idx: Searching for object near (%u,%u)",ssx>>8,ssy>>8); */
-    if (lvl==NULL) return -1;
-    int range;
-    unsigned int best_sx, best_sy;
-    int best_z;
-    unsigned long best_dist;
-    best_sx=0;best_sy=0;best_z=-1;best_dist=ULONG_MAX;
-    short found_previously=0;
-    int range_limit=max(lvl->subsize.x,lvl->subsize.y);
-    /* Searching for objects - first at close distance, then increase range */
-    for (range=0; range<range_limit; range++)
-    {
-        int test_sx,test_sy;
-        int test_z;
-        unsigned long test_dist;
-        /* Preparing sweep bounds for given range */
-        int sx_llimit,sx_hlimit;
-        int sy_llimit,sy_hlimit;
-        sx_llimit=(ssx>>8)-range;
-        sx_hlimit=(ssx>>8)+range;
-        sy_llimit=(ssy>>8)-range;
-        sy_hlimit=(ssy>>8)+range;
-        if (sx_llimit>=(int)lvl->subsize.x) sx_llimit=lvl->subsize.x-1;
-        if (sx_llimit<0) sx_llimit=0;
-        if (sx_hlimit>=(int)lvl->subsize.x) sx_hlimit=lvl->subsize.x-1;
-        if (sx_hlimit<0) sx_hlimit=0;
-        if (sy_llimit>=(int)lvl->subsize.y) sy_llimit=lvl->subsize.y-1;
-        if (sy_llimit<0) sy_llimit=0;
-        if (sy_hlimit>=(int)lvl->subsize.y) sy_hlimit=lvl->subsize.y-1;
-        if (sy_hlimit<0) sy_hlimit=0;
-        /* Remember if we have found some objects previously */
-        if (best_z>=0) found_previously=1;
-        /* Now we can sweep the borders for objects */
-        for (test_sy=sy_llimit;test_sy<=sy_hlimit;test_sy++)
-        {
-            int num_limit;
-            /*Do two times: for test_sx=sx_llimit and test_sx=sx_hlimit */
-            test_sx=sx_llimit;
-/*    message_log(" get_nearest_object_idx: Searching subtile (%u,%u)",test_sx,test_sy); */
-            num_limit=get_object_subnums(lvl,test_sx,test_sy);
-            for (test_z=0;test_z<=num_limit;test_z++)
-            {
-                unsigned char *obj;
-                obj=get_object(lvl,test_sx,test_sy,test_z);
-                switch (get_object_type(lvl,test_sx,test_sy,test_z))
-                {
-                case OBJECT_TYPE_THING:
-                    test_dist=get_thing_distance_adv(obj,ssx,ssy);
-                    break;
-                case OBJECT_TYPE_ACTNPT:
-                    test_dist=get_actnpt_distance_adv(obj,ssx,ssy);
-                    break;
-                case OBJECT_TYPE_STLIGHT:
-                    test_dist=get_stlight_distance_adv(obj,ssx,ssy);
-                    break;
-                default:
-                    test_dist=ULONG_MAX;
-                    break;
-                }
-                if (test_dist<best_dist)
-                {
-                    best_sx=test_sx;
-                    best_sy=test_sy;
-                    best_z=test_z;
-                    best_dist=test_dist;
-                }
-            }
-            test_sx=sx_hlimit;
-/*    message_log(" get_nearest_object_idx: Searching subtile (%u,%u)",test_sx,test_sy); */
-            num_limit=get_object_subnums(lvl,test_sx,test_sy);
-            for (test_z=0;test_z<=num_limit;test_z++)
-            {
-                unsigned char *obj;
-                obj=get_object(lvl,test_sx,test_sy,test_z);
-                switch (get_object_type(lvl,test_sx,test_sy,test_z))
-                {
-                case OBJECT_TYPE_THING:
-                    test_dist=get_thing_distance_adv(obj,ssx,ssy);
-                    break;
-                case OBJECT_TYPE_ACTNPT:
-                    test_dist=get_actnpt_distance_adv(obj,ssx,ssy);
-                    break;
-                case OBJECT_TYPE_STLIGHT:
-                    test_dist=get_stlight_distance_adv(obj,ssx,ssy);
-                    break;
-                default:
-                    test_dist=ULONG_MAX;
-                    break;
-                }
-                if (test_dist<best_dist)
-                {
-                    best_sx=test_sx;
-                    best_sy=test_sy;
-                    best_z=test_z;
-                    best_dist=test_dist;
-                }
-            }
-        }
-        for (test_sx=sx_llimit+1;test_sx<sx_hlimit;test_sx++)
-        {
-            int num_limit;
-            /* Repeat the previous loop, but for test_sy=sy_llimit and test_sy=sy_hlimit */
-            test_sy=sy_llimit;
-/*    message_log(" get_nearest_object_idx: Searching subtile (%u,%u)",test_sx,test_sy); */
-            num_limit=get_object_subnums(lvl,test_sx,test_sy);
-            for (test_z=0;test_z<=num_limit;test_z++)
-            {
-                unsigned char *obj;
-                obj=get_object(lvl,test_sx,test_sy,test_z);
-                switch (get_object_type(lvl,test_sx,test_sy,test_z))
-                {
-                case OBJECT_TYPE_THING:
-                    test_dist=get_thing_distance_adv(obj,ssx,ssy);
-                    break;
-                case OBJECT_TYPE_ACTNPT:
-                    test_dist=get_actnpt_distance_adv(obj,ssx,ssy);
-                    break;
-                case OBJECT_TYPE_STLIGHT:
-                    test_dist=get_stlight_distance_adv(obj,ssx,ssy);
-                    break;
-                default:
-                    test_dist=ULONG_MAX;
-                    break;
-                }
-                if (test_dist<best_dist)
-                {
-                    best_sx=test_sx;
-                    best_sy=test_sy;
-                    best_z=test_z;
-                    best_dist=test_dist;
-                }
-            }
-            test_sy=sy_hlimit;
-/*    message_log(" get_nearest_object_idx: Searching subtile (%u,%u)",test_sx,test_sy); */
-            num_limit=get_object_subnums(lvl,test_sx,test_sy);
-            for (test_z=0;test_z<=num_limit;test_z++)
-            {
-                unsigned char *obj;
-                obj=get_object(lvl,test_sx,test_sy,test_z);
-                switch (get_object_type(lvl,test_sx,test_sy,test_z))
-                {
-                case OBJECT_TYPE_THING:
-                    test_dist=get_thing_distance_adv(obj,ssx,ssy);
-                    break;
-                case OBJECT_TYPE_ACTNPT:
-                    test_dist=get_actnpt_distance_adv(obj,ssx,ssy);
-                    break;
-                case OBJECT_TYPE_STLIGHT:
-                    test_dist=get_stlight_distance_adv(obj,ssx,ssy);
-                    break;
-                default:
-                    test_dist=ULONG_MAX;
-                    break;
-                }
-                if (test_dist<best_dist)
-                {
-                    best_sx=test_sx;
-                    best_sy=test_sy;
-                    best_z=test_z;
-                    best_dist=test_dist;
-                }
-            }
-        }
-        /* If we found something in previous turn, then we won't get anything better */
-        if (found_previously) break;
-    }
-    if (best_z<0)
+    struct OBJECT_INDEX nearest;
+    if (get_nearest_objects_list(lvl,ssx,ssy,ULONG_MAX,&nearest,1)<1)
     {
         /*message_log(" get_nearest_object_idx: Nothing found"); */
         return -1;
     }
-    /*message_log(" get_nearest_object_idx: Returning object at distance %u",best_dist); */
-    *sx=best_sx;
-    *sy=best_sy;
-    *z=best_z;
-    return best_dist;
+    *sx=nearest.sx;
+    *sy=nearest.sy;
+    *z=nearest.num;
+    return nearest.dist;
 }
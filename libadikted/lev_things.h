@@ -23,6 +23,17 @@ struct IPOINT_2D;
 
 #include "globals.h"
 
+/**
+ * Indices of an object in LEVEL, and its distance from searched position.
+ * Used as result of nearest objects search.
+ */
+struct OBJECT_INDEX {
+    unsigned int sx;
+    unsigned int sy;
+    unsigned int num; /* thing number or object index, depending on search */
+    unsigned long dist;
+  };
+
 typedef void (*cr_tng_func)(struct LEVEL *lvl, const int tx, const int ty,
         const unsigned char *surr_slb,const unsigned char *surr_own,const struct UPOINT_2D corner_pos);
 
@@ -35,6 +46,25 @@ DLLIMPORT unsigned short get_search_objtype_count(void);
 DLLIMPORT unsigned char *find_next_object_on_map(struct LEVEL *lvl, int *tx, int *ty, unsigned short srch_idx);
 DLLIMPORT short subtl_in_effectgen_range(struct LEVEL *lvl,unsigned int sx,unsigned int sy);
 
+unsigned long get_rect_distance_adv(const int ssx,const int ssy,
+    const int x_start,const int y_start,const int x_end,const int y_end);
+void nearest_objects_list_add(struct OBJECT_INDEX *list,unsigned int *count,
+    const unsigned int max_count,const unsigned int sx,const unsigned int sy,
+    const unsigned int num,const unsigned long dist);
+void nearest_objects_search_tile(const struct LEVEL *lvl,
+    const unsigned int ssx,const unsigned int ssy,
+    const unsigned int tx,const unsigned int ty,const unsigned long max_dist,
+    const short obj_type,struct OBJECT_INDEX *list,unsigned int *count,
+    const unsigned int max_count);
+unsigned int get_nearest_objects_in_buckets(const struct LEVEL *lvl,
+    const unsigned int ssx,const unsigned int ssy,const unsigned long max_dist,
+    const short obj_type,struct OBJECT_INDEX *list,const unsigned int max_count);
+DLLIMPORT unsigned int get_nearest_things_list(const struct LEVEL *lvl,
+    const unsigned int ssx,const unsigned int ssy,const unsigned long max_dist,
+    struct OBJECT_INDEX *list,const unsigned int max_count);
+DLLIMPORT unsigned int get_nearest_objects_list(const struct LEVEL *lvl,
+    const unsigned int ssx,const unsigned int ssy,const unsigned long max_dist,
+    struct OBJECT_INDEX *list,const unsigned int max_count);
 DLLIMPORT long get_nearest_thing_idx(const struct LEVEL *lvl,
     const unsigned int ssx,const unsigned int ssy,
     unsigned int *sx,unsigned int *sy,unsigned int *num);
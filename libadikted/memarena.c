@@ -0,0 +1,154 @@
+/******************************************************************************/
+/** @file memarena.c
+ * Another Dungeon Keeper Map Editor.
+ * @par Purpose:
+ *     Arena allocator for variable-size data released all at once.
+ * @par Comment:
+ *     Used for storing decomposed level script, which consists of many
+ *     small strings which live exactly as long as the script.
+ * @date     17 Oct 2026
+ * @par  Copying and copyrights:
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ */
+/******************************************************************************/
+
+#include "memarena.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "msg_log.h"
+
+/**
+ * Memory block of the arena; the allocated data follows it.
+ */
+struct MEMORY_ARENA_BLOCK
+{
+    struct MEMORY_ARENA_BLOCK *next;
+    unsigned long size;
+    unsigned long used;
+};
+
+/**
+ * Creates new MEMORY_ARENA structure. No blocks are allocated until
+ * the first memarena_alloc() call.
+ * @param arena Double pointer to MEMORY_ARENA structure.
+ * @param block_size Size of a block, in bytes; zero means default.
+ * @return Returns true on success, false on error.
+ *     On error, the *arena pointer is set to NULL.
+ */
+short memarena_new(struct MEMORY_ARENA **arena, unsigned long block_size)
+{
+  (*arena)=malloc(sizeof(struct MEMORY_ARENA));
+  if ((*arena)==NULL)
+  {
+      message_error("memarena_new: Cannot allocate memory");
+      return false;
+  }
+  if (block_size<MEMARENA_MIN_BLOCK_SIZE)
+      block_size=MEMARENA_MIN_BLOCK_SIZE;
+  (*arena)->block_size=block_size;
+  (*arena)->first=NULL;
+  (*arena)->curr=NULL;
+  return true;
+}
+
+/**
+ * Frees the MEMORY_ARENA structure, with all data allocated from it.
+ * @param arena Double pointer to MEMORY_ARENA structure.
+ * @return Returns true on success, false on error.
+ */
+short memarena_free(struct MEMORY_ARENA **arena)
+{
+  if ((*arena)!=NULL)
+  {
+      memarena_clear(*arena);
+      free(*arena);
+  }
+  (*arena)=NULL;
+  return true;
+}
+
+/**
+ * Releases all data allocated from the arena, and frees its blocks.
+ * The arena itself remains valid and may be used again.
+ * @param arena Pointer to MEMORY_ARENA structure.
+ * @return Returns true on success, false on error.
+ */
+short memarena_clear(struct MEMORY_ARENA *arena)
+{
+  if (arena==NULL) return false;
+  struct MEMORY_ARENA_BLOCK *blk=arena->first;
+  while (blk!=NULL)
+  {
+      struct MEMORY_ARENA_BLOCK *next=blk->next;
+      free(blk);
+      blk=next;
+  }
+  arena->first=NULL;
+  arena->curr=NULL;
+  return true;
+}
+
+/**
+ * Releases all data allocated from the arena, but keeps its blocks
+ * so they can be reused without allocating memory again.
+ * @param arena Pointer to MEMORY_ARENA structure.
+ * @return Returns true on success, false on error.
+ */
+short memarena_reset(struct MEMORY_ARENA *arena)
+{
+  if (arena==NULL) return false;
+  struct MEMORY_ARENA_BLOCK *blk;
+  for (blk=arena->first; blk!=NULL; blk=blk->next)
+      blk->used=0;
+  arena->curr=arena->first;
+  return true;
+}
+
+/**
+ * Allocates data from the arena. Content of the data is undefined.
+ * The data is aligned to pointer size.
+ * @param arena Pointer to MEMORY_ARENA structure.
+ * @param size Size of the data, in bytes.
+ * @return Returns the new data, or NULL on error.
+ */
+void *memarena_alloc(struct MEMORY_ARENA *arena, unsigned long size)
+{
+  if (arena==NULL) return NULL;
+  /* Round the size, so every allocation is aligned */
+  size=((size+sizeof(unsigned char *)-1)/sizeof(unsigned char *))*sizeof(unsigned char *);
+  struct MEMORY_ARENA_BLOCK *prev=NULL;
+  struct MEMORY_ARENA_BLOCK *blk=arena->curr;
+  /* Blocks after the current one are empty, if memarena_reset() was used */
+  while ((blk!=NULL)&&(blk->used+size>blk->size))
+  {
+      prev=blk;
+      blk=blk->next;
+  }
+  if (blk==NULL)
+  {
+      unsigned long blk_size=arena->block_size;
+      if (blk_size<size)
+          blk_size=size;
+      blk=(struct MEMORY_ARENA_BLOCK *)malloc(sizeof(struct MEMORY_ARENA_BLOCK)+blk_size);
+      if (blk==NULL)
+      {
+          message_error("memarena_alloc: Cannot allocate block of %lu bytes",blk_size);
+          return NULL;
+      }
+      blk->next=NULL;
+      blk->size=blk_size;
+      blk->used=0;
+      if (prev!=NULL)
+          prev->next=blk;
+      else
+          arena->first=blk;
+  }
+  arena->curr=blk;
+  unsigned char *ptr=(unsigned char *)(blk+1)+blk->used;
+  blk->used+=size;
+  return ptr;
+}
@@ -0,0 +1,45 @@
+/******************************************************************************/
+/** @file memarena.h
+ * Another Dungeon Keeper Map Editor.
+ * @par Purpose:
+ *     Header file. Defines exported routines from memarena.c
+ * @par Comment:
+ *     None.
+ * @date     17 Oct 2026
+ * @par  Copying and copyrights:
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ */
+/******************************************************************************/
+
+#ifndef ADIKT_MEMARENA_H
+#define ADIKT_MEMARENA_H
+
+#include "globals.h"
+
+/* Minimal size of a single block, in bytes */
+#define MEMARENA_MIN_BLOCK_SIZE 65536
+
+struct MEMORY_ARENA_BLOCK;
+
+/**
+ * Memory arena for variable-size data.
+ * Allocations are made by moving a pointer inside big blocks;
+ * the data can't be released separately - all of it is released at once.
+ */
+struct MEMORY_ARENA
+{
+    unsigned long block_size; /* size of next allocated block, in bytes */
+    struct MEMORY_ARENA_BLOCK *first;
+    struct MEMORY_ARENA_BLOCK *curr; /* block from which data is allocated */
+};
+
+DLLIMPORT short memarena_new(struct MEMORY_ARENA **arena, unsigned long block_size);
+DLLIMPORT short memarena_free(struct MEMORY_ARENA **arena);
+DLLIMPORT short memarena_clear(struct MEMORY_ARENA *arena);
+DLLIMPORT short memarena_reset(struct MEMORY_ARENA *arena);
+DLLIMPORT void *memarena_alloc(struct MEMORY_ARENA *arena, unsigned long size);
+
+#endif /* ADIKT_MEMARENA_H */
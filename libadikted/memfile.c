@@ -25,6 +25,18 @@
 #include <time.h>
 #include "dernc.h"
 
+#if defined(_WIN32)
+#define MEMFILE_MAP_WIN32
+#include <windows.h>
+#elif defined(unix) || defined(__unix__) || defined(__APPLE__)
+#define MEMFILE_MAP_POSIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 
 /**
  * Creates new MEMORY_FILE structure.
@@ -42,6 +54,7 @@ short memfile_new(struct MEMORY_FILE **mfile, unsigned long alloc_len)
   (*mfile)->alloc_len=alloc_len;
   (*mfile)->alloc_delta=0;
   (*mfile)->errcode=MFILE_OK;
+  (*mfile)->mapped=false;
   if (alloc_len>0)
   {
     (*mfile)->content=malloc(alloc_len);
@@ -68,7 +81,10 @@ short memfile_free(struct MEMORY_FILE **mfile)
   if ((*mfile)!=NULL)
   {
 /*message_log("  memfile_free: content %X",(*mfile)->content); */
-      free((*mfile)->content);
+      if ((*mfile)->mapped)
+        memfile_unmap(*mfile,false);
+      else
+        free((*mfile)->content);
       free((*mfile));
   }
   (*mfile)=NULL;
@@ -83,6 +99,12 @@ short memfile_free(struct MEMORY_FILE **mfile)
  */
 short memfile_growalloc(struct MEMORY_FILE *mfile, unsigned long alloc_len)
 {
+  /* Mapped file can't be modified - copy it first */
+  if (mfile->mapped)
+  {
+      if (memfile_unmap(mfile,true)!=MFILE_OK)
+        return mfile->errcode;
+  }
   if (mfile->alloc_len < alloc_len)
   {
       mfile->content=realloc(mfile->content,alloc_len+mfile->alloc_delta);
@@ -137,7 +159,10 @@ short memfile_set(struct MEMORY_FILE *mfile,
     unsigned char *buf,unsigned long len,unsigned long alloc_len)
 {
     mfile->pos=0;
-    free(mfile->content);
+    if (mfile->mapped)
+      memfile_unmap(mfile,false);
+    else
+      free(mfile->content);
     if (((len>0)||(alloc_len>0))&&(buf==NULL))
     {
       mfile->content=NULL;
@@ -164,6 +189,9 @@ unsigned char *memfile_leave_content(struct MEMORY_FILE **mfile)
   unsigned char *content=NULL;
   if ((*mfile)!=NULL)
   {
+      /* The content must be freeable by caller */
+      if ((*mfile)->mapped)
+        memfile_unmap(*mfile,true);
       content=(*mfile)->content;
       free((*mfile));
   }
@@ -322,6 +350,143 @@ short memfile_readnew(struct MEMORY_FILE **mfile,const char *fname,unsigned long
     return errcode;
 }
 
+/**
+ * Maps a file into memory, without reading it into a buffer.
+ * The content is read-only, and is loaded on access from system file cache.
+ * Compressed files, very small files and files which can't be mapped,
+ * are read and decompressed by memfile_read() instead.
+ * Automatically creates new MEMORY_FILE at start.
+ * @see memfile_readnew
+ * @param mfile Double pointer to MEMORY_FILE structure, which will contain the file.
+ * @param fname The input file name.
+ * @param max_size Maximum acceptable input file size.
+ * @return Returns MFILE_OK, or negative error code.
+ *     On error, the *mfile is set to NULL.
+ */
+short memfile_mapnew(struct MEMORY_FILE **mfile,const char *fname,unsigned long max_size)
+{
+    short errcode;
+    unsigned char *content=NULL;
+    unsigned long plen=0;
+    if (fname==NULL)
+        return MFILE_INTERNAL;
+    errcode = memfile_new(mfile,0);
+    if (errcode != MFILE_OK)
+        return errcode;
+#if defined(MEMFILE_MAP_WIN32)
+    HANDLE hfile;
+    hfile=CreateFileA(fname,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+    if (hfile!=INVALID_HANDLE_VALUE)
+    {
+      DWORD size_high=0;
+      plen=GetFileSize(hfile,&size_high);
+      if ((plen!=INVALID_FILE_SIZE)&&(size_high==0)&&(plen>=SIZEOF_RNC_HEADER)&&(plen<=max_size))
+      {
+        HANDLE hmap;
+        hmap=CreateFileMappingA(hfile,NULL,PAGE_READONLY,0,0,NULL);
+        if (hmap!=NULL)
+        {
+          /* The view remains valid after closing handles */
+          content=(unsigned char *)MapViewOfFile(hmap,FILE_MAP_READ,0,0,0);
+          CloseHandle(hmap);
+        }
+      }
+      CloseHandle(hfile);
+    }
+#elif defined(MEMFILE_MAP_POSIX)
+    int fd;
+    fd=open(fname,O_RDONLY);
+    if (fd>=0)
+    {
+      struct stat attrib;
+      if ((fstat(fd,&attrib)==0)&&(attrib.st_size>=SIZEOF_RNC_HEADER)&&((unsigned long)attrib.st_size<=max_size))
+      {
+        plen=attrib.st_size;
+        /* The mapping remains valid after closing the file */
+        content=(unsigned char *)mmap(NULL,plen,PROT_READ,MAP_PRIVATE,fd,0);
+        if (content==(unsigned char *)MAP_FAILED)
+          content=NULL;
+      }
+      close(fd);
+    }
+#endif
+    if (content!=NULL)
+    {
+      (*mfile)->content=content;
+      (*mfile)->len=plen;
+      (*mfile)->alloc_len=plen;
+      (*mfile)->mapped=true;
+      /* Compressed files are unpacked into memory buffer */
+      if ((long)rnc_ulen(content)==RNC_FILE_IS_NOT_RNC)
+          return MFILE_OK;
+      memfile_unmap(*mfile,false);
+    }
+    /* Fallback - reading file into a buffer */
+    errcode = memfile_read((*mfile),fname,max_size);
+    if (errcode != MFILE_OK)
+        memfile_free(mfile);
+    return errcode;
+}
+
+/**
+ * Releases file mapping used as MEMORY_FILE content.
+ * @param mfile Pointer to MEMORY_FILE structure.
+ * @param keep_content If true, the content is copied into a buffer
+ *     before the mapping is released; otherwise the MEMORY_FILE is emptied.
+ * @return Returns MFILE_OK, or negative error code.
+ */
+short memfile_unmap(struct MEMORY_FILE *mfile,short keep_content)
+{
+    unsigned char *buf=NULL;
+    if (!mfile->mapped)
+    {
+      mfile->errcode=MFILE_OK;
+      return mfile->errcode;
+    }
+    if ((keep_content)&&(mfile->len>0))
+    {
+      buf=(unsigned char *)malloc(mfile->len);
+      if (buf==NULL)
+      {
+        mfile->errcode=MFILE_MALLOC_ERR;
+        return mfile->errcode;
+      }
+      memcpy(buf,mfile->content,mfile->len);
+    }
+#if defined(MEMFILE_MAP_WIN32)
+    UnmapViewOfFile(mfile->content);
+#elif defined(MEMFILE_MAP_POSIX)
+    munmap(mfile->content,mfile->alloc_len);
+#endif
+    mfile->mapped=false;
+    mfile->content=buf;
+    if (buf==NULL)
+    {
+      mfile->len=0;
+      mfile->pos=0;
+    }
+    mfile->alloc_len=mfile->len;
+    mfile->errcode=MFILE_OK;
+    return mfile->errcode;
+}
+
+/**
+ * Makes sure the whole content is loaded into memory. For mapped files,
+ * reads one byte of every page, so that the disk reading is done now,
+ * and not when the content is accessed later.
+ * @param mfile Pointer to MEMORY_FILE structure.
+ */
+void memfile_prefault(struct MEMORY_FILE *mfile)
+{
+    volatile unsigned char val;
+    unsigned long i;
+    if ((mfile==NULL)||(!mfile->mapped))
+      return;
+    for (i=0;i<mfile->len;i+=MEMFILE_PAGE_SIZE)
+      val=mfile->content[i];
+    (void)val;
+}
+
 char *memfile_error(int errcode)
 {
     static char *const errors[] = {
@@ -26,6 +26,9 @@
  */
 #define MAX_FILE_SIZE 734003200
 
+/* Size of memory page; mapped files are loaded from disk in such blocks */
+#define MEMFILE_PAGE_SIZE 4096
+
 /*first 16 errors are reserved to RNC support */
 #define MFILE_OK             0
 #define MFILE_CANNOT_OPEN  -17
@@ -42,6 +45,8 @@ struct MEMORY_FILE
     unsigned long pos;
     unsigned char *content;
     short errcode;
+    /* True if content is a read-only mapping of the file */
+    short mapped;
 };
 
 DLLIMPORT short memfile_new(struct MEMORY_FILE **mfile, unsigned long alloc_len);
@@ -49,6 +54,9 @@ DLLIMPORT short memfile_free(struct MEMORY_FILE **mfile);
 DLLIMPORT unsigned char *memfile_leave_content(struct MEMORY_FILE **mfile);
 DLLIMPORT short memfile_read(struct MEMORY_FILE *mfile,const char *fname,unsigned long max_size);
 DLLIMPORT short memfile_readnew(struct MEMORY_FILE **mfile,const char *fname,unsigned long max_size);
+DLLIMPORT short memfile_mapnew(struct MEMORY_FILE **mfile,const char *fname,unsigned long max_size);
+DLLIMPORT short memfile_unmap(struct MEMORY_FILE *mfile,short keep_content);
+DLLIMPORT void memfile_prefault(struct MEMORY_FILE *mfile);
 DLLIMPORT short memfile_add(struct MEMORY_FILE *mfile,
     const unsigned char *buf,unsigned long buf_len);
 DLLIMPORT short memfile_set(struct MEMORY_FILE *mfile,
@@ -0,0 +1,217 @@
+/******************************************************************************/
+/** @file mempool.c
+ * Another Dungeon Keeper Map Editor.
+ * @par Purpose:
+ *     Pool allocator for small, fixed-size records.
+ * @par Comment:
+ *     Used for storing level objects, which are numerous and small,
+ *     and would otherwise require separate allocation for each one.
+ * @date     17 Oct 2026
+ * @par  Copying and copyrights:
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ */
+/******************************************************************************/
+
+#include "mempool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "msg_log.h"
+
+/**
+ * Creates new MEMORY_POOL structure.
+ * @param pool Double pointer to MEMORY_POOL structure.
+ * @param rec_size Size of every record, in bytes.
+ * @param block_recs Initial amount of records in a block.
+ * @return Returns true on success, false on error.
+ *     On error, the *pool pointer is set to NULL.
+ */
+short mempool_new(struct MEMORY_POOL **pool, unsigned long rec_size,
+    unsigned long block_recs)
+{
+  (*pool)=malloc(sizeof(struct MEMORY_POOL));
+  if ((*pool)==NULL)
+  {
+      message_error("mempool_new: Cannot allocate memory");
+      return false;
+  }
+  /* Free slots store a pointer to next free slot, so they can't be smaller */
+  if (rec_size<sizeof(unsigned char *))
+      rec_size=sizeof(unsigned char *);
+  /* Round the size, so every slot is aligned */
+  rec_size=((rec_size+sizeof(unsigned char *)-1)/sizeof(unsigned char *))*sizeof(unsigned char *);
+  if (block_recs<1)
+      block_recs=1;
+  (*pool)->rec_size=rec_size;
+  (*pool)->block_recs=block_recs;
+  (*pool)->blocks=NULL;
+  (*pool)->blocks_len=NULL;
+  (*pool)->blocks_count=0;
+  (*pool)->free_rec=NULL;
+  (*pool)->free_count=0;
+  (*pool)->used_count=0;
+  return true;
+}
+
+/**
+ * Frees the MEMORY_POOL structure, with all records allocated from it.
+ * @param pool Double pointer to MEMORY_POOL structure.
+ * @return Returns true on success, false on error.
+ */
+short mempool_free(struct MEMORY_POOL **pool)
+{
+  if ((*pool)!=NULL)
+  {
+      mempool_clear(*pool);
+      free(*pool);
+  }
+  (*pool)=NULL;
+  return true;
+}
+
+/**
+ * Releases all records allocated from the pool at once.
+ * The pool itself remains valid and may be used again.
+ * @param pool Pointer to MEMORY_POOL structure.
+ * @return Returns true on success, false on error.
+ */
+short mempool_clear(struct MEMORY_POOL *pool)
+{
+  if (pool==NULL) return false;
+  unsigned int i;
+  for (i=0; i<pool->blocks_count; i++)
+      free(pool->blocks[i]);
+  free(pool->blocks);
+  free(pool->blocks_len);
+  pool->blocks=NULL;
+  pool->blocks_len=NULL;
+  pool->blocks_count=0;
+  pool->free_rec=NULL;
+  pool->free_count=0;
+  pool->used_count=0;
+  return true;
+}
+
+/**
+ * Allocates new block of records and puts its slots on the free list.
+ * @param pool Pointer to MEMORY_POOL structure.
+ * @param count Amount of records in the new block.
+ * @return Returns true on success, false on error.
+ */
+short mempool_add_block(struct MEMORY_POOL *pool, unsigned long count)
+{
+  unsigned char **blocks;
+  unsigned long *blocks_len;
+  blocks=(unsigned char **)realloc(pool->blocks,(pool->blocks_count+1)*sizeof(unsigned char *));
+  if (blocks==NULL)
+  {
+      message_error("mempool_add_block: Cannot allocate memory");
+      return false;
+  }
+  pool->blocks=blocks;
+  blocks_len=(unsigned long *)realloc(pool->blocks_len,(pool->blocks_count+1)*sizeof(unsigned long));
+  if (blocks_len==NULL)
+  {
+      message_error("mempool_add_block: Cannot allocate memory");
+      return false;
+  }
+  pool->blocks_len=blocks_len;
+  unsigned char *block;
+  block=(unsigned char *)malloc(count*pool->rec_size);
+  if (block==NULL)
+  {
+      message_error("mempool_add_block: Cannot allocate block of %lu records",count);
+      return false;
+  }
+  pool->blocks[pool->blocks_count]=block;
+  pool->blocks_len[pool->blocks_count]=count;
+  pool->blocks_count++;
+  /* Put the slots on free list, so that they're used in order */
+  unsigned long i;
+  for (i=count; i>0; i--)
+  {
+      unsigned char *rec=block+(i-1)*pool->rec_size;
+      memcpy(rec,&(pool->free_rec),sizeof(unsigned char *));
+      pool->free_rec=rec;
+  }
+  pool->free_count+=count;
+  return true;
+}
+
+/**
+ * Makes sure the pool can allocate given amount of records
+ * without allocating more blocks.
+ * @param pool Pointer to MEMORY_POOL structure.
+ * @param count Amount of records which are to be allocated.
+ * @return Returns true on success, false on error.
+ */
+short mempool_reserve(struct MEMORY_POOL *pool, unsigned long count)
+{
+  if (pool==NULL) return false;
+  if (count<=pool->free_count)
+      return true;
+  return mempool_add_block(pool,count-pool->free_count);
+}
+
+/**
+ * Allocates a record from the pool. Content of the record is undefined.
+ * @param pool Pointer to MEMORY_POOL structure.
+ * @return Returns the new record, or NULL on error.
+ */
+unsigned char *mempool_alloc(struct MEMORY_POOL *pool)
+{
+  if (pool==NULL) return NULL;
+  if (pool->free_rec==NULL)
+  {
+      if (!mempool_add_block(pool,pool->block_recs))
+          return NULL;
+      /* Every next block is larger, so the amount of blocks stays small */
+      if (pool->block_recs < MEMPOOL_MAX_BLOCK_RECS)
+          pool->block_recs*=2;
+  }
+  unsigned char *rec=pool->free_rec;
+  memcpy(&(pool->free_rec),rec,sizeof(unsigned char *));
+  pool->free_count--;
+  pool->used_count++;
+  return rec;
+}
+
+/**
+ * Returns a record to the pool, so it can be reused.
+ * @param pool Pointer to MEMORY_POOL structure.
+ * @param rec The record to release.
+ * @return Returns true if the record was released, false if it
+ *     wasn't allocated from this pool.
+ */
+short mempool_release(struct MEMORY_POOL *pool, unsigned char *rec)
+{
+  if (!mempool_owns(pool,rec))
+      return false;
+  memcpy(rec,&(pool->free_rec),sizeof(unsigned char *));
+  pool->free_rec=rec;
+  pool->free_count++;
+  pool->used_count--;
+  return true;
+}
+
+/**
+ * Checks if the record was allocated from given pool.
+ * @param pool Pointer to MEMORY_POOL structure.
+ * @param rec The record to check.
+ * @return Returns true if the record belongs to the pool, false otherwise.
+ */
+short mempool_owns(const struct MEMORY_POOL *pool, const unsigned char *rec)
+{
+  if ((pool==NULL)||(rec==NULL)) return false;
+  unsigned int i;
+  for (i=0; i<pool->blocks_count; i++)
+  {
+      const unsigned char *block=pool->blocks[i];
+      if ((rec>=block) && (rec<block+pool->blocks_len[i]*pool->rec_size))
+          return true;
+  }
+  return false;
+}
@@ -0,0 +1,52 @@
+/******************************************************************************/
+/** @file mempool.h
+ * Another Dungeon Keeper Map Editor.
+ * @par Purpose:
+ *     Header file. Defines exported routines from mempool.c
+ * @par Comment:
+ *     None.
+ * @date     17 Oct 2026
+ * @par  Copying and copyrights:
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ */
+/******************************************************************************/
+
+#ifndef ADIKT_MEMPOOL_H
+#define ADIKT_MEMPOOL_H
+
+#include "globals.h"
+
+/* Maximal amount of records in a single block, when growing automatically */
+#define MEMPOOL_MAX_BLOCK_RECS 4096
+
+/**
+ * Pool of fixed-size records.
+ * Records are allocated in blocks; released records are kept
+ * on a free list and reused, and all blocks are released at once.
+ */
+struct MEMORY_POOL
+{
+    unsigned long rec_size;   /* size of one slot, in bytes */
+    unsigned long block_recs; /* amount of slots in next allocated block */
+    unsigned char **blocks;
+    unsigned long *blocks_len; /* amount of slots in every block */
+    unsigned int blocks_count;
+    unsigned char *free_rec;  /* first unused slot; next one is stored inside */
+    unsigned long free_count;
+    unsigned long used_count;
+};
+
+DLLIMPORT short mempool_new(struct MEMORY_POOL **pool, unsigned long rec_size,
+    unsigned long block_recs);
+DLLIMPORT short mempool_free(struct MEMORY_POOL **pool);
+DLLIMPORT short mempool_clear(struct MEMORY_POOL *pool);
+short mempool_add_block(struct MEMORY_POOL *pool, unsigned long count);
+DLLIMPORT short mempool_reserve(struct MEMORY_POOL *pool, unsigned long count);
+DLLIMPORT unsigned char *mempool_alloc(struct MEMORY_POOL *pool);
+DLLIMPORT short mempool_release(struct MEMORY_POOL *pool, unsigned char *rec);
+DLLIMPORT short mempool_owns(const struct MEMORY_POOL *pool, const unsigned char *rec);
+
+#endif /* ADIKT_MEMPOOL_H */
@@ -19,12 +19,7 @@
 #include "msg_log.h"
 
 #include "globals.h"
-
-char *message_prv;
-char *message;
-short message_hold;
-unsigned int message_getcount;
-char *msgout_fname;
+#include "lbcontext.h"
 
 /**
  * Only logs the message, without showing on screen.
@@ -34,9 +29,10 @@ char *msgout_fname;
  */
 void message_log_vl(const char *format, va_list val)
 {
-    if (msgout_fname==NULL) return;
+    struct ADIKT_CONTEXT *ctx=adikt_context_get();
+    if (ctx->msgout_fname==NULL) return;
     FILE *msgout_fp;
-    msgout_fp=fopen(msgout_fname,"ab");
+    msgout_fp=fopen(ctx->msgout_fname,"ab");
     if (msgout_fp!=NULL)
     {
       /* Write to log file if it is opened */
@@ -53,9 +49,10 @@ void message_log_vl(const char *format, va_list val)
  */
 void message_log_simp(const char *str)
 {
-    if (msgout_fname==NULL) return;
+    struct ADIKT_CONTEXT *ctx=adikt_context_get();
+    if (ctx->msgout_fname==NULL) return;
     FILE *msgout_fp;
-    msgout_fp=fopen(msgout_fname,"ab");
+    msgout_fp=fopen(ctx->msgout_fname,"ab");
     /* Write to log file if it is opened */
     if (msgout_fp!=NULL)
     {
@@ -72,7 +69,8 @@ void message_log_simp(const char *str)
  */
 void message_log(const char *format, ...)
 {
-    if (msgout_fname==NULL) return;
+    struct ADIKT_CONTEXT *ctx=adikt_context_get();
+    if (ctx->msgout_fname==NULL) return;
     va_list val;
     va_start(val, format);
     message_log_vl(format, val);
@@ -87,9 +85,10 @@ void message_log(const char *format, ...)
  */
 void message_error(const char *format, ...)
 {
+    struct ADIKT_CONTEXT *ctx=adikt_context_get();
     va_list val;
     va_start(val, format);
-    char *msg=message_prv;
+    char *msg=ctx->message_prv;
     if (msg==NULL)
     {
         msg=(char *)malloc(LINEMSG_SIZE*sizeof(char));
@@ -104,10 +103,10 @@ void message_error(const char *format, ...)
     /* Write to log file if it is prepared */
     message_log_simp(msg);
     /* Store the message */
-    message_prv=message;
-    message=msg;
-    message_hold=true;
-    message_getcount=0;
+    ctx->message_prv=ctx->message;
+    ctx->message=msg;
+    ctx->message_hold=true;
+    ctx->message_getcount=0;
 }
 
 /**
@@ -116,7 +115,8 @@ void message_error(const char *format, ...)
  */
 short message_is_empty(void)
 {
-     if ((message!=NULL)&&(message[0]>'\0')) return false;
+     struct ADIKT_CONTEXT *ctx=adikt_context_get();
+     if ((ctx->message!=NULL)&&(ctx->message[0]>'\0')) return false;
      return true;
 }
 
@@ -128,10 +128,11 @@ short message_is_empty(void)
  */
 void message_info(const char *format, ...)
 {
+    struct ADIKT_CONTEXT *ctx=adikt_context_get();
     va_list val;
     va_start(val, format);
-    char *msg=message_prv;
-    if ((msg==NULL)||(message_hold))
+    char *msg=ctx->message_prv;
+    if ((msg==NULL)||(ctx->message_hold))
     {
         msg=(char *)malloc(LINEMSG_SIZE*sizeof(char));
         if (msg==NULL)
@@ -144,15 +145,15 @@ void message_info(const char *format, ...)
     va_end(val);
     /* Write to log file if it is prepared */
     message_log_simp(msg);
-    if ((!message_is_empty())&&(message_hold))
+    if ((!message_is_empty())&&(ctx->message_hold))
     {
       free(msg);
     } else
     {
-      message_prv=message;
-      message=msg;
-      message_hold=false;
-      message_getcount=0;
+      ctx->message_prv=ctx->message;
+      ctx->message=msg;
+      ctx->message_hold=false;
+      ctx->message_getcount=0;
     }
 }
 
@@ -164,9 +165,10 @@ void message_info(const char *format, ...)
  */
 void message_info_force(const char *format, ...)
 {
+    struct ADIKT_CONTEXT *ctx=adikt_context_get();
     va_list val;
     va_start(val, format);
-    char *msg=message_prv;
+    char *msg=ctx->message_prv;
     if (msg==NULL)
     {
         msg=(char *)malloc(LINEMSG_SIZE*sizeof(char));
@@ -181,10 +183,10 @@ void message_info_force(const char *format, ...)
     /* Write to log file if it is prepared */
     message_log_simp(msg);
     /* Update message variables */
-    message_prv=message;
-    message=msg;
-    message_hold=false;
-    message_getcount=0;
+    ctx->message_prv=ctx->message;
+    ctx->message=msg;
+    ctx->message_hold=false;
+    ctx->message_getcount=0;
 }
 
 /**
@@ -195,7 +197,8 @@ void message_info_force(const char *format, ...)
  */
 short message_hold_get(void)
 {
-      return message_hold;
+      struct ADIKT_CONTEXT *ctx=adikt_context_get();
+      return ctx->message_hold;
 }
 
 /**
@@ -206,7 +209,8 @@ short message_hold_get(void)
  */
 unsigned int message_getcount_get(void)
 {
-      return message_getcount;
+      struct ADIKT_CONTEXT *ctx=adikt_context_get();
+      return ctx->message_getcount;
 }
 
 /**
@@ -216,7 +220,8 @@ unsigned int message_getcount_get(void)
  */
 void message_release(void)
 {
-      message_hold=false;
+      struct ADIKT_CONTEXT *ctx=adikt_context_get();
+      ctx->message_hold=false;
 }
 
 /**
@@ -225,8 +230,9 @@ void message_release(void)
  */
 char *message_get(void)
 {
-     message_getcount++;
-     return message;
+     struct ADIKT_CONTEXT *ctx=adikt_context_get();
+     ctx->message_getcount++;
+     return ctx->message;
 }
 
 /**
@@ -235,50 +241,54 @@ char *message_get(void)
  */
 char *message_get_prev(void)
 {
-     return message_prv;
+     struct ADIKT_CONTEXT *ctx=adikt_context_get();
+     return ctx->message_prv;
 }
 
 /**
  * Sets message log file name. Rewrites it, then writes header and two
- * last messages.
+ * last messages. The name is set for context used by current thread.
  * @param fname The file name under which log is written.
  * @return Returns true if the log was created, otherwise false.
  */
 short set_msglog_fname(char *fname)
 {
+    struct ADIKT_CONTEXT *ctx=adikt_context_get();
     if ((fname==NULL)||(fname[0]=='\0'))
     {
-        msgout_fname=NULL;
+        ctx->msgout_fname=NULL;
         return false;
     }
     FILE *msgout_fp;
-    msgout_fname=strdup(fname);
-    msgout_fp=fopen(msgout_fname,"wb");
+    ctx->msgout_fname=strdup(fname);
+    msgout_fp=fopen(ctx->msgout_fname,"wb");
     if (msgout_fp!=NULL)
     {
       fprintf(msgout_fp,"%s message log file\r\n",PROGRAM_NAME);
-      if (message_prv!=NULL)
-        fprintf(msgout_fp,"%s\r\n",message_prv);
-      if (message!=NULL)
-        fprintf(msgout_fp,"%s\r\n",message);
+      if (ctx->message_prv!=NULL)
+        fprintf(msgout_fp,"%s\r\n",ctx->message_prv);
+      if (ctx->message!=NULL)
+        fprintf(msgout_fp,"%s\r\n",ctx->message);
       fclose(msgout_fp);
       return true;
     }
-    free(msgout_fname);
-    msgout_fname=NULL;
+    free(ctx->msgout_fname);
+    ctx->msgout_fname=NULL;
     return false;
 }
 
 /**
  * Clears message log variables without freeing memory (drops any pointers).
+ * Message variables are kept in the context used by current thread.
  */
 void init_messages(void)
 {
-  message=NULL;
-  message_prv=NULL;
-  message_hold=false;
-  message_getcount=0;
-  msgout_fname=NULL;
+  struct ADIKT_CONTEXT *ctx=adikt_context_get();
+  ctx->message=NULL;
+  ctx->message_prv=NULL;
+  ctx->message_hold=false;
+  ctx->message_getcount=0;
+  ctx->msgout_fname=NULL;
 }
 
 /**
@@ -286,7 +296,8 @@ void init_messages(void)
  */
 void free_messages(void)
 {
-    free(message_prv);
-    free(message);
-    free(msgout_fname);
+    struct ADIKT_CONTEXT *ctx=adikt_context_get();
+    free(ctx->message_prv);
+    free(ctx->message);
+    free(ctx->msgout_fname);
 }
@@ -25,6 +25,7 @@
 #include "obj_things.h"
 #include "graffiti.h"
 #include "bulcommn.h"
+#include "msg_log.h"
 
 static void (*custom_columns_gen [])(struct COLUMN_REC *clm_recs[9],
         unsigned char *,unsigned char *, unsigned char **)={
@@ -95,9 +96,9 @@ const unsigned short dir_rot_270[]={
       IDIR_SW,IDIR_WEST,IDIR_NW,IDIR_SOUTH,IDIR_CENTR,IDIR_NORTH,
       IDIR_SE,IDIR_EAST,IDIR_NE, };
 
-short fill_reinforced_corner=true;
-short frail_columns_near_short=true;
-short frail_columns_near_tall=true;
+THREAD_LOCAL short fill_reinforced_corner=true;
+THREAD_LOCAL short frail_columns_near_short=true;
+THREAD_LOCAL short frail_columns_near_tall=true;
 
 /*
  * Returns custom column type name as text
@@ -255,6 +256,170 @@ void create_columns_for_slab(struct COLUMN_REC *clm_recs[9],struct LEVOPTIONS *o
     }
 }
 
+/*
+ * Creates new, empty column generation cache.
+ */
+short clm_gencache_new(struct CLM_GEN_CACHE **cache)
+{
+  (*cache)=(struct CLM_GEN_CACHE *)malloc(sizeof(struct CLM_GEN_CACHE));
+  if ((*cache)==NULL)
+  {
+      message_error("clm_gencache_new: Cannot allocate memory");
+      return false;
+  }
+  (*cache)->entries=(struct CLM_GEN_CACHE_ENTRY *)malloc(CLM_GEN_CACHE_ENTRIES*sizeof(struct CLM_GEN_CACHE_ENTRY));
+  if ((*cache)->entries==NULL)
+  {
+      message_error("clm_gencache_new: Cannot allocate cache entries");
+      free(*cache);
+      (*cache)=NULL;
+      return false;
+  }
+  int i;
+  for (i=0;i<CLM_GEN_CACHE_ENTRIES;i++)
+  {
+      (*cache)->entries[i].used=false;
+      (*cache)->entries[i].recs=NULL;
+  }
+  (*cache)->hits=0;
+  (*cache)->misses=0;
+  (*cache)->uncacheable=0;
+  return true;
+}
+
+/*
+ * Frees the column generation cache.
+ */
+void clm_gencache_free(struct CLM_GEN_CACHE **cache)
+{
+  if ((*cache)==NULL) return;
+  int i;
+  for (i=0;i<CLM_GEN_CACHE_ENTRIES;i++)
+      free((*cache)->entries[i].recs);
+  free((*cache)->entries);
+  free(*cache);
+  (*cache)=NULL;
+}
+
+/*
+ * Drops all entries from the column generation cache, and clears counters.
+ */
+void clm_gencache_clear(struct CLM_GEN_CACHE *cache)
+{
+  if (cache==NULL) return;
+  int i;
+  for (i=0;i<CLM_GEN_CACHE_ENTRIES;i++)
+      cache->entries[i].used=false;
+  cache->hits=0;
+  cache->misses=0;
+  cache->uncacheable=0;
+}
+
+/*
+ * Prepares the column generation cache key. The key contains everything
+ * which may affect the generated columns: the slab surrounding, surrounding
+ * things (without their map position) and generation options.
+ * Returns hash of the key.
+ */
+unsigned int clm_gencache_make_key(unsigned char *key,struct LEVOPTIONS *optns,
+        unsigned char *surr_slb,unsigned char *surr_own, unsigned char **surr_tng)
+{
+  int i,pos;
+  pos=0;
+  for (i=0;i<9;i++)
+      key[pos++]=surr_slb[i];
+  for (i=0;i<9;i++)
+      key[pos++]=surr_own[i];
+  for (i=0;i<9;i++)
+  {
+      if (surr_tng[i]!=NULL)
+      {
+        key[pos++]=1;
+        /* Skip the first bytes - map position of the thing */
+        memcpy(key+pos,surr_tng[i]+SIZEOF_DK_TNG_REC-CLM_GEN_CACHE_TNG_BYTES,CLM_GEN_CACHE_TNG_BYTES);
+      } else
+      {
+        key[pos++]=0;
+        memset(key+pos,0,CLM_GEN_CACHE_TNG_BYTES);
+      }
+      pos+=CLM_GEN_CACHE_TNG_BYTES;
+  }
+  key[pos++]=optns->unaffected_gems;
+  key[pos++]=optns->unaffected_rock;
+  key[pos++]=optns->fill_reinforced_corner;
+  key[pos++]=optns->frail_columns;
+  /* The global values which may remain from previous generation */
+  key[pos++]=fill_reinforced_corner;
+  key[pos++]=0;
+  unsigned int hash=2166136261u;
+  for (i=0;i<pos;i++)
+  {
+      hash^=key[i];
+      hash*=16777619u;
+  }
+  return hash;
+}
+
+/*
+ * Fills up 9 CLM entries needed for given slab with specified surroundings.
+ * Works like create_columns_for_slab(), but first searches the cache
+ * for columns generated for identical surrounding. Generation results
+ * which haven't used random numbers are stored in the cache.
+ */
+void create_columns_for_slab_cached(struct CLM_GEN_CACHE *cache,
+        struct COLUMN_REC *clm_recs[9],struct LEVOPTIONS *optns,
+        unsigned char *surr_slb,unsigned char *surr_own, unsigned char **surr_tng)
+{
+  if (cache==NULL)
+  {
+      create_columns_for_slab(clm_recs,optns,surr_slb,surr_own,surr_tng);
+      return;
+  }
+  unsigned char key[CLM_GEN_CACHE_KEY_SIZE];
+  unsigned int hash=clm_gencache_make_key(key,optns,surr_slb,surr_own,surr_tng);
+  struct CLM_GEN_CACHE_ENTRY *entry=&(cache->entries[hash%CLM_GEN_CACHE_ENTRIES]);
+  int i;
+  if ((entry->used) && (memcmp(entry->key,key,CLM_GEN_CACHE_KEY_SIZE)==0))
+  {
+      for (i=0;i<9;i++)
+        memcpy(clm_recs[i],&(entry->recs[i]),sizeof(struct COLUMN_REC));
+      /* Generation sets these globals, so set them as well */
+      frail_columns_near_short=((optns->frail_columns&1)==1);
+      frail_columns_near_tall=((optns->frail_columns&2)==2);
+      switch (surr_slb[IDIR_CENTR])
+      {
+        case SLAB_TYPE_WALLDRAPE:
+        case SLAB_TYPE_WALLTORCH:
+        case SLAB_TYPE_WALLWTWINS:
+        case SLAB_TYPE_WALLWWOMAN:
+        case SLAB_TYPE_WALLPAIRSHR:
+          fill_reinforced_corner=optns->fill_reinforced_corner;
+          break;
+      }
+      cache->hits++;
+      return;
+  }
+  cache->misses++;
+  unsigned long rnd_count=get_rnd_calls_count();
+  create_columns_for_slab(clm_recs,optns,surr_slb,surr_own,surr_tng);
+  /* Random columns must be generated every time */
+  if (get_rnd_calls_count()!=rnd_count)
+  {
+      cache->uncacheable++;
+      return;
+  }
+  if (entry->recs==NULL)
+  {
+      entry->recs=(struct COLUMN_REC *)malloc(9*sizeof(struct COLUMN_REC));
+      if (entry->recs==NULL)
+        return;
+  }
+  memcpy(entry->key,key,CLM_GEN_CACHE_KEY_SIZE);
+  for (i=0;i<9;i++)
+    memcpy(&(entry->recs[i]),clm_recs[i],sizeof(struct COLUMN_REC));
+  entry->used=true;
+}
+
 /*
  * A helper function for using surr_own array
  */
@@ -25,11 +25,41 @@ struct COLUMN_REC;
 
 #define CUST_CLM_GEN_MAX_INDEX  41
 
+/* Amount of entries in the column generation cache */
+#define CLM_GEN_CACHE_ENTRIES 1024
+/* Amount of bytes of every surrounding thing which are used as cache key */
+#define CLM_GEN_CACHE_TNG_BYTES 17
+/* Size of the column generation cache key */
+#define CLM_GEN_CACHE_KEY_SIZE (9+9+9*(1+CLM_GEN_CACHE_TNG_BYTES)+6)
+
 struct DK_CUSTOM_CLM {
     unsigned short wib_val;
     struct COLUMN_REC *rec;
   };
 
+/**
+ * Single entry of the column generation cache.
+ * Stores columns generated for the slab surrounding identified by key.
+ */
+struct CLM_GEN_CACHE_ENTRY {
+    short used;
+    unsigned char key[CLM_GEN_CACHE_KEY_SIZE];
+    struct COLUMN_REC *recs;
+  };
+
+/**
+ * Cache of column generation results.
+ * Slabs with identical surroundings get identical columns, unless
+ * random numbers are used to generate them - so only results which
+ * haven't used rnd() are stored.
+ */
+struct CLM_GEN_CACHE {
+    struct CLM_GEN_CACHE_ENTRY *entries;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long uncacheable;
+  };
+
 typedef void (*cr_clm_func)(struct COLUMN_REC *clm_recs[9],
         unsigned char *surr_slb,unsigned char *surr_own, unsigned char **surr_tng);
 
@@ -43,6 +73,12 @@ DLLIMPORT short fill_custom_column_data(unsigned short idx,struct COLUMN_REC *cl
 
 DLLIMPORT void create_columns_for_slab(struct COLUMN_REC *clm_recs[9],struct LEVOPTIONS *optns,
         unsigned char *surr_slb,unsigned char *surr_own, unsigned char **surr_tng);
+DLLIMPORT short clm_gencache_new(struct CLM_GEN_CACHE **cache);
+DLLIMPORT void clm_gencache_free(struct CLM_GEN_CACHE **cache);
+DLLIMPORT void clm_gencache_clear(struct CLM_GEN_CACHE *cache);
+DLLIMPORT void create_columns_for_slab_cached(struct CLM_GEN_CACHE *cache,
+        struct COLUMN_REC *clm_recs[9],struct LEVOPTIONS *optns,
+        unsigned char *surr_slb,unsigned char *surr_own, unsigned char **surr_tng);
 DLLIMPORT unsigned char *surr_tng_find(unsigned char **surr_tng,unsigned char type_idx);
 
 void create_columns_slb_unaffected_rock(struct COLUMN_REC *clm_recs[9],
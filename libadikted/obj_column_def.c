@@ -449,6 +449,29 @@ unsigned short compute_clm_rec_solid(const struct COLUMN_REC *clm_rec)
     return solid;
 }
 
+/*
+ * Computes hash value of the column. Columns which are identical
+ * for compare_column_recs() always have the same hash.
+ */
+unsigned int compute_clm_rec_hash(const struct COLUMN_REC *clm_rec)
+{
+    if (clm_rec==NULL) return 0;
+    unsigned int hash=2166136261u;
+    hash=(hash^clm_rec->height)*16777619u;
+    hash=(hash^clm_rec->lintel)*16777619u;
+    hash=(hash^clm_rec->solid)*16777619u;
+    hash=(hash^clm_rec->base)*16777619u;
+    int i;
+    for (i=0;i<8;i++)
+    {
+      /* Cubes which are not in solid mask are ignored on comparing */
+      if (clm_rec->solid&(1<<i))
+        hash=(hash^clm_rec->c[i])*16777619u;
+    }
+    hash^=(hash>>15);
+    return hash;
+}
+
 unsigned int get_clm_entry_use(const unsigned char *clmentry)
 {
     return (unsigned int)clmentry[0]+(clmentry[1]<<8);
@@ -67,6 +67,7 @@ DLLIMPORT void fill_column_rec(struct COLUMN_REC *clm_rec, const unsigned int us
         const int c4, const int c5, const int c6, const int c7);
 DLLIMPORT unsigned short compute_clm_rec_height(const struct COLUMN_REC *clm_rec);
 DLLIMPORT unsigned short compute_clm_rec_solid(const struct COLUMN_REC *clm_rec);
+DLLIMPORT unsigned int compute_clm_rec_hash(const struct COLUMN_REC *clm_rec);
 DLLIMPORT short compare_column_recs(struct COLUMN_REC *clm_rec1, struct COLUMN_REC *clm_rec2);
 DLLIMPORT short clm_rec_copy(struct COLUMN_REC *dest_rec,const struct COLUMN_REC *src_rec);
 
@@ -408,6 +408,7 @@ void actions_crcrtr(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *workdata,
           set_thing_subtile_h(thing,1);
           set_thing_level(thing,workdata->list->val1);
           set_thing_owner(thing,workdata->list->val2);
+          level_mark_thing_changed(workdata->lvl,thing);
           mdend[MD_CRTR](scrmode,workdata);
         }; break;
         default:
@@ -813,7 +814,10 @@ void actions_editem(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *workdata,
           if (index_func!=NULL)
               real_index=index_func(workdata->list->pos);
           if (real_index>=0)
+          {
             set_thing_subtype(workdata->list->ptr,real_index);
+            level_mark_thing_changed(workdata->lvl,workdata->list->ptr);
+          }
           mdend[MD_EITM](scrmode,workdata);
           if (real_index<0)
           {
@@ -868,6 +872,7 @@ void actions_edcrtr(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *workdata,
           set_thing_subtype(workdata->list->ptr,workdata->list->pos+1);
           set_thing_level(workdata->list->ptr,workdata->list->val1);
           set_thing_owner(workdata->list->ptr,workdata->list->val2);
+          level_mark_thing_changed(workdata->lvl,workdata->list->ptr);
           mdend[MD_ECRT](scrmode,workdata);
           message_info("Creature properties changed");
           break;
@@ -902,6 +907,7 @@ void actions_edefct(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *workdata,
         case KEY_ENTER:
           set_thing_subtype(workdata->list->ptr,workdata->list->pos+1);
           set_thing_owner(workdata->list->ptr,workdata->list->val2);
+          level_mark_thing_changed(workdata->lvl,workdata->list->ptr);
           mdend[MD_EFCT](scrmode,workdata);
           message_info("Effect Generator properties changed");
           break;
@@ -936,6 +942,7 @@ void actions_edtrap(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *workdata,
         case KEY_ENTER:
           set_thing_subtype(workdata->list->ptr,workdata->list->pos+1);
           set_thing_owner(workdata->list->ptr,workdata->list->val2);
+          level_mark_thing_changed(workdata->lvl,workdata->list->ptr);
           mdend[MD_ETRP](scrmode,workdata);
           message_info("Trap properties changed");
           break;
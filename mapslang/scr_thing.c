@@ -312,6 +312,7 @@ void actions_mdtng(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *workdata,i
             case OBJECT_TYPE_THING:
               thing = get_object(workdata->lvl,subpos.x,subpos.y,visiting_z);
               set_thing_owner(thing,get_owner_next(get_thing_owner(thing)));
+              level_mark_thing_changed(workdata->lvl,thing);
               message_info("Object owner switched");
               break;
             default:
@@ -330,6 +331,7 @@ void actions_mdtng(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *workdata,i
               thing = get_object(workdata->lvl,subpos.x,subpos.y,visiting_z);
               if (switch_thing_subtype(thing,(key==KEY_SHIFT_S)))
               {
+                level_mark_thing_changed(workdata->lvl,thing);
                 message_info("Thing type switched to next.");
               } else
                 message_error("This thing has no level/type, or its limit is reached.");
@@ -1183,15 +1185,18 @@ void tng_change_height(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *workda
       set_stlight_subtpos_h(obj,subheight);
       break;
     case OBJECT_TYPE_ACTNPT:
+      level_mark_object_changed(workdata->lvl,sx,sy,get_actnpt_range_adv(obj));
       set_actnpt_range_subtile(obj,height);
       set_actnpt_range_subtpos(obj,subheight);
       set_brighten_for_actnpt(workdata->mapmode,obj);
+      level_mark_object_changed(workdata->lvl,sx,sy,get_actnpt_range_adv(obj));
       break;
     case OBJECT_TYPE_THING:
       set_thing_subtile_h(obj,height);
       set_thing_subtpos_h(obj,subheight);
       break;
     }
+    level_mark_subtls_changed(workdata->lvl,sx,sx,sy,sy);
 }
 
 void tng_change_range(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *workdata, unsigned int sx, unsigned int sy,unsigned int z,int delta_range)
@@ -1239,6 +1244,8 @@ void tng_change_range(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *workdat
       message_error("Cannot recognize object");
       return;
     }
+    /* Circle of the previous range has to be redrawn too */
+    level_mark_object_changed(workdata->lvl,sx,sy,(rng<<8)+subrng-delta_range);
     while (subrng<0)
     {
         rng--;
@@ -1291,6 +1298,7 @@ void tng_change_range(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *workdat
           workdata->mdtng->obj_ranges_changed=true;
       break;
     }
+    level_mark_object_changed(workdata->lvl,sx,sy,(rng<<8)+subrng);
 }
 
 void action_edit_object(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *workdata)
@@ -1382,6 +1390,7 @@ void action_inc_object_level(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *
             if (crtr_lev<9)
             {
                 set_thing_level(thing,crtr_lev+1);
+                level_mark_thing_changed(workdata->lvl,thing);
                 message_info("Creature level increased.");
             } else
                 message_error("Creature level limit reached.");
@@ -1396,6 +1405,7 @@ void action_inc_object_level(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *
         } else
         if (switch_thing_subtype(thing,true))
         {
+            level_mark_thing_changed(workdata->lvl,thing);
             message_info("Item type switched to next.");
         } else
             message_error("This thing has no level/type, or its limit is reached.");
@@ -1413,6 +1423,7 @@ void action_inc_object_level(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *
               intens+=4;
             if (intens>255) intens=255;
             set_stlight_intensivity(stlight,intens);
+            level_mark_object_changed(workdata->lvl,subpos.x,subpos.y,get_stlight_range_adv(stlight));
             message_info("Static light intensivity increased.");
         } else
         {
@@ -1449,6 +1460,7 @@ void action_dec_object_level(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *
             if (crtr_lev>0)
             {
                 set_thing_level(thing,crtr_lev-1);
+                level_mark_thing_changed(workdata->lvl,thing);
                 message_info("Creature level decreased.");
             } else
             message_error("Creature level limit reached.");
@@ -1463,6 +1475,7 @@ void action_dec_object_level(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *
         } else
         if (switch_thing_subtype(thing,false))
         {
+            level_mark_thing_changed(workdata->lvl,thing);
             message_info("Item type switched to previous.");
         } else
             message_error("This thing has no level/type, or its limit is reached.");
@@ -1476,6 +1489,7 @@ void action_dec_object_level(struct SCRMODE_DATA *scrmode,struct WORKMODE_DATA *
         {
             intens--;
             set_stlight_intensivity(stlight,intens);
+            level_mark_object_changed(workdata->lvl,subpos.x,subpos.y,get_stlight_range_adv(stlight));
             message_info("Static light intensivity decreased.");
         } else
         {
@@ -1505,6 +1519,9 @@ void tng_change_actnpt_level(struct WORKMODE_DATA *workdata,unsigned char *actnp
     if (num!=apt_num)
     {
         set_actnpt_number(actnpt,apt_num);
+        unsigned int sx=get_actnpt_subtile_x(actnpt);
+        unsigned int sy=get_actnpt_subtile_y(actnpt);
+        level_mark_subtls_changed(workdata->lvl,sx,sx,sy,sy);
         char *oper;
         if (apt_num>num)
           oper="increased";
@@ -1528,6 +1545,9 @@ void tng_change_herogate_number(struct WORKMODE_DATA *workdata,unsigned char *th
     if (num!=newnum)
     {
         set_thing_level(thing,newnum);
+        unsigned int sx=get_thing_subtile_x(thing);
+        unsigned int sy=get_thing_subtile_y(thing);
+        level_mark_subtls_changed(workdata->lvl,sx,sx,sy,sy);
         char *oper;
         if (newnum>num)
           oper="increased";
@@ -20,6 +20,7 @@
 #include "var_utils.h"
 
 #include "../libadikted/globals.h"
+#include "../libadikted/draw_map.h"
 #include <stdarg.h>
 #include "input_kb.h"
 #include "output_scr.h"
@@ -90,6 +91,7 @@ void done(struct SCRMODE_DATA **scrmode,struct WORKMODE_DATA *workdata)
         if (scrmode!=NULL)
           free_levscr(scrmode,workdata);
     }
+    free_draw_resources_cache();
     // Write to log file if it is prepared
     message_log_simp(PROGRAM_NAME " work is done");
     free_messages();